@@ -42,6 +42,14 @@ Rectangle {
                     height: 24
                     onClicked: layerModel.addLayer()
                 }
+
+                IconButton {
+                    iconText: "\u270E"
+                    tooltip: "\uBCA1\uD130 \uB808\uC774\uC5B4 \uCD94\uAC00"
+                    width: 24
+                    height: 24
+                    onClicked: layerModel.addVectorLayer()
+                }
             }
 
             // Bottom border
@@ -74,6 +82,7 @@ Rectangle {
                 required property string layerName
                 required property real layerOpacity
                 required property bool layerVisible
+                required property int layerType
 
                 property bool editing: false
 
@@ -144,6 +153,14 @@ Rectangle {
                         }
                     }
 
+                    // Vector layer marker
+                    Label {
+                        text: "\uBCA1\uD130"
+                        font.pixelSize: Theme.fontSizeSmall
+                        color: Theme.textTertiary
+                        visible: layerDelegate.layerType === 1 && !layerDelegate.editing
+                    }
+
                     // Opacity percentage
                     Label {
                         text: Math.round(layerDelegate.layerOpacity * 100) + "%"
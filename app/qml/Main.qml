@@ -35,6 +35,7 @@ ApplicationWindow {
     // Bind theme
     Component.onCompleted: {
         Theme.dark = Qt.binding(() => AppController.isDarkTheme)
+        recoveryModal.visible = AppController.hasRecovery
     }
 
     // --- Keyboard Shortcuts ---
@@ -42,6 +43,7 @@ ApplicationWindow {
     Shortcut { sequence: "P"; onActivated: AppController.currentTool = 0 }  // Pen
     Shortcut { sequence: "E"; onActivated: AppController.currentTool = 1 }  // Eraser
     Shortcut { sequence: "G"; onActivated: AppController.currentTool = 2 }  // Fill
+    Shortcut { sequence: "V"; onActivated: AppController.currentTool = 4 }  // Move
 
     Shortcut {
         sequence: StandardKey.Undo
@@ -224,6 +226,34 @@ ApplicationWindow {
         }
     }
 
+    // --- Crash Recovery Modal ---
+    Modal {
+        id: recoveryModal
+        title: "작업 복구"
+        message: "이전 세션이 정상적으로 종료되지 않았습니다. 자동 저장된 작업을 복구하시겠습니까?"
+        actions: [
+            {
+                label: "복구",
+                variant: "primary",
+                action: () => {
+                    recoveryModal.visible = false
+                    AppController.recoverDocument()
+                }
+            },
+            {
+                label: "삭제",
+                variant: "danger",
+                action: () => {
+                    recoveryModal.visible = false
+                    AppController.discardRecovery()
+                }
+            }
+        ]
+        // Requires an explicit choice: autosave stays off until then,
+        // so the old recovery file is never overwritten by accident
+        onClosed: {}
+    }
+
     function executePendingAction() {
         let action = root._pendingAction
         root._pendingAction = ""
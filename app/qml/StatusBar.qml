@@ -29,6 +29,8 @@ Rectangle {
                 case 0: return "펜"
                 case 1: return "지우개"
                 case 2: return "채우기"
+                case 3: return "선택"
+                case 4: return "이동"
                 default: return ""
                 }
             }
@@ -52,6 +52,16 @@ Rectangle {
             }
         }
 
+        // --- Save Compression ---
+        SegmentedControl {
+            model: [
+                { label: "빠름", value: 0 },
+                { label: "작게", value: 1 }
+            ]
+            currentIndex: AppController.saveCompression
+            onSelected: (index) => { AppController.saveCompression = index }
+        }
+
         // Separator
         Rectangle { width: 1; height: 20; color: Theme.borderColor }
 
@@ -0,0 +1,193 @@
+#include <QColor>
+#include <QCoreApplication>
+#include <QTextStream>
+
+#include "core/Layer.h"
+#include "core/Stroke.h"
+#include "core/TileManager.h"
+#include "engine/BrushDab.h"
+#include "engine/BrushEngine.h"
+#include "engine/DabKernel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace comicos;
+
+// Dab throughput of the brush path: BrushEngine strokes at each kernel
+// level, against a copy of the original per-pixel renderer (a sqrt, a tile
+// lookup and a float blend per pixel). Soft round brush, full pressure,
+// capsules off, -O2 release builds only give meaningful numbers.
+
+namespace {
+
+constexpr double MIN_SECONDS = 0.5;
+constexpr float HARDNESS = 0.5f;
+const QColor COLOR(40, 90, 200);
+
+/// A gentle horizontal wave across a few tiles.
+std::vector<CanvasPoint> strokePath() {
+    std::vector<CanvasPoint> points;
+    for (int i = 0; i <= 200; ++i) {
+        const float t = static_cast<float>(i) / 200.0f;
+        CanvasPoint p;
+        p.x = 300.0f + 1400.0f * t;
+        p.y = 700.0f + 150.0f * std::sin(t * 6.0f);
+        points.push_back(p);
+    }
+    return points;
+}
+
+std::vector<BrushDab> placeDabs(const std::vector<CanvasPoint>& path, float size) {
+    DabPlacer placer;
+    std::vector<BrushDab> dabs;
+    placer.placeDabs(path.front(), path.front(), size, HARDNESS, dabs);
+    for (size_t i = 1; i < path.size(); ++i) {
+        placer.placeDabs(path[i - 1], path[i], size, HARDNESS, dabs);
+    }
+    return dabs;
+}
+
+/// The dab renderer before the kernels, for the baseline column.
+void renderDabPerPixel(TileManager& tiles, const BrushDab& dab) {
+    const float r = dab.radius < 0.1f ? 0.5f : dab.radius;
+    const int minX = static_cast<int>(std::floor(dab.x - r));
+    const int minY = static_cast<int>(std::floor(dab.y - r));
+    const int maxX = static_cast<int>(std::ceil(dab.x + r));
+    const int maxY = static_cast<int>(std::ceil(dab.y + r));
+
+    for (int py = minY; py <= maxY; ++py) {
+        for (int px = minX; px <= maxX; ++px) {
+            const float dx = px + 0.5f - dab.x;
+            const float dy = py + 0.5f - dab.y;
+            const float dist = std::sqrt(dx * dx + dy * dy);
+            if (dist > r) continue;
+
+            const float t = dist / r;
+            float sa = t <= dab.hardness
+                ? 1.0f : 1.0f - (t - dab.hardness) / (1.0f - dab.hardness + 0.001f);
+            sa *= dab.opacity;
+
+            const TileCoord tc = pixelToTile(px, py);
+            Tile* tile = tiles.getOrCreateTile(tc);
+            tile->ensureAllocated();
+            const int lx = px - tc.tx * TILE_SIZE;
+            const int ly = py - tc.ty * TILE_SIZE;
+            const Pixel dst = tile->pixelAt(lx, ly);
+
+            const float da = dst.a / 255.0f;
+            const float outA = sa + da * (1.0f - sa);
+            if (outA <= 0.0f) continue;
+            auto mix = [&](float src, uint8_t d) {
+                const float v = (src * sa + d / 255.0f * da * (1.0f - sa)) / outA;
+                return static_cast<uint8_t>(std::clamp(v * 255.0f, 0.0f, 255.0f));
+            };
+            tile->setPixelAt(lx, ly, {mix(COLOR.redF(), dst.r), mix(COLOR.greenF(), dst.g),
+                                      mix(COLOR.blueF(), dst.b),
+                                      static_cast<uint8_t>(outA * 255.0f)});
+        }
+    }
+}
+
+/// Runs `stroke` on fresh layers until MIN_SECONDS have passed; strokes per second.
+template <typename Fn>
+double strokesPerSecond(Fn&& stroke) {
+    using Clock = std::chrono::steady_clock;
+    stroke();  // Warm-up: stamp cache, wet layer tiles
+    int count = 0;
+    const auto start = Clock::now();
+    double elapsed = 0.0;
+    do {
+        stroke();
+        ++count;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < MIN_SECONDS);
+    return count / elapsed;
+}
+
+/// All pixels of `layer`, tile by tile in coordinate order.
+std::vector<uint8_t> layerPixels(const Layer& layer) {
+    std::vector<const Tile*> tiles = layer.tiles().residentTiles();
+    std::sort(tiles.begin(), tiles.end(),
+              [](const Tile* a, const Tile* b) { return a->coord() < b->coord(); });
+    std::vector<uint8_t> pixels;
+    for (const Tile* tile : tiles) {
+        if (tile->isEmpty()) continue;
+        pixels.insert(pixels.end(), tile->constData(), tile->constData() + TILE_BYTES);
+    }
+    return pixels;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    const std::vector<CanvasPoint> path = strokePath();
+    std::vector<DabKernelLevel> levels{DabKernelLevel::Scalar};
+    for (DabKernelLevel level : {DabKernelLevel::Sse41, DabKernelLevel::Avx2}) {
+        if (level <= DabKernels::bestLevel()) levels.push_back(level);
+    }
+
+    out << "diameter  per-pixel";
+    for (DabKernelLevel level : levels) out << "  " << DabKernels::name(level).rightJustified(9);
+    out << "  speedup  (dabs/s)\n";
+
+    bool identical = true;
+    for (float size : {50.0f, 150.0f, 300.0f}) {
+        const std::vector<BrushDab> dabs = placeDabs(path, size);
+
+        const double baseline = strokesPerSecond([&] {
+            Layer layer(1);
+            for (const BrushDab& dab : dabs) renderDabPerPixel(layer.tiles(), dab);
+        }) * dabs.size();
+
+        Stroke params;
+        params.setColor(COLOR);
+        params.setBrushSize(size);
+        params.setHardness(HARDNESS);
+        params.setTargetLayerId(1);
+
+        BrushEngine engine;
+        engine.setCapsules(false);
+        std::vector<uint8_t> reference;
+        out << QString::number(size, 'f', 0).rightJustified(8)
+            << QString::number(baseline, 'f', 0).rightJustified(11);
+        double best = 0.0;
+        for (DabKernelLevel level : levels) {
+            DabKernels::setLevel(level);
+            Layer layer(1);
+            auto stroke = [&] {
+                layer.tiles().clear();
+                engine.beginStroke(&layer, params);
+                for (const CanvasPoint& p : path) engine.addPoint(p);
+                engine.endStroke();
+                engine.takeBeforeSnapshots();
+            };
+            const double rate = strokesPerSecond(stroke) * dabs.size();
+            best = std::max(best, rate);
+            out << QString::number(rate, 'f', 0).rightJustified(11);
+
+            // Every level must paint the same bytes as the scalar kernels
+            std::vector<uint8_t> pixels = layerPixels(layer);
+            if (reference.empty()) {
+                reference = std::move(pixels);
+            } else if (pixels != reference) {
+                identical = false;
+            }
+        }
+        out << QString::number(best / baseline, 'f', 1).rightJustified(8) << "x\n";
+    }
+    DabKernels::setLevel(DabKernels::bestLevel());
+
+    if (!identical) {
+        out << "MISMATCH: kernel levels painted different pixels\n";
+        return 1;
+    }
+    out << "All kernel levels painted identical pixels.\n";
+    return 0;
+}
@@ -1,17 +1,21 @@
 #pragma once
 
+#include "bridge/Autosaver.h"
 #include "bridge/DocumentModel.h"
 #include "core/Document.h"
 #include "core/History.h"
 #include "core/Types.h"
-#include "engine/BrushEngine.h"
+#include "core/VectorLayer.h"
+#include "engine/BrushThread.h"
+#include "engine/LayerTransform.h"
 #include "render/CanvasItem.h"
 #include <QObject>
 #include <QQmlEngine>
+#include <optional>
 
 namespace comicos {
 
-/// Undoable command for a completed brush stroke.
+/// Undoable command for a completed brush stroke or fill.
 /// Stores before/after tile snapshots for the affected tiles.
 /// Uses LayerStack + LayerId instead of raw Layer* to survive layer deletion.
 class StrokeCommand : public HistoryCommand {
@@ -33,6 +37,29 @@ private:
     bool m_firstRedo = true;
 };
 
+/// Undoable change to the strokes of a vector layer: a stroke drawn, or all
+/// of them transformed. Strokes are shared with the layer and between
+/// steps, so a step only costs the strokes it added.
+class VectorStrokeCommand : public HistoryCommand {
+public:
+    VectorStrokeCommand(LayerStack* layers, LayerId layerId,
+                        VectorLayer::StrokeList before, VectorLayer::StrokeList after);
+
+    void undo() override;
+    void redo() override;
+    size_t memoryUsage() const override { return m_memory; }
+
+private:
+    void apply(const VectorLayer::StrokeList& strokes);
+
+    LayerStack* m_layers;
+    LayerId m_layerId;
+    VectorLayer::StrokeList m_before;
+    VectorLayer::StrokeList m_after;
+    size_t m_memory = 0;
+    bool m_firstRedo = true;
+};
+
 /// Main application controller exposed to QML.
 /// Bridges QML UI actions to C++ core logic.
 class AppController : public QObject {
@@ -45,6 +72,28 @@ class AppController : public QObject {
     Q_PROPERTY(QColor currentColor READ currentColor WRITE setCurrentColor NOTIFY currentColorChanged)
     Q_PROPERTY(qreal brushSize READ brushSize WRITE setBrushSize NOTIFY brushSizeChanged)
     Q_PROPERTY(qreal brushHardness READ brushHardness WRITE setBrushHardness NOTIFY brushHardnessChanged)
+    /// Image tip id from loadBrushTip(); -1 = round tip.
+    Q_PROPERTY(int brushTip READ brushTip WRITE setBrushTip NOTIFY brushTipChanged)
+    /// Tip rotation in degrees.
+    Q_PROPERTY(qreal brushAngle READ brushAngle WRITE setBrushAngle NOTIFY brushAngleChanged)
+    /// Tip minor/major axis ratio, 0.05..1.
+    Q_PROPERTY(qreal brushAspect READ brushAspect WRITE setBrushAspect NOTIFY brushAspectChanged)
+    /// Fill tool: largest colour difference still filled, 0..255.
+    Q_PROPERTY(int fillTolerance READ fillTolerance WRITE setFillTolerance NOTIFY fillToleranceChanged)
+    /// Fill tool: compare against all visible layers instead of the active one.
+    Q_PROPERTY(bool fillSampleMerged READ fillSampleMerged WRITE setFillSampleMerged NOTIFY fillSampleMergedChanged)
+    /// Fill tool: close line art gaps up to about twice this many pixels, 0..32.
+    Q_PROPERTY(int fillGapClose READ fillGapClose WRITE setFillGapClose NOTIFY fillGapCloseChanged)
+    /// Move tool: resampling when a scale or rotation is applied, 0 bilinear, 1 bicubic.
+    Q_PROPERTY(int transformFilter READ transformFilter WRITE setTransformFilter NOTIFY transformFilterChanged)
+
+    // --- Selection ---
+    /// How the Select tool's rectangle combines with the selection
+    /// (SelectionOp: 0 replace, 1 add, 2 subtract, 3 intersect).
+    Q_PROPERTY(int selectionMode READ selectionMode WRITE setSelectionMode NOTIFY selectionModeChanged)
+    Q_PROPERTY(bool hasSelection READ hasSelection NOTIFY selectionChanged)
+    /// Canvas rect around the selection, or the rectangle being dragged.
+    Q_PROPERTY(QRect selectionBounds READ selectionBounds NOTIFY selectionChanged)
 
     // --- Theme ---
     Q_PROPERTY(QString theme READ theme WRITE setTheme NOTIFY themeChanged)
@@ -58,6 +107,21 @@ class AppController : public QObject {
     Q_PROPERTY(bool canRedo READ canRedo NOTIFY historyChanged)
     Q_PROPERTY(bool isDirty READ isDirty NOTIFY dirtyChanged)
     Q_PROPERTY(QString filePath READ filePath NOTIFY filePathChanged)
+    /// 0 = fast (LZ), 1 = small (Deflate). See TileEncoding.
+    Q_PROPERTY(int saveCompression READ saveCompression WRITE setSaveCompression NOTIFY saveCompressionChanged)
+    /// Mean input-to-pixel latency of the last stroke, in milliseconds.
+    Q_PROPERTY(qreal inputLatency READ inputLatency NOTIFY inputLatencyChanged)
+    /// How far ahead the stroke tip is predicted, in milliseconds (0 = off).
+    Q_PROPERTY(qreal predictionHorizon READ predictionHorizon WRITE setPredictionHorizon NOTIFY predictionHorizonChanged)
+    /// Share of predicted pixels the last stroke did not actually draw.
+    Q_PROPERTY(qreal predictionError READ predictionError NOTIFY predictionErrorChanged)
+
+    // --- Pages ---
+    Q_PROPERTY(int pageCount READ pageCount NOTIFY pagesChanged)
+    Q_PROPERTY(int currentPage READ currentPage WRITE setCurrentPage NOTIFY pagesChanged)
+
+    // --- Crash Recovery ---
+    Q_PROPERTY(bool hasRecovery READ hasRecovery NOTIFY recoveryChanged)
 
 public:
     explicit AppController(QObject* parent = nullptr);
@@ -68,12 +132,32 @@ public:
     QColor currentColor() const;
     qreal brushSize() const;
     qreal brushHardness() const;
+    int brushTip() const;
+    qreal brushAngle() const;
+    qreal brushAspect() const;
+    int fillTolerance() const;
+    bool fillSampleMerged() const;
+    int fillGapClose() const;
+    int transformFilter() const;
 
     // --- Tool Setters ---
     void setCurrentTool(int tool);
     void setCurrentColor(const QColor& color);
     void setBrushSize(qreal size);
     void setBrushHardness(qreal hardness);
+    void setBrushTip(int tipId);
+    void setBrushAngle(qreal degrees);
+    void setBrushAspect(qreal aspect);
+    void setFillTolerance(int tolerance);
+    void setFillSampleMerged(bool merged);
+    void setFillGapClose(int pixels);
+    void setTransformFilter(int filter);
+
+    // --- Selection ---
+    int selectionMode() const;
+    void setSelectionMode(int mode);
+    bool hasSelection() const;
+    QRect selectionBounds() const;
 
     // --- Theme ---
     QString theme() const;
@@ -88,14 +172,51 @@ public:
     bool canRedo() const;
     bool isDirty() const;
     QString filePath() const;
+    int saveCompression() const;
+    void setSaveCompression(int mode);
+    qreal inputLatency() const;
+    qreal predictionHorizon() const;
+    void setPredictionHorizon(qreal ms);
+    qreal predictionError() const;
+
+    // --- Pages ---
+    int pageCount() const;
+    int currentPage() const;
+    void setCurrentPage(int index);
+
+    // --- Crash Recovery ---
+    bool hasRecovery() const;
 
     // --- Actions (invocable from QML) ---
     Q_INVOKABLE void newDocument(int width, int height, int dpi = 300);
     Q_INVOKABLE bool saveDocument();
     Q_INVOKABLE bool saveDocumentTo(const QString& path);
     Q_INVOKABLE bool openDocument(const QString& path);
+    Q_INVOKABLE bool recoverDocument();
+    Q_INVOKABLE void discardRecovery();
     Q_INVOKABLE void undo();
     Q_INVOKABLE void redo();
+    /// New page after the current one, same canvas size; becomes current.
+    Q_INVOKABLE void addPage();
+    Q_INVOKABLE void removePage(int index);
+    Q_INVOKABLE void selectAll();
+    Q_INVOKABLE void deselect();
+    Q_INVOKABLE void invertSelection();
+    /// Add an image brush tip; returns its id for brushTip, or -1.
+    Q_INVOKABLE int loadBrushTip(const QString& path);
+    /// Flat the active (line-art) layer: fill every closed region into a
+    /// new "Flats" layer below it, each in its own colour, or with
+    /// `useHints` only the regions under hint strokes on the layer directly
+    /// above, in their colour. Returns the number of regions filled.
+    Q_INVOKABLE int flatRegions(bool useHints);
+    /// Transform the active layer about the centre of its content: offset
+    /// in canvas pixels, uniform scale, rotation in degrees. Shown as a fast
+    /// preview (for dragging handles or sliders) until commitTransform()
+    /// resamples at full quality as one undo step; cancelTransform() puts
+    /// the layer back. The Move tool drags the offset the same way.
+    Q_INVOKABLE void previewTransform(qreal dx, qreal dy, qreal scale, qreal degrees);
+    Q_INVOKABLE void commitTransform();
+    Q_INVOKABLE void cancelTransform();
 
     // --- Canvas Integration ---
     Q_INVOKABLE void setCanvasItem(CanvasItem* item);
@@ -111,25 +232,90 @@ signals:
     void currentColorChanged();
     void brushSizeChanged();
     void brushHardnessChanged();
+    void brushTipChanged();
+    void brushAngleChanged();
+    void brushAspectChanged();
+    void fillToleranceChanged();
+    void fillSampleMergedChanged();
+    void fillGapCloseChanged();
+    void transformFilterChanged();
+    void selectionModeChanged();
+    void selectionChanged();
     void themeChanged();
     void historyChanged();
     void dirtyChanged();
     void filePathChanged();
+    void saveCompressionChanged();
+    void inputLatencyChanged();
+    void predictionHorizonChanged();
+    void predictionErrorChanged();
+    void pagesChanged();
+    void recoveryChanged();
     void canvasNeedsUpdate();
 
 private:
+    /// Rebind the layer model and canvas after the edited page changed.
+    void onActivePageChanged();
+
+    /// Bucket fill of the active layer from canvasPos, as one undo step.
+    void fillAt(QPointF canvasPos);
+
+    /// Canvas rect spanned by the Select tool's drag so far.
+    QRect marqueeRect() const;
+
+    // --- Layer Transform ---
+    /// Start transforming the active layer, if not already; false if it
+    /// cannot be edited.
+    bool beginTransform();
+    /// Render the pending transform onto its layer; false if the layer is gone.
+    /// Vector layers transform their strokes instead of resampling pixels.
+    bool applyTransform(TransformQuality quality);
+    bool isTransforming() const { return m_transform || m_transformStrokes; }
+
+    // --- Brush Thread ---
+    void onTilesPublished();
+    /// Push the stroke the brush thread finished to history; false if none.
+    bool commitFinishedStroke();
+    /// Cancel the stroke in progress and commit finished ones (and a pending
+    /// transform), before an operation that changes the document.
+    void finishStrokes();
+
     std::unique_ptr<Document> m_document;
     DocumentModel* m_layerModel = nullptr;
-    BrushEngine m_brushEngine;
+    BrushThread m_brushThread;
+    std::vector<TileCoord> m_publishedTiles;  // Scratch: onTilesPublished()
     CanvasItem* m_canvasItem = nullptr;
+    Autosaver m_autosaver;
+    bool m_hasRecovery = false;
 
     ToolType m_currentTool = ToolType::Pen;
     QColor m_currentColor = Qt::black;
     qreal m_brushSize = 10.0;
     qreal m_brushHardness = 1.0;
+    int m_brushTip = -1;
+    qreal m_brushAngle = 0.0;
+    qreal m_brushAspect = 1.0;
+    int m_fillTolerance = 0;
+    bool m_fillSampleMerged = false;
+    int m_fillGapClose = 0;
+    SelectionOp m_selectionMode = SelectionOp::Replace;
+    bool m_selecting = false;
+    QPointF m_selectFrom;
+    QPointF m_selectTo;
+    int m_transformFilter = 1;
+    std::unique_ptr<LayerTransform> m_transform;
+    std::optional<VectorLayer::StrokeList> m_transformStrokes;  // Vector layers: the strokes before
+    LayerId m_transformLayer = 0;
+    QRect m_transformBounds;  // Content, about whose centre it scales and rotates
+    QPointF m_transformOffset;
+    qreal m_transformScale = 1.0;
+    qreal m_transformRotation = 0.0;
+    bool m_moving = false;
+    QPointF m_moveFrom;
     QString m_theme = QStringLiteral("system");
-
-    Layer* m_strokeLayer = nullptr;
+    int m_saveCompression = 0;
+    qreal m_inputLatency = 0.0;
+    qreal m_predictionError = 0.0;
 };
 
 }  // namespace comicos
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "core/Document.h"
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <functional>
+
+namespace comicos {
+
+/// Periodic background autosave to a recovery file.
+///
+/// Each save takes a Document::snapshot() on the UI thread (tile buffers are
+/// shared copy-on-write, so this is O(tiles) pointer copies) and serializes
+/// it on a dedicated worker thread. Saves are deferred while the busy check
+/// reports an active stroke and retried shortly after the canvas goes idle,
+/// so autosave never competes with drawing for frame time.
+///
+/// The recovery file is removed on clean shutdown and after a manual save.
+/// If it exists at startup, the previous session ended abnormally.
+class Autosaver : public QObject {
+    Q_OBJECT
+
+public:
+    explicit Autosaver(QObject* parent = nullptr);
+    ~Autosaver() override;
+
+    /// Document to autosave (not owned). Resets the change state.
+    void setDocument(const Document* document);
+
+    /// While disabled nothing is written (e.g. until an existing recovery
+    /// file has been recovered or discarded).
+    void setEnabled(bool enabled);
+
+    /// Interval between autosaves, in milliseconds.
+    void setInterval(int msec);
+
+    /// Autosave is postponed while this returns true (e.g. stroke in progress).
+    void setBusyCheck(std::function<bool()> isBusy);
+
+    /// The document changed since the last autosave.
+    void markChanged();
+
+    /// Block until an in-flight write has finished.
+    void waitForIdle();
+
+    // --- Recovery ---
+    static QString recoveryPath();
+    static bool hasRecovery();
+
+    /// Path the recovered document was saved under (empty if it never was).
+    static QString recoveryOriginalPath();
+
+    /// Remove the recovery file (after a manual save or on clean exit).
+    void discardRecovery();
+
+signals:
+    /// Emitted on the UI thread after each background write.
+    void autosaved(bool ok);
+
+private:
+    void trySave();
+    void finishSave(bool ok);
+
+    static QString recoveryDir();
+    static QString recoveryInfoPath();
+
+    static constexpr int DEFAULT_INTERVAL_MS = 60 * 1000;
+    static constexpr int IDLE_DELAY_MS = 1500;
+
+    const Document* m_document = nullptr;
+    std::function<bool()> m_isBusy;
+    QTimer m_timer;
+    QTimer m_idleTimer;    // Retry after activity stops
+    QThreadPool m_pool;    // Single thread: writes never overlap
+    bool m_enabled = true;
+    bool m_writing = false;
+    bool m_changed = false;
+    bool m_pending = false;  // A save was postponed
+};
+
+}  // namespace comicos
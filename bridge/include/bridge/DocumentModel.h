@@ -4,6 +4,7 @@
 #include "core/Types.h"
 #include <QAbstractListModel>
 #include <QQmlEngine>
+#include <functional>
 
 namespace comicos {
 
@@ -26,6 +27,7 @@ public:
         VisibleRole,
         LockedRole,
         BlendModeRole,
+        TypeRole,  // LayerType: 0 raster, 1 vector
     };
 
     explicit DocumentModel(QObject* parent = nullptr);
@@ -33,6 +35,10 @@ public:
 
     void setDocument(Document* document);
 
+    /// Called before layers are removed, duplicated or reordered, e.g. to
+    /// finish strokes that still paint into them.
+    void setBeforeLayerChange(std::function<void()> callback);
+
     // --- QAbstractListModel ---
     int rowCount(const QModelIndex& parent = {}) const override;
     QVariant data(const QModelIndex& index, int role) const override;
@@ -42,6 +48,8 @@ public:
 
     // --- Layer Operations (invocable from QML) ---
     Q_INVOKABLE void addLayer();
+    /// Add a layer that stores strokes instead of pixels (VectorLayer).
+    Q_INVOKABLE void addVectorLayer();
     Q_INVOKABLE void removeLayer(int index);
     Q_INVOKABLE void duplicateLayer(int index);
     Q_INVOKABLE void moveLayer(int from, int to);
@@ -49,6 +57,10 @@ public:
     Q_INVOKABLE void setLayerOpacity(int index, qreal opacity);
     Q_INVOKABLE void setLayerVisible(int index, bool visible);
 
+    /// Add an empty layer at stack index `layerIndex` (0 = bottom), which
+    /// becomes active. For operations that create layers from C++.
+    Layer* insertLayer(int layerIndex, const QString& name);
+
     // --- Properties ---
     int activeLayerIndex() const;
     void setActiveLayerIndex(int index);
@@ -64,6 +76,7 @@ signals:
 
 private:
     Document* m_document = nullptr;
+    std::function<void()> m_beforeLayerChange;
 };
 
 }  // namespace comicos
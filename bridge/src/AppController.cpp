@@ -1,6 +1,15 @@
 #include "bridge/AppController.h"
+#include "core/CmcFormat.h"
+#include "engine/Compositor.h"
+#include "engine/FloodFill.h"
+#include "engine/RegionMap.h"
+#include "engine/StrokeRasterizer.h"
 #include <QGuiApplication>
 #include <QStyleHints>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
 
 namespace comicos {
 
@@ -16,12 +25,15 @@ StrokeCommand::StrokeCommand(
     , m_before(std::move(before))
     , m_firstRedo(true)
 {
-    // Capture "after" state — the stroke is already applied by BrushEngine
+    // Capture "after" state — the stroke is already applied by BrushEngine.
+    // Interning first lets identical tiles (and their snapshots) share pixels.
     Layer* layer = m_layers->layerById(m_layerId);
     if (layer) {
         for (const auto& tc : m_coords) {
-            const Tile* tile = layer->tiles().tileAt(tc);
-            if (tile && !tile->isEmpty()) {
+            if (!layer->tiles().hasTile(tc)) continue;
+            Tile* tile = layer->tiles().getOrCreateTile(tc);
+            if (!tile->isEmpty()) {
+                tile->intern();
                 m_after[tc] = tile->clone();
             }
         }
@@ -75,14 +87,71 @@ size_t StrokeCommand::memoryUsage() const {
     return count * TILE_BYTES;
 }
 
+// --- VectorStrokeCommand ---
+
+VectorStrokeCommand::VectorStrokeCommand(LayerStack* layers, LayerId layerId,
+                                         VectorLayer::StrokeList before,
+                                         VectorLayer::StrokeList after)
+    : m_layers(layers)
+    , m_layerId(layerId)
+    , m_before(std::move(before))
+    , m_after(std::move(after))
+{
+    std::unordered_set<const Stroke*> kept;
+    for (const auto& stroke : m_before) kept.insert(stroke.get());
+    for (const auto& stroke : m_after) {
+        if (kept.count(stroke.get())) continue;
+        m_memory += sizeof(Stroke) + stroke->points().size() * sizeof(CanvasPoint);
+    }
+}
+
+void VectorStrokeCommand::undo() {
+    apply(m_before);
+}
+
+void VectorStrokeCommand::redo() {
+    if (m_firstRedo) {
+        m_firstRedo = false;
+        return;
+    }
+    apply(m_after);
+}
+
+void VectorStrokeCommand::apply(const VectorLayer::StrokeList& strokes) {
+    Layer* layer = m_layers->layerById(m_layerId);
+    if (!layer || layer->type() != LayerType::Vector) return;  // Layer was deleted
+    static_cast<VectorLayer*>(layer)->setStrokes(strokes);
+}
+
 // --- AppController ---
 
 AppController::AppController(QObject* parent) : QObject(parent) {
     m_document = std::make_unique<Document>();
 
+    // Vector layers draw with the brush thread's image tips
+    StrokeRasterizer::install(&m_brushThread.tipAtlas());
+
+    // A recovery file left behind means the last session did not exit cleanly
+    m_hasRecovery = Autosaver::hasRecovery();
+    m_autosaver.setEnabled(!m_hasRecovery);
+    // A transform in progress leaves preview pixels on its layer
+    m_autosaver.setBusyCheck([this]() { return m_brushThread.isBusy() || isTransforming(); });
+    m_autosaver.setDocument(m_document.get());
+
+    // The brush thread reports back through the event loop
+    m_brushThread.setTilesPublishedHandler([this]() {
+        QMetaObject::invokeMethod(this, [this]() { onTilesPublished(); }, Qt::QueuedConnection);
+    });
+    m_brushThread.setStrokeFinishedHandler([this]() {
+        QMetaObject::invokeMethod(this, [this]() { commitFinishedStroke(); },
+                                  Qt::QueuedConnection);
+    });
+
     // Create layer model and bind to document
     m_layerModel = new DocumentModel(this);
     m_layerModel->setDocument(m_document.get());
+    // Strokes in flight commit into their layer before it is removed or moved
+    m_layerModel->setBeforeLayerChange([this]() { finishStrokes(); });
 
     // When layer visuals change, repaint canvas
     connect(m_layerModel, &DocumentModel::layerVisualChanged, this, [this]() {
@@ -90,6 +159,7 @@ AppController::AppController(QObject* parent) : QObject(parent) {
             m_canvasItem->invalidateCanvas();
         }
         m_document->setDirty(true);
+        m_autosaver.markChanged();
         emit canvasNeedsUpdate();
         emit dirtyChanged();
     });
@@ -105,7 +175,11 @@ AppController::AppController(QObject* parent) : QObject(parent) {
     }
 }
 
-AppController::~AppController() = default;
+AppController::~AppController() {
+    // Clean exit: unsaved changes were already confirmed by the user.
+    // Keep an unrecovered file from a previous crash for the next launch.
+    if (!m_hasRecovery) m_autosaver.discardRecovery();
+}
 
 // --- Tool Getters ---
 
@@ -125,6 +199,34 @@ qreal AppController::brushHardness() const {
     return m_brushHardness;
 }
 
+int AppController::brushTip() const {
+    return m_brushTip;
+}
+
+qreal AppController::brushAngle() const {
+    return m_brushAngle;
+}
+
+qreal AppController::brushAspect() const {
+    return m_brushAspect;
+}
+
+int AppController::fillTolerance() const {
+    return m_fillTolerance;
+}
+
+bool AppController::fillSampleMerged() const {
+    return m_fillSampleMerged;
+}
+
+int AppController::fillGapClose() const {
+    return m_fillGapClose;
+}
+
+int AppController::transformFilter() const {
+    return m_transformFilter;
+}
+
 // --- Tool Setters ---
 
 void AppController::setCurrentTool(int tool) {
@@ -154,6 +256,103 @@ void AppController::setBrushHardness(qreal hardness) {
     emit brushHardnessChanged();
 }
 
+void AppController::setBrushTip(int tipId) {
+    if (tipId >= m_brushThread.tipAtlas().count()) return;
+    tipId = qMax(tipId, -1);
+    if (m_brushTip == tipId) return;
+    m_brushTip = tipId;
+    emit brushTipChanged();
+}
+
+void AppController::setBrushAngle(qreal degrees) {
+    degrees = std::fmod(degrees, 360.0);
+    if (qFuzzyCompare(m_brushAngle, degrees)) return;
+    m_brushAngle = degrees;
+    emit brushAngleChanged();
+}
+
+void AppController::setBrushAspect(qreal aspect) {
+    aspect = qBound(0.05, aspect, 1.0);
+    if (qFuzzyCompare(m_brushAspect, aspect)) return;
+    m_brushAspect = aspect;
+    emit brushAspectChanged();
+}
+
+void AppController::setFillTolerance(int tolerance) {
+    tolerance = qBound(0, tolerance, 255);
+    if (m_fillTolerance == tolerance) return;
+    m_fillTolerance = tolerance;
+    emit fillToleranceChanged();
+}
+
+void AppController::setFillSampleMerged(bool merged) {
+    if (m_fillSampleMerged == merged) return;
+    m_fillSampleMerged = merged;
+    emit fillSampleMergedChanged();
+}
+
+void AppController::setFillGapClose(int pixels) {
+    pixels = qBound(0, pixels, FloodFill::MAX_GAP_CLOSE);
+    if (m_fillGapClose == pixels) return;
+    m_fillGapClose = pixels;
+    emit fillGapCloseChanged();
+}
+
+void AppController::setTransformFilter(int filter) {
+    filter = qBound(0, filter, 1);
+    if (m_transformFilter == filter) return;
+    m_transformFilter = filter;
+    emit transformFilterChanged();
+}
+
+// --- Selection ---
+
+int AppController::selectionMode() const {
+    return static_cast<int>(m_selectionMode);
+}
+
+void AppController::setSelectionMode(int mode) {
+    const auto op = static_cast<SelectionOp>(qBound(0, mode, 3));
+    if (m_selectionMode == op) return;
+    m_selectionMode = op;
+    emit selectionModeChanged();
+}
+
+bool AppController::hasSelection() const {
+    return m_document && !m_document->selection().isEmpty();
+}
+
+QRect AppController::selectionBounds() const {
+    if (m_selecting) return marqueeRect();
+    return m_document ? m_document->selection().bounds() : QRect();
+}
+
+QRect AppController::marqueeRect() const {
+    const QRectF drag = QRectF(m_selectFrom, m_selectTo).normalized();
+    const QRect canvas(QPoint(0, 0), m_document->canvasSize());
+    return QRect(QPoint(qRound(drag.left()), qRound(drag.top())),
+                 QPoint(qRound(drag.right()) - 1, qRound(drag.bottom()) - 1))
+        .intersected(canvas);
+}
+
+void AppController::selectAll() {
+    if (!m_document) return;
+    m_document->selection().selectAll(m_document->canvasSize());
+    emit selectionChanged();
+}
+
+void AppController::deselect() {
+    if (!m_document) return;
+    m_document->selection().clear();
+    emit selectionChanged();
+}
+
+void AppController::invertSelection() {
+    if (!m_document) return;
+    m_document->selection().invert(m_document->canvasSize());
+    emit selectionChanged();
+}
+
 // --- Theme ---
 
 QString AppController::theme() const {
@@ -198,24 +397,265 @@ QString AppController::filePath() const {
     return m_document ? m_document->filePath() : QString();
 }
 
+qreal AppController::inputLatency() const {
+    return m_inputLatency;
+}
+
+qreal AppController::predictionHorizon() const {
+    return m_brushThread.predictionHorizon();
+}
+
+void AppController::setPredictionHorizon(qreal ms) {
+    ms = qBound(0.0, ms, static_cast<qreal>(MotionPredictor::MAX_HORIZON_MS));
+    if (qFuzzyCompare(predictionHorizon(), ms)) return;
+    m_brushThread.setPredictionHorizon(static_cast<float>(ms));
+    emit predictionHorizonChanged();
+}
+
+qreal AppController::predictionError() const {
+    return m_predictionError;
+}
+
+bool AppController::hasRecovery() const {
+    return m_hasRecovery;
+}
+
+int AppController::saveCompression() const {
+    return m_saveCompression;
+}
+
+void AppController::setSaveCompression(int mode) {
+    mode = qBound(0, mode, 1);
+    if (m_saveCompression == mode) return;
+    m_saveCompression = mode;
+    emit saveCompressionChanged();
+}
+
+// --- Pages ---
+
+int AppController::pageCount() const {
+    return m_document ? m_document->pageCount() : 0;
+}
+
+int AppController::currentPage() const {
+    return m_document ? m_document->activePageIndex() : 0;
+}
+
+void AppController::setCurrentPage(int index) {
+    if (!m_document || index == m_document->activePageIndex()) return;
+    if (index < 0 || index >= m_document->pageCount()) return;
+
+    // The stroke layer belongs to the page being left
+    finishStrokes();
+
+    m_document->setActivePage(index);
+    onActivePageChanged();
+}
+
+void AppController::addPage() {
+    if (!m_document) return;
+
+    finishStrokes();
+
+    const int index = m_document->activePageIndex() + 1;
+    m_document->insertPage(index, m_document->canvasSize());
+    m_document->setActivePage(index);
+    m_document->setDirty(true);
+    m_autosaver.markChanged();
+    onActivePageChanged();
+    emit dirtyChanged();
+}
+
+void AppController::removePage(int index) {
+    if (!m_document || m_document->pageCount() <= 1) return;
+    if (index < 0 || index >= m_document->pageCount()) return;
+
+    finishStrokes();
+
+    m_document->removePage(index);
+    m_document->setDirty(true);
+    m_autosaver.markChanged();
+    onActivePageChanged();
+    emit dirtyChanged();
+}
+
+int AppController::loadBrushTip(const QString& path) {
+    const int id = m_brushThread.tipAtlas().loadTip(path);
+    if (id >= 0) setBrushTip(id);
+    return id;
+}
+
+int AppController::flatRegions(bool useHints) {
+    if (!m_document) return 0;
+    finishStrokes();
+
+    LayerStack& layers = m_document->layers();
+    Layer* lineArt = layers.activeLayer();
+    if (!lineArt) return 0;
+    const int index = layers.indexOf(lineArt->id());
+    const Layer* hints = useHints ? layers.layerAt(index + 1) : nullptr;
+    if (useHints && !hints) return 0;
+
+    RegionMap regions;
+    if (!regions.build(*lineArt, m_document->canvasSize())) return 0;
+    const auto colors = useHints ? regions.colorsFromHints(*hints) : regions.distinctColors();
+    const auto filled = std::count_if(colors.begin(), colors.end(),
+                                      [](const Pixel& c) { return c.a > 0; });
+    if (filled == 0) return 0;
+
+    // A new layer, like the layer panel's "add layer" (not an undo step)
+    Layer* flats = m_layerModel->insertLayer(index, QStringLiteral("Flats"));
+    regions.paint(*flats, colors);
+
+    m_document->setDirty(true);
+    m_autosaver.markChanged();
+    emit dirtyChanged();
+    emit canvasNeedsUpdate();
+    if (m_canvasItem) {
+        m_canvasItem->invalidateCanvas();
+    }
+    return static_cast<int>(filled);
+}
+
+// --- Layer Transform ---
+
+bool AppController::beginTransform() {
+    if (isTransforming()) return true;
+    if (!m_document) return false;
+    finishStrokes();
+
+    Layer* layer = m_document->layers().activeLayer();
+    if (!layer || layer->isLocked()) return false;
+    if (layer->type() == LayerType::Vector) {
+        // Strokes are transformed as strokes, so they stay sharp
+        const auto& strokes = static_cast<const VectorLayer&>(*layer).strokes();
+        m_transformStrokes = strokes;
+        m_transformBounds = {};
+        for (const auto& stroke : strokes) {
+            m_transformBounds |= VectorLayer::strokeBounds(*stroke);
+        }
+    } else {
+        m_transform = std::make_unique<LayerTransform>(*layer);
+        m_transformBounds = m_transform->contentBounds();
+    }
+    m_transformLayer = layer->id();
+    m_transformOffset = {};
+    m_transformScale = 1.0;
+    m_transformRotation = 0.0;
+    return true;
+}
+
+bool AppController::applyTransform(TransformQuality quality) {
+    Layer* layer = m_document->layers().layerById(m_transformLayer);
+    if (!layer) {
+        // Deleted meanwhile: nothing to show
+        m_transform.reset();
+        m_transformStrokes.reset();
+        return false;
+    }
+
+    // Scale and rotate about the content's centre, then offset
+    const QPointF pivot = QRectF(m_transformBounds).center();
+    QTransform transform;
+    transform.translate(pivot.x() + m_transformOffset.x(), pivot.y() + m_transformOffset.y());
+    transform.rotate(m_transformRotation);
+    transform.scale(m_transformScale, m_transformScale);
+    transform.translate(-pivot.x(), -pivot.y());
+
+    const auto tiles = m_transformStrokes
+        ? static_cast<VectorLayer*>(layer)->setStrokes(
+              VectorLayer::transformed(*m_transformStrokes, transform))
+        : m_transform->apply(*layer, transform, quality);
+    emit canvasNeedsUpdate();
+    if (m_canvasItem) {
+        m_canvasItem->invalidateTiles(tiles);
+    }
+    return true;
+}
+
+void AppController::previewTransform(qreal dx, qreal dy, qreal scale, qreal degrees) {
+    if (!beginTransform()) return;
+    m_transformOffset = QPointF(dx, dy);
+    m_transformScale = scale;
+    m_transformRotation = degrees;
+    applyTransform(TransformQuality::Preview);
+}
+
+void AppController::commitTransform() {
+    m_moving = false;
+    if (!isTransforming()) return;
+    if (m_transformOffset.isNull() && m_transformScale == 1.0 && m_transformRotation == 0.0) {
+        cancelTransform();  // A click without a drag
+        return;
+    }
+    const auto quality = m_transformFilter == 0 ? TransformQuality::Bilinear
+                                                : TransformQuality::Bicubic;
+    if (applyTransform(quality)) {
+        if (m_transformStrokes) {
+            const auto* layer = static_cast<const VectorLayer*>(
+                m_document->layers().layerById(m_transformLayer));
+            m_document->history().push(std::make_unique<VectorStrokeCommand>(
+                &m_document->layers(), m_transformLayer, std::move(*m_transformStrokes),
+                layer->strokes()));
+        } else {
+            m_document->history().push(std::make_unique<StrokeCommand>(
+                &m_document->layers(), m_transformLayer, m_transform->touchedTiles(),
+                m_transform->takeBefore()));
+        }
+        m_document->setDirty(true);
+        m_autosaver.markChanged();
+        emit historyChanged();
+        emit dirtyChanged();
+    }
+    m_transform.reset();
+    m_transformStrokes.reset();
+}
+
+void AppController::cancelTransform() {
+    m_moving = false;
+    if (!isTransforming()) return;
+    if (Layer* layer = m_document->layers().layerById(m_transformLayer)) {
+        const auto tiles = m_transformStrokes
+            ? static_cast<VectorLayer*>(layer)->setStrokes(std::move(*m_transformStrokes))
+            : m_transform->restore(*layer);
+        emit canvasNeedsUpdate();
+        if (m_canvasItem) {
+            m_canvasItem->invalidateTiles(tiles);
+        }
+    }
+    m_transform.reset();
+    m_transformStrokes.reset();
+}
+
+void AppController::onActivePageChanged() {
+    m_layerModel->setDocument(m_document.get());
+    if (m_canvasItem) {
+        m_canvasItem->setDocument(m_document.get());
+    }
+    emit pagesChanged();
+    emit selectionChanged();
+    emit historyChanged();
+    emit canvasNeedsUpdate();
+}
+
 // --- Actions ---
 
 void AppController::newDocument(int width, int height, int dpi) {
-    // Cancel any in-progress stroke before replacing document
-    if (m_brushEngine.isActive()) {
-        m_brushEngine.cancelStroke();
-        m_strokeLayer = nullptr;
-    }
+    // Settle strokes before replacing document
+    finishStrokes();
 
     m_document = std::make_unique<Document>(QSize(width, height));
     m_document->setDpi(dpi);
 
     m_layerModel->setDocument(m_document.get());
+    m_autosaver.setDocument(m_document.get());
 
     if (m_canvasItem) {
         m_canvasItem->setDocument(m_document.get());
     }
 
+    emit pagesChanged();
+    emit selectionChanged();
     emit historyChanged();
     emit dirtyChanged();
     emit filePathChanged();
@@ -230,53 +670,105 @@ bool AppController::saveDocument() {
 bool AppController::saveDocumentTo(const QString& path) {
     if (!m_document) return false;
 
-    // Cancel any in-progress stroke before saving
-    if (m_brushEngine.isActive()) {
-        m_brushEngine.cancelStroke();
-        m_strokeLayer = nullptr;
-    }
+    // Settle strokes before saving
+    finishStrokes();
 
-    if (!m_document->save(path))
+    // An in-flight autosave may still reference tiles mapped from `path`
+    m_autosaver.waitForIdle();
+
+    // Previews show the first page (the cover); other pages may be loading
+    // or evicting in the background until the wait
+    m_document->waitForResidency();
+    auto encoding = m_saveCompression == 1 ? TileEncoding::small() : TileEncoding::fast();
+    const Page& cover = m_document->page(0);
+    auto preview = Compositor().renderPreview(cover.layers(), cover.canvasSize());
+    if (!m_document->save(path, encoding, preview))
         return false;
 
+    if (!m_hasRecovery) m_autosaver.discardRecovery();
+
     emit dirtyChanged();
     emit filePathChanged();
     return true;
 }
 
 bool AppController::openDocument(const QString& path) {
-    // Cancel any in-progress stroke before replacing document
-    if (m_brushEngine.isActive()) {
-        m_brushEngine.cancelStroke();
-        m_strokeLayer = nullptr;
-    }
+    // Settle strokes before replacing document
+    finishStrokes();
 
     auto doc = Document::load(path);
     if (!doc) return false;
 
     m_document = std::move(doc);
     m_layerModel->setDocument(m_document.get());
+    m_autosaver.setDocument(m_document.get());
+
+    if (m_canvasItem) {
+        m_canvasItem->setDocument(m_document.get());
+    }
+
+    emit pagesChanged();
+    emit selectionChanged();
+    emit historyChanged();
+    emit dirtyChanged();
+    emit filePathChanged();
+    return true;
+}
+
+bool AppController::recoverDocument() {
+    if (!m_hasRecovery) return false;
+
+    finishStrokes();
+
+    auto doc = Document::load(Autosaver::recoveryPath());
+    if (!doc) {
+        discardRecovery();
+        return false;
+    }
+
+    // Copy the tiles into memory now: the recovery file is overwritten by the
+    // next autosave. They stay encoded, so a long chapter still fits.
+    doc->waitForResidency();
+    CmcFormat::detachFromFile(*doc, Autosaver::recoveryPath());
+    doc->setFilePath(Autosaver::recoveryOriginalPath());
+    doc->setDirty(true);
+
+    m_document = std::move(doc);
+    m_layerModel->setDocument(m_document.get());
+    m_autosaver.setDocument(m_document.get());
+    m_autosaver.markChanged();
 
     if (m_canvasItem) {
         m_canvasItem->setDocument(m_document.get());
     }
 
+    m_hasRecovery = false;
+    m_autosaver.setEnabled(true);
+    emit recoveryChanged();
+    emit pagesChanged();
+    emit selectionChanged();
     emit historyChanged();
     emit dirtyChanged();
     emit filePathChanged();
     return true;
 }
 
+void AppController::discardRecovery() {
+    if (!m_hasRecovery) return;
+    m_autosaver.discardRecovery();
+    m_hasRecovery = false;
+    m_autosaver.setEnabled(true);
+    emit recoveryChanged();
+}
+
 void AppController::undo() {
     if (!m_document) return;
 
-    // Cancel any in-progress stroke before undo
-    if (m_brushEngine.isActive()) {
-        m_brushEngine.cancelStroke();
-        m_strokeLayer = nullptr;
-    }
+    // Settle strokes before undo
+    finishStrokes();
 
     m_document->history().undo();
+    m_autosaver.markChanged();
     emit historyChanged();
 
     if (m_canvasItem) {
@@ -287,13 +779,11 @@ void AppController::undo() {
 void AppController::redo() {
     if (!m_document) return;
 
-    // Cancel any in-progress stroke before redo
-    if (m_brushEngine.isActive()) {
-        m_brushEngine.cancelStroke();
-        m_strokeLayer = nullptr;
-    }
+    // Settle strokes before redo
+    finishStrokes();
 
     m_document->history().redo();
+    m_autosaver.markChanged();
     emit historyChanged();
 
     if (m_canvasItem) {
@@ -303,6 +793,9 @@ void AppController::redo() {
 
 void AppController::setCanvasItem(CanvasItem* item) {
     m_canvasItem = item;
+    if (m_canvasItem) {
+        m_canvasItem->setBrushThread(&m_brushThread);
+    }
     if (m_canvasItem && m_document) {
         m_canvasItem->setDocument(m_document.get());
     }
@@ -313,62 +806,180 @@ void AppController::setCanvasItem(CanvasItem* item) {
 void AppController::onStrokeStarted(QPointF canvasPos, float pressure) {
     if (!m_document) return;
 
+    if (m_currentTool == ToolType::Fill) {
+        fillAt(canvasPos);
+        return;
+    }
+    if (m_currentTool == ToolType::Select) {
+        m_selecting = true;
+        m_selectFrom = m_selectTo = canvasPos;
+        emit selectionChanged();
+        return;
+    }
+    if (m_currentTool == ToolType::Move) {
+        // Carries on from a transform already shown (e.g. a rotation)
+        if (!beginTransform()) return;
+        m_moving = true;
+        m_moveFrom = canvasPos - m_transformOffset;
+        return;
+    }
+
     // Only Pen and Eraser use the brush engine
     if (m_currentTool != ToolType::Pen && m_currentTool != ToolType::Eraser) return;
 
+    // Paint on top of a transform still shown as a preview, not under it
+    commitTransform();
+
     Layer* layer = m_document->layers().activeLayer();
     if (!layer || layer->isLocked()) return;
 
-    m_strokeLayer = layer;
-
     Stroke stroke;
     stroke.setToolType(m_currentTool);
     stroke.setColor(m_currentColor);
     stroke.setBrushSize(m_brushSize);
     stroke.setHardness(m_brushHardness);
+    stroke.setTipAngle(static_cast<float>(qDegreesToRadians(m_brushAngle)));
+    stroke.setTipAspect(static_cast<float>(m_brushAspect));
     stroke.setTargetLayerId(layer->id());
+    // Vector strokes are redrawn from their points alone, also after
+    // reopening: image tips only exist for the session, so they use the
+    // round tip
+    if (layer->type() == LayerType::Raster) stroke.setTipId(m_brushTip);
+    if (!m_document->selection().isEmpty() && layer->type() == LayerType::Raster) {
+        stroke.setSelection(std::make_shared<const Selection>(m_document->selection()));
+    }
 
-    m_brushEngine.beginStroke(layer, stroke);
+    m_brushThread.resetStats();
+    m_brushThread.beginStroke(stroke);
 
     CanvasPoint point;
     point.x = canvasPos.x();
     point.y = canvasPos.y();
     point.pressure = pressure;
-    m_brushEngine.addPoint(point);
+    m_brushThread.addPoint(point);
+}
+
+void AppController::fillAt(QPointF canvasPos) {
+    // The fill reads the layer, so the brush thread must be done with it
+    finishStrokes();
+
+    // Fills are pixels: vector layers only hold strokes
+    Layer* layer = m_document->layers().activeLayer();
+    if (!layer || layer->isLocked() || layer->type() != LayerType::Raster) return;
+
+    FillOptions options;
+    options.tolerance = m_fillTolerance;
+    options.sample = m_fillSampleMerged ? FillSample::Merged : FillSample::CurrentLayer;
+    options.gapClose = m_fillGapClose;
+
+    FloodFill fill(m_document->layers(), *layer, m_document->canvasSize(), options);
+    if (!fill.compute(qFloor(canvasPos.x()), qFloor(canvasPos.y()))) return;
+
+    std::unordered_map<TileCoord, std::unique_ptr<Tile>> before;
+    auto tiles = fill.apply(*layer, m_currentColor, &before, &m_document->selection());
+    if (tiles.empty()) return;
+    m_document->history().push(std::make_unique<StrokeCommand>(
+        &m_document->layers(), layer->id(), tiles, std::move(before)));
 
+    m_document->setDirty(true);
+    m_autosaver.markChanged();
+    emit historyChanged();
+    emit dirtyChanged();
     emit canvasNeedsUpdate();
+    if (m_canvasItem) {
+        m_canvasItem->invalidateTiles(tiles);
+    }
 }
 
 void AppController::onStrokeUpdated(QPointF canvasPos, float pressure) {
-    if (!m_brushEngine.isActive()) return;
+    if (m_selecting) {
+        m_selectTo = canvasPos;
+        emit selectionChanged();
+        return;
+    }
+    if (m_moving) {
+        // Whole pixels keep a plain drag on the exact (copying) path
+        const QPointF offset = canvasPos - m_moveFrom;
+        previewTransform(qRound(offset.x()), qRound(offset.y()), m_transformScale,
+                         m_transformRotation);
+        return;
+    }
+    if (!m_brushThread.isActive()) return;
 
     CanvasPoint point;
     point.x = canvasPos.x();
     point.y = canvasPos.y();
     point.pressure = pressure;
-    m_brushEngine.addPoint(point);
-
-    emit canvasNeedsUpdate();
+    m_brushThread.addPoint(point);
 }
 
 void AppController::onStrokeEnded() {
-    if (!m_brushEngine.isActive()) return;
+    if (m_selecting) {
+        // A click without a drag selects nothing: in replace mode, deselect
+        m_selecting = false;
+        m_document->selection().combine(Selection::fromRect(marqueeRect()), m_selectionMode);
+        emit selectionChanged();
+        return;
+    }
+    if (m_moving) {
+        commitTransform();
+        return;
+    }
 
-    auto affectedTiles = m_brushEngine.endStroke();
-    auto beforeSnapshots = m_brushEngine.takeBeforeSnapshots();
+    // Committed once the brush thread has caught up (commitFinishedStroke)
+    m_brushThread.endStroke();
+}
 
-    if (m_strokeLayer && !affectedTiles.empty()) {
+void AppController::onTilesPublished() {
+    m_brushThread.takePublishedTiles(m_publishedTiles);
+    if (m_canvasItem) {
+        m_canvasItem->invalidateTiles(m_publishedTiles);
+    }
+    emit canvasNeedsUpdate();
+}
+
+bool AppController::commitFinishedStroke() {
+    BrushThread::CommittedStroke stroke;
+    if (!m_brushThread.commitStroke(m_document->layers(), &stroke)) return false;
+
+    if (stroke.layer && !stroke.tiles.empty() && stroke.layer->type() == LayerType::Vector) {
+        // The tiles already show the stroke; the layer only records it
+        auto* layer = static_cast<VectorLayer*>(stroke.layer);
+        auto before = layer->strokes();
+        layer->appendPainted(std::make_shared<const Stroke>(std::move(stroke.stroke)));
+        m_document->history().push(std::make_unique<VectorStrokeCommand>(
+            &m_document->layers(), layer->id(), std::move(before), layer->strokes()));
+    } else if (stroke.layer && !stroke.tiles.empty()) {
         auto cmd = std::make_unique<StrokeCommand>(
-            &m_document->layers(), m_strokeLayer->id(),
-            affectedTiles, std::move(beforeSnapshots));
+            &m_document->layers(), stroke.layer->id(),
+            stroke.tiles, std::move(stroke.before));
         m_document->history().push(std::move(cmd));
     }
 
-    m_strokeLayer = nullptr;
+    m_inputLatency = m_brushThread.latency().meanMs;
+    const auto prediction = m_brushThread.prediction();
+    m_predictionError = prediction.predictedPixels
+        ? static_cast<qreal>(prediction.mispredictedPixels) / prediction.predictedPixels
+        : 0.0;
     m_document->setDirty(true);
+    m_autosaver.markChanged();
+    emit inputLatencyChanged();
+    emit predictionErrorChanged();
     emit historyChanged();
     emit dirtyChanged();
     emit canvasNeedsUpdate();
+    if (m_canvasItem) {
+        m_canvasItem->invalidateTiles(stroke.tiles);
+    }
+    return true;
+}
+
+void AppController::finishStrokes() {
+    commitTransform();
+    m_brushThread.cancelStroke();
+    do {
+        m_brushThread.waitForIdle();
+    } while (commitFinishedStroke());
 }
 
 }  // namespace comicos
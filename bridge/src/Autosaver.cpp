@@ -0,0 +1,133 @@
+#include "bridge/Autosaver.h"
+#include "core/CmcFormat.h"
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <memory>
+
+namespace comicos {
+
+Autosaver::Autosaver(QObject* parent) : QObject(parent) {
+    m_pool.setMaxThreadCount(1);
+
+    m_timer.setInterval(DEFAULT_INTERVAL_MS);
+    connect(&m_timer, &QTimer::timeout, this, [this]() {
+        if (m_changed) trySave();
+    });
+    m_timer.start();
+
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(IDLE_DELAY_MS);
+    connect(&m_idleTimer, &QTimer::timeout, this, &Autosaver::trySave);
+}
+
+Autosaver::~Autosaver() {
+    m_pool.waitForDone();
+}
+
+void Autosaver::setDocument(const Document* document) {
+    waitForIdle();
+    m_document = document;
+    m_changed = false;
+    m_pending = false;
+    m_idleTimer.stop();
+}
+
+void Autosaver::setEnabled(bool enabled) {
+    m_enabled = enabled;
+    if (!enabled) m_idleTimer.stop();
+}
+
+void Autosaver::setInterval(int msec) {
+    m_timer.setInterval(msec);
+}
+
+void Autosaver::setBusyCheck(std::function<bool()> isBusy) {
+    m_isBusy = std::move(isBusy);
+}
+
+void Autosaver::markChanged() {
+    m_changed = true;
+    // A postponed save runs once activity has settled
+    if (m_pending) m_idleTimer.start();
+}
+
+void Autosaver::waitForIdle() {
+    m_pool.waitForDone();
+}
+
+// --- Saving ---
+
+void Autosaver::trySave() {
+    if (!m_enabled || !m_document || !m_changed) return;
+
+    if (m_writing || (m_isBusy && m_isBusy())) {
+        m_pending = true;
+        return;
+    }
+
+    m_pending = false;
+    m_changed = false;
+    m_writing = true;
+
+    // Cheap copy on the UI thread; everything else happens on the worker
+    std::shared_ptr<const Document> snapshot = m_document->snapshot();
+
+    m_pool.start([this, snapshot]() {
+        QDir().mkpath(recoveryDir());
+        bool ok = CmcFormat::save(*snapshot, recoveryPath());
+        if (ok) {
+            QSaveFile info(recoveryInfoPath());
+            ok = info.open(QIODevice::WriteOnly) &&
+                 info.write(snapshot->filePath().toUtf8()) >= 0 &&
+                 info.commit();
+        }
+        // Delivered on the UI thread; dropped if we are destroyed first
+        QMetaObject::invokeMethod(this, [this, ok]() { finishSave(ok); },
+                                  Qt::QueuedConnection);
+    });
+}
+
+void Autosaver::finishSave(bool ok) {
+    m_writing = false;
+    if (!ok) m_changed = true;  // Try again on the next tick
+    if (m_pending) m_idleTimer.start();
+    emit autosaved(ok);
+}
+
+// --- Recovery ---
+
+QString Autosaver::recoveryDir() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) +
+           QStringLiteral("/recovery");
+}
+
+QString Autosaver::recoveryPath() {
+    return recoveryDir() + QStringLiteral("/autosave.cmc");
+}
+
+QString Autosaver::recoveryInfoPath() {
+    return recoveryDir() + QStringLiteral("/autosave.path");
+}
+
+bool Autosaver::hasRecovery() {
+    return QFile::exists(recoveryPath());
+}
+
+QString Autosaver::recoveryOriginalPath() {
+    QFile info(recoveryInfoPath());
+    if (!info.open(QIODevice::ReadOnly)) return {};
+    return QString::fromUtf8(info.readAll());
+}
+
+void Autosaver::discardRecovery() {
+    waitForIdle();
+    m_changed = false;
+    m_pending = false;
+    m_idleTimer.stop();
+    QFile::remove(recoveryPath());
+    QFile::remove(recoveryInfoPath());
+}
+
+}  // namespace comicos
@@ -1,4 +1,5 @@
 #include "bridge/DocumentModel.h"
+#include <utility>
 
 namespace comicos {
 
@@ -13,6 +14,10 @@ void DocumentModel::setDocument(Document* document) {
     emit activeLayerChanged();
 }
 
+void DocumentModel::setBeforeLayerChange(std::function<void()> callback) {
+    m_beforeLayerChange = std::move(callback);
+}
+
 int DocumentModel::rowCount(const QModelIndex& parent) const {
     if (parent.isValid() || !m_document) return 0;
     return m_document->layers().count();
@@ -39,6 +44,8 @@ QVariant DocumentModel::data(const QModelIndex& index, int role) const {
         return layer->isLocked();
     case BlendModeRole:
         return static_cast<int>(layer->blendMode());
+    case TypeRole:
+        return static_cast<int>(layer->type());
     }
 
     return {};
@@ -85,6 +92,7 @@ QHash<int, QByteArray> DocumentModel::roleNames() const {
         {VisibleRole, "layerVisible"},
         {LockedRole, "layerLocked"},
         {BlendModeRole, "layerBlendMode"},
+        {TypeRole, "layerType"},
     };
 }
 
@@ -101,8 +109,32 @@ void DocumentModel::addLayer() {
     emit activeLayerChanged();
 }
 
+void DocumentModel::addVectorLayer() {
+    if (!m_document) return;
+    beginInsertRows({}, 0, 0);  // Top of list (reversed)
+    m_document->layers().addLayer(QString(), LayerType::Vector);
+    endInsertRows();
+    emit activeLayerChanged();
+}
+
+Layer* DocumentModel::insertLayer(int layerIndex, const QString& name) {
+    if (!m_document) return nullptr;
+
+    auto& layers = m_document->layers();
+    layerIndex = qBound(0, layerIndex, layers.count());
+    const int row = layers.count() - layerIndex;  // Reversed, after insertion
+    beginInsertRows({}, row, row);
+    Layer* layer = layers.addLayer(name);
+    layers.moveLayer(layers.count() - 1, layerIndex);
+    endInsertRows();
+    emit activeLayerChanged();
+    emit layerVisualChanged();
+    return layer;
+}
+
 void DocumentModel::removeLayer(int index) {
     if (!m_document || m_document->layers().count() <= 1) return;
+    if (m_beforeLayerChange) m_beforeLayerChange();
 
     int layerIndex = m_document->layers().count() - 1 - index;
     auto* layer = m_document->layers().layerAt(layerIndex);
@@ -117,6 +149,7 @@ void DocumentModel::removeLayer(int index) {
 
 void DocumentModel::duplicateLayer(int index) {
     if (!m_document) return;
+    if (m_beforeLayerChange) m_beforeLayerChange();
 
     int layerIndex = m_document->layers().count() - 1 - index;
     auto* layer = m_document->layers().layerAt(layerIndex);
@@ -136,6 +169,7 @@ void DocumentModel::moveLayer(int from, int to) {
     int toLayer = m_document->layers().count() - 1 - to;
 
     if (fromLayer == toLayer) return;
+    if (m_beforeLayerChange) m_beforeLayerChange();
 
     beginMoveRows({}, from, from, {}, to > from ? to + 1 : to);
     m_document->layers().moveLayer(fromLayer, toLayer);
@@ -0,0 +1,265 @@
+#include "CliCommands.h"
+#include "core/CmcFormat.h"
+#include "core/Document.h"
+#include "core/Layer.h"
+#include "core/LayerStack.h"
+#include "core/Page.h"
+#include "core/Tile.h"
+#include "core/TileManager.h"
+#include "core/VectorLayer.h"
+#include "engine/Compositor.h"
+#include "engine/Exporter.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace comicos {
+
+// --- Helpers ---
+
+static QString formatBytes(quint64 bytes) {
+    return QStringLiteral("%1 MB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+static FileResult failure(const QString& message) {
+    return {false, message};
+}
+
+QString CliCommands::outputPath(const QString& input, const QString& suffix,
+                                const CliOptions& options, int page) {
+    QFileInfo info(input);
+    QDir dir(options.outputDir.isEmpty() ? info.absolutePath() : options.outputDir);
+    QString name = info.completeBaseName();
+    if (page >= 0) name += QStringLiteral("_p%1").arg(page + 1, 2, 10, QLatin1Char('0'));
+    return dir.filePath(name + QStringLiteral(".") + suffix);
+}
+
+// --- Commands ---
+
+FileResult CliCommands::flatten(const QString& path, const CliOptions& options) {
+    auto doc = CmcFormat::load(path);
+    if (!doc) return failure(QStringLiteral("cannot read document"));
+
+    // Streamed band by band: tiles are decoded while compositing and only
+    // two tile rows of output are held, whatever the page size.
+    ExportOptions exportOptions;
+    exportOptions.format = options.imageFormat == QStringLiteral("tiff") ? ImageFormat::Tiff
+                                                                         : ImageFormat::Png;
+    exportOptions.bitDepth = options.bitDepth;
+
+    // One image per page; pages stay lazy until their turn
+    for (int p = 0; p < doc->pageCount(); ++p) {
+        const Page& page = doc->page(p);
+        const QString target =
+            outputPath(path, options.imageFormat, options, doc->pageCount() > 1 ? p : -1);
+        if (!Exporter::exportFlattened(page.layers(), page.canvasSize(), doc->dpi(), target,
+                                       exportOptions))
+            return failure(QStringLiteral("cannot write %1").arg(target));
+    }
+    return {true, {}};
+}
+
+FileResult CliCommands::exportLayered(const QString& path, const CliOptions& options) {
+    auto doc = CmcFormat::load(path);
+    if (!doc) return failure(QStringLiteral("cannot read document"));
+
+    const LayeredFormat format = options.imageFormat == QStringLiteral("ora")
+                                     ? LayeredFormat::OpenRaster
+                                     : LayeredFormat::Psd;
+    for (int p = 0; p < doc->pageCount(); ++p) {
+        const Page& page = doc->page(p);
+        const QString target =
+            outputPath(path, options.imageFormat, options, doc->pageCount() > 1 ? p : -1);
+        if (!Exporter::exportLayered(page.layers(), page.canvasSize(), doc->dpi(), target,
+                                     format))
+            return failure(QStringLiteral("cannot write %1").arg(target));
+    }
+    return {true, {}};
+}
+
+FileResult CliCommands::convert(const QString& path, const CliOptions& options) {
+    auto doc = CmcFormat::load(path);
+    if (!doc) return failure(QStringLiteral("cannot read document"));
+
+    // Writing over the input is safe: save() moves the payloads tiles read
+    // from the target into memory before replacing it.
+    const QString target = outputPath(path, QStringLiteral("cmc"), options);
+    bool ok = false;
+    if (options.targetVersion == 1) {
+        ok = CmcFormat::saveV1(*doc, target);
+    } else {
+        DocumentPreview preview;
+        if (options.previews) {
+            // Of the first page: the cover, for multi-page documents
+            preview = Compositor().renderPreview(doc->page(0).layers(),
+                                                 doc->page(0).canvasSize());
+        }
+        ok = CmcFormat::save(*doc, target, options.encoding, preview);
+    }
+    if (!ok) return failure(QStringLiteral("cannot write %1").arg(target));
+    return {true, {}};
+}
+
+FileResult CliCommands::stats(const QString& path, const CliOptions& options) {
+    const int version = CmcFormat::formatVersion(path);
+    auto doc = CmcFormat::load(path);
+    if (!doc) return failure(QStringLiteral("cannot read document"));
+
+    struct CodecStats {
+        size_t tiles = 0;
+        size_t payloads = 0;  // Distinct payloads (deduplicated tiles share one)
+        quint64 stored = 0;   // Encoded bytes of distinct payloads
+    };
+    std::map<TileCodec, CodecStats> codecs;
+    std::set<std::pair<const TileSource*, quint64>> seenPayloads;
+    size_t totalTiles = 0;
+    size_t decodedTiles = 0;  // Resident tiles have no stored size (v1 loads eagerly)
+
+    QString report;
+    QTextStream out(&report);
+    out << path << "\n";
+    out << "  format    v" << version << ", " << doc->page(0).canvasSize().width() << "x"
+        << doc->page(0).canvasSize().height() << " px, " << doc->dpi() << " dpi\n";
+    out << "  file      " << formatBytes(static_cast<quint64>(QFileInfo(path).size())) << "\n";
+    if (doc->pageCount() > 1) out << "  pages     " << doc->pageCount() << "\n";
+
+    for (int p = 0; p < doc->pageCount(); ++p) {
+        const Page& page = doc->page(p);
+        if (doc->pageCount() > 1) {
+            out << "  page " << QString::number(p + 1).leftJustified(4) << " "
+                << page.canvasSize().width() << "x" << page.canvasSize().height() << " px\n";
+        }
+        out << "  layers    " << page.layers().count() << "\n";
+
+        for (const auto& layer : page.layers().layers()) {
+            if (layer->type() == LayerType::Vector) {
+                // No stored tiles: they are drawn from the strokes
+                const auto& vector = static_cast<const VectorLayer&>(*layer);
+                out << "    " << layer->name() << ": vector, " << vector.strokes().size()
+                    << " strokes\n";
+                continue;
+            }
+            const auto& tiles = layer->tiles();
+            quint64 layerStored = 0;
+            for (const auto& [coord, lazy] : tiles.lazyTiles()) {
+                CodecStats& codec = codecs[lazy.ref.codec];
+                ++codec.tiles;
+                layerStored += lazy.ref.size;
+                if (seenPayloads.emplace(lazy.source.get(), lazy.ref.offset).second) {
+                    ++codec.payloads;
+                    codec.stored += lazy.ref.size;
+                }
+            }
+            decodedTiles += tiles.residentTileCount();
+            totalTiles += tiles.tileCount();
+
+            out << "    " << layer->name() << ": " << tiles.tileCount() << " tiles";
+            if (layerStored > 0) out << ", " << formatBytes(layerStored) << " stored";
+            out << "\n";
+        }
+    }
+
+    size_t uniquePayloads = 0;
+    for (const auto& [codec, s] : codecs) uniquePayloads += s.payloads;
+    out << "  tiles     " << totalTiles;
+    if (uniquePayloads > 0) out << " (" << uniquePayloads << " unique payloads)";
+    out << "\n";
+
+    for (const auto& [codec, s] : codecs) {
+        const quint64 raw = static_cast<quint64>(s.payloads) * TILE_BYTES;
+        const double ratio = s.stored > 0 ? static_cast<double>(raw) / s.stored : 0.0;
+        out << "  " << TileCodecs::name({codec, TileFilter::None}).leftJustified(8)
+            << "  " << s.tiles << " tiles, " << formatBytes(s.stored) << " stored / "
+            << formatBytes(raw) << " raw, " << QString::number(ratio, 'f', 1) << "x\n";
+    }
+    if (decodedTiles > 0) {
+        out << "  decoded   " << decodedTiles << " tiles (stored size unknown)\n";
+    }
+
+    if (options.benchmark) {
+        // Every distinct tile, decoded; measures what re-saving would cost
+        std::vector<const uint8_t*> pixels;
+        std::set<const uint8_t*> seenPixels;
+        for (int p = 0; p < doc->pageCount(); ++p) {
+            for (const auto& layer : doc->page(p).layers().layers()) {
+                for (const Tile* tile : layer->tiles().allTiles()) {
+                    if (tile->isEmpty()) continue;
+                    if (seenPixels.insert(tile->constData()).second) {
+                        pixels.push_back(tile->constData());
+                    }
+                }
+            }
+        }
+        out << "  benchmark (" << pixels.size() << " tiles)\n";
+        for (const auto& result : TileCodecs::benchmark(pixels)) {
+            out << "    " << result.name.leftJustified(16)
+                << QString::number(result.ratio, 'f', 1) << "x  encode "
+                << QString::number(result.encodeMBps, 'f', 0) << " MB/s  decode "
+                << QString::number(result.decodeMBps, 'f', 0) << " MB/s\n";
+        }
+    }
+
+    out.flush();
+    return {true, report};
+}
+
+// --- Batch ---
+
+int CliCommands::runBatch(const QStringList& files, Command command, const CliOptions& options) {
+    std::vector<FileResult> results(files.size());
+    std::atomic<int> finished{0};
+    std::mutex logMutex;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // One file per task: documents are independent, so workers never contend
+    // except on the shared tile store.
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(1, options.jobs));
+    for (qsizetype i = 0; i < files.size(); ++i) {
+        pool.start([&, i]() {
+            QElapsedTimer fileTimer;
+            fileTimer.start();
+            results[i] = command(files[i], options);
+            const int n = ++finished;
+
+            std::lock_guard<std::mutex> lock(logMutex);
+            QTextStream err(stderr);
+            err << "[" << n << "/" << files.size() << "] " << files[i] << ": "
+                << (results[i].ok ? QStringLiteral("ok") : results[i].message)
+                << " (" << fileTimer.elapsed() << " ms)\n";
+        });
+    }
+    pool.waitForDone();
+
+    int failed = 0;
+    QTextStream out(stdout);
+    for (const FileResult& result : results) {
+        if (!result.ok) {
+            ++failed;
+        } else if (!result.message.isEmpty()) {
+            out << result.message;
+        }
+    }
+    out.flush();
+
+    const double seconds = timer.nsecsElapsed() / 1e9;
+    const double pagesPerMinute = seconds > 0.0 ? (files.size() - failed) * 60.0 / seconds : 0.0;
+    QTextStream err(stderr);
+    err << (files.size() - failed) << "/" << files.size() << " files in "
+        << QString::number(seconds, 'f', 2) << " s, "
+        << QString::number(pagesPerMinute, 'f', 1) << " pages/min ("
+        << pool.maxThreadCount() << " jobs)\n";
+    return failed;
+}
+
+}  // namespace comicos
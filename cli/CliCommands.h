@@ -0,0 +1,62 @@
+#pragma once
+
+#include "core/TileCodec.h"
+#include <QString>
+#include <QStringList>
+
+namespace comicos {
+
+/// Options shared by the comicos-cli subcommands.
+struct CliOptions {
+    int jobs = 1;                   // Worker threads (files processed in parallel)
+    QString outputDir;              // Empty: next to each input file
+    QString imageFormat = "png";    // flatten: png | tiff; export: psd | ora
+    int bitDepth = 8;               // flatten: 8 or 16 bits per sample
+    int targetVersion = 2;          // convert: .cmc format version to write
+    TileEncoding encoding = TileEncoding::fast();  // convert: tile codec (v2)
+    bool previews = true;           // convert: embed thumbnail + preview pyramid (v2)
+    bool benchmark = false;         // stats: also benchmark every tile codec
+};
+
+/// Outcome of one file in a batch.
+struct FileResult {
+    bool ok = false;
+    QString message;  // Error text, or the report (stats)
+};
+
+/// Headless operations on .cmc files, for build servers without a display.
+/// Uses only core and engine: no QML, no GPU.
+///
+/// Each command handles one file and shares no state with other files, so
+/// runBatch() fans a chapter out over a pool of worker threads.
+class CliCommands {
+public:
+    using Command = FileResult (*)(const QString& path, const CliOptions& options);
+
+    /// Composite all visible layers and stream a PNG/TIFF at document DPI,
+    /// one image per page.
+    static FileResult flatten(const QString& path, const CliOptions& options);
+
+    /// Write a layered PSD/OpenRaster file per page, keeping layer names,
+    /// opacity, visibility and blend modes.
+    static FileResult exportLayered(const QString& path, const CliOptions& options);
+
+    /// Rewrite a .cmc file as v1 or v2 (with the chosen tile codec).
+    static FileResult convert(const QString& path, const CliOptions& options);
+
+    /// Layers, tiles, stored bytes and compression ratio per codec.
+    static FileResult stats(const QString& path, const CliOptions& options);
+
+    /// Run `command` over `files` on `options.jobs` threads. Progress goes to
+    /// stderr as files finish; reports go to stdout in input order, followed
+    /// by the batch throughput. Returns the number of failed files.
+    static int runBatch(const QStringList& files, Command command, const CliOptions& options);
+
+private:
+    /// `<output dir or input dir>/<input base name>.<suffix>`, with `_p01`
+    /// etc. before the suffix when `page` is given (multi-page documents).
+    static QString outputPath(const QString& input, const QString& suffix,
+                              const CliOptions& options, int page = -1);
+};
+
+}  // namespace comicos
@@ -0,0 +1,148 @@
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThread>
+
+#include "CliCommands.h"
+#include "engine/StrokeRasterizer.h"
+
+using namespace comicos;
+
+// Headless entry point: no QGuiApplication, no QML, no GPU. Runs anywhere
+// core and engine build, e.g. Linux build servers rendering chapters for print.
+
+static int usageError(const QString& message) {
+    QTextStream(stderr) << "comicos-cli: " << message << "\n"
+                        << "Try 'comicos-cli --help'.\n";
+    return 2;
+}
+
+/// Expands directories to the .cmc files they contain (sorted by name),
+/// so a whole chapter can be passed as one argument.
+static QStringList expandInputs(const QStringList& args) {
+    QStringList files;
+    for (const QString& arg : args) {
+        if (QFileInfo(arg).isDir()) {
+            QDir dir(arg);
+            for (const QString& name : dir.entryList({QStringLiteral("*.cmc")}, QDir::Files,
+                                                     QDir::Name)) {
+                files << dir.filePath(name);
+            }
+        } else {
+            files << arg;
+        }
+    }
+    return files;
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("comicos-cli");
+    app.setApplicationVersion(COMICOS_VERSION);
+    app.setOrganizationName("Comicos");
+
+    // Vector layers draw their tiles from strokes; image tips are not saved
+    // with documents, so strokes that used one draw with the round tip
+    StrokeRasterizer::install(nullptr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Batch processing of Comicos .cmc documents.\n\n"
+        "Commands:\n"
+        "  flatten   Composite visible layers to PNG/TIFF\n"
+        "  export    Layered PSD/OpenRaster with names, opacity and blend modes\n"
+        "  convert   Rewrite as .cmc v1 or v2 (in place unless --output is given)\n"
+        "  stats     Layers, tiles, stored bytes and codec ratios");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("command", "flatten, export, convert or stats.");
+    parser.addPositionalArgument("files", ".cmc files or directories of them.", "<files...>");
+
+    QCommandLineOption jobsOption({"j", "jobs"}, "Files processed in parallel (default: CPU count).",
+                                  "n");
+    QCommandLineOption outputOption({"o", "output"}, "Output directory (default: next to input).",
+                                    "dir");
+    QCommandLineOption formatOption(
+        "format", "flatten: png or tiff (default: png); export: psd or ora (default: psd).",
+        "format");
+    QCommandLineOption depthOption("depth", "flatten: bits per sample, 8 or 16 (default: 8).",
+                                   "bits", "8");
+    QCommandLineOption versionOption("to", "convert: .cmc version to write, 1 or 2 (default: 2).",
+                                     "version", "2");
+    QCommandLineOption compressionOption(
+        "compression", "convert: v2 tile compression, fast or small (default: fast).", "mode",
+        "fast");
+    QCommandLineOption noPreviewOption("no-preview", "convert: do not embed preview images.");
+    QCommandLineOption benchmarkOption("benchmark", "stats: also benchmark every tile codec.");
+    parser.addOptions({jobsOption, outputOption, formatOption, depthOption, versionOption,
+                       compressionOption, noPreviewOption, benchmarkOption});
+    parser.process(app);
+
+    QStringList args = parser.positionalArguments();
+    if (args.isEmpty()) return usageError("missing command");
+    const QString command = args.takeFirst();
+
+    CliOptions options;
+    options.jobs = QThread::idealThreadCount();
+    if (parser.isSet(jobsOption)) {
+        bool ok = false;
+        options.jobs = parser.value(jobsOption).toInt(&ok);
+        if (!ok || options.jobs < 1) return usageError("--jobs must be a positive number");
+    }
+    options.outputDir = parser.value(outputOption);
+    if (parser.isSet(formatOption)) {
+        options.imageFormat = parser.value(formatOption).toLower();
+    } else if (command == "export") {
+        options.imageFormat = "psd";
+    }
+    options.previews = !parser.isSet(noPreviewOption);
+    options.benchmark = parser.isSet(benchmarkOption);
+
+    if (command == "export") {
+        if (options.imageFormat != "psd" && options.imageFormat != "ora") {
+            return usageError("--format must be psd or ora for export");
+        }
+    } else if (options.imageFormat != "png" && options.imageFormat != "tiff") {
+        return usageError("--format must be png or tiff");
+    }
+    const QString depth = parser.value(depthOption);
+    if (depth != "8" && depth != "16") return usageError("--depth must be 8 or 16");
+    options.bitDepth = depth.toInt();
+
+    const QString version = parser.value(versionOption);
+    if (version != "1" && version != "2") return usageError("--to must be 1 or 2");
+    options.targetVersion = version.toInt();
+
+    const QString compression = parser.value(compressionOption);
+    if (compression == "fast") {
+        options.encoding = TileEncoding::fast();
+    } else if (compression == "small") {
+        options.encoding = TileEncoding::small();
+    } else {
+        return usageError("--compression must be fast or small");
+    }
+
+    CliCommands::Command run = nullptr;
+    if (command == "flatten") {
+        run = &CliCommands::flatten;
+    } else if (command == "export") {
+        run = &CliCommands::exportLayered;
+    } else if (command == "convert") {
+        run = &CliCommands::convert;
+    } else if (command == "stats") {
+        run = &CliCommands::stats;
+    } else {
+        return usageError(QStringLiteral("unknown command '%1'").arg(command));
+    }
+
+    const QStringList files = expandInputs(args);
+    if (files.isEmpty()) return usageError("no input files");
+    if (!options.outputDir.isEmpty() && !QDir().mkpath(options.outputDir)) {
+        return usageError(QStringLiteral("cannot create %1").arg(options.outputDir));
+    }
+
+    return CliCommands::runBatch(files, run, options) == 0 ? 0 : 1;
+}
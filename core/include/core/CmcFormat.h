@@ -1,31 +1,103 @@
 #pragma once
 
 #include "core/Document.h"
+#include "core/DocumentPreview.h"
+#include "core/TileCodec.h"
+#include <QImage>
+#include <QSize>
 #include <QString>
 #include <memory>
 
+class QDataStream;
+
 namespace comicos {
 
 /// Chunk-based binary format (.cmc) for saving/loading documents.
 ///
-/// File layout:
-///   [Magic: "CMC\x01"]  — 4 bytes, magic + format version
-///   [Tag: 4B] [Size: uint32] [Data]  — repeated chunks
-///   ["END\0"] [Size: 0]             — terminator
+/// File layout (v2, written by save):
+///   [Magic: "CMC\x02"]                   — 4 bytes, magic + format version
+///   [Tag: 4B] [Size: uint64] [Data]      — repeated chunks (CANV, LYRS, PAGE, THMB, PRVW, TILE...)
+///   ["INDX"] [Size: uint64] [Entries]    — chunk index
+///   ["END\0"] [Size: 8] [INDX offset]    — terminator, points back at the index
+///
+/// CANV, LYRS:  first page's canvas size (+ DPI) and layers
+/// PAGE data:   [page: u32] [width: u32] [height: u32] then the LYRS layout
+///              — one per page after the first (multi-page documents only)
+/// THMB data:   PNG thumbnail (optional)
+/// PRVW data:   PNG preview pyramid level (optional, one chunk per level)
+/// TILE data:   [layerId: u64] [tx: i32] [ty: i32] [codec: u8] [payload]
+///              — layerId carries the page number in its high 32 bits
+/// TREF data:   [layerId: u64] [tx: i32] [ty: i32] [codec: u8]
+///              [payload offset: u64] [payload size: u64]
+///              — a tile whose content equals an earlier TILE's payload
+/// STRK data:   [layerId: u64] [count: u32] then per stroke
+///              [tool: u8] [color: u32 ARGB] [size: f32] [hardness: f32]
+///              [tipId: i32] [tipAngle: f32] [tipAspect: f32] [points: u32]
+///              then per point [x, y, pressure, tiltX, tiltY: f32]
+///              — the strokes of a vector layer, which has no TILE chunks;
+///              readers without vector layers see it as an empty layer.
+///              tipId is reserved: written as -1 and ignored (round tip),
+///              since image tips are not stored in the file
+/// INDX data:   [count: u32] then per chunk
+///              [tag: 4B] [layerId: u64] [tx: i32] [ty: i32] [codec: u8]
+///              [offset: u64] [size: u64]
+/// Index offset/size locate the chunk data (for TILE: the encoded payload).
+/// TREF tiles are indexed as TILE entries pointing at the shared payload.
+/// THMB/PRVW entries store the image width/height in tx/ty and precede all
+/// tile entries, so loadThumbnail()/loadPreview() read the trailer, the
+/// first index block and one image chunk — a few seeks, whatever the file size.
+/// save() writes each distinct tile content once (content hash + memcmp);
+/// duplicates of lazy tiles are detected by their source payload.
+/// Codecs are per tile (see TileCodec), so files may mix them; save() encodes
+/// with the given TileEncoding and transcodes lazy tiles stored differently.
+///
+/// load() memory-maps v2 files and reads only the trailer, the index and the
+/// header chunks. Tiles are registered as lazy tiles that are decoded on first
+/// access, so opening a file costs O(chunk count), not O(file size).
+/// If the index is missing (truncated file), chunk headers are scanned instead.
 ///
+/// Saving over the file tiles are read from never copies them into memory:
+/// after the new file is committed, those tiles (lazy ones, and resident
+/// ones via their origin) are re-pointed at the payloads just written.
+///
+/// v1 files ("CMC\x01", uint32 chunk sizes, no index) are still loaded, eagerly.
 /// Unknown chunks are skipped by size, enabling forward compatibility.
 class CmcFormat {
 public:
-    static bool save(const Document& doc, const QString& path);
+    static bool save(const Document& doc, const QString& path,
+                     const TileEncoding& encoding = TileEncoding::fast(),
+                     const DocumentPreview& preview = {});
+
+    /// Write the v1 layout (zlib tiles, no index, no previews), for readers
+    /// that predate v2. Lossless, but files are larger and load eagerly.
+    /// Vector layers are written as the tiles their strokes draw.
+    static bool saveV1(const Document& doc, const QString& path);
+
     static std::unique_ptr<Document> load(const QString& path);
 
+    /// Format version from the file header (0 if not a .cmc file).
+    static int formatVersion(const QString& path);
+
+    /// Copy the encoded tiles `doc` still reads from `path` into memory, so
+    /// the file can be deleted (save() needs no detaching). Tiles stay
+    /// encoded and lazy; resident tiles forget it as their origin.
+    static void detachFromFile(const Document& doc, const QString& path);
+
+    // --- Previews (no layer or tile parsing) ---
+    /// Embedded thumbnail. Null if the file has none (older or unindexed file).
+    static QImage loadThumbnail(const QString& path);
+
+    /// Smallest embedded preview level covering `minSize` (the largest level
+    /// if none does). Null if the file has no previews.
+    static QImage loadPreview(const QString& path, const QSize& minSize);
+
 private:
-    static constexpr char MAGIC[4] = {'C', 'M', 'C', '\x01'};
+    static std::unique_ptr<Document> loadV1(QDataStream& in);
+    static std::unique_ptr<Document> loadV2(const QString& path);
 
-    static constexpr char TAG_CANV[4] = {'C', 'A', 'N', 'V'};
-    static constexpr char TAG_LYRS[4] = {'L', 'Y', 'R', 'S'};
-    static constexpr char TAG_TILE[4] = {'T', 'I', 'L', 'E'};
-    static constexpr char TAG_END[4]  = {'E', 'N', 'D', '\0'};
+    static constexpr char MAGIC[3] = {'C', 'M', 'C'};
+    static constexpr quint8 VERSION_1 = 1;
+    static constexpr quint8 VERSION = 2;
 };
 
 }  // namespace comicos
@@ -1,36 +1,87 @@
 #pragma once
 
+#include "core/DocumentPreview.h"
 #include "core/History.h"
 #include "core/LayerStack.h"
+#include "core/Page.h"
+#include "core/TileCodec.h"
 #include "core/Types.h"
 #include <QSize>
 #include <QString>
+#include <QThreadPool>
+#include <atomic>
 #include <memory>
+#include <vector>
 
 namespace comicos {
 
 /// Root document model.
-/// Contains all layers, history, and document-level settings.
+/// Contains the pages (each with its own layers and history) and
+/// document-level settings.
 /// This is the top-level data object that gets serialized to .cmc files.
+///
+/// Canvas, layer and history accessors refer to the active page, so code
+/// that edits one canvas does not need to know about pages.
+///
+/// Only the active page and its RESIDENT_NEIGHBORS on each side are kept
+/// decoded. Changing the active page loads the new neighbours and evicts
+/// pages further away on a background thread (see Page::evict), so turning
+/// a page usually finds it decoded already, and a chapter never is as a whole.
 class Document {
 public:
+    static constexpr int RESIDENT_NEIGHBORS = 1;
+
     Document();
     explicit Document(const QSize& canvasSize);
     ~Document();
 
-    // --- Canvas ---
-    QSize canvasSize() const { return m_canvasSize; }
-    void setCanvasSize(const QSize& size) { m_canvasSize = size; }
+    // --- Canvas (active page) ---
+    QSize canvasSize() const { return activePage().canvasSize(); }
+    void setCanvasSize(const QSize& size) { activePage().setCanvasSize(size); }
     int dpi() const { return m_dpi; }
     void setDpi(int dpi) { m_dpi = dpi; }
 
-    // --- Layers ---
-    LayerStack& layers() { return m_layers; }
-    const LayerStack& layers() const { return m_layers; }
+    // --- Layers (active page) ---
+    LayerStack& layers() { return activePage().layers(); }
+    const LayerStack& layers() const { return activePage().layers(); }
+
+    // --- Selection (active page) ---
+    Selection& selection() { return activePage().selection(); }
+    const Selection& selection() const { return activePage().selection(); }
+
+    // --- History (active page) ---
+    History& history() { return activePage().history(); }
+    const History& history() const { return activePage().history(); }
+
+    // --- Pages ---
+    int pageCount() const { return static_cast<int>(m_pages.size()); }
+    int activePageIndex() const { return m_activePage; }
+    Page& activePage() { return *m_pages[m_activePage]; }
+    const Page& activePage() const { return *m_pages[m_activePage]; }
+
+    /// Any page. Pages other than the active one may be loaded or evicted
+    /// in the background: call waitForResidency() before reading them.
+    Page& page(int index) { return *m_pages[index]; }
+    const Page& page(int index) const { return *m_pages[index]; }
+
+    /// Switch the edited page. Returns immediately unless a background job
+    /// is working on that page; tiles it has not loaded yet are decoded on
+    /// first access.
+    void setActivePage(int index);
+
+    /// Insert a page with one empty layer. Returns the new page.
+    Page& insertPage(int index, const QSize& canvasSize);
 
-    // --- History ---
-    History& history() { return m_history; }
-    const History& history() const { return m_history; }
+    /// Insert a page as loaded from a file (no default layer).
+    Page& insertPage(int index, std::unique_ptr<Page> page);
+
+    /// Remove a page. The last page cannot be removed.
+    void removePage(int index);
+
+    void movePage(int from, int to);
+
+    /// Block until background page loads and evictions have finished.
+    void waitForResidency() const;
 
     // --- File ---
     const QString& filePath() const { return m_filePath; }
@@ -38,20 +89,32 @@ public:
     bool isDirty() const { return m_dirty; }
     void setDirty(bool dirty) { m_dirty = dirty; }
 
+    // --- Snapshot ---
+    /// Copy of canvas settings, pages and file path, without history.
+    /// Tile pixels are shared copy-on-write, so this is cheap enough to call
+    /// on the UI thread; the copy can then be serialized on another thread.
+    std::unique_ptr<Document> snapshot() const;
+
     // --- Serialization ---
-    bool save(const QString& path);
+    /// `preview` is embedded for file browsers (see CmcFormat::loadThumbnail).
+    bool save(const QString& path, const TileEncoding& encoding = TileEncoding::fast(),
+              const DocumentPreview& preview = {});
     static std::unique_ptr<Document> load(const QString& path);
 
-    // Extension point: export to PNG/PSD/etc.
-    // QImage exportFlattened() const;
-
 private:
-    QSize m_canvasSize{2480, 3508};  // A4 at 300dpi
+    /// Queue loads of the active page's neighbours and evictions of the
+    /// other pages. Jobs queued by earlier calls are skipped.
+    void scheduleResidency();
+
     int m_dpi = 300;
-    LayerStack m_layers;
-    History m_history;
+    std::vector<std::unique_ptr<Page>> m_pages;
+    int m_activePage = 0;
     QString m_filePath;
     bool m_dirty = false;
+
+    // Declared last: destroyed (and drained) before the pages its jobs use
+    std::atomic<int> m_residencyGeneration{0};
+    mutable QThreadPool m_residencyPool;  // Single thread: jobs run in order
 };
 
 }  // namespace comicos
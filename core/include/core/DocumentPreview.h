@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QImage>
+#include <vector>
+
+namespace comicos {
+
+/// Flattened previews embedded in .cmc files, so file browsers and page
+/// overviews can show a document without loading its layers.
+/// Rendered by the engine (Compositor::renderPreview) and passed to
+/// CmcFormat::save; null images are not written.
+struct DocumentPreview {
+    static constexpr int THUMBNAIL_SIZE = 128;      // Max edge in pixels
+    static constexpr int PYRAMID_MAX_SIZE = 1024;   // Max edge of the largest level
+    static constexpr int PYRAMID_MIN_SIZE = 256;    // Max edge of the smallest level
+
+    QImage thumbnail;
+    std::vector<QImage> levels;  // Largest first, each half the previous
+
+    bool isEmpty() const { return thumbnail.isNull() && levels.empty(); }
+};
+
+}  // namespace comicos
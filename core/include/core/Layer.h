@@ -8,11 +8,15 @@
 namespace comicos {
 
 /// A single layer in the document.
-/// Each layer owns a TileManager that stores its pixel content.
+/// Each layer owns a TileManager that stores its pixel content. Other layer
+/// types (VectorLayer) derive from it and keep their tiles as a cache of
+/// what they draw, so everything that reads pixels works on any layer.
 class Layer {
 public:
     explicit Layer(LayerId id, const QString& name = QString());
-    ~Layer();
+    virtual ~Layer();
+
+    virtual LayerType type() const { return LayerType::Raster; }
 
     // --- Properties ---
     LayerId id() const { return m_id; }
@@ -37,18 +41,22 @@ public:
     const TileManager& tiles() const { return m_tiles; }
 
     // --- Operations ---
-    void clear();
+    virtual void clear();
 
-    /// Deep clone this layer (new ID).
+    /// Clone this layer (new ID). Tile pixels are shared copy-on-write.
     std::unique_ptr<Layer> clone(LayerId newId) const;
 
-    // Extension point: layer types (raster, vector, text, adjustment)
-    // virtual LayerType type() const { return LayerType::Raster; }
+    /// Copy of the same type with the same ID and name, for document snapshots.
+    virtual std::unique_ptr<Layer> snapshot() const;
 
     // Extension point: clipping mask, layer mask
     // Layer* mask() const;
     // void setMask(std::unique_ptr<Layer> mask);
 
+protected:
+    /// Copy properties and tiles (pixels shared copy-on-write) into `copy`.
+    void copyTo(Layer& copy) const;
+
 private:
     LayerId m_id;
     QString m_name;
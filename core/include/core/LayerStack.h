@@ -16,7 +16,7 @@ public:
 
     // --- Layer Management ---
     /// Add a new empty layer on top. Returns the new layer.
-    Layer* addLayer(const QString& name = QString());
+    Layer* addLayer(const QString& name = QString(), LayerType type = LayerType::Raster);
 
     /// Insert a layer at the given index.
     Layer* insertLayer(int index, std::unique_ptr<Layer> layer);
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "core/History.h"
+#include "core/LayerStack.h"
+#include "core/Selection.h"
+#include "core/TileCodec.h"
+#include <QSize>
+#include <mutex>
+
+namespace comicos {
+
+/// One page of a document: its canvas size, layers and undo history.
+///
+/// Pages away from the one being edited can be evicted: their decoded tiles
+/// become lazy tiles again, so a chapter only keeps a few pages decoded.
+/// Tiles nothing wrote to since they were decoded go back to their payload
+/// (in the file they were loaded from, or an earlier eviction); only the
+/// others are encoded, into an in-memory TileSource. Document schedules loads and
+/// evictions on a background thread (see Document::setActivePage).
+class Page {
+public:
+    explicit Page(const QSize& canvasSize);
+    ~Page();
+
+    Page(const Page&) = delete;
+    Page& operator=(const Page&) = delete;
+
+    // --- Canvas ---
+    QSize canvasSize() const { return m_canvasSize; }
+    void setCanvasSize(const QSize& size) { m_canvasSize = size; }
+
+    // --- Layers ---
+    LayerStack& layers() { return m_layers; }
+    const LayerStack& layers() const { return m_layers; }
+
+    // --- Selection ---
+    /// Not saved, and not part of snapshots.
+    Selection& selection() { return m_selection; }
+    const Selection& selection() const { return m_selection; }
+
+    // --- History ---
+    /// Per page: commands reference this page's layer stack.
+    History& history() { return m_history; }
+    const History& history() const { return m_history; }
+
+    // --- Residency ---
+    /// Decoded tiles across all layers.
+    size_t residentTileCount() const;
+
+    /// Tiles still encoded (in a file or in memory) across all layers.
+    size_t lazyTileCount() const;
+
+    /// Decode every lazy tile of raster layers.
+    void makeResident();
+
+    /// Make every decoded tile lazy again: unchanged tiles point back at
+    /// their origin, changed ones are encoded into one in-memory source.
+    /// Empty tiles are dropped. Vector layers just drop their drawn tiles.
+    void evict(const TileEncoding& encoding = TileEncoding::fast());
+
+    /// Copy of canvas size and layers (tiles shared copy-on-write), without history.
+    std::unique_ptr<Page> snapshot() const;
+
+private:
+    friend class Document;
+
+    QSize m_canvasSize;
+    LayerStack m_layers;
+    Selection m_selection;
+    History m_history;
+
+    // Held by background residency jobs; Document takes it to mark the page
+    // active, after which jobs leave the page alone.
+    std::mutex m_residencyMutex;
+    bool m_active = false;
+};
+
+}  // namespace comicos
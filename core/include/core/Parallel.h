@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <latch>
+
+namespace comicos {
+
+/// Runs fn(i) for i in [0, count) on the global thread pool.
+///
+/// Indices are handed out dynamically, so uneven items (empty vs. busy
+/// tiles) balance themselves. The calling thread works too, and helpers are
+/// only started while the pool has idle threads (tryStart), so nested calls
+/// from pool threads cannot deadlock; they just run with less help.
+/// `fn` must be safe to call concurrently for different indices.
+template <typename Fn>
+void parallelFor(int count, Fn&& fn) {
+    if (count <= 0) return;
+
+    std::atomic<int> next{0};
+    auto work = [&]() {
+        for (int i = next.fetch_add(1); i < count; i = next.fetch_add(1)) fn(i);
+    };
+
+    QThreadPool* pool = QThreadPool::globalInstance();
+    const int helpers = std::min(count - 1, pool->maxThreadCount());
+    std::latch done(helpers);
+    int started = 0;
+    while (started < helpers && pool->tryStart([&]() {
+        work();
+        done.count_down();
+    })) {
+        ++started;
+    }
+    done.count_down(helpers - started);
+
+    work();
+    done.wait();
+}
+
+}  // namespace comicos
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "core/Types.h"
+#include <QRect>
+#include <QSize>
+#include <memory>
+#include <unordered_map>
+
+namespace comicos {
+
+/// How a new shape combines with the current selection.
+enum class SelectionOp : uint8_t {
+    Replace,
+    Add,        // Union (max)
+    Subtract,   // min(a, 255 - b)
+    Intersect,  // min
+};
+
+/// Selection mask: 8-bit coverage per canvas pixel (255 = selected), on the
+/// same TILE_SIZE grid and TileCoord keys as TileManager.
+///
+/// Tiles are sparse and have three states. Tiles missing from the map are
+/// not selected, and fully selected tiles are stored without pixels, so
+/// neither costs memory. Only Partial tiles hold a mask byte per pixel.
+/// Those buffers are copy-on-write like Tile's, so copying a selection (e.g.
+/// to hand it to the brush thread) costs O(tiles).
+///
+/// Boolean operations work tile by tile. Full and None tiles are settled
+/// without touching pixels, and Partial pairs are combined with SSE2 byte
+/// min/max. Tiles that come out all 0 or all 255 collapse back to a state.
+///
+/// An empty selection means "no selection": tools then edit everything.
+class Selection {
+public:
+    enum class TileState : uint8_t { None, Partial, Full };
+
+    Selection();
+    ~Selection();
+
+    Selection(const Selection& other);
+    Selection& operator=(const Selection& other);
+    Selection(Selection&& other) noexcept;
+    Selection& operator=(Selection&& other) noexcept;
+
+    /// Pixels inside `rect`.
+    static Selection fromRect(const QRect& rect);
+
+    // --- State ---
+    bool isEmpty() const { return m_tiles.empty(); }
+    void clear() { m_tiles.clear(); }
+
+    /// Every tile of a canvas of `canvasSize`.
+    void selectAll(const QSize& canvasSize);
+
+    /// Swap selected and unselected pixels within the canvas.
+    void invert(const QSize& canvasSize);
+
+    // --- Access ---
+    TileState stateAt(const TileCoord& coord) const;
+
+    /// Mask of a Partial tile (TILE_PIXELS bytes); nullptr for other states.
+    const uint8_t* maskAt(const TileCoord& coord) const;
+
+    uint8_t valueAt(int x, int y) const;
+
+    /// Smallest rect holding every selected pixel (empty if none).
+    QRect bounds() const;
+
+    /// Tiles holding a mask buffer.
+    size_t partialTileCount() const;
+
+    // --- Operations ---
+    void combine(const Selection& other, SelectionOp op);
+
+    /// coverage[i] = min(coverage[i], mask[i]): limit coverage (a wet layer
+    /// tile, a fill mask) to a Partial tile's mask.
+    static void clip(uint8_t* coverage, const uint8_t* mask, int count);
+
+private:
+    using Buffer = std::shared_ptr<uint8_t[]>;  // Null = Full
+
+    /// Turn a Partial tile that came out uniform back into a state.
+    /// Returns false if the tile should be erased (nothing selected).
+    static bool settle(Buffer& buffer);
+
+    void unite(const Selection& other);
+    void subtract(const Selection& other);
+    void intersect(const Selection& other);
+
+    std::unordered_map<TileCoord, Buffer> m_tiles;
+};
+
+}  // namespace comicos
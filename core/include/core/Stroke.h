@@ -1,7 +1,9 @@
 #pragma once
 
+#include "core/Selection.h"
 #include "core/Types.h"
 #include <QColor>
+#include <memory>
 #include <vector>
 
 namespace comicos {
@@ -26,18 +28,40 @@ public:
     float hardness() const { return m_hardness; }
     void setHardness(float hardness) { m_hardness = hardness; }
 
+    /// Brush tip image (engine BrushTipAtlas id); -1 for the round tip.
+    int tipId() const { return m_tipId; }
+    void setTipId(int id) { m_tipId = id; }
+
+    /// Tip rotation in radians.
+    float tipAngle() const { return m_tipAngle; }
+    void setTipAngle(float radians) { m_tipAngle = radians; }
+
+    /// Tip minor/major axis ratio, 0..1.
+    float tipAspect() const { return m_tipAspect; }
+    void setTipAspect(float aspect) { m_tipAspect = aspect; }
+
     LayerId targetLayerId() const { return m_targetLayerId; }
     void setTargetLayerId(LayerId id) { m_targetLayerId = id; }
 
+    /// Selection the stroke is limited to (null = none). Shared and never
+    /// modified, so the brush thread can read it while the document changes.
+    const std::shared_ptr<const Selection>& selection() const { return m_selection; }
+    void setSelection(std::shared_ptr<const Selection> selection) {
+        m_selection = std::move(selection);
+    }
+
     // --- Point Data ---
     void addPoint(const CanvasPoint& point);
+    void clearPoints() { m_points.clear(); }
+    /// Room for `count` points, so adding them does not reallocate.
+    void reservePoints(int count) { m_points.reserve(count); }
     const std::vector<CanvasPoint>& points() const { return m_points; }
     int pointCount() const { return static_cast<int>(m_points.size()); }
 
     /// Bounding rect of the stroke (in canvas pixel coordinates).
     QRectF boundingRect() const;
 
-    // Extension point: brush texture, spacing, dynamics
+    // Extension point: spacing, dynamics
     // BrushPreset* brushPreset() const;
     // void setBrushPreset(BrushPreset* preset);
 
@@ -46,7 +70,11 @@ private:
     QColor m_color = Qt::black;
     float m_brushSize = 3.0f;
     float m_hardness = 1.0f;
+    int m_tipId = -1;
+    float m_tipAngle = 0.0f;
+    float m_tipAspect = 1.0f;
     LayerId m_targetLayerId = 0;
+    std::shared_ptr<const Selection> m_selection;
     std::vector<CanvasPoint> m_points;
 };
 
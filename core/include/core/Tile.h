@@ -1,5 +1,6 @@
 #pragma once
 
+#include "core/TileSource.h"
 #include "core/Types.h"
 #include <QImage>
 #include <memory>
@@ -11,6 +12,16 @@ namespace comicos {
 /// Tiles are the fundamental unit of the canvas. The entire canvas
 /// is divided into a grid of tiles to enable efficient rendering,
 /// memory management, and undo/redo operations.
+///
+/// Pixel buffers are copy-on-write: copying a tile shares its buffer, and
+/// the first write through data()/setPixelAt()/clear() detaches it. Undo
+/// snapshots and document snapshots (autosave) therefore cost O(tiles).
+/// A shared buffer is never written, so another thread may read a copy
+/// while the original keeps being edited.
+///
+/// Every write access bumps a content generation; contentHash() is cached
+/// against it. Write through a pointer from data() before hashing, not after.
+/// Write accesses also forget the tile's origin (see origin()).
 class Tile {
 public:
     Tile();
@@ -34,8 +45,28 @@ public:
 
     /// Raw pixel data pointer (may be null if not allocated).
     const uint8_t* constData() const;
+    /// Writable pixel data; detaches a shared buffer first.
     uint8_t* data();
 
+    /// True if the pixel buffer is shared with another tile copy, or
+    /// pooled by TileStore (and so shared with any tile interned later).
+    bool isShared() const;
+
+    // --- Content Addressing ---
+    /// Hash of the pixel content (0 for unallocated tiles), computed lazily.
+    uint64_t contentHash() const;
+
+    /// Share the pixel buffer with any identical tile (see TileStore).
+    void intern();
+
+    // --- Origin ---
+    /// Source of the payload the pixels were decoded from, while they still
+    /// match it (null once written to, or if never decoded). Page::evict()
+    /// makes such tiles lazy again without encoding them.
+    const std::shared_ptr<const TileSource>& origin() const { return m_origin; }
+    const TileRef& originRef() const { return m_originRef; }
+    void setOrigin(std::shared_ptr<const TileSource> source, const TileRef& ref);
+
     /// Get/set individual pixel (bounds-checked within tile).
     Pixel pixelAt(int localX, int localY) const;
     void setPixelAt(int localX, int localY, const Pixel& pixel);
@@ -44,9 +75,15 @@ public:
     /// Clear all pixels to transparent.
     void clear();
 
-    /// Create a deep copy of this tile.
+    /// Create a copy of this tile (shares pixels until either side writes).
+    /// The copy has no origin: snapshots (undo history) never keep the file
+    /// the pixels came from open.
     std::unique_ptr<Tile> clone() const;
 
+    /// Take over `other`'s pixels, shared until either side writes. Keeps
+    /// this tile's coordinate.
+    void sharePixels(const Tile& other);
+
     /// Convert to QImage for display/export.
     QImage toImage() const;
 
@@ -55,9 +92,19 @@ public:
     // static Tile decompress(const TileCoord& coord, const std::vector<uint8_t>& data);
 
 private:
+    /// Give this tile its own copy of a shared buffer.
+    void detach();
+
     TileCoord m_coord;
-    std::unique_ptr<uint8_t[]> m_data;  // RGBA8, TILE_SIZE*TILE_SIZE*4 bytes
+    std::shared_ptr<uint8_t[]> m_data;  // RGBA8, TILE_SIZE*TILE_SIZE*4 bytes, copy-on-write
     bool m_dirty = false;
+
+    uint32_t m_generation = 0;                // Bumped on every write access
+    mutable uint32_t m_hashGeneration = ~0u;  // Generation m_hash belongs to
+    mutable uint64_t m_hash = 0;
+
+    std::shared_ptr<const TileSource> m_origin;
+    TileRef m_originRef;
 };
 
 }  // namespace comicos
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+namespace comicos {
+
+/// Compression codec of an encoded tile payload.
+/// Stored per TILE chunk (and per index entry) in .cmc files.
+enum class TileCodec : uint8_t {
+    Zlib = 0,     // qCompress of raw RGBA8 (the only codec in .cmc v1)
+    Lz = 1,       // Fast byte-oriented LZ77 (LZ4-style block format)
+    Deflate = 2,  // zlib at maximum level — best ratio, slowest
+};
+
+/// Reversible pre-filter applied before Lz/Deflate compression.
+/// Planar splits RGBA into four channel planes; Sub/Up additionally replace
+/// each byte by its difference to the left/upper neighbour in its plane.
+/// Flat ink and empty areas then become long runs of zeros.
+enum class TileFilter : uint8_t {
+    None = 0,
+    Planar = 1,
+    PlanarSub = 2,
+    PlanarUp = 3,
+};
+
+/// Codec + filter used when encoding tiles (chosen per save).
+struct TileEncoding {
+    TileCodec codec = TileCodec::Lz;
+    TileFilter filter = TileFilter::PlanarUp;
+
+    /// Favor save/load speed.
+    static TileEncoding fast() { return {TileCodec::Lz, TileFilter::PlanarUp}; }
+    /// Favor file size.
+    static TileEncoding small() { return {TileCodec::Deflate, TileFilter::PlanarUp}; }
+};
+
+/// Result of TileCodecs::benchmark for one encoding.
+struct TileCodecBenchmark {
+    TileEncoding encoding;
+    QString name;
+    double ratio = 0.0;       // raw bytes / encoded bytes
+    double encodeMBps = 0.0;  // raw MB per second
+    double decodeMBps = 0.0;
+};
+
+/// Encodes/decodes RGBA8 tile pixels (TILE_BYTES) to/from payloads.
+///
+/// Payload layout: Zlib payloads are plain qCompress output. Filtered codecs
+/// (Lz, Deflate) prefix the compressed body with one TileFilter byte.
+/// Codecs are looked up in a table indexed by TileCodec, so adding a codec
+/// is one compress/decompress pair plus an enum value.
+class TileCodecs {
+public:
+    /// Encode a full tile of RGBA8 pixels.
+    static QByteArray encode(const uint8_t* pixels, const TileEncoding& encoding);
+
+    /// Decode a payload into `out` (TILE_BYTES). Returns false on corrupt data.
+    static bool decode(TileCodec codec, const char* data, qsizetype size, uint8_t* out);
+
+    /// Human-readable name, e.g. "lz+planar+up".
+    static QString name(const TileEncoding& encoding);
+
+    /// Encode and decode every tile with each built-in encoding, measuring
+    /// compression ratio and throughput. Tiles are TILE_BYTES RGBA8 buffers.
+    static std::vector<TileCodecBenchmark> benchmark(const std::vector<const uint8_t*>& tiles);
+};
+
+}  // namespace comicos
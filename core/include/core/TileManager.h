@@ -1,7 +1,9 @@
 #pragma once
 
 #include "core/Tile.h"
+#include "core/TileSource.h"
 #include "core/Types.h"
+#include <QRect>
 #include <QRectF>
 #include <memory>
 #include <unordered_map>
@@ -12,29 +14,82 @@ namespace comicos {
 /// Manages a sparse grid of tiles for a single layer.
 /// Only allocates tiles where actual content exists (sparse storage).
 /// This is the key data structure for large canvas support.
+///
+/// Tiles can also be registered lazily (addLazyTile): they count as present
+/// but stay encoded in their TileSource until first accessed, at which point
+/// they are decoded and become resident.
 class TileManager {
 public:
+    /// A tile that has not been decoded yet.
+    struct LazyTile {
+        std::shared_ptr<const TileSource> source;
+        TileRef ref;
+    };
+
     TileManager();
     ~TileManager();
 
     // --- Tile Access ---
     /// Get tile at coordinate (returns nullptr if not allocated).
+    /// Materializes the tile if it is still lazy.
     const Tile* tileAt(const TileCoord& coord) const;
 
     /// Get or create tile at coordinate (allocates on demand).
     Tile* getOrCreateTile(const TileCoord& coord);
 
-    /// Check if tile exists at coordinate.
+    /// Check if tile exists at coordinate (resident or lazy, never decodes).
     bool hasTile(const TileCoord& coord) const;
 
+    /// Check if tile at coordinate is decoded in memory.
+    bool isResident(const TileCoord& coord) const;
+
     /// Remove tile (free memory for empty tiles).
     void removeTile(const TileCoord& coord);
 
+    // --- Lazy Tiles ---
+    /// Register a tile whose content stays in `source` until first access.
+    void addLazyTile(const TileCoord& coord,
+                     std::shared_ptr<const TileSource> source, const TileRef& ref);
+
+    /// Tiles that are still encoded in their source.
+    const std::unordered_map<TileCoord, LazyTile>& lazyTiles() const { return m_lazy; }
+
+    /// Decode all lazy tiles. Their sources stay referenced as the tiles'
+    /// origins (Tile::origin()) until the tiles are written to.
+    void materializeAll() const;
+
+    /// Drop the pixels of a resident tile that `source` reproduces exactly,
+    /// making it lazy again. Pixels do not change (hence const).
+    void evictTile(const TileCoord& coord, std::shared_ptr<const TileSource> source,
+                   const TileRef& ref) const;
+
+    /// Re-point lazy tiles stored in `from` at `to`. `refs` maps a payload's
+    /// offset in `from` to its ref in `to`; other lazy tiles are left alone.
+    /// Resident tiles decoded from `from` get the new origin, or none if
+    /// their payload is not in `refs`. Pixels do not change (hence const,
+    /// like materializing).
+    void relocateLazyTiles(const TileSource* from, const std::shared_ptr<const TileSource>& to,
+                           const std::unordered_map<quint64, TileRef>& refs) const;
+
+    /// Pixels of a tile without making a lazy tile resident: the resident
+    /// buffer, or the lazy tile decoded into `scratch` (TILE_BYTES).
+    /// Null if there is no tile or it is empty. For read-only passes
+    /// (previews, export) over documents that may not fit in memory.
+    const uint8_t* pixelsAt(const TileCoord& coord, uint8_t* scratch) const;
+
+    /// Copy the pixels of `rect` into RGBA8 rows `bytesPerLine` apart
+    /// (transparent where there is no tile). Like pixelsAt(), lazy tiles
+    /// stay lazy. Safe to call concurrently while nothing writes the layer.
+    void readPixels(const QRect& rect, uint8_t* out, qsizetype bytesPerLine) const;
+
     // --- Iteration ---
-    /// All allocated tiles.
+    /// All allocated tiles (materializes lazy tiles).
     std::vector<const Tile*> allTiles() const;
     std::vector<Tile*> allTilesMut();
 
+    /// Tiles already decoded in memory (does not materialize).
+    std::vector<const Tile*> residentTiles() const;
+
     /// Tiles that intersect a given pixel rect.
     std::vector<Tile*> tilesInRect(const QRectF& pixelRect);
 
@@ -48,8 +103,11 @@ public:
     /// Clear all tiles.
     void clear();
 
-    /// Number of allocated tiles.
-    size_t tileCount() const { return m_tiles.size(); }
+    /// Number of allocated tiles (resident + lazy).
+    size_t tileCount() const { return m_tiles.size() + m_lazy.size(); }
+
+    /// Number of tiles decoded in memory.
+    size_t residentTileCount() const { return m_tiles.size(); }
 
     /// Bounding rect of all allocated tiles (in pixel coordinates).
     QRectF boundingRect() const;
@@ -66,7 +124,12 @@ public:
     // void enableDiskCache(const QString& cachePath);
 
 private:
-    std::unordered_map<TileCoord, std::unique_ptr<Tile>> m_tiles;
+    /// Decode a lazy tile into m_tiles. Returns nullptr if not lazy or corrupt.
+    Tile* materialize(const TileCoord& coord) const;
+
+    // Mutable: materializing a lazy tile does not change logical content.
+    mutable std::unordered_map<TileCoord, std::unique_ptr<Tile>> m_tiles;
+    mutable std::unordered_map<TileCoord, LazyTile> m_lazy;
 };
 
 }  // namespace comicos
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "core/TileCodec.h"
+#include <QByteArray>
+#include <QString>
+#include <cstdint>
+#include <utility>
+
+namespace comicos {
+
+/// Location of an encoded tile payload inside a TileSource.
+struct TileRef {
+    quint64 offset = 0;
+    quint64 size = 0;
+    TileCodec codec = TileCodec::Zlib;
+};
+
+/// Backing store for tiles that are not resident in memory yet.
+/// TileManager keeps a TileRef per lazy tile and decodes it on first access.
+/// Sources are immutable and shared (between layers, clones and snapshots),
+/// so implementations must allow concurrent reads.
+class TileSource {
+public:
+    virtual ~TileSource() = default;
+
+    /// File the payloads live in (empty for in-memory sources).
+    virtual QString filePath() const = 0;
+
+    /// Encoded payload bytes. May alias the source's own memory,
+    /// so the result must not outlive the source.
+    virtual QByteArray payload(const TileRef& ref) const = 0;
+
+    /// Decode a payload into `out` (TILE_BYTES). Returns false on corrupt
+    /// data. Sources that draw their tiles (VectorLayer) override this and
+    /// have no payloads.
+    virtual bool decode(const TileRef& ref, uint8_t* out) const {
+        QByteArray bytes = payload(ref);
+        if (bytes.isEmpty()) return false;
+        return TileCodecs::decode(ref.codec, bytes.constData(), bytes.size(), out);
+    }
+
+    /// False for sources that draw their tiles from data that changes
+    /// (VectorLayer): tiles decoded from them get no origin (Tile::origin()).
+    virtual bool storesPayloads() const { return true; }
+};
+
+/// Payloads held in one in-memory buffer: tiles of evicted pages, and tiles
+/// detached from a file that is about to be replaced.
+class MemoryTileSource final : public TileSource {
+public:
+    explicit MemoryTileSource(QByteArray data) : m_data(std::move(data)) {}
+
+    QString filePath() const override { return {}; }
+
+    QByteArray payload(const TileRef& ref) const override {
+        const auto size = static_cast<quint64>(m_data.size());
+        if (ref.offset > size || ref.size > size - ref.offset) return {};
+        return QByteArray::fromRawData(m_data.constData() + ref.offset,
+                                       static_cast<qsizetype>(ref.size));
+    }
+
+    quint64 size() const { return static_cast<quint64>(m_data.size()); }
+
+private:
+    QByteArray m_data;
+};
+
+}  // namespace comicos
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace comicos {
+
+/// Process-wide content-addressed pool of tile pixel buffers.
+///
+/// Tiles with identical pixels intern() to one shared buffer, so duplicated
+/// layers, pasted panels and repeated screentone cost one buffer in memory
+/// (including the copies held by undo snapshots). Interned buffers are
+/// shared, so copy-on-write Tiles never modify them in place.
+///
+/// The store only holds weak references. A buffer intern() returns carries
+/// a deleter that removes it from the store when the last tile lets go of
+/// it, so the store never keeps pixels alive. Thread-safe.
+class TileStore {
+public:
+    using Buffer = std::shared_ptr<uint8_t[]>;
+
+    static TileStore& instance();
+
+    /// 64-bit hash of TILE_BYTES of pixels (SSE2 when available, identical
+    /// result on the scalar path). Equal hashes are confirmed by memcmp.
+    static uint64_t hash(const uint8_t* pixels);
+
+    /// Canonical buffer with the same content as `buffer` (`buffer` itself
+    /// if it is the first of its kind). `contentHash` must be hash(buffer).
+    Buffer intern(const Buffer& buffer, uint64_t contentHash);
+
+    /// True if `buffer` came from intern(). Its only owner must not write
+    /// to it either: intern() may hand it out again at any time.
+    static bool isPooled(const Buffer& buffer);
+
+    /// Number of distinct buffers currently pooled.
+    size_t size() const;
+
+private:
+    struct Entry {
+        const uint8_t* pixels = nullptr;  // Alive while the entry is listed
+        std::weak_ptr<uint8_t[]> buffer;
+    };
+    struct Release;
+
+    TileStore() = default;
+
+    /// Unlist the expired buffer at `pixels` (its deleter is running).
+    void release(uint64_t contentHash, const uint8_t* pixels);
+
+    mutable std::mutex m_mutex;
+    std::unordered_multimap<uint64_t, Entry> m_buffers;
+};
+
+}  // namespace comicos
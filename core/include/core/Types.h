@@ -36,9 +36,9 @@ struct CanvasPoint {
     float x = 0.0f;
     float y = 0.0f;
     float pressure = 1.0f;
-    float tiltX = 0.0f;
+    float tiltX = 0.0f;  // Degrees from vertical
     float tiltY = 0.0f;
-    double timestamp = 0.0;
+    double timestamp = 0.0;  // Milliseconds, monotonic; 0 if unknown
 };
 
 // --- Blend Mode ---
@@ -50,6 +50,13 @@ enum class BlendMode : uint8_t {
     // TODO: Add more blend modes as needed
 };
 
+// --- Layer Type ---
+enum class LayerType : uint8_t {
+    Raster,  // Pixels in tiles
+    Vector,  // Strokes, rasterized into tiles on demand (VectorLayer)
+    // Extension point: text, adjustment
+};
+
 // --- Tool Type ---
 enum class ToolType : uint8_t {
     Pen,
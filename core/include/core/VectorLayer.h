@@ -0,0 +1,90 @@
+#pragma once
+
+#include "core/Layer.h"
+#include "core/Stroke.h"
+#include "core/Types.h"
+#include <QRect>
+#include <QTransform>
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace comicos {
+
+/// Layer that stores its content as strokes (points, pressure and brush
+/// settings) instead of pixels.
+///
+/// Its tiles are a cache of what the strokes draw. Each one is registered
+/// lazily against a source that draws it from the strokes touching it, so
+/// a tile costs memory only once something reads it: tileAt() keeps it
+/// (the canvas), pixelsAt() draws it without keeping it (export, previews).
+/// evictRaster() drops drawn tiles again. Editing the strokes redraws only
+/// the tiles within the bounds of the strokes that changed.
+///
+/// The brush engine draws a stroke onto the tiles while it is painted;
+/// appendPainted() then records it without drawing anything again.
+class VectorLayer final : public Layer {
+public:
+    using StrokeList = std::vector<std::shared_ptr<const Stroke>>;
+
+    /// Draws `strokes`, in order, over a transparent tile `coord` into `out`
+    /// (TILE_BYTES, every byte written). False if nothing was drawn. Called
+    /// concurrently from any thread that reads tiles.
+    using Rasterizer = std::function<bool(const std::vector<const Stroke*>& strokes,
+                                          const TileCoord& coord, uint8_t* out)>;
+
+    /// Drawn tiles a layer keeps beyond those on screen (see evictRaster).
+    static constexpr size_t RASTER_CACHE_TILES = 64;
+
+    explicit VectorLayer(LayerId id, const QString& name = QString());
+    ~VectorLayer() override;
+
+    LayerType type() const override { return LayerType::Vector; }
+
+    /// Set once at startup by the engine; until then tiles draw empty.
+    static void setRasterizer(Rasterizer rasterizer);
+
+    // --- Strokes ---
+    const StrokeList& strokes() const { return m_strokes; }
+
+    /// Record a stroke the brush engine has already drawn onto the tiles.
+    void appendPainted(std::shared_ptr<const Stroke> stroke);
+
+    /// Replace the strokes. Tiles under strokes that were added or removed
+    /// are drawn again on next access; returns them.
+    std::vector<TileCoord> setStrokes(StrokeList strokes);
+
+    /// Replace stroke `index`. Returns the tiles to redraw.
+    std::vector<TileCoord> replaceStroke(size_t index, std::shared_ptr<const Stroke> stroke);
+
+    /// `strokes` mapped through `transform` (affine): points move, brush
+    /// size and tip angle follow its scale and rotation. For setStrokes().
+    static StrokeList transformed(const StrokeList& strokes, const QTransform& transform);
+
+    /// Canvas pixels a stroke can draw into.
+    static QRect strokeBounds(const Stroke& stroke);
+
+    // --- Raster Cache ---
+    /// Drop drawn tiles not in `keep` once more than `budget` are resident;
+    /// they are drawn again on next access. Pixels do not change (hence
+    /// const, like materializing).
+    void evictRaster(const std::unordered_set<TileCoord>& keep = {}, size_t budget = 0) const;
+
+    // --- Layer ---
+    void clear() override;
+    std::unique_ptr<Layer> snapshot() const override;
+
+private:
+    class Source;
+
+    /// Make tiles `coords` lazy in the current source, or remove those no
+    /// stroke touches.
+    void invalidate(const std::vector<TileCoord>& coords);
+
+    StrokeList m_strokes;
+    std::vector<QRect> m_bounds;  // strokeBounds() of each of m_strokes
+    std::shared_ptr<const Source> m_source;  // Draws m_strokes
+};
+
+}  // namespace comicos
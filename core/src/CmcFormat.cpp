@@ -1,14 +1,27 @@
 #include "core/CmcFormat.h"
 #include "core/Layer.h"
 #include "core/LayerStack.h"
+#include "core/Page.h"
 #include "core/Tile.h"
+#include "core/TileCodec.h"
 #include "core/TileManager.h"
+#include "core/TileSource.h"
 #include "core/Types.h"
+#include "core/VectorLayer.h"
+#include <QBuffer>
 #include <QByteArray>
 #include <QDataStream>
 #include <QFile>
+#include <QFileInfo>
 #include <QIODevice>
 #include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace comicos {
 
@@ -26,87 +39,750 @@ static bool tagsEqual(const char a[4], const char b[4]) {
     return a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3];
 }
 
+static void configureStream(QDataStream& s) {
+    s.setVersion(QDataStream::Qt_6_5);
+    s.setByteOrder(QDataStream::LittleEndian);
+}
+
+namespace {
+
+constexpr char TAG_CANV[4] = {'C', 'A', 'N', 'V'};
+constexpr char TAG_LYRS[4] = {'L', 'Y', 'R', 'S'};
+constexpr char TAG_PAGE[4] = {'P', 'A', 'G', 'E'};
+constexpr char TAG_THMB[4] = {'T', 'H', 'M', 'B'};
+constexpr char TAG_PRVW[4] = {'P', 'R', 'V', 'W'};
+constexpr char TAG_TILE[4] = {'T', 'I', 'L', 'E'};
+constexpr char TAG_TREF[4] = {'T', 'R', 'E', 'F'};
+constexpr char TAG_STRK[4] = {'S', 'T', 'R', 'K'};
+constexpr char TAG_INDX[4] = {'I', 'N', 'D', 'X'};
+constexpr char TAG_END[4]  = {'E', 'N', 'D', '\0'};
+
+/// Parsed CANV + LYRS + PAGE chunks (shared by the v1 and v2 loaders).
+struct HeaderInfo {
+    int dpi = 300;
+    bool hasCanv = false;
+
+    struct LayerInfo {
+        quint64 id;
+        QString name;
+        float opacity;
+        bool visible;
+        bool locked;
+        quint8 blendMode;
+        bool vector = false;  // Has a STRK chunk
+    };
+
+    /// The first page comes from CANV + LYRS, every other from a PAGE chunk.
+    struct PageInfo {
+        quint32 index = 0;  // Page number in the file, 0-based
+        QSize canvasSize;
+        std::vector<LayerInfo> layers;
+        quint64 activeLayerId = 0;
+        quint64 nextLayerId = 1;
+    };
+    std::vector<PageInfo> pages = std::vector<PageInfo>(1);
+};
+
+/// Layer field of TILE/TREF chunks and INDX entries: the layer id, with the
+/// page number in the high 32 bits. It is 0 for the first page, so
+/// single-page files are unchanged and older readers skip other pages' tiles.
+quint64 tileLayerKey(quint32 pageIndex, LayerId layerId) {
+    return (static_cast<quint64>(pageIndex) << 32) | layerId;
+}
+
+/// One INDX entry. Size on disk: 4 + 8 + 4 + 4 + 1 + 8 + 8 bytes.
+struct IndexEntry {
+    char tag[4] = {};
+    quint64 layerId = 0;
+    qint32 tx = 0;
+    qint32 ty = 0;
+    quint8 codec = 0;
+    quint64 offset = 0;
+    quint64 size = 0;
+};
+constexpr quint64 INDEX_ENTRY_BYTES = 37;
+constexpr quint64 TILE_HEADER_BYTES = 17;  // layerId + tx + ty + codec
+constexpr quint64 TREF_BYTES = TILE_HEADER_BYTES + 16;  // + payload offset + size
+constexpr quint64 CHUNK_HEADER_BYTES = 12;  // tag + uint64 size
+
+/// Read-only view of a v2 file, shared by all lazy tiles loaded from it.
+/// The whole file is memory-mapped so pages are only faulted in for the
+/// chunks that are actually read; falls back to seek+read if mapping fails.
+class CmcFileSource final : public TileSource {
+public:
+    explicit CmcFileSource(const QString& path) : m_file(path) {}
+
+    ~CmcFileSource() override {
+        if (m_map) m_file.unmap(m_map);
+    }
+
+    /// `map` = false reads with seek+read only (for a handful of small reads).
+    bool open(bool map = true) {
+        if (!m_file.open(QIODevice::ReadOnly)) return false;
+        m_path = QFileInfo(m_file.fileName()).canonicalFilePath();
+        m_size = static_cast<quint64>(m_file.size());
+        if (map) m_map = m_file.map(0, m_file.size());
+        return true;
+    }
+
+    QString filePath() const override { return m_path; }
+    quint64 size() const { return m_size; }
+
+    /// Bytes at [offset, offset + size). Empty if out of range.
+    QByteArray read(quint64 offset, quint64 size) const {
+        if (offset > m_size || size > m_size - offset) return {};
+        if (m_map) {
+            return QByteArray::fromRawData(reinterpret_cast<const char*>(m_map + offset),
+                                           static_cast<qsizetype>(size));
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_file.seek(static_cast<qint64>(offset))) return {};
+        return m_file.read(static_cast<qint64>(size));
+    }
+
+    QByteArray payload(const TileRef& ref) const override {
+        return read(ref.offset, ref.size);
+    }
+
+private:
+    mutable QFile m_file;
+    mutable std::mutex m_mutex;
+    QString m_path;
+    quint64 m_size = 0;
+    uchar* m_map = nullptr;
+};
+
+}  // namespace
+
+static void parseCanv(const QByteArray& data, HeaderInfo& info) {
+    QDataStream s(data);
+    configureStream(s);
+    quint32 w, h, d;
+    s >> w >> h >> d;
+    info.pages[0].canvasSize = QSize(w, h);
+    info.dpi = d;
+    info.hasCanv = true;
+}
+
+/// Layer list as stored in LYRS and at the end of PAGE.
+static void readLayers(QDataStream& s, HeaderInfo::PageInfo& page) {
+    quint32 count;
+    s >> count >> page.activeLayerId >> page.nextLayerId;
+
+    page.layers.reserve(count);
+    for (quint32 i = 0; i < count; ++i) {
+        HeaderInfo::LayerInfo li;
+        s >> li.id >> li.name >> li.opacity
+          >> li.visible >> li.locked >> li.blendMode;
+        page.layers.push_back(std::move(li));
+    }
+}
+
+static void parseLyrs(const QByteArray& data, HeaderInfo& info) {
+    QDataStream s(data);
+    configureStream(s);
+    readLayers(s, info.pages[0]);
+}
+
+static void parsePage(const QByteArray& data, HeaderInfo& info) {
+    QDataStream s(data);
+    configureStream(s);
+    HeaderInfo::PageInfo page;
+    quint32 w, h;
+    s >> page.index >> w >> h;
+    page.canvasSize = QSize(w, h);
+    readLayers(s, page);
+    if (s.status() != QDataStream::Ok || page.index == 0) return;  // Damaged chunk
+    info.pages.push_back(std::move(page));
+}
+
+/// STRK chunk data: the strokes of a vector layer stored under `layerKey`.
+/// The tip id field is always -1 (round): BrushTipAtlas ids are only valid
+/// for the session, and tips are not saved.
+static QByteArray serializeStrokes(quint64 layerKey, const VectorLayer& layer) {
+    QByteArray buf;
+    QDataStream s(&buf, QIODevice::WriteOnly);
+    configureStream(s);
+    s.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    s << layerKey << static_cast<quint32>(layer.strokes().size());
+    for (const auto& stroke : layer.strokes()) {
+        s << static_cast<quint8>(stroke->toolType())
+          << static_cast<quint32>(stroke->color().rgba())
+          << stroke->brushSize() << stroke->hardness()
+          << static_cast<qint32>(-1) << stroke->tipAngle() << stroke->tipAspect()
+          << static_cast<quint32>(stroke->points().size());
+        // Timestamps only drive prediction while drawing: not stored
+        for (const CanvasPoint& p : stroke->points()) {
+            s << p.x << p.y << p.pressure << p.tiltX << p.tiltY;
+        }
+    }
+    return buf;
+}
+
+/// Strokes of one STRK chunk, and the layer they belong to.
+struct StrokeChunk {
+    quint64 layerKey = 0;
+    VectorLayer::StrokeList strokes;
+};
+
+static bool parseStrokes(const QByteArray& data, StrokeChunk& chunk) {
+    QDataStream s(data);
+    configureStream(s);
+    s.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    quint32 count = 0;
+    s >> chunk.layerKey >> count;
+    for (quint32 i = 0; i < count && s.status() == QDataStream::Ok; ++i) {
+        quint8 tool = 0;
+        quint32 rgba = 0, points = 0;
+        qint32 tipId = -1;
+        float size = 0, hardness = 0, tipAngle = 0, tipAspect = 1;
+        s >> tool >> rgba >> size >> hardness >> tipId >> tipAngle >> tipAspect >> points;
+        // tipId is not applied: an id from another session would name
+        // whatever tip has it now (see serializeStrokes())
+
+        auto stroke = std::make_shared<Stroke>();
+        stroke->setToolType(static_cast<ToolType>(tool));
+        stroke->setColor(QColor::fromRgba(rgba));
+        stroke->setBrushSize(size);
+        stroke->setHardness(hardness);
+        stroke->setTipAngle(tipAngle);
+        stroke->setTipAspect(tipAspect);
+        stroke->setTargetLayerId(chunk.layerKey & 0xFFFFFFFFu);
+        for (quint32 j = 0; j < points && s.status() == QDataStream::Ok; ++j) {
+            CanvasPoint p;
+            s >> p.x >> p.y >> p.pressure >> p.tiltX >> p.tiltY;
+            stroke->addPoint(p);
+        }
+        chunk.strokes.push_back(std::move(stroke));
+    }
+    return s.status() == QDataStream::Ok;
+}
+
+static void fillStack(LayerStack& stack, const HeaderInfo::PageInfo& page) {
+    for (const auto& li : page.layers) {
+        std::unique_ptr<Layer> layer;
+        if (li.vector) {
+            layer = std::make_unique<VectorLayer>(li.id, li.name);
+        } else {
+            layer = std::make_unique<Layer>(li.id, li.name);
+        }
+        layer->setOpacity(li.opacity);
+        layer->setVisible(li.visible);
+        layer->setLocked(li.locked);
+        layer->setBlendMode(static_cast<BlendMode>(li.blendMode));
+        stack.insertLayer(stack.count(), std::move(layer));
+    }
+    stack.setActiveLayerId(page.activeLayerId);
+    stack.setNextId(page.nextLayerId);
+}
+
+/// Creates the document with its pages in file order. `stacks` maps each
+/// page number in the file to its layers, for routing tiles.
+static std::unique_ptr<Document> createDocument(
+    HeaderInfo& info, std::unordered_map<quint32, LayerStack*>& stacks) {
+    std::stable_sort(info.pages.begin() + 1, info.pages.end(),
+                     [](const auto& a, const auto& b) { return a.index < b.index; });
+
+    auto doc = std::make_unique<Document>(info.pages[0].canvasSize);
+    doc->setDpi(info.dpi);
+
+    // Remove the default layer created by the constructor
+    auto& stack = doc->layers();
+    if (stack.count() > 0) {
+        stack.removeLayer(stack.layerAt(0)->id());
+    }
+
+    // Recreate pages and layers from file
+    fillStack(stack, info.pages[0]);
+    stacks[0] = &stack;
+    for (size_t i = 1; i < info.pages.size(); ++i) {
+        const auto& pageInfo = info.pages[i];
+        if (stacks.count(pageInfo.index)) continue;  // Duplicate page number
+        auto page = std::make_unique<Page>(pageInfo.canvasSize);
+        fillStack(page->layers(), pageInfo);
+        stacks[pageInfo.index] = &doc->insertPage(doc->pageCount(), std::move(page)).layers();
+    }
+    return doc;
+}
+
+/// Layer of a tile chunk (see tileLayerKey). Null if unknown.
+static Layer* layerForKey(const std::unordered_map<quint32, LayerStack*>& stacks, quint64 key) {
+    auto it = stacks.find(static_cast<quint32>(key >> 32));
+    if (it == stacks.end()) return nullptr;
+    return it->second->layerById(key & 0xFFFFFFFFu);
+}
+
 // --- Save ---
 
-bool CmcFormat::save(const Document& doc, const QString& path) {
+/// CANV chunk data (same in v1 and v2): the first page's canvas and the DPI.
+static QByteArray serializeCanv(const Document& doc) {
+    QByteArray buf;
+    QDataStream s(&buf, QIODevice::WriteOnly);
+    configureStream(s);
+    s << static_cast<quint32>(doc.page(0).canvasSize().width())
+      << static_cast<quint32>(doc.page(0).canvasSize().height())
+      << static_cast<quint32>(doc.dpi());
+    return buf;
+}
+
+static void writeLayers(QDataStream& s, const LayerStack& stack) {
+    s << static_cast<quint32>(stack.count())
+      << static_cast<quint64>(stack.activeLayerId())
+      << static_cast<quint64>(stack.peekNextId());
+
+    for (const auto& layer : stack.layers()) {
+        s << static_cast<quint64>(layer->id())
+          << layer->name()
+          << layer->opacity()
+          << layer->isVisible()
+          << layer->isLocked()
+          << static_cast<quint8>(layer->blendMode());
+    }
+}
+
+/// LYRS chunk data (same in v1 and v2): the first page's layers.
+static QByteArray serializeLyrs(const LayerStack& stack) {
+    QByteArray buf;
+    QDataStream s(&buf, QIODevice::WriteOnly);
+    configureStream(s);
+    writeLayers(s, stack);
+    return buf;
+}
+
+/// PAGE chunk data: page number, canvas size, then the LYRS layout.
+static QByteArray serializePage(const Page& page, quint32 index) {
+    QByteArray buf;
+    QDataStream s(&buf, QIODevice::WriteOnly);
+    configureStream(s);
+    s << index
+      << static_cast<quint32>(page.canvasSize().width())
+      << static_cast<quint32>(page.canvasSize().height());
+    writeLayers(s, page.layers());
+    return buf;
+}
+
+/// Payloads the tiles of a document read from the file being replaced, by
+/// source and old offset, and where save() wrote them in the new file.
+using Relocation = std::map<const TileSource*, std::unordered_map<quint64, TileRef>>;
+
+/// Re-point the tiles of `doc` that read a source in `moved` at `to`.
+static void relocate(const Document& doc, const std::shared_ptr<const TileSource>& to,
+                     const Relocation& moved) {
+    for (int p = 0; p < doc.pageCount(); ++p) {
+        for (const auto& layer : doc.page(p).layers().layers()) {
+            for (const auto& [from, refs] : moved) {
+                layer->tiles().relocateLazyTiles(from, to, refs);
+            }
+        }
+    }
+}
+
+/// Before the file being replaced is committed: copy the payloads `doc`
+/// reads from it (its sources in `moved`) into memory and point the tiles
+/// there, so the old file is no longer open or mapped. Windows cannot
+/// replace it otherwise. `moved` then maps the memory copies to the new
+/// file, for relocateToFile(); the copies live only until then.
+static void releaseTarget(const Document& doc, Relocation& moved) {
+    if (moved.empty()) return;
+
+    // Each payload is copied once, however many tiles share it
+    Relocation toMemory;
+    QByteArray data;
+    auto copy = [&](const TileSource* source, const TileRef& ref) {
+        auto& refs = toMemory[source];
+        if (refs.count(ref.offset)) return;
+        const QByteArray payload = source->payload(ref);
+        if (payload.isEmpty()) return;
+        refs[ref.offset] = {static_cast<quint64>(data.size()),
+                            static_cast<quint64>(payload.size()), ref.codec};
+        data.append(payload);
+    };
+    for (int p = 0; p < doc.pageCount(); ++p) {
+        for (const auto& layer : doc.page(p).layers().layers()) {
+            for (const Tile* tile : layer->tiles().residentTiles()) {
+                if (moved.count(tile->origin().get())) {
+                    copy(tile->origin().get(), tile->originRef());
+                }
+            }
+            for (const auto& [coord, lazy] : layer->tiles().lazyTiles()) {
+                if (moved.count(lazy.source.get())) copy(lazy.source.get(), lazy.ref);
+            }
+        }
+    }
+
+    auto memory = std::make_shared<const MemoryTileSource>(std::move(data));
+    relocate(doc, memory, toMemory);
+
+    Relocation fromMemory;
+    auto& refs = fromMemory[memory.get()];
+    for (const auto& [source, sourceRefs] : toMemory) {
+        const auto& written = moved[source];
+        for (const auto& [offset, ref] : sourceRefs) {
+            if (auto it = written.find(offset); it != written.end()) refs[ref.offset] = it->second;
+        }
+    }
+    moved = std::move(fromMemory);
+}
+
+/// After the file at `path` was replaced: point the tiles of `doc` that
+/// releaseTarget() moved to memory at the new file. If it cannot be opened
+/// they keep reading their in-memory copies.
+static void relocateToFile(const Document& doc, const QString& path, const Relocation& moved) {
+    if (moved.empty()) return;
+    auto file = std::make_shared<CmcFileSource>(path);
+    if (!file->open()) return;
+    relocate(doc, std::move(file), moved);
+}
+
+void CmcFormat::detachFromFile(const Document& doc, const QString& path) {
+    const QString target = QFileInfo(path).canonicalFilePath();
+    if (target.isEmpty()) return;
+
+    // Each payload is copied once, however many tiles share it
+    std::map<const TileSource*, std::unordered_map<quint64, TileRef>> refs;
+    QByteArray data;
+    for (int p = 0; p < doc.pageCount(); ++p) {
+        for (const auto& layer : doc.page(p).layers().layers()) {
+            // Resident tiles only forget the file as their origin
+            for (const Tile* tile : layer->tiles().residentTiles()) {
+                const TileSource* origin = tile->origin().get();
+                if (origin && origin->filePath() == target) refs[origin];
+            }
+            for (const auto& [coord, lazy] : layer->tiles().lazyTiles()) {
+                if (lazy.source->filePath() != target) continue;
+                auto& sourceRefs = refs[lazy.source.get()];
+                if (sourceRefs.count(lazy.ref.offset)) continue;
+
+                const QByteArray payload = lazy.source->payload(lazy.ref);
+                if (payload.isEmpty()) continue;
+                sourceRefs[lazy.ref.offset] = {static_cast<quint64>(data.size()),
+                                               static_cast<quint64>(payload.size()),
+                                               lazy.ref.codec};
+                data.append(payload);
+            }
+        }
+    }
+    if (refs.empty()) return;
+
+    auto memory = std::make_shared<const MemoryTileSource>(std::move(data));
+    for (int p = 0; p < doc.pageCount(); ++p) {
+        for (const auto& layer : doc.page(p).layers().layers()) {
+            for (const auto& [source, sourceRefs] : refs) {
+                layer->tiles().relocateLazyTiles(source, memory, sourceRefs);
+            }
+        }
+    }
+}
+
+bool CmcFormat::save(const Document& doc, const QString& path, const TileEncoding& encoding,
+                     const DocumentPreview& preview) {
+    // Tiles may read the file being replaced: they are moved off it before
+    // the commit and re-pointed at the new file after it
+    const QString target = QFileInfo(path).canonicalFilePath();
+    auto readsTarget = [&](const TileSource* source) {
+        return source && !target.isEmpty() && source->filePath() == target;
+    };
+    Relocation moved;
+
     QSaveFile file(path);
     if (!file.open(QIODevice::WriteOnly))
         return false;
 
     QDataStream out(&file);
-    out.setVersion(QDataStream::Qt_6_5);
-    out.setByteOrder(QDataStream::LittleEndian);
+    configureStream(out);
 
     // Magic
-    out.writeRawData(MAGIC, 4);
+    out.writeRawData(MAGIC, 3);
+    out << VERSION;
 
-    // CANV chunk
-    {
-        QByteArray buf;
-        QDataStream s(&buf, QIODevice::WriteOnly);
-        s.setVersion(QDataStream::Qt_6_5);
-        s.setByteOrder(QDataStream::LittleEndian);
-        s << static_cast<quint32>(doc.canvasSize().width())
-          << static_cast<quint32>(doc.canvasSize().height())
-          << static_cast<quint32>(doc.dpi());
-
-        writeTag(out, TAG_CANV);
-        out << static_cast<quint32>(buf.size());
-        out.writeRawData(buf.constData(), buf.size());
+    std::vector<IndexEntry> index;
+
+    // Writes a whole chunk and records its data location in the index.
+    auto writeChunk = [&](const char tag[4], const QByteArray& data) -> IndexEntry& {
+        writeTag(out, tag);
+        out << static_cast<quint64>(data.size());
+        auto offset = static_cast<quint64>(file.pos());
+        out.writeRawData(data.constData(), data.size());
+
+        IndexEntry entry;
+        std::memcpy(entry.tag, tag, 4);
+        entry.offset = offset;
+        entry.size = static_cast<quint64>(data.size());
+        index.push_back(entry);
+        return index.back();
+    };
+
+    writeChunk(TAG_CANV, serializeCanv(doc));
+    writeChunk(TAG_LYRS, serializeLyrs(doc.page(0).layers()));
+    for (int p = 1; p < doc.pageCount(); ++p) {
+        IndexEntry& entry = writeChunk(TAG_PAGE, serializePage(doc.page(p), p));
+        entry.tx = p;
+    }
+
+    // THMB + PRVW chunks — before any tile, so their index entries come first
+    auto writeImage = [&](const char tag[4], const QImage& image) {
+        if (image.isNull()) return;
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        if (!image.save(&buffer, "PNG")) return;
+        IndexEntry& entry = writeChunk(tag, png);
+        entry.tx = image.width();
+        entry.ty = image.height();
+    };
+    writeImage(TAG_THMB, preview.thumbnail);
+    for (const QImage& level : preview.levels) {
+        writeImage(TAG_PRVW, level);
+    }
+
+    // TILE chunks — one per unique tile payload. Tiles whose content was
+    // already written become TREF chunks pointing at that payload.
+    struct WrittenPayload {
+        const uint8_t* pixels;  // Alive until save returns (owned by doc)
+        TileCodec codec;
+        quint64 offset;
+        quint64 size;
+
+        TileRef ref() const { return {offset, size, codec}; }
+    };
+    std::unordered_multimap<quint64, WrittenPayload> writtenByHash;
+    std::map<std::pair<const TileSource*, quint64>, WrittenPayload> writtenBySource;
+    std::vector<uint8_t> transcodeBuffer;
+
+    // Layers of all pages, with the key their tiles are stored under
+    std::vector<std::pair<quint64, const Layer*>> layers;
+    for (int p = 0; p < doc.pageCount(); ++p) {
+        for (const auto& layer : doc.page(p).layers().layers()) {
+            layers.emplace_back(tileLayerKey(p, layer->id()), layer.get());
+        }
+    }
+
+    for (const auto& keyed : layers) {
+        const quint64 layerKey = keyed.first;
+        const Layer* layer = keyed.second;
+
+        // Vector layers store strokes; their tiles are drawn from them
+        if (layer->type() == LayerType::Vector) {
+            IndexEntry& entry = writeChunk(
+                TAG_STRK, serializeStrokes(layerKey, static_cast<const VectorLayer&>(*layer)));
+            entry.layerId = layerKey;
+            continue;
+        }
+
+        auto writeHeader = [&](QDataStream& s, const TileCoord& coord, TileCodec codec) {
+            s << layerKey
+              << static_cast<qint32>(coord.tx)
+              << static_cast<qint32>(coord.ty)
+              << static_cast<quint8>(codec);
+        };
+
+        auto addIndexEntry = [&](const TileCoord& coord, const WrittenPayload& p) {
+            // TREF entries are indexed as TILE: readers need no special case
+            IndexEntry entry;
+            std::memcpy(entry.tag, TAG_TILE, 4);
+            entry.layerId = layerKey;
+            entry.tx = coord.tx;
+            entry.ty = coord.ty;
+            entry.codec = static_cast<quint8>(p.codec);
+            entry.offset = p.offset;
+            entry.size = p.size;
+            index.push_back(entry);
+        };
+
+        auto writeTile = [&](const TileCoord& coord, TileCodec codec,
+                             const QByteArray& payload) -> WrittenPayload {
+            QByteArray header;
+            QDataStream s(&header, QIODevice::WriteOnly);
+            configureStream(s);
+            writeHeader(s, coord, codec);
+
+            writeTag(out, TAG_TILE);
+            out << static_cast<quint64>(header.size() + payload.size());
+            out.writeRawData(header.constData(), header.size());
+            auto offset = static_cast<quint64>(file.pos());
+            out.writeRawData(payload.constData(), payload.size());
+
+            WrittenPayload written{nullptr, codec, offset, static_cast<quint64>(payload.size())};
+            addIndexEntry(coord, written);
+            return written;
+        };
+
+        auto writeRef = [&](const TileCoord& coord, const WrittenPayload& target) {
+            QByteArray data;
+            QDataStream s(&data, QIODevice::WriteOnly);
+            configureStream(s);
+            writeHeader(s, coord, target.codec);
+            s << target.offset << target.size;
+
+            writeTag(out, TAG_TREF);
+            out << static_cast<quint64>(data.size());
+            out.writeRawData(data.constData(), data.size());
+            addIndexEntry(coord, target);
+        };
+
+        // Writes decoded pixels once per distinct content
+        auto writePixels = [&](const TileCoord& coord, const uint8_t* pixels,
+                               quint64 hash) -> WrittenPayload {
+            auto [begin, end] = writtenByHash.equal_range(hash);
+            for (auto it = begin; it != end; ++it) {
+                if (std::memcmp(it->second.pixels, pixels, TILE_BYTES) == 0) {
+                    writeRef(coord, it->second);
+                    return it->second;
+                }
+            }
+            WrittenPayload written = writeTile(coord, encoding.codec,
+                                               TileCodecs::encode(pixels, encoding));
+            written.pixels = pixels;
+            writtenByHash.emplace(hash, written);
+            return written;
+        };
+
+        const auto& tiles = layer->tiles();
+        for (const Tile* tile : tiles.residentTiles()) {
+            if (tile->isEmpty()) continue;
+            const WrittenPayload written =
+                writePixels(tile->coord(), tile->constData(), tile->contentHash());
+            if (readsTarget(tile->origin().get())) {
+                moved[tile->origin().get()][tile->originRef().offset] = written.ref();
+            }
+        }
+
+        // Tiles that were never decoded are copied verbatim when they already
+        // use the requested codec; otherwise they are transcoded.
+        for (const auto& [coord, lazy] : tiles.lazyTiles()) {
+            auto key = std::make_pair(lazy.source.get(), lazy.ref.offset);
+            if (auto it = writtenBySource.find(key); it != writtenBySource.end()) {
+                writeRef(coord, it->second);
+                continue;
+            }
+
+            QByteArray payload = lazy.source->payload(lazy.ref);
+            if (payload.isEmpty()) continue;
+            if (lazy.ref.codec == encoding.codec) {
+                writtenBySource[key] = writeTile(coord, lazy.ref.codec, payload);
+            } else {
+                // Transcoded tiles are deduplicated by source payload only,
+                // so their pixels need not stay in memory for comparisons
+                if (transcodeBuffer.empty()) transcodeBuffer.resize(TILE_BYTES);
+                if (!TileCodecs::decode(lazy.ref.codec, payload.constData(), payload.size(),
+                                        transcodeBuffer.data()))
+                    continue;
+                writtenBySource[key] = writeTile(
+                    coord, encoding.codec, TileCodecs::encode(transcodeBuffer.data(), encoding));
+            }
+            if (readsTarget(lazy.source.get())) {
+                moved[lazy.source.get()][lazy.ref.offset] = writtenBySource[key].ref();
+            }
+        }
     }
 
-    // LYRS chunk
+    // INDX chunk
+    auto indexOffset = static_cast<quint64>(file.pos());
     {
-        const auto& stack = doc.layers();
         QByteArray buf;
         QDataStream s(&buf, QIODevice::WriteOnly);
-        s.setVersion(QDataStream::Qt_6_5);
-        s.setByteOrder(QDataStream::LittleEndian);
-
-        s << static_cast<quint32>(stack.count())
-          << static_cast<quint64>(stack.activeLayerId())
-          << static_cast<quint64>(stack.peekNextId());
-
-        for (const auto& layer : stack.layers()) {
-            s << static_cast<quint64>(layer->id())
-              << layer->name()
-              << layer->opacity()
-              << layer->isVisible()
-              << layer->isLocked()
-              << static_cast<quint8>(layer->blendMode());
+        configureStream(s);
+        s << static_cast<quint32>(index.size());
+        for (const auto& e : index) {
+            s.writeRawData(e.tag, 4);
+            s << e.layerId << e.tx << e.ty << e.codec << e.offset << e.size;
         }
 
-        writeTag(out, TAG_LYRS);
-        out << static_cast<quint32>(buf.size());
+        writeTag(out, TAG_INDX);
+        out << static_cast<quint64>(buf.size());
         out.writeRawData(buf.constData(), buf.size());
     }
 
-    // TILE chunks — one per non-empty tile
-    {
-        const auto& stack = doc.layers();
-        for (const auto& layer : stack.layers()) {
-            auto tiles = layer->tiles().allTiles();
-            for (const Tile* tile : tiles) {
-                if (tile->isEmpty()) continue;
+    // END chunk (points back at the index)
+    writeTag(out, TAG_END);
+    out << static_cast<quint64>(sizeof(quint64)) << indexOffset;
+
+    releaseTarget(doc, moved);
+    if (!file.commit()) return false;
+    relocateToFile(doc, path, moved);
+    return true;
+}
+
+bool CmcFormat::saveV1(const Document& doc, const QString& path) {
+    // As in save(): tiles reading the file being replaced are moved off it
+    // before the commit and re-pointed at the payloads written here
+    const QString target = QFileInfo(path).canonicalFilePath();
+    auto readsTarget = [&](const TileSource* source) {
+        return source && !target.isEmpty() && source->filePath() == target;
+    };
+    Relocation moved;
 
-                const uint8_t* raw = tile->constData();
-                if (!raw) continue;
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
 
-                QByteArray uncompressed(reinterpret_cast<const char*>(raw), TILE_BYTES);
-                QByteArray compressed = qCompress(uncompressed);
+    QDataStream out(&file);
+    configureStream(out);
 
+    out.writeRawData(MAGIC, 3);
+    out << VERSION_1;
+
+    auto writeChunk = [&](const char tag[4], const QByteArray& data) {
+        writeTag(out, tag);
+        out << static_cast<quint32>(data.size());
+        out.writeRawData(data.constData(), data.size());
+    };
+
+    writeChunk(TAG_CANV, serializeCanv(doc));
+    writeChunk(TAG_LYRS, serializeLyrs(doc.page(0).layers()));
+    for (int p = 1; p < doc.pageCount(); ++p) {
+        writeChunk(TAG_PAGE, serializePage(doc.page(p), p));
+    }
+
+    // TILE chunks — v1 only knows zlib. Lazy zlib tiles are copied verbatim,
+    // everything else is decoded (without becoming resident) and re-encoded.
+    std::vector<uint8_t> scratch(TILE_BYTES);
+    for (int p = 0; p < doc.pageCount(); ++p) {
+        for (const auto& layer : doc.page(p).layers().layers()) {
+            const auto& tiles = layer->tiles();
+            const quint64 layerKey = tileLayerKey(p, layer->id());
+
+            // Returns where the payload landed: it ends the chunk
+            auto writeTile = [&](const TileCoord& coord, const QByteArray& compressed) {
                 QByteArray buf;
                 QDataStream s(&buf, QIODevice::WriteOnly);
-                s.setVersion(QDataStream::Qt_6_5);
-                s.setByteOrder(QDataStream::LittleEndian);
-                s << static_cast<quint64>(layer->id())
-                  << static_cast<qint32>(tile->coord().tx)
-                  << static_cast<qint32>(tile->coord().ty)
+                configureStream(s);
+                s << layerKey
+                  << static_cast<qint32>(coord.tx)
+                  << static_cast<qint32>(coord.ty)
                   << compressed;
+                writeChunk(TAG_TILE, buf);
+                const auto size = static_cast<quint64>(compressed.size());
+                return TileRef{static_cast<quint64>(file.pos()) - size, size, TileCodec::Zlib};
+            };
 
-                writeTag(out, TAG_TILE);
-                out << static_cast<quint32>(buf.size());
-                out.writeRawData(buf.constData(), buf.size());
+            for (const Tile* tile : tiles.residentTiles()) {
+                if (tile->isEmpty()) continue;
+                const TileRef ref = writeTile(
+                    tile->coord(),
+                    TileCodecs::encode(tile->constData(), {TileCodec::Zlib, TileFilter::None}));
+                if (readsTarget(tile->origin().get())) {
+                    moved[tile->origin().get()][tile->originRef().offset] = ref;
+                }
+            }
+            for (const auto& [coord, lazy] : tiles.lazyTiles()) {
+                TileRef ref;
+                QByteArray payload;
+                if (lazy.ref.codec == TileCodec::Zlib) payload = lazy.source->payload(lazy.ref);
+                if (!payload.isEmpty()) {
+                    ref = writeTile(coord, payload);
+                } else {
+                    // Vector layer tiles have no payload and are drawn here
+                    const uint8_t* pixels = tiles.pixelsAt(coord, scratch.data());
+                    if (!pixels) continue;
+                    ref = writeTile(coord, TileCodecs::encode(pixels, {TileCodec::Zlib,
+                                                                       TileFilter::None}));
+                }
+                if (readsTarget(lazy.source.get())) {
+                    moved[lazy.source.get()][lazy.ref.offset] = ref;
+                }
             }
         }
     }
@@ -115,7 +791,10 @@ bool CmcFormat::save(const Document& doc, const QString& path) {
     writeTag(out, TAG_END);
     out << static_cast<quint32>(0);
 
-    return file.commit();
+    releaseTarget(doc, moved);
+    if (!file.commit()) return false;
+    relocateToFile(doc, path, moved);
+    return true;
 }
 
 // --- Load ---
@@ -126,30 +805,35 @@ std::unique_ptr<Document> CmcFormat::load(const QString& path) {
         return nullptr;
 
     QDataStream in(&file);
-    in.setVersion(QDataStream::Qt_6_5);
-    in.setByteOrder(QDataStream::LittleEndian);
+    configureStream(in);
 
     // Verify magic
-    char magic[4];
-    if (in.readRawData(magic, 4) != 4) return nullptr;
-    if (!tagsEqual(magic, MAGIC)) return nullptr;
+    char magic[3];
+    quint8 version = 0;
+    if (in.readRawData(magic, 3) != 3) return nullptr;
+    if (magic[0] != MAGIC[0] || magic[1] != MAGIC[1] || magic[2] != MAGIC[2]) return nullptr;
+    in >> version;
 
-    // Temporary storage for parsed data
-    QSize canvasSize;
-    int dpi = 300;
-    bool hasCanv = false;
+    if (version == VERSION_1) return loadV1(in);
+    if (version == VERSION) {
+        file.close();
+        return loadV2(path);
+    }
+    return nullptr;  // Written by a newer version
+}
 
-    struct LayerInfo {
-        quint64 id;
-        QString name;
-        float opacity;
-        bool visible;
-        bool locked;
-        quint8 blendMode;
-    };
-    std::vector<LayerInfo> layerInfos;
-    quint64 activeLayerId = 0;
-    quint64 nextLayerId = 1;
+int CmcFormat::formatVersion(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return 0;
+
+    char header[4];
+    if (file.read(header, 4) != 4) return 0;
+    if (header[0] != MAGIC[0] || header[1] != MAGIC[1] || header[2] != MAGIC[2]) return 0;
+    return static_cast<quint8>(header[3]);
+}
+
+std::unique_ptr<Document> CmcFormat::loadV1(QDataStream& in) {
+    HeaderInfo info;
 
     struct TileInfo {
         quint64 layerId;
@@ -175,28 +859,15 @@ std::unique_ptr<Document> CmcFormat::load(const QString& path) {
         if (in.readRawData(chunkData.data(), size) != static_cast<int>(size))
             return nullptr;
 
-        QDataStream s(chunkData);
-        s.setVersion(QDataStream::Qt_6_5);
-        s.setByteOrder(QDataStream::LittleEndian);
-
         if (tagsEqual(tag, TAG_CANV)) {
-            quint32 w, h, d;
-            s >> w >> h >> d;
-            canvasSize = QSize(w, h);
-            dpi = d;
-            hasCanv = true;
+            parseCanv(chunkData, info);
         } else if (tagsEqual(tag, TAG_LYRS)) {
-            quint32 count;
-            s >> count >> activeLayerId >> nextLayerId;
-
-            layerInfos.reserve(count);
-            for (quint32 i = 0; i < count; ++i) {
-                LayerInfo li;
-                s >> li.id >> li.name >> li.opacity
-                  >> li.visible >> li.locked >> li.blendMode;
-                layerInfos.push_back(std::move(li));
-            }
+            parseLyrs(chunkData, info);
+        } else if (tagsEqual(tag, TAG_PAGE)) {
+            parsePage(chunkData, info);
         } else if (tagsEqual(tag, TAG_TILE)) {
+            QDataStream s(chunkData);
+            configureStream(s);
             TileInfo ti;
             s >> ti.layerId >> ti.tx >> ti.ty >> ti.compressed;
             tileInfos.push_back(std::move(ti));
@@ -204,46 +875,240 @@ std::unique_ptr<Document> CmcFormat::load(const QString& path) {
         // Unknown chunks are silently skipped (forward compatibility)
     }
 
-    if (!hasCanv) return nullptr;
-
-    // Build document
-    auto doc = std::make_unique<Document>(canvasSize);
-    doc->setDpi(dpi);
-
-    // Remove the default layer created by the constructor
-    auto& stack = doc->layers();
-    if (stack.count() > 0) {
-        stack.removeLayer(stack.layerAt(0)->id());
-    }
+    if (!info.hasCanv) return nullptr;
 
-    // Recreate layers from file
-    for (const auto& li : layerInfos) {
-        auto layer = std::make_unique<Layer>(li.id, li.name);
-        layer->setOpacity(li.opacity);
-        layer->setVisible(li.visible);
-        layer->setLocked(li.locked);
-        layer->setBlendMode(static_cast<BlendMode>(li.blendMode));
-        stack.insertLayer(stack.count(), std::move(layer));
-    }
-    stack.setActiveLayerId(activeLayerId);
-    stack.setNextId(nextLayerId);
+    std::unordered_map<quint32, LayerStack*> stacks;
+    auto doc = createDocument(info, stacks);
 
     // Restore tile data
     for (const auto& ti : tileInfos) {
-        Layer* layer = stack.layerById(ti.layerId);
+        Layer* layer = layerForKey(stacks, ti.layerId);
         if (!layer) continue;
 
-        QByteArray raw = qUncompress(ti.compressed);
-        if (raw.size() != TILE_BYTES) continue;
-
         TileCoord coord{ti.tx, ti.ty};
         Tile* tile = layer->tiles().getOrCreateTile(coord);
         tile->ensureAllocated();
-        std::memcpy(tile->data(), raw.constData(), TILE_BYTES);
+        if (!TileCodecs::decode(TileCodec::Zlib, ti.compressed.constData(),
+                                ti.compressed.size(), tile->data())) {
+            layer->tiles().removeTile(coord);
+        }
+    }
+
+    doc->setDirty(false);
+    return doc;
+}
+
+static std::unique_ptr<QDataStream> makeStream(const QByteArray& data) {
+    auto s = std::make_unique<QDataStream>(data);
+    configureStream(*s);
+    return s;
+}
+
+/// Reads INDX entries located via the END trailer (fast path).
+/// With `stopAt`, entries are read in small blocks and reading ends before
+/// the first entry it accepts, so a prefix of a large index costs one read.
+static bool readIndex(const CmcFileSource& source, std::vector<IndexEntry>& entries,
+                      const std::function<bool(const IndexEntry&)>& stopAt = {}) {
+    const quint64 trailerBytes = CHUNK_HEADER_BYTES + sizeof(quint64);
+    if (source.size() < 4 + trailerBytes) return false;
+
+    auto t = makeStream(source.read(source.size() - trailerBytes, trailerBytes));
+    char tag[4];
+    quint64 size = 0, indexOffset = 0;
+    if (!readTag(*t, tag) || !tagsEqual(tag, TAG_END)) return false;
+    *t >> size >> indexOffset;
+    if (size != sizeof(quint64)) return false;
+
+    QByteArray chunkHeader = source.read(indexOffset, CHUNK_HEADER_BYTES + sizeof(quint32));
+    if (chunkHeader.isEmpty()) return false;
+    auto h = makeStream(chunkHeader);
+    quint64 indexSize = 0;
+    quint32 count = 0;
+    if (!readTag(*h, tag) || !tagsEqual(tag, TAG_INDX)) return false;
+    *h >> indexSize >> count;
+    if (indexSize < sizeof(quint32)) return false;
+    if (count > (indexSize - sizeof(quint32)) / INDEX_ENTRY_BYTES) return false;
+
+    constexpr quint32 BLOCK_ENTRIES = 16;
+    entries.clear();
+    entries.reserve(stopAt ? BLOCK_ENTRIES : count);
+
+    quint64 pos = indexOffset + CHUNK_HEADER_BYTES + sizeof(quint32);
+    while (count > 0) {
+        quint32 n = stopAt ? std::min(count, BLOCK_ENTRIES) : count;
+        QByteArray block = source.read(pos, n * INDEX_ENTRY_BYTES);
+        if (block.isEmpty()) return false;
+        auto s = makeStream(block);
+        for (quint32 i = 0; i < n; ++i) {
+            IndexEntry e;
+            s->readRawData(e.tag, 4);
+            *s >> e.layerId >> e.tx >> e.ty >> e.codec >> e.offset >> e.size;
+            if (s->status() != QDataStream::Ok) return false;
+            if (e.offset > source.size() || e.size > source.size() - e.offset) return false;
+            if (stopAt && stopAt(e)) return true;
+            entries.push_back(e);
+        }
+        pos += n * INDEX_ENTRY_BYTES;
+        count -= n;
+    }
+    return true;
+}
+
+/// Slow path (truncated/damaged file): walk chunk headers from the start.
+static bool scanChunks(const CmcFileSource& source, std::vector<IndexEntry>& entries) {
+    entries.clear();
+    quint64 pos = 4;
+    while (pos + CHUNK_HEADER_BYTES <= source.size()) {
+        auto h = makeStream(source.read(pos, CHUNK_HEADER_BYTES));
+        IndexEntry e;
+        quint64 size = 0;
+        readTag(*h, e.tag);
+        *h >> size;
+        if (tagsEqual(e.tag, TAG_END)) break;
+
+        quint64 dataOffset = pos + CHUNK_HEADER_BYTES;
+        if (size > source.size() - dataOffset) break;  // Truncated chunk
+
+        if (tagsEqual(e.tag, TAG_TILE)) {
+            if (size < TILE_HEADER_BYTES) return false;
+            auto t = makeStream(source.read(dataOffset, TILE_HEADER_BYTES));
+            *t >> e.layerId >> e.tx >> e.ty >> e.codec;
+            e.offset = dataOffset + TILE_HEADER_BYTES;
+            e.size = size - TILE_HEADER_BYTES;
+        } else if (tagsEqual(e.tag, TAG_TREF)) {
+            // Reference to a payload written by an earlier TILE chunk
+            if (size < TREF_BYTES) return false;
+            auto t = makeStream(source.read(dataOffset, TREF_BYTES));
+            *t >> e.layerId >> e.tx >> e.ty >> e.codec >> e.offset >> e.size;
+            if (e.offset > source.size() || e.size > source.size() - e.offset) break;
+            std::memcpy(e.tag, TAG_TILE, 4);
+        } else {
+            e.offset = dataOffset;
+            e.size = size;
+        }
+        entries.push_back(e);
+        pos = dataOffset + size;
+    }
+    return !entries.empty();
+}
+
+std::unique_ptr<Document> CmcFormat::loadV2(const QString& path) {
+    auto source = std::make_shared<CmcFileSource>(path);
+    if (!source->open()) return nullptr;
+
+    std::vector<IndexEntry> entries;
+    if (!readIndex(*source, entries) && !scanChunks(*source, entries)) return nullptr;
+
+    HeaderInfo info;
+    std::vector<StrokeChunk> strokeChunks;
+    for (const auto& e : entries) {
+        if (tagsEqual(e.tag, TAG_CANV)) {
+            parseCanv(source->read(e.offset, e.size), info);
+        } else if (tagsEqual(e.tag, TAG_LYRS)) {
+            parseLyrs(source->read(e.offset, e.size), info);
+        } else if (tagsEqual(e.tag, TAG_PAGE)) {
+            parsePage(source->read(e.offset, e.size), info);
+        } else if (tagsEqual(e.tag, TAG_STRK)) {
+            StrokeChunk chunk;
+            if (parseStrokes(source->read(e.offset, e.size), chunk)) {
+                strokeChunks.push_back(std::move(chunk));
+            }
+        }
+        // Unknown chunks are silently skipped (forward compatibility)
+    }
+
+    if (!info.hasCanv) return nullptr;
+
+    // Layers with strokes are created as vector layers
+    for (const auto& chunk : strokeChunks) {
+        for (auto& page : info.pages) {
+            if (page.index != chunk.layerKey >> 32) continue;
+            for (auto& li : page.layers) {
+                if (li.id == (chunk.layerKey & 0xFFFFFFFFu)) li.vector = true;
+            }
+        }
+    }
+
+    std::unordered_map<quint32, LayerStack*> stacks;
+    auto doc = createDocument(info, stacks);
+
+    for (auto& chunk : strokeChunks) {
+        Layer* layer = layerForKey(stacks, chunk.layerKey);
+        if (layer && layer->type() == LayerType::Vector) {
+            static_cast<VectorLayer*>(layer)->setStrokes(std::move(chunk.strokes));
+        }
+    }
+
+    // Register tiles lazily; entries are grouped by layer
+    Layer* layer = nullptr;
+    quint64 layerKey = 0;
+    for (const auto& e : entries) {
+        if (!tagsEqual(e.tag, TAG_TILE)) continue;
+        if (!layer || layerKey != e.layerId) {
+            layer = layerForKey(stacks, e.layerId);
+            layerKey = e.layerId;
+            if (!layer) continue;
+        }
+
+        TileRef ref{e.offset, e.size, static_cast<TileCodec>(e.codec)};
+        layer->tiles().addLazyTile({e.tx, e.ty}, source, ref);
     }
 
     doc->setDirty(false);
     return doc;
 }
 
+// --- Previews ---
+
+/// THMB/PRVW index entries of a v2 file; they precede all tile entries.
+static std::vector<IndexEntry> readPreviewEntries(const CmcFileSource& source,
+                                                  const char magic[3], quint8 version) {
+    QByteArray head = source.read(0, 4);
+    if (head.size() != 4 || std::memcmp(head.constData(), magic, 3) != 0 ||
+        static_cast<quint8>(head[3]) != version)
+        return {};
+
+    std::vector<IndexEntry> entries;
+    auto isTile = [](const IndexEntry& e) { return tagsEqual(e.tag, TAG_TILE); };
+    if (!readIndex(source, entries, isTile)) return {};
+
+    std::vector<IndexEntry> previews;
+    for (const auto& e : entries) {
+        if (tagsEqual(e.tag, TAG_THMB) || tagsEqual(e.tag, TAG_PRVW)) previews.push_back(e);
+    }
+    return previews;
+}
+
+static QImage readImage(const CmcFileSource& source, const IndexEntry& entry) {
+    QImage image;
+    image.loadFromData(source.read(entry.offset, entry.size), "PNG");
+    return image;
+}
+
+QImage CmcFormat::loadThumbnail(const QString& path) {
+    CmcFileSource source(path);
+    if (!source.open(false)) return {};
+
+    for (const auto& e : readPreviewEntries(source, MAGIC, VERSION)) {
+        if (tagsEqual(e.tag, TAG_THMB)) return readImage(source, e);
+    }
+    return {};
+}
+
+QImage CmcFormat::loadPreview(const QString& path, const QSize& minSize) {
+    CmcFileSource source(path);
+    if (!source.open(false)) return {};
+
+    // Levels are sorted largest first: the last one that still covers
+    // minSize is the cheapest to decode.
+    const auto entries = readPreviewEntries(source, MAGIC, VERSION);
+    const IndexEntry* best = nullptr;
+    for (const auto& e : entries) {
+        if (!tagsEqual(e.tag, TAG_PRVW)) continue;
+        bool covers = e.tx >= minSize.width() && e.ty >= minSize.height();
+        if (!best || covers) best = &e;
+    }
+    return best ? readImage(source, *best) : QImage();
+}
+
 }  // namespace comicos
@@ -1,21 +1,152 @@
 #include "core/Document.h"
 #include "core/CmcFormat.h"
+#include <algorithm>
+#include <cstdlib>
 
 namespace comicos {
 
-Document::Document() {
-    // Create default layer
-    m_layers.addLayer(QStringLiteral("레이어 1"));
+static const QSize DEFAULT_CANVAS_SIZE(2480, 3508);  // A4 at 300dpi
+
+Document::Document() : Document(DEFAULT_CANVAS_SIZE) {}
+
+Document::Document(const QSize& canvasSize) {
+    m_residencyPool.setMaxThreadCount(1);
+    insertPage(0, canvasSize);
+}
+
+Document::~Document() {
+    // Skip queued jobs, wait for the running one
+    ++m_residencyGeneration;
+    m_residencyPool.waitForDone();
+}
+
+// --- Pages ---
+
+void Document::setActivePage(int index) {
+    if (index < 0 || index >= pageCount() || index == m_activePage) return;
+
+    {
+        Page& previous = activePage();
+        std::lock_guard<std::mutex> lock(previous.m_residencyMutex);
+        previous.m_active = false;
+    }
+    {
+        // Waits if a job is loading or evicting this page right now
+        Page& next = *m_pages[index];
+        std::lock_guard<std::mutex> lock(next.m_residencyMutex);
+        next.m_active = true;
+    }
+    m_activePage = index;
+    scheduleResidency();
 }
 
-Document::Document(const QSize& canvasSize) : m_canvasSize(canvasSize) {
-    m_layers.addLayer(QStringLiteral("레이어 1"));
+Page& Document::insertPage(int index, const QSize& canvasSize) {
+    auto page = std::make_unique<Page>(canvasSize);
+    page->layers().addLayer(QStringLiteral("레이어 1"));
+    return insertPage(index, std::move(page));
+}
+
+Page& Document::insertPage(int index, std::unique_ptr<Page> page) {
+    waitForResidency();
+    index = std::clamp(index, 0, pageCount());
+
+    Page& inserted = *page;
+    m_pages.insert(m_pages.begin() + index, std::move(page));
+    if (pageCount() == 1) {
+        inserted.m_active = true;
+    } else if (index <= m_activePage) {
+        ++m_activePage;
+    }
+    return inserted;
+}
+
+void Document::removePage(int index) {
+    if (index < 0 || index >= pageCount() || pageCount() == 1) return;
+    waitForResidency();
+
+    const bool wasActive = index == m_activePage;
+    m_pages.erase(m_pages.begin() + index);
+    if (index < m_activePage) {
+        --m_activePage;
+    } else if (wasActive) {
+        m_activePage = std::min(index, pageCount() - 1);
+        m_pages[m_activePage]->m_active = true;
+        scheduleResidency();
+    }
+}
+
+void Document::movePage(int from, int to) {
+    if (from < 0 || from >= pageCount() || to < 0 || to >= pageCount() || from == to) return;
+    waitForResidency();
+
+    const Page* active = m_pages[m_activePage].get();
+    auto page = std::move(m_pages[from]);
+    m_pages.erase(m_pages.begin() + from);
+    m_pages.insert(m_pages.begin() + to, std::move(page));
+    for (int i = 0; i < pageCount(); ++i) {
+        if (m_pages[i].get() == active) m_activePage = i;
+    }
+}
+
+void Document::waitForResidency() const {
+    m_residencyPool.waitForDone();
+}
+
+void Document::scheduleResidency() {
+    const int generation = ++m_residencyGeneration;
+
+    auto schedule = [&](Page* page, bool resident) {
+        m_residencyPool.start([this, page, resident, generation]() {
+            if (m_residencyGeneration.load() != generation) return;  // Superseded
+
+            std::lock_guard<std::mutex> lock(page->m_residencyMutex);
+            if (page->m_active) return;
+            if (resident) {
+                page->makeResident();
+            } else {
+                page->evict();
+            }
+        });
+    };
+
+    // Neighbours first: they are the next pages the user turns to
+    for (int i = 0; i < pageCount(); ++i) {
+        if (i != m_activePage && std::abs(i - m_activePage) <= RESIDENT_NEIGHBORS)
+            schedule(m_pages[i].get(), true);
+    }
+    for (int i = 0; i < pageCount(); ++i) {
+        if (std::abs(i - m_activePage) > RESIDENT_NEIGHBORS)
+            schedule(m_pages[i].get(), false);
+    }
+}
+
+// --- Snapshot ---
+
+std::unique_ptr<Document> Document::snapshot() const {
+    // Pages other than the active one must not be read while a job works on them
+    waitForResidency();
+
+    auto copy = std::make_unique<Document>();
+    copy->m_dpi = m_dpi;
+    copy->m_filePath = m_filePath;
+    copy->m_dirty = m_dirty;
+
+    // Replace the default page created by the constructor
+    copy->m_pages.clear();
+    for (const auto& page : m_pages) {
+        copy->m_pages.push_back(page->snapshot());
+    }
+    copy->m_activePage = m_activePage;
+    copy->m_pages[m_activePage]->m_active = true;
+    return copy;
 }
 
-Document::~Document() = default;
+// --- Serialization ---
 
-bool Document::save(const QString& path) {
-    if (!CmcFormat::save(*this, path))
+bool Document::save(const QString& path, const TileEncoding& encoding,
+                    const DocumentPreview& preview) {
+    waitForResidency();
+    if (!CmcFormat::save(*this, path, encoding, preview))
         return false;
     m_filePath = path;
     m_dirty = false;
@@ -24,8 +155,10 @@ bool Document::save(const QString& path) {
 
 std::unique_ptr<Document> Document::load(const QString& path) {
     auto doc = CmcFormat::load(path);
-    if (doc)
+    if (doc) {
         doc->setFilePath(path);
+        doc->scheduleResidency();  // Prefetch the first page's neighbours
+    }
     return doc;
 }
 
@@ -12,20 +12,36 @@ void Layer::clear() {
 }
 
 std::unique_ptr<Layer> Layer::clone(LayerId newId) const {
-    auto copy = std::make_unique<Layer>(newId, m_name + " (복사)");
-    copy->m_opacity = m_opacity;
-    copy->m_visible = m_visible;
-    copy->m_locked = m_locked;
-    copy->m_blendMode = m_blendMode;
-
-    // Deep copy tile data
-    for (auto* tile : m_tiles.allTiles()) {
+    auto copy = snapshot();
+    copy->m_id = newId;
+    copy->m_name = m_name + " (복사)";
+    return copy;
+}
+
+std::unique_ptr<Layer> Layer::snapshot() const {
+    auto copy = std::make_unique<Layer>(m_id, m_name);
+    copyTo(*copy);
+    return copy;
+}
+
+void Layer::copyTo(Layer& copy) const {
+    copy.m_opacity = m_opacity;
+    copy.m_visible = m_visible;
+    copy.m_locked = m_locked;
+    copy.m_blendMode = m_blendMode;
+
+    // Tile copies share pixel buffers until either side writes
+    for (auto* tile : m_tiles.residentTiles()) {
         if (!tile->isEmpty()) {
-            auto* newTile = copy->m_tiles.getOrCreateTile(tile->coord());
+            auto* newTile = copy.m_tiles.getOrCreateTile(tile->coord());
             *newTile = *tile;
         }
     }
-    return copy;
+
+    // Lazy tiles are immutable in their source; share them instead of decoding
+    for (auto& [coord, lazy] : m_tiles.lazyTiles()) {
+        copy.m_tiles.addLazyTile(coord, lazy.source, lazy.ref);
+    }
 }
 
 }  // namespace comicos
@@ -1,4 +1,5 @@
 #include "core/LayerStack.h"
+#include "core/VectorLayer.h"
 #include <algorithm>
 
 namespace comicos {
@@ -6,9 +7,14 @@ namespace comicos {
 LayerStack::LayerStack() = default;
 LayerStack::~LayerStack() = default;
 
-Layer* LayerStack::addLayer(const QString& name) {
+Layer* LayerStack::addLayer(const QString& name, LayerType type) {
     auto id = nextId();
-    auto layer = std::make_unique<Layer>(id, name);
+    std::unique_ptr<Layer> layer;
+    if (type == LayerType::Vector) {
+        layer = std::make_unique<VectorLayer>(id, name);
+    } else {
+        layer = std::make_unique<Layer>(id, name);
+    }
     auto* ptr = layer.get();
     m_layers.push_back(std::move(layer));
     m_activeLayerId = id;
@@ -0,0 +1,91 @@
+#include "core/Page.h"
+#include "core/Tile.h"
+#include "core/TileManager.h"
+#include "core/TileSource.h"
+#include "core/VectorLayer.h"
+#include <QByteArray>
+#include <vector>
+
+namespace comicos {
+
+Page::Page(const QSize& canvasSize) : m_canvasSize(canvasSize) {}
+
+Page::~Page() = default;
+
+size_t Page::residentTileCount() const {
+    size_t count = 0;
+    for (const auto& layer : m_layers.layers()) count += layer->tiles().residentTileCount();
+    return count;
+}
+
+size_t Page::lazyTileCount() const {
+    size_t count = 0;
+    for (const auto& layer : m_layers.layers()) count += layer->tiles().lazyTiles().size();
+    return count;
+}
+
+void Page::makeResident() {
+    // Vector layers draw their tiles when they are shown, not ahead
+    for (const auto& layer : m_layers.layers()) {
+        if (layer->type() == LayerType::Raster) layer->tiles().materializeAll();
+    }
+}
+
+void Page::evict(const TileEncoding& encoding) {
+    struct Evicted {
+        TileManager* tiles;
+        TileCoord coord;
+        std::shared_ptr<const TileSource> source;  // Null: the new in-memory source
+        TileRef ref;
+    };
+    std::vector<Evicted> evicted;
+    std::vector<std::pair<TileManager*, TileCoord>> empty;
+    QByteArray data;
+
+    for (const auto& layer : m_layers.layers()) {
+        // Their strokes redraw them: no need to encode
+        if (layer->type() == LayerType::Vector) {
+            static_cast<const VectorLayer&>(*layer).evictRaster();
+            continue;
+        }
+        TileManager& tiles = layer->tiles();
+        for (const Tile* tile : tiles.residentTiles()) {
+            if (tile->isEmpty()) {
+                empty.emplace_back(&tiles, tile->coord());
+                continue;
+            }
+            // Unchanged since decoding: its payload is still there
+            if (tile->origin()) {
+                evicted.push_back({&tiles, tile->coord(), tile->origin(), tile->originRef()});
+                continue;
+            }
+            const QByteArray payload = TileCodecs::encode(tile->constData(), encoding);
+            evicted.push_back({&tiles, tile->coord(), nullptr,
+                               {static_cast<quint64>(data.size()),
+                                static_cast<quint64>(payload.size()), encoding.codec}});
+            data.append(payload);
+        }
+    }
+    if (evicted.empty() && empty.empty()) return;
+
+    // Registering a lazy tile drops the decoded one
+    std::shared_ptr<const TileSource> memory;
+    if (!data.isEmpty()) memory = std::make_shared<const MemoryTileSource>(std::move(data));
+    for (const auto& e : evicted) {
+        e.tiles->addLazyTile(e.coord, e.source ? e.source : memory, e.ref);
+    }
+    for (const auto& [tiles, coord] : empty) tiles->removeTile(coord);
+}
+
+std::unique_ptr<Page> Page::snapshot() const {
+    auto copy = std::make_unique<Page>(m_canvasSize);
+    auto& stack = copy->m_layers;
+    for (const auto& layer : m_layers.layers()) {
+        stack.insertLayer(stack.count(), layer->snapshot());
+    }
+    stack.setActiveLayerId(m_layers.activeLayerId());
+    stack.setNextId(m_layers.peekNextId());
+    return copy;
+}
+
+}  // namespace comicos
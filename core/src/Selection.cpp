@@ -0,0 +1,281 @@
+#include "core/Selection.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COMICOS_SELECTION_SSE2
+#endif
+
+namespace comicos {
+
+// --- Mask Kernels ---
+// SSE2 is part of x86-64, so no runtime dispatch is needed. Other targets
+// use the scalar loops, which compilers vectorize on their own.
+
+namespace {
+
+enum class Kernel { Max, Min, MinInverse, Inverse };
+
+/// dst[i] = a[i] op b[i]; dst may be a (Inverse ignores a).
+template <Kernel K>
+void combineBytes(uint8_t* dst, const uint8_t* a, const uint8_t* b, int count) {
+    int i = 0;
+#ifdef COMICOS_SELECTION_SSE2
+    const __m128i ones = _mm_set1_epi8(static_cast<char>(0xFF));
+    for (; i + 16 <= count; i += 16) {
+        const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i out;
+        if constexpr (K == Kernel::Inverse) {
+            out = _mm_xor_si128(y, ones);
+        } else {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            if constexpr (K == Kernel::Max) {
+                out = _mm_max_epu8(x, y);
+            } else if constexpr (K == Kernel::Min) {
+                out = _mm_min_epu8(x, y);
+            } else {
+                out = _mm_min_epu8(x, _mm_xor_si128(y, ones));
+            }
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), out);
+    }
+#endif
+    for (; i < count; ++i) {
+        if constexpr (K == Kernel::Max) {
+            dst[i] = std::max(a[i], b[i]);
+        } else if constexpr (K == Kernel::Min) {
+            dst[i] = std::min(a[i], b[i]);
+        } else if constexpr (K == Kernel::MinInverse) {
+            dst[i] = std::min<uint8_t>(a[i], 255 - b[i]);
+        } else {
+            dst[i] = 255 - b[i];
+        }
+    }
+}
+
+/// True if all `count` bytes equal `value`.
+bool allBytes(const uint8_t* p, int count, uint8_t value) {
+    int i = 0;
+#ifdef COMICOS_SELECTION_SSE2
+    const __m128i v = _mm_set1_epi8(static_cast<char>(value));
+    for (; i + 16 <= count; i += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, v)) != 0xFFFF) return false;
+    }
+#endif
+    for (; i < count; ++i) {
+        if (p[i] != value) return false;
+    }
+    return true;
+}
+
+/// ours = ours op theirs for a Partial tile: in place unless the buffer is
+/// shared, then straight into a new one, which saves copying it first.
+template <Kernel K>
+void combineTile(std::shared_ptr<uint8_t[]>& ours, const uint8_t* theirs) {
+    auto out = ours.use_count() > 1 ? std::shared_ptr<uint8_t[]>(new uint8_t[TILE_PIXELS]) : ours;
+    combineBytes<K>(out.get(), ours.get(), theirs, TILE_PIXELS);
+    ours = std::move(out);
+}
+
+std::shared_ptr<uint8_t[]> newMask(uint8_t fill) {
+    auto buffer = std::shared_ptr<uint8_t[]>(new uint8_t[TILE_PIXELS]);
+    std::memset(buffer.get(), fill, TILE_PIXELS);
+    return buffer;
+}
+
+}  // namespace
+
+// --- Selection ---
+
+Selection::Selection() = default;
+Selection::~Selection() = default;
+
+Selection::Selection(const Selection& other) = default;
+Selection& Selection::operator=(const Selection& other) = default;
+Selection::Selection(Selection&& other) noexcept = default;
+Selection& Selection::operator=(Selection&& other) noexcept = default;
+
+Selection Selection::fromRect(const QRect& rect) {
+    Selection s;
+    if (rect.isEmpty()) return s;
+
+    const TileCoord first = pixelToTile(rect.left(), rect.top());
+    const TileCoord last = pixelToTile(rect.right(), rect.bottom());
+    for (int ty = first.ty; ty <= last.ty; ++ty) {
+        for (int tx = first.tx; tx <= last.tx; ++tx) {
+            const QRect tileRect(tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+            const QRect part = tileRect.intersected(rect);
+            if (part == tileRect) {
+                s.m_tiles[{tx, ty}] = nullptr;
+                continue;
+            }
+            Buffer mask = newMask(0);
+            for (int y = part.top(); y <= part.bottom(); ++y) {
+                std::memset(mask.get() + (y - tileRect.top()) * TILE_SIZE
+                                + (part.left() - tileRect.left()),
+                            255, part.width());
+            }
+            s.m_tiles[{tx, ty}] = std::move(mask);
+        }
+    }
+    return s;
+}
+
+void Selection::selectAll(const QSize& canvasSize) {
+    m_tiles.clear();
+    const int cols = (std::max(canvasSize.width(), 0) + TILE_SIZE - 1) / TILE_SIZE;
+    const int rows = (std::max(canvasSize.height(), 0) + TILE_SIZE - 1) / TILE_SIZE;
+    for (int ty = 0; ty < rows; ++ty) {
+        for (int tx = 0; tx < cols; ++tx) m_tiles[{tx, ty}] = nullptr;
+    }
+}
+
+void Selection::invert(const QSize& canvasSize) {
+    Selection all;
+    all.selectAll(canvasSize);
+    all.subtract(*this);
+    *this = std::move(all);
+}
+
+// --- Access ---
+
+Selection::TileState Selection::stateAt(const TileCoord& coord) const {
+    auto it = m_tiles.find(coord);
+    if (it == m_tiles.end()) return TileState::None;
+    return it->second ? TileState::Partial : TileState::Full;
+}
+
+const uint8_t* Selection::maskAt(const TileCoord& coord) const {
+    auto it = m_tiles.find(coord);
+    return it != m_tiles.end() ? it->second.get() : nullptr;
+}
+
+uint8_t Selection::valueAt(int x, int y) const {
+    const TileCoord tc = pixelToTile(x, y);
+    auto it = m_tiles.find(tc);
+    if (it == m_tiles.end()) return 0;
+    if (!it->second) return 255;
+    return it->second[(y - tc.ty * TILE_SIZE) * TILE_SIZE + (x - tc.tx * TILE_SIZE)];
+}
+
+QRect Selection::bounds() const {
+    QRect result;
+    for (const auto& [tc, buffer] : m_tiles) {
+        const QRect tileRect(tc.tx * TILE_SIZE, tc.ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+        if (!buffer) {
+            result = result.united(tileRect);
+            continue;
+        }
+        int x0 = TILE_SIZE, x1 = -1, y0 = TILE_SIZE, y1 = -1;
+        for (int y = 0; y < TILE_SIZE; ++y) {
+            const uint8_t* row = buffer.get() + y * TILE_SIZE;
+            int first = 0;
+            while (first < TILE_SIZE && !row[first]) ++first;
+            if (first == TILE_SIZE) continue;
+            int last = TILE_SIZE - 1;
+            while (!row[last]) --last;
+            x0 = std::min(x0, first);
+            x1 = std::max(x1, last);
+            y0 = std::min(y0, y);
+            y1 = y;
+        }
+        result = result.united(QRect(tileRect.left() + x0, tileRect.top() + y0,
+                                     x1 - x0 + 1, y1 - y0 + 1));
+    }
+    return result;
+}
+
+size_t Selection::partialTileCount() const {
+    return static_cast<size_t>(std::count_if(m_tiles.begin(), m_tiles.end(),
+                                             [](const auto& entry) { return entry.second; }));
+}
+
+// --- Operations ---
+
+void Selection::clip(uint8_t* coverage, const uint8_t* mask, int count) {
+    combineBytes<Kernel::Min>(coverage, coverage, mask, count);
+}
+
+bool Selection::settle(Buffer& buffer) {
+    if (allBytes(buffer.get(), TILE_PIXELS, 0)) return false;
+    if (allBytes(buffer.get(), TILE_PIXELS, 255)) buffer.reset();
+    return true;
+}
+
+void Selection::combine(const Selection& other, SelectionOp op) {
+    if (&other == this) {
+        const Selection copy = other;
+        combine(copy, op);
+        return;
+    }
+    switch (op) {
+    case SelectionOp::Replace:
+        *this = other;
+        break;
+    case SelectionOp::Add:
+        unite(other);
+        break;
+    case SelectionOp::Subtract:
+        subtract(other);
+        break;
+    case SelectionOp::Intersect:
+        intersect(other);
+        break;
+    }
+}
+
+void Selection::unite(const Selection& other) {
+    for (const auto& [tc, theirs] : other.m_tiles) {
+        auto [it, inserted] = m_tiles.try_emplace(tc, theirs);
+        if (inserted || !it->second) continue;  // New tile, or already Full
+        if (!theirs) {
+            it->second.reset();  // Anything with Full is Full
+            continue;
+        }
+        combineTile<Kernel::Max>(it->second, theirs.get());
+        settle(it->second);
+    }
+}
+
+void Selection::subtract(const Selection& other) {
+    for (const auto& [tc, theirs] : other.m_tiles) {
+        auto it = m_tiles.find(tc);
+        if (it == m_tiles.end()) continue;
+        if (!theirs) {
+            m_tiles.erase(it);
+            continue;
+        }
+        if (!it->second) {
+            it->second = Buffer(new uint8_t[TILE_PIXELS]);
+            combineTile<Kernel::Inverse>(it->second, theirs.get());
+        } else {
+            combineTile<Kernel::MinInverse>(it->second, theirs.get());
+        }
+        if (!settle(it->second)) m_tiles.erase(it);
+    }
+}
+
+void Selection::intersect(const Selection& other) {
+    for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+        auto theirs = other.m_tiles.find(it->first);
+        if (theirs == other.m_tiles.end()) {
+            it = m_tiles.erase(it);
+            continue;
+        }
+        if (!theirs->second) {
+            ++it;  // Full keeps ours as is
+            continue;
+        }
+        if (!it->second) {
+            it->second = theirs->second;
+            ++it;
+            continue;
+        }
+        combineTile<Kernel::Min>(it->second, theirs->second.get());
+        it = settle(it->second) ? std::next(it) : m_tiles.erase(it);
+    }
+}
+
+}  // namespace comicos
@@ -1,6 +1,8 @@
 #include "core/Tile.h"
+#include "core/TileStore.h"
 #include <algorithm>
 #include <cstring>
+#include <utility>
 
 namespace comicos {
 
@@ -10,43 +12,40 @@ Tile::Tile(const TileCoord& coord) : m_coord(coord) {}
 
 Tile::~Tile() = default;
 
-Tile::Tile(const Tile& other)
-    : m_coord(other.m_coord), m_dirty(other.m_dirty) {
-    if (other.m_data) {
-        m_data = std::make_unique<uint8_t[]>(TILE_BYTES);
-        std::memcpy(m_data.get(), other.m_data.get(), TILE_BYTES);
-    }
-}
-
-Tile& Tile::operator=(const Tile& other) {
-    if (this != &other) {
-        m_coord = other.m_coord;
-        m_dirty = other.m_dirty;
-        if (other.m_data) {
-            if (!m_data) m_data = std::make_unique<uint8_t[]>(TILE_BYTES);
-            std::memcpy(m_data.get(), other.m_data.get(), TILE_BYTES);
-        } else {
-            m_data.reset();
-        }
-    }
-    return *this;
-}
+Tile::Tile(const Tile& other) = default;
+Tile& Tile::operator=(const Tile& other) = default;
 
 Tile::Tile(Tile&& other) noexcept = default;
 Tile& Tile::operator=(Tile&& other) noexcept = default;
 
 void Tile::ensureAllocated() {
     if (!m_data) {
-        m_data = std::make_unique<uint8_t[]>(TILE_BYTES);
+        m_data = std::shared_ptr<uint8_t[]>(new uint8_t[TILE_BYTES]);
         std::memset(m_data.get(), 0, TILE_BYTES);
+        ++m_generation;
+        m_origin.reset();
     }
 }
 
+bool Tile::isShared() const {
+    return m_data && (m_data.use_count() > 1 || TileStore::isPooled(m_data));
+}
+
+void Tile::detach() {
+    if (!isShared()) return;
+    auto copy = std::shared_ptr<uint8_t[]>(new uint8_t[TILE_BYTES]);
+    std::memcpy(copy.get(), m_data.get(), TILE_BYTES);
+    m_data = std::move(copy);
+}
+
 const uint8_t* Tile::constData() const {
     return m_data.get();
 }
 
 uint8_t* Tile::data() {
+    detach();
+    ++m_generation;
+    m_origin.reset();
     return m_data.get();
 }
 
@@ -61,6 +60,9 @@ Pixel Tile::pixelAt(int localX, int localY) const {
 void Tile::setPixelAt(int localX, int localY, const Pixel& pixel) {
     if (localX < 0 || localX >= TILE_SIZE || localY < 0 || localY >= TILE_SIZE) return;
     ensureAllocated();
+    detach();
+    ++m_generation;
+    m_origin.reset();
     int offset = (localY * TILE_SIZE + localX) * 4;
     m_data[offset] = pixel.r;
     m_data[offset + 1] = pixel.g;
@@ -71,16 +73,56 @@ void Tile::setPixelAt(int localX, int localY, const Pixel& pixel) {
 
 void Tile::clear() {
     if (m_data) {
-        std::memset(m_data.get(), 0, TILE_BYTES);
+        if (isShared()) {
+            m_data.reset();  // Cheaper than detaching just to overwrite
+            ensureAllocated();
+        } else {
+            std::memset(m_data.get(), 0, TILE_BYTES);
+        }
+        ++m_generation;
+        m_origin.reset();
         m_dirty = true;
     }
 }
 
+uint64_t Tile::contentHash() const {
+    if (!m_data) return 0;
+    if (m_hashGeneration != m_generation) {
+        m_hash = TileStore::hash(m_data.get());
+        m_hashGeneration = m_generation;
+    }
+    return m_hash;
+}
+
+void Tile::setOrigin(std::shared_ptr<const TileSource> source, const TileRef& ref) {
+    m_origin = std::move(source);
+    m_originRef = ref;
+}
+
+void Tile::intern() {
+    if (!m_data) return;
+    m_data = TileStore::instance().intern(m_data, contentHash());
+}
+
 std::unique_ptr<Tile> Tile::clone() const {
     auto copy = std::make_unique<Tile>(*this);
+    copy->setOrigin(nullptr, {});
     return copy;
 }
 
+void Tile::sharePixels(const Tile& other) {
+    if (&other == this) return;
+    m_data = other.m_data;
+    ++m_generation;
+    m_origin = other.m_origin;
+    m_originRef = other.m_originRef;
+    if (other.m_hashGeneration == other.m_generation) {
+        m_hash = other.m_hash;
+        m_hashGeneration = m_generation;
+    }
+    m_dirty = true;
+}
+
 QImage Tile::toImage() const {
     if (!m_data) {
         return QImage(TILE_SIZE, TILE_SIZE, QImage::Format_RGBA8888);
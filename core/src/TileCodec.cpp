@@ -0,0 +1,508 @@
+#include "core/TileCodec.h"
+#include "core/Types.h"
+#include <QElapsedTimer>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iterator>
+#include <memory>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMICOS_CODEC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace comicos {
+
+// --- Prediction Filters ---
+// Planes are TILE_SIZE rows of TILE_SIZE bytes; TILE_SIZE is a multiple of 16.
+
+/// Per-thread buffer for the filtered (planar) representation of one tile.
+static uint8_t* filterScratch() {
+    thread_local std::unique_ptr<uint8_t[]> scratch(new uint8_t[TILE_BYTES]);
+    return scratch.get();
+}
+
+/// RGBA interleaved -> four channel planes.
+static void planarize(const uint8_t* src, uint8_t* dst) {
+    uint8_t* r = dst;
+    uint8_t* g = dst + TILE_PIXELS;
+    uint8_t* b = dst + TILE_PIXELS * 2;
+    uint8_t* a = dst + TILE_PIXELS * 3;
+#ifdef COMICOS_CODEC_SSE2
+    // 16 pixels per iteration: a 4x16 byte transpose via unpack steps
+    for (int i = 0; i < TILE_PIXELS; i += 16) {
+        const auto* p = reinterpret_cast<const __m128i*>(src + i * 4);
+        __m128i v0 = _mm_loadu_si128(p);
+        __m128i v1 = _mm_loadu_si128(p + 1);
+        __m128i v2 = _mm_loadu_si128(p + 2);
+        __m128i v3 = _mm_loadu_si128(p + 3);
+
+        __m128i t0 = _mm_unpacklo_epi8(v0, v1);
+        __m128i t1 = _mm_unpackhi_epi8(v0, v1);
+        __m128i t2 = _mm_unpacklo_epi8(v2, v3);
+        __m128i t3 = _mm_unpackhi_epi8(v2, v3);
+
+        __m128i u0 = _mm_unpacklo_epi8(t0, t1);
+        __m128i u1 = _mm_unpackhi_epi8(t0, t1);
+        __m128i u2 = _mm_unpacklo_epi8(t2, t3);
+        __m128i u3 = _mm_unpackhi_epi8(t2, t3);
+
+        __m128i w0 = _mm_unpacklo_epi8(u0, u1);  // r0..r7  g0..g7
+        __m128i w1 = _mm_unpackhi_epi8(u0, u1);  // b0..b7  a0..a7
+        __m128i w2 = _mm_unpacklo_epi8(u2, u3);  // r8..r15 g8..g15
+        __m128i w3 = _mm_unpackhi_epi8(u2, u3);  // b8..b15 a8..a15
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(r + i), _mm_unpacklo_epi64(w0, w2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(g + i), _mm_unpackhi_epi64(w0, w2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(b + i), _mm_unpacklo_epi64(w1, w3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(a + i), _mm_unpackhi_epi64(w1, w3));
+    }
+#else
+    for (int i = 0; i < TILE_PIXELS; ++i) {
+        r[i] = src[i * 4];
+        g[i] = src[i * 4 + 1];
+        b[i] = src[i * 4 + 2];
+        a[i] = src[i * 4 + 3];
+    }
+#endif
+}
+
+/// Four channel planes -> RGBA interleaved.
+static void interleave(const uint8_t* src, uint8_t* dst) {
+    const uint8_t* r = src;
+    const uint8_t* g = src + TILE_PIXELS;
+    const uint8_t* b = src + TILE_PIXELS * 2;
+    const uint8_t* a = src + TILE_PIXELS * 3;
+#ifdef COMICOS_CODEC_SSE2
+    for (int i = 0; i < TILE_PIXELS; i += 16) {
+        __m128i vr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i));
+        __m128i vg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+
+        __m128i rgLo = _mm_unpacklo_epi8(vr, vg);
+        __m128i rgHi = _mm_unpackhi_epi8(vr, vg);
+        __m128i baLo = _mm_unpacklo_epi8(vb, va);
+        __m128i baHi = _mm_unpackhi_epi8(vb, va);
+
+        auto* p = reinterpret_cast<__m128i*>(dst + i * 4);
+        _mm_storeu_si128(p, _mm_unpacklo_epi16(rgLo, baLo));
+        _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(rgLo, baLo));
+        _mm_storeu_si128(p + 2, _mm_unpacklo_epi16(rgHi, baHi));
+        _mm_storeu_si128(p + 3, _mm_unpackhi_epi16(rgHi, baHi));
+    }
+#else
+    for (int i = 0; i < TILE_PIXELS; ++i) {
+        dst[i * 4] = r[i];
+        dst[i * 4 + 1] = g[i];
+        dst[i * 4 + 2] = b[i];
+        dst[i * 4 + 3] = a[i];
+    }
+#endif
+}
+
+/// In place: row[x] -= row[x - 1] (right to left, so inputs stay unfiltered).
+static void subEncodeRow(uint8_t* row) {
+    int x = TILE_SIZE - 1;
+#ifdef COMICOS_CODEC_SSE2
+    for (; x >= 16; x -= 16) {
+        auto* cur = reinterpret_cast<__m128i*>(row + x - 15);
+        auto* left = reinterpret_cast<const __m128i*>(row + x - 16);
+        _mm_storeu_si128(cur, _mm_sub_epi8(_mm_loadu_si128(cur), _mm_loadu_si128(left)));
+    }
+#endif
+    // Remaining leading bytes (all of them without SSE2)
+    for (; x >= 1; --x) {
+        row[x] = static_cast<uint8_t>(row[x] - row[x - 1]);
+    }
+}
+
+/// In place prefix sum: inverse of subEncodeRow.
+static void subDecodeRow(uint8_t* row) {
+#ifdef COMICOS_CODEC_SSE2
+    // Log-step prefix sum inside each vector, then add the carried last byte
+    uint8_t carry = 0;
+    for (int x = 0; x < TILE_SIZE; x += 16) {
+        auto* p = reinterpret_cast<__m128i*>(row + x);
+        __m128i v = _mm_loadu_si128(p);
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(carry)));
+        _mm_storeu_si128(p, v);
+        carry = row[x + 15];
+    }
+#else
+    for (int x = 1; x < TILE_SIZE; ++x) {
+        row[x] = static_cast<uint8_t>(row[x] + row[x - 1]);
+    }
+#endif
+}
+
+/// In place: row -= above.
+static void upEncodeRow(uint8_t* row, const uint8_t* above) {
+#ifdef COMICOS_CODEC_SSE2
+    for (int x = 0; x < TILE_SIZE; x += 16) {
+        auto* p = reinterpret_cast<__m128i*>(row + x);
+        __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x));
+        _mm_storeu_si128(p, _mm_sub_epi8(_mm_loadu_si128(p), up));
+    }
+#else
+    for (int x = 0; x < TILE_SIZE; ++x) {
+        row[x] = static_cast<uint8_t>(row[x] - above[x]);
+    }
+#endif
+}
+
+/// In place: row += above.
+static void upDecodeRow(uint8_t* row, const uint8_t* above) {
+#ifdef COMICOS_CODEC_SSE2
+    for (int x = 0; x < TILE_SIZE; x += 16) {
+        auto* p = reinterpret_cast<__m128i*>(row + x);
+        __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x));
+        _mm_storeu_si128(p, _mm_add_epi8(_mm_loadu_si128(p), up));
+    }
+#else
+    for (int x = 0; x < TILE_SIZE; ++x) {
+        row[x] = static_cast<uint8_t>(row[x] + above[x]);
+    }
+#endif
+}
+
+static void applyFilter(const uint8_t* pixels, uint8_t* out, TileFilter filter) {
+    planarize(pixels, out);
+    const int rows = TILE_SIZE * 4;  // four planes stacked vertically
+
+    if (filter == TileFilter::PlanarSub) {
+        for (int y = 0; y < rows; ++y) subEncodeRow(out + y * TILE_SIZE);
+    } else if (filter == TileFilter::PlanarUp) {
+        // Bottom-up so each row still sees its unfiltered neighbour;
+        // the first row of every plane is kept as-is.
+        for (int y = rows - 1; y > 0; --y) {
+            if (y % TILE_SIZE == 0) continue;
+            upEncodeRow(out + y * TILE_SIZE, out + (y - 1) * TILE_SIZE);
+        }
+    }
+}
+
+static void removeFilter(uint8_t* filtered, uint8_t* pixels, TileFilter filter) {
+    const int rows = TILE_SIZE * 4;
+
+    if (filter == TileFilter::PlanarSub) {
+        for (int y = 0; y < rows; ++y) subDecodeRow(filtered + y * TILE_SIZE);
+    } else if (filter == TileFilter::PlanarUp) {
+        for (int y = 1; y < rows; ++y) {
+            if (y % TILE_SIZE == 0) continue;
+            upDecodeRow(filtered + y * TILE_SIZE, filtered + (y - 1) * TILE_SIZE);
+        }
+    }
+    interleave(filtered, pixels);
+}
+
+// --- LZ Codec ---
+// LZ4-style block: sequences of [token][literal len ext][literals]
+// [offset: u16 LE][match len ext]. Token high nibble = literal length,
+// low nibble = match length - 4; 15 means "extended by following bytes,
+// each 255 continues". The final sequence has literals only.
+
+constexpr size_t LZ_MIN_MATCH = 4;
+constexpr int LZ_HASH_BITS = 14;
+constexpr size_t LZ_MAX_OFFSET = 65535;
+
+static inline uint32_t lzRead32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lzHash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static inline uint8_t* lzWriteLength(uint8_t* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = static_cast<uint8_t>(len);
+    return op;
+}
+
+static inline bool lzReadLength(const uint8_t*& ip, const uint8_t* iend, size_t& len) {
+    uint8_t b;
+    do {
+        if (ip >= iend) return false;
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+static uint8_t* lzEmit(uint8_t* op, const uint8_t* literals, size_t litLen,
+                       size_t offset, size_t matchLen) {
+    uint8_t* token = op++;
+    size_t ml = matchLen ? matchLen - LZ_MIN_MATCH : 0;
+    *token = static_cast<uint8_t>((std::min<size_t>(litLen, 15) << 4) |
+                                  std::min<size_t>(ml, 15));
+    if (litLen >= 15) op = lzWriteLength(op, litLen - 15);
+    std::memcpy(op, literals, litLen);
+    op += litLen;
+
+    if (matchLen) {
+        *op++ = static_cast<uint8_t>(offset & 0xFF);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+        if (ml >= 15) op = lzWriteLength(op, ml - 15);
+    }
+    return op;
+}
+
+static size_t lzMatchLength(const uint8_t* a, const uint8_t* b, const uint8_t* end) {
+    const uint8_t* start = b;
+    if constexpr (std::endian::native == std::endian::little) {
+        while (b + 8 <= end) {
+            uint64_t x, y;
+            std::memcpy(&x, a, 8);
+            std::memcpy(&y, b, 8);
+            if (x != y) return (b - start) + std::countr_zero(x ^ y) / 8;
+            a += 8;
+            b += 8;
+        }
+    }
+    while (b < end && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return b - start;
+}
+
+static QByteArray lzCompress(const uint8_t* src, size_t n) {
+    QByteArray out(static_cast<qsizetype>(n + n / 255 + 16), Qt::Uninitialized);
+    auto* op = reinterpret_cast<uint8_t*>(out.data());
+    auto* ostart = op;
+
+    auto table = std::make_unique<uint32_t[]>(size_t(1) << LZ_HASH_BITS);
+    std::fill_n(table.get(), size_t(1) << LZ_HASH_BITS, 0u);
+
+    size_t anchor = 0;
+    size_t i = 1;  // position 0 can never match (table is zero-initialized)
+    unsigned misses = 0;
+
+    while (n >= LZ_MIN_MATCH && i <= n - LZ_MIN_MATCH) {
+        uint32_t v = lzRead32(src + i);
+        uint32_t h = lzHash(v);
+        size_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(i);
+
+        if (candidate < i && i - candidate <= LZ_MAX_OFFSET &&
+            lzRead32(src + candidate) == v) {
+            size_t len = LZ_MIN_MATCH + lzMatchLength(src + candidate + LZ_MIN_MATCH,
+                                                     src + i + LZ_MIN_MATCH, src + n);
+            op = lzEmit(op, src + anchor, i - anchor, i - candidate, len);
+            i += len;
+            anchor = i;
+            misses = 0;
+        } else {
+            // Skip faster through incompressible data
+            i += 1 + (misses++ >> 5);
+        }
+    }
+
+    op = lzEmit(op, src + anchor, n - anchor, 0, 0);
+    out.resize(op - ostart);
+    return out;
+}
+
+static bool lzDecompress(const char* data, qsizetype size, uint8_t* dst, size_t n) {
+    const auto* ip = reinterpret_cast<const uint8_t*>(data);
+    const uint8_t* iend = ip + size;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + n;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+
+        size_t litLen = token >> 4;
+        if (litLen == 15 && !lzReadLength(ip, iend, litLen)) return false;
+        if (litLen > size_t(iend - ip) || litLen > size_t(oend - op)) return false;
+        std::memcpy(op, ip, litLen);
+        op += litLen;
+        ip += litLen;
+
+        if (ip == iend) break;  // Last sequence: literals only
+
+        if (iend - ip < 2) return false;
+        size_t offset = ip[0] | (size_t(ip[1]) << 8);
+        ip += 2;
+
+        size_t matchLen = token & 15;
+        if (matchLen == 15 && !lzReadLength(ip, iend, matchLen)) return false;
+        matchLen += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > size_t(op - dst) || matchLen > size_t(oend - op))
+            return false;
+
+        const uint8_t* match = op - offset;
+        if (offset == 1) {
+            std::memset(op, *match, matchLen);
+        } else if (offset >= matchLen) {
+            std::memcpy(op, match, matchLen);
+        } else {
+            for (size_t k = 0; k < matchLen; ++k) op[k] = match[k];
+        }
+        op += matchLen;
+    }
+    return op == oend;
+}
+
+// --- Zlib / Deflate ---
+
+static QByteArray zlibCompress(const uint8_t* src, size_t n) {
+    return qCompress(src, static_cast<qsizetype>(n));
+}
+
+static QByteArray deflateCompress(const uint8_t* src, size_t n) {
+    return qCompress(src, static_cast<qsizetype>(n), 9);
+}
+
+static bool zlibDecompress(const char* data, qsizetype size, uint8_t* dst, size_t n) {
+    QByteArray raw = qUncompress(reinterpret_cast<const uchar*>(data), size);
+    if (raw.size() != static_cast<qsizetype>(n)) return false;
+    std::memcpy(dst, raw.constData(), n);
+    return true;
+}
+
+// --- Codec Table ---
+
+namespace {
+
+struct CodecOps {
+    const char* name;
+    bool filtered;  // payload carries a TileFilter byte
+    QByteArray (*compress)(const uint8_t* src, size_t n);
+    bool (*decompress)(const char* data, qsizetype size, uint8_t* dst, size_t n);
+};
+
+}  // namespace
+
+/// Indexed by TileCodec.
+static const CodecOps* codecOps(TileCodec codec) {
+    static const CodecOps ops[] = {
+        {"zlib", false, zlibCompress, zlibDecompress},
+        {"lz", true, lzCompress, lzDecompress},
+        {"deflate", true, deflateCompress, zlibDecompress},
+    };
+    auto index = static_cast<size_t>(codec);
+    return index < std::size(ops) ? &ops[index] : nullptr;
+}
+
+// --- TileCodecs ---
+
+QByteArray TileCodecs::encode(const uint8_t* pixels, const TileEncoding& encoding) {
+    const CodecOps* ops = codecOps(encoding.codec);
+    if (!ops) return {};
+    if (!ops->filtered) return ops->compress(pixels, TILE_BYTES);
+
+    QByteArray body;
+    if (encoding.filter == TileFilter::None) {
+        body = ops->compress(pixels, TILE_BYTES);
+    } else {
+        uint8_t* filtered = filterScratch();
+        applyFilter(pixels, filtered, encoding.filter);
+        body = ops->compress(filtered, TILE_BYTES);
+    }
+
+    QByteArray payload;
+    payload.reserve(body.size() + 1);
+    payload.append(static_cast<char>(encoding.filter));
+    payload.append(body);
+    return payload;
+}
+
+bool TileCodecs::decode(TileCodec codec, const char* data, qsizetype size, uint8_t* out) {
+    const CodecOps* ops = codecOps(codec);
+    if (!ops || size <= 0) return false;  // Unknown codec (newer version) or empty
+    if (!ops->filtered) return ops->decompress(data, size, out, TILE_BYTES);
+
+    auto filter = static_cast<TileFilter>(data[0]);
+    if (filter > TileFilter::PlanarUp) return false;
+    if (filter == TileFilter::None) return ops->decompress(data + 1, size - 1, out, TILE_BYTES);
+
+    uint8_t* filtered = filterScratch();
+    if (!ops->decompress(data + 1, size - 1, filtered, TILE_BYTES)) return false;
+    removeFilter(filtered, out, filter);
+    return true;
+}
+
+QString TileCodecs::name(const TileEncoding& encoding) {
+    const CodecOps* ops = codecOps(encoding.codec);
+    if (!ops) return QStringLiteral("unknown");
+
+    QString result = QString::fromUtf8(ops->name);
+    if (!ops->filtered) return result;
+
+    switch (encoding.filter) {
+    case TileFilter::None:
+        break;
+    case TileFilter::Planar:
+        result += QStringLiteral("+planar");
+        break;
+    case TileFilter::PlanarSub:
+        result += QStringLiteral("+planar+sub");
+        break;
+    case TileFilter::PlanarUp:
+        result += QStringLiteral("+planar+up");
+        break;
+    }
+    return result;
+}
+
+std::vector<TileCodecBenchmark> TileCodecs::benchmark(const std::vector<const uint8_t*>& tiles) {
+    const TileEncoding encodings[] = {
+        {TileCodec::Zlib, TileFilter::None},
+        {TileCodec::Lz, TileFilter::None},
+        {TileCodec::Lz, TileFilter::Planar},
+        {TileCodec::Lz, TileFilter::PlanarSub},
+        {TileCodec::Lz, TileFilter::PlanarUp},
+        {TileCodec::Deflate, TileFilter::PlanarSub},
+        {TileCodec::Deflate, TileFilter::PlanarUp},
+    };
+
+    std::vector<TileCodecBenchmark> results;
+    if (tiles.empty()) return results;
+
+    const double rawBytes = static_cast<double>(tiles.size()) * TILE_BYTES;
+    auto decoded = std::make_unique<uint8_t[]>(TILE_BYTES);
+
+    for (const auto& encoding : encodings) {
+        std::vector<QByteArray> payloads;
+        payloads.reserve(tiles.size());
+
+        QElapsedTimer timer;
+        timer.start();
+        for (const uint8_t* tile : tiles) {
+            payloads.push_back(encode(tile, encoding));
+        }
+        const qint64 encodeNs = std::max<qint64>(timer.nsecsElapsed(), 1);
+
+        double encodedBytes = 0.0;
+        timer.restart();
+        for (const auto& payload : payloads) {
+            decode(encoding.codec, payload.constData(), payload.size(), decoded.get());
+            encodedBytes += payload.size();
+        }
+        const qint64 decodeNs = std::max<qint64>(timer.nsecsElapsed(), 1);
+
+        TileCodecBenchmark result;
+        result.encoding = encoding;
+        result.name = name(encoding);
+        result.ratio = encodedBytes > 0.0 ? rawBytes / encodedBytes : 0.0;
+        result.encodeMBps = rawBytes / 1e6 / (encodeNs / 1e9);
+        result.decodeMBps = rawBytes / 1e6 / (decodeNs / 1e9);
+        results.push_back(result);
+    }
+    return results;
+}
+
+}  // namespace comicos
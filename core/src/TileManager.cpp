@@ -1,6 +1,7 @@
 #include "core/TileManager.h"
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <limits>
 
 namespace comicos {
@@ -10,26 +11,134 @@ TileManager::~TileManager() = default;
 
 const Tile* TileManager::tileAt(const TileCoord& coord) const {
     auto it = m_tiles.find(coord);
-    return (it != m_tiles.end()) ? it->second.get() : nullptr;
+    if (it != m_tiles.end()) return it->second.get();
+    return m_lazy.empty() ? nullptr : materialize(coord);
 }
 
 Tile* TileManager::getOrCreateTile(const TileCoord& coord) {
+    auto it = m_tiles.find(coord);
+    if (it != m_tiles.end()) return it->second.get();
+
+    if (Tile* tile = materialize(coord)) return tile;
+
     auto& ptr = m_tiles[coord];
-    if (!ptr) {
-        ptr = std::make_unique<Tile>(coord);
-    }
+    ptr = std::make_unique<Tile>(coord);
     return ptr.get();
 }
 
 bool TileManager::hasTile(const TileCoord& coord) const {
+    return m_tiles.count(coord) > 0 || m_lazy.count(coord) > 0;
+}
+
+bool TileManager::isResident(const TileCoord& coord) const {
     return m_tiles.count(coord) > 0;
 }
 
 void TileManager::removeTile(const TileCoord& coord) {
     m_tiles.erase(coord);
+    m_lazy.erase(coord);
+}
+
+// --- Lazy Tiles ---
+
+void TileManager::addLazyTile(const TileCoord& coord,
+                              std::shared_ptr<const TileSource> source,
+                              const TileRef& ref) {
+    m_tiles.erase(coord);
+    m_lazy[coord] = {std::move(source), ref};
+}
+
+Tile* TileManager::materialize(const TileCoord& coord) const {
+    auto it = m_lazy.find(coord);
+    if (it == m_lazy.end()) return nullptr;
+
+    const LazyTile lazy = std::move(it->second);
+    m_lazy.erase(it);
+    auto tile = std::make_unique<Tile>(coord);
+    tile->ensureAllocated();
+    if (!lazy.source->decode(lazy.ref, tile->data())) {
+        return nullptr;  // Corrupt payload: treat as missing (like v1 load)
+    }
+
+    tile->intern();  // Files store duplicates once; keep them shared in memory
+    if (lazy.source->storesPayloads()) tile->setOrigin(lazy.source, lazy.ref);
+
+    auto* ptr = tile.get();
+    m_tiles[coord] = std::move(tile);
+    return ptr;
+}
+
+void TileManager::materializeAll() const {
+    while (!m_lazy.empty()) {
+        materialize(m_lazy.begin()->first);
+    }
+}
+
+void TileManager::evictTile(const TileCoord& coord, std::shared_ptr<const TileSource> source,
+                            const TileRef& ref) const {
+    if (m_tiles.erase(coord) == 0) return;
+    m_lazy[coord] = {std::move(source), ref};
+}
+
+void TileManager::relocateLazyTiles(const TileSource* from,
+                                    const std::shared_ptr<const TileSource>& to,
+                                    const std::unordered_map<quint64, TileRef>& refs) const {
+    for (auto& [coord, lazy] : m_lazy) {
+        if (lazy.source.get() != from) continue;
+        auto it = refs.find(lazy.ref.offset);
+        if (it != refs.end()) lazy = {to, it->second};
+    }
+    for (auto& [coord, tile] : m_tiles) {
+        if (tile->origin().get() != from) continue;
+        auto it = refs.find(tile->originRef().offset);
+        if (it != refs.end()) {
+            tile->setOrigin(to, it->second);
+        } else {
+            tile->setOrigin(nullptr, {});
+        }
+    }
+}
+
+const uint8_t* TileManager::pixelsAt(const TileCoord& coord, uint8_t* scratch) const {
+    auto it = m_tiles.find(coord);
+    if (it != m_tiles.end()) return it->second->constData();
+
+    auto lazy = m_lazy.find(coord);
+    if (lazy == m_lazy.end()) return nullptr;
+    return lazy->second.source->decode(lazy->second.ref, scratch) ? scratch : nullptr;
+}
+
+void TileManager::readPixels(const QRect& rect, uint8_t* out, qsizetype bytesPerLine) const {
+    for (int y = 0; y < rect.height(); ++y) {
+        std::memset(out + y * bytesPerLine, 0, static_cast<size_t>(rect.width()) * 4);
+    }
+    if (rect.isEmpty()) return;
+
+    std::vector<uint8_t> scratch(TILE_BYTES);
+    const TileCoord first = pixelToTile(rect.left(), rect.top());
+    const TileCoord last = pixelToTile(rect.right(), rect.bottom());
+    for (int ty = first.ty; ty <= last.ty; ++ty) {
+        for (int tx = first.tx; tx <= last.tx; ++tx) {
+            const uint8_t* src = pixelsAt({tx, ty}, scratch.data());
+            if (!src) continue;
+
+            const QRect tileRect(tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+            const QRect part = tileRect.intersected(rect);
+            for (int y = part.top(); y <= part.bottom(); ++y) {
+                std::memcpy(out + (y - rect.top()) * bytesPerLine + (part.left() - rect.left()) * 4,
+                            src + ((y - tileRect.top()) * TILE_SIZE + part.left() - tileRect.left()) * 4,
+                            static_cast<size_t>(part.width()) * 4);
+            }
+        }
+    }
 }
 
 std::vector<const Tile*> TileManager::allTiles() const {
+    materializeAll();
+    return residentTiles();
+}
+
+std::vector<const Tile*> TileManager::residentTiles() const {
     std::vector<const Tile*> result;
     result.reserve(m_tiles.size());
     for (auto& [coord, tile] : m_tiles) {
@@ -39,6 +148,7 @@ std::vector<const Tile*> TileManager::allTiles() const {
 }
 
 std::vector<Tile*> TileManager::allTilesMut() {
+    materializeAll();
     std::vector<Tile*> result;
     result.reserve(m_tiles.size());
     for (auto& [coord, tile] : m_tiles) {
@@ -61,6 +171,8 @@ std::vector<Tile*> TileManager::tilesInRect(const QRectF& pixelRect) {
             auto it = m_tiles.find({tx, ty});
             if (it != m_tiles.end()) {
                 result.push_back(it->second.get());
+            } else if (Tile* tile = materialize({tx, ty})) {
+                result.push_back(tile);
             }
         }
     }
@@ -85,10 +197,11 @@ void TileManager::clearDirtyFlags() {
 
 void TileManager::clear() {
     m_tiles.clear();
+    m_lazy.clear();
 }
 
 QRectF TileManager::boundingRect() const {
-    if (m_tiles.empty()) return {};
+    if (m_tiles.empty() && m_lazy.empty()) return {};
 
     int minTx = std::numeric_limits<int>::max();
     int minTy = std::numeric_limits<int>::max();
@@ -101,6 +214,12 @@ QRectF TileManager::boundingRect() const {
         maxTx = std::max(maxTx, coord.tx);
         maxTy = std::max(maxTy, coord.ty);
     }
+    for (auto& [coord, lazy] : m_lazy) {
+        minTx = std::min(minTx, coord.tx);
+        minTy = std::min(minTy, coord.ty);
+        maxTx = std::max(maxTx, coord.tx);
+        maxTy = std::max(maxTy, coord.ty);
+    }
 
     return QRectF(
         minTx * TILE_SIZE, minTy * TILE_SIZE,
@@ -121,6 +240,7 @@ std::unordered_map<TileCoord, std::unique_ptr<Tile>> TileManager::snapshotDirtyT
 void TileManager::restoreSnapshot(
     const std::unordered_map<TileCoord, std::unique_ptr<Tile>>& snapshot) {
     for (auto& [coord, tile] : snapshot) {
+        m_lazy.erase(coord);
         m_tiles[coord] = tile->clone();
         m_tiles[coord]->setDirty(true);
     }
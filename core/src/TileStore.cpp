@@ -0,0 +1,181 @@
+#include "core/TileStore.h"
+#include "core/Types.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMICOS_HASH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace comicos {
+
+// --- Hash ---
+// XXH3-style accumulation: eight 64-bit lanes per 64-byte stripe, each
+// adding lo32(x) * hi32(x) of the keyed input plus the neighbouring lane's
+// raw input. The key is offset per stripe and lanes are scrambled every
+// 1 KiB, so the result depends on stripe order. Tiles are a fixed size,
+// so there is no tail handling.
+
+constexpr size_t HASH_STRIPE = 64;
+constexpr size_t HASH_STRIPES_PER_BLOCK = 16;
+constexpr uint64_t PRIME32_1 = 0x9E3779B1u;
+constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ull;
+
+alignas(16) static const uint64_t HASH_KEY[8] = {
+    0xBE4BA423396CFEB8ull, 0x1CAD21F72C81017Cull, 0xDB979083E96DD4DEull,
+    0x1F67B3B7A4A44072ull, 0x78E5C0CC4EE679CBull, 0x2172FFCC7DD05A82ull,
+    0x8E2443F7744608B8ull, 0x4C263A81E69035E0ull,
+};
+
+static_assert(TILE_BYTES % (HASH_STRIPE * HASH_STRIPES_PER_BLOCK) == 0);
+
+static uint64_t finalize(const uint64_t acc[8]) {
+    uint64_t h = TILE_BYTES * PRIME64_1;
+    for (int i = 0; i < 8; ++i) {
+        h ^= acc[i] * PRIME64_2;
+        h = ((h << 31) | (h >> 33)) * PRIME64_1;
+    }
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+#ifdef COMICOS_HASH_SSE2
+
+uint64_t TileStore::hash(const uint8_t* pixels) {
+    __m128i acc[4];
+    for (int i = 0; i < 4; ++i) {
+        acc[i] = _mm_set_epi64x(static_cast<long long>(PRIME64_1 + 2 * i + 1),
+                                static_cast<long long>(PRIME64_1 + 2 * i));
+    }
+    const auto* key = reinterpret_cast<const __m128i*>(HASH_KEY);
+    const __m128i prime = _mm_set1_epi32(static_cast<int>(PRIME32_1));
+
+    const uint8_t* p = pixels;
+    const uint8_t* end = pixels + TILE_BYTES;
+    while (p < end) {
+        for (size_t s = 0; s < HASH_STRIPES_PER_BLOCK; ++s, p += HASH_STRIPE) {
+            const __m128i stripe = _mm_set1_epi64x(static_cast<long long>(s * PRIME64_3));
+            for (int i = 0; i < 4; ++i) {
+                __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p) + i);
+                __m128i stripeKey = _mm_add_epi64(_mm_load_si128(key + i), stripe);
+                __m128i keyed = _mm_xor_si128(data, stripeKey);
+                __m128i hi = _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1));
+                __m128i product = _mm_mul_epu32(keyed, hi);
+                __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+                acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, swapped));
+            }
+        }
+        // Scramble: acc = (acc ^ (acc >> 47) ^ key) * PRIME32_1
+        for (int i = 0; i < 4; ++i) {
+            __m128i a = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+            a = _mm_xor_si128(a, _mm_load_si128(key + i));
+            __m128i lo = _mm_mul_epu32(a, prime);
+            __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+            acc[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+        }
+    }
+
+    alignas(16) uint64_t lanes[8];
+    for (int i = 0; i < 4; ++i) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes) + i, acc[i]);
+    }
+    return finalize(lanes);
+}
+
+#else
+
+uint64_t TileStore::hash(const uint8_t* pixels) {
+    uint64_t acc[8];
+    for (int i = 0; i < 8; ++i) acc[i] = PRIME64_1 + i;
+
+    const uint8_t* p = pixels;
+    const uint8_t* end = pixels + TILE_BYTES;
+    while (p < end) {
+        for (size_t s = 0; s < HASH_STRIPES_PER_BLOCK; ++s, p += HASH_STRIPE) {
+            uint64_t data[8];
+            std::memcpy(data, p, sizeof(data));  // Little-endian lanes
+            for (int i = 0; i < 8; ++i) {
+                uint64_t keyed = data[i] ^ (HASH_KEY[i] + s * PRIME64_3);
+                acc[i] += (keyed & 0xFFFFFFFFu) * (keyed >> 32) + data[i ^ 1];
+            }
+        }
+        for (int i = 0; i < 8; ++i) {
+            acc[i] = (acc[i] ^ (acc[i] >> 47) ^ HASH_KEY[i]) * PRIME32_1;
+        }
+    }
+    return finalize(acc);
+}
+
+#endif
+
+// --- Store ---
+
+/// Deleter of pooled buffers. It owns the buffer as it was before interning
+/// and frees it only after the store has unlisted it, so listed pixels stay
+/// readable under the store's lock.
+struct TileStore::Release {
+    uint64_t contentHash;
+    Buffer original;
+
+    void operator()(uint8_t* pixels) {
+        TileStore::instance().release(contentHash, pixels);
+        original.reset();
+    }
+};
+
+TileStore& TileStore::instance() {
+    // Never destroyed: pooled buffers may outlive static destruction
+    static TileStore* store = new TileStore;
+    return *store;
+}
+
+TileStore::Buffer TileStore::intern(const Buffer& buffer, uint64_t contentHash) {
+    if (!buffer || isPooled(buffer)) return buffer;
+
+    // Declared before the lock: if this becomes the last reference, its
+    // deleter takes the lock itself
+    Buffer found;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto [begin, end] = m_buffers.equal_range(contentHash);
+    for (auto it = begin; it != end; ++it) {
+        const Entry& entry = it->second;
+        if (entry.pixels != buffer.get()
+            && std::memcmp(entry.pixels, buffer.get(), TILE_BYTES) != 0) {
+            continue;
+        }
+        found = entry.buffer.lock();
+        if (found) return found;  // Else it is being released: list a new one
+    }
+
+    Buffer pooled(buffer.get(), Release{contentHash, buffer});
+    m_buffers.emplace(contentHash, Entry{pooled.get(), pooled});
+    return pooled;
+}
+
+bool TileStore::isPooled(const Buffer& buffer) {
+    return std::get_deleter<Release>(buffer) != nullptr;
+}
+
+void TileStore::release(uint64_t contentHash, const uint8_t* pixels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto [begin, end] = m_buffers.equal_range(contentHash);
+    for (auto it = begin; it != end; ++it) {
+        if (it->second.pixels == pixels && it->second.buffer.expired()) {
+            m_buffers.erase(it);
+            return;
+        }
+    }
+}
+
+size_t TileStore::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_buffers.size();
+}
+
+}  // namespace comicos
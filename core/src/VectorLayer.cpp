@@ -0,0 +1,220 @@
+#include "core/VectorLayer.h"
+#include "core/TileSource.h"
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace comicos {
+
+namespace {
+
+VectorLayer::Rasterizer& installedRasterizer() {
+    static VectorLayer::Rasterizer instance;
+    return instance;
+}
+
+QRect tileRect(const TileCoord& coord) {
+    return QRect(coord.tx * TILE_SIZE, coord.ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+}
+
+/// Add the tiles `rect` overlaps to `out`.
+void addTilesIn(const QRect& rect, std::set<TileCoord>& out) {
+    if (rect.isEmpty()) return;
+    const TileCoord first = pixelToTile(rect.left(), rect.top());
+    const TileCoord last = pixelToTile(rect.right(), rect.bottom());
+    for (int ty = first.ty; ty <= last.ty; ++ty) {
+        for (int tx = first.tx; tx <= last.tx; ++tx) out.insert({tx, ty});
+    }
+}
+
+}  // namespace
+
+// --- Source ---
+
+/// Draws tiles from a fixed list of strokes. Every edit makes a new source;
+/// lazy tiles left pointing at an older one are those the edit did not
+/// touch, which the older list draws the same.
+class VectorLayer::Source final : public TileSource {
+public:
+    /// `bounds` holds strokeBounds() of each stroke.
+    Source(const StrokeList& strokes, const std::vector<QRect>& bounds) {
+        m_strokes.reserve(strokes.size());
+        for (size_t i = 0; i < strokes.size(); ++i) m_strokes.push_back({strokes[i], bounds[i]});
+    }
+
+    QString filePath() const override { return {}; }
+    QByteArray payload(const TileRef& /*ref*/) const override { return {}; }
+    bool storesPayloads() const override { return false; }
+
+    bool decode(const TileRef& ref, uint8_t* out) const override {
+        const TileCoord coord = coordOf(ref);
+        const QRect rect = tileRect(coord);
+        std::vector<const Stroke*> strokes;
+        for (const auto& entry : m_strokes) {
+            if (entry.bounds.intersects(rect)) strokes.push_back(entry.stroke.get());
+        }
+        const Rasterizer& draw = installedRasterizer();
+        return !strokes.empty() && draw && draw(strokes, coord, out);
+    }
+
+    bool touches(const TileCoord& coord) const {
+        const QRect rect = tileRect(coord);
+        return std::any_of(m_strokes.begin(), m_strokes.end(),
+                           [&](const Entry& entry) { return entry.bounds.intersects(rect); });
+    }
+
+    /// There is no payload: the ref carries the tile's coordinate.
+    static TileRef refFor(const TileCoord& coord) {
+        TileRef ref;
+        ref.offset = (static_cast<quint64>(static_cast<quint32>(coord.tx)) << 32)
+                     | static_cast<quint32>(coord.ty);
+        return ref;
+    }
+
+    static TileCoord coordOf(const TileRef& ref) {
+        return {static_cast<int>(static_cast<quint32>(ref.offset >> 32)),
+                static_cast<int>(static_cast<quint32>(ref.offset))};
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const Stroke> stroke;
+        QRect bounds;
+    };
+    std::vector<Entry> m_strokes;
+};
+
+// --- VectorLayer ---
+
+VectorLayer::VectorLayer(LayerId id, const QString& name)
+    : Layer(id, name), m_source(std::make_shared<const Source>(StrokeList{}, m_bounds)) {}
+
+VectorLayer::~VectorLayer() = default;
+
+void VectorLayer::setRasterizer(Rasterizer rasterizer) {
+    installedRasterizer() = std::move(rasterizer);
+}
+
+void VectorLayer::appendPainted(std::shared_ptr<const Stroke> stroke) {
+    // Only the new stroke's bounds are computed; the others are kept
+    m_bounds.push_back(strokeBounds(*stroke));
+    m_strokes.push_back(std::move(stroke));
+    m_source = std::make_shared<const Source>(m_strokes, m_bounds);
+}
+
+std::vector<TileCoord> VectorLayer::setStrokes(StrokeList strokes) {
+    // Strokes are shared and never modified, so the pointer identifies one
+    // (and its bounds need not be computed again)
+    std::unordered_map<const Stroke*, QRect> before;
+    std::unordered_set<const Stroke*> after;
+    for (size_t i = 0; i < m_strokes.size(); ++i) before.emplace(m_strokes[i].get(), m_bounds[i]);
+    for (const auto& stroke : strokes) after.insert(stroke.get());
+
+    std::set<TileCoord> changed;
+    for (size_t i = 0; i < m_strokes.size(); ++i) {
+        if (!after.count(m_strokes[i].get())) addTilesIn(m_bounds[i], changed);
+    }
+    std::vector<QRect> bounds;
+    bounds.reserve(strokes.size());
+    for (const auto& stroke : strokes) {
+        auto it = before.find(stroke.get());
+        if (it != before.end()) {
+            bounds.push_back(it->second);
+        } else {
+            bounds.push_back(strokeBounds(*stroke));
+            addTilesIn(bounds.back(), changed);
+        }
+    }
+
+    m_strokes = std::move(strokes);
+    m_bounds = std::move(bounds);
+    m_source = std::make_shared<const Source>(m_strokes, m_bounds);
+    std::vector<TileCoord> coords(changed.begin(), changed.end());
+    invalidate(coords);
+    return coords;
+}
+
+std::vector<TileCoord> VectorLayer::replaceStroke(size_t index,
+                                                  std::shared_ptr<const Stroke> stroke) {
+    if (index >= m_strokes.size()) return {};
+    StrokeList strokes = m_strokes;
+    strokes[index] = std::move(stroke);
+    return setStrokes(std::move(strokes));
+}
+
+VectorLayer::StrokeList VectorLayer::transformed(const StrokeList& strokes,
+                                                 const QTransform& transform) {
+    const float scale = static_cast<float>(std::sqrt(std::abs(transform.determinant())));
+    const float angle = static_cast<float>(std::atan2(transform.m12(), transform.m11()));
+    const float c = std::cos(angle), s = std::sin(angle);
+
+    StrokeList result;
+    result.reserve(strokes.size());
+    for (const auto& stroke : strokes) {
+        auto copy = std::make_shared<Stroke>(*stroke);
+        copy->clearPoints();
+        for (CanvasPoint p : stroke->points()) {
+            const QPointF mapped = transform.map(QPointF(p.x, p.y));
+            p.x = static_cast<float>(mapped.x());
+            p.y = static_cast<float>(mapped.y());
+            const float tiltX = p.tiltX;
+            p.tiltX = tiltX * c - p.tiltY * s;
+            p.tiltY = tiltX * s + p.tiltY * c;
+            copy->addPoint(p);
+        }
+        copy->setBrushSize(stroke->brushSize() * scale);
+        copy->setTipAngle(stroke->tipAngle() + angle);
+        result.push_back(std::move(copy));
+    }
+    return result;
+}
+
+QRect VectorLayer::strokeBounds(const Stroke& stroke) {
+    // Stroke::boundingRect() covers the brush radius; antialiasing and the
+    // smallest dab size may reach a pixel further
+    const QRectF rect = stroke.boundingRect();
+    if (rect.isNull()) return {};
+    return rect.toAlignedRect().adjusted(-2, -2, 2, 2);
+}
+
+void VectorLayer::invalidate(const std::vector<TileCoord>& coords) {
+    for (const TileCoord& coord : coords) {
+        if (m_source->touches(coord)) {
+            tiles().addLazyTile(coord, m_source, Source::refFor(coord));
+        } else {
+            tiles().removeTile(coord);
+        }
+    }
+}
+
+// --- Raster Cache ---
+
+void VectorLayer::evictRaster(const std::unordered_set<TileCoord>& keep, size_t budget) const {
+    if (tiles().residentTileCount() <= budget) return;
+    for (const Tile* tile : tiles().residentTiles()) {
+        const TileCoord coord = tile->coord();
+        if (!keep.count(coord)) tiles().evictTile(coord, m_source, Source::refFor(coord));
+    }
+}
+
+// --- Layer ---
+
+void VectorLayer::clear() {
+    Layer::clear();
+    m_strokes.clear();
+    m_bounds.clear();
+    m_source = std::make_shared<const Source>(m_strokes, m_bounds);
+}
+
+std::unique_ptr<Layer> VectorLayer::snapshot() const {
+    auto copy = std::make_unique<VectorLayer>(id(), name());
+    copyTo(*copy);
+    copy->m_strokes = m_strokes;
+    copy->m_bounds = m_bounds;
+    copy->m_source = m_source;
+    return copy;
+}
+
+}  // namespace comicos
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "engine/BrushDab.h"
+#include <QRect>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace comicos {
+
+/// The area a solid round dab sweeps moving in a straight line from one
+/// dab to the next, its radius and opacity changing linearly on the way:
+/// the convex hull of the two end discs.
+///
+/// Under Max accumulation a pixel ends up with the opacity of the strongest
+/// dab covering it, so the capsule gives each pixel that opacity directly,
+/// in one pass over the swept area, instead of stamping the many
+/// overlapping dabs the spacing would place. The span of the hull on each
+/// canvas row is found once, from the two discs and their outer tangents.
+/// Inside the disc at the stronger end every pixel gets that end's
+/// opacity; elsewhere the strongest covering dab comes from solving a
+/// quadratic in the dab's position along the segment. Pixels are sampled
+/// at their centres like solid stamps (StampCache::isSolidDisc), with no
+/// antialiasing.
+///
+/// Consecutive capsules share an end disc. When the previous capsule has
+/// deposited it and the opacity does not rise along this one, the disc is
+/// left out: each pixel of a steady stroke is written about once.
+class BrushCapsule {
+public:
+    /// Below this radius dabs are cheap and cached, and capsules not worth it.
+    static constexpr float MIN_RADIUS = 32.0f;
+
+    /// An empty capsule, for reset().
+    BrushCapsule() = default;
+
+    /// Capsule from dab `from` to dab `to` (position, radius and opacity
+    /// are used). With `startDeposited`, the previous capsule ended at
+    /// `from` and its disc is already in the coverage.
+    BrushCapsule(const BrushDab& from, const BrushDab& to, bool startDeposited);
+
+    /// Turn this into the capsule above, reusing its row buffer.
+    void reset(const BrushDab& from, const BrushDab& to, bool startDeposited);
+
+    /// Nothing to deposit.
+    bool isEmpty() const { return m_empty; }
+
+    /// Canvas pixels the capsule may cover.
+    const QRect& bounds() const { return m_bounds; }
+
+    /// Pixels the capsule writes (for scheduling).
+    size_t pixelCount() const { return m_pixels; }
+
+    /// True if the capsule writes any pixel of the tile at (tileX, tileY)
+    /// (its top-left canvas pixel).
+    bool coversTile(int tileX, int tileY) const;
+
+    /// Max-accumulate the capsule's coverage (0..255) into one coverage tile.
+    void depositTile(int tileX, int tileY, uint8_t* coverage) const;
+
+private:
+    /// Canvas columns of one row: [begin, end) is inside the hull and
+    /// [discBegin, discEnd) inside the strong end's disc (within the first).
+    struct Row {
+        int begin = 0;
+        int end = 0;
+        int discBegin = 0;
+        int discEnd = 0;
+    };
+
+    Row computeRow(int y) const;
+
+    /// Coverage of a pixel inside the hull but outside the strong end's disc,
+    /// (qx, qy) from that end's centre.
+    uint8_t sweptCoverage(float qx, float qy) const;
+
+    // The strong end (higher opacity) is `a`; the capsule runs from a to b
+    float m_ax = 0.0f, m_ay = 0.0f, m_ar = 0.0f, m_ao = 0.0f;
+    float m_bx = 0.0f, m_by = 0.0f, m_br = 0.0f, m_bo = 0.0f;
+    uint8_t m_discCoverage = 0;
+    bool m_skipDisc = false;  // The strong end's disc is already deposited
+    bool m_constant = false;  // Same coverage everywhere
+    bool m_disc = false;      // One end disc holds the other: just that disc
+    bool m_empty = true;
+
+    /// An outer tangent, between the rows it spans: x = x0 + (y - y0) * slope.
+    struct Tangent {
+        float y0 = 0.0f;
+        float y1 = -1.0f;  // Empty
+        float x0 = 0.0f;
+        float slope = 0.0f;
+    };
+
+    // Outer tangents (from a + ar * n to b + br * n for both normals n) and
+    // the quadratic terms of sweptCoverage()
+    Tangent m_tangents[2];
+    float m_dx = 0.0f, m_dy = 0.0f, m_dr = 0.0f, m_a = 0.0f;
+    QRect m_bounds;
+    std::vector<Row> m_rows;  // Per row of m_bounds
+    size_t m_pixels = 0;
+};
+
+}  // namespace comicos
@@ -1,25 +1,37 @@
 #pragma once
 
 #include "core/Types.h"
-#include <QColor>
+#include <algorithm>
+#include <type_traits>
 #include <vector>
 
 namespace comicos {
 
 /// A single brush "dab" - the atomic unit of brush rendering.
 /// A stroke is composed of many dabs placed along the path.
+///
+/// Plain data: the colour is the stroke's (see WetLayer::paint()), so dabs
+/// copy as 32 bytes into reused batches.
 struct BrushDab {
     float x = 0.0f;
     float y = 0.0f;
     float radius = 1.0f;
     float opacity = 1.0f;
     float hardness = 1.0f;
-    QColor color = Qt::black;
+    float rotation = 0.0f;  // Radians, clockwise on screen
+    float aspect = 1.0f;    // Minor/major axis, 0..1
+    int textureId = -1;     // BrushTipAtlas id; -1 = round tip
+};
+static_assert(std::is_trivially_copyable_v<BrushDab>);
 
-    // Extension point: brush texture, rotation, aspect ratio
-    // float rotation = 0.0f;
-    // float aspect = 1.0f;
-    // int textureId = -1;
+/// Shape of the brush tip, applied to every dab of a stroke.
+struct DabTip {
+    int textureId = -1;
+    float angle = 0.0f;   // Radians
+    float aspect = 1.0f;
+    /// Turn and squash the tip with pen tilt: the tip points along the
+    /// tilt azimuth and flattens as the pen leans over.
+    bool followTilt = true;
 };
 
 /// Generates dab positions along a stroke path with spacing control.
@@ -32,20 +44,32 @@ public:
     void setSpacing(float spacing) { m_spacing = spacing; }
     float spacing() const { return m_spacing; }
 
+    /// Distance between dabs of a brush `brushSize` wide.
+    float step(float brushSize) const { return std::max(brushSize * m_spacing, 0.5f); }
+
+    void setTip(const DabTip& tip) { m_tip = tip; }
+    const DabTip& tip() const { return m_tip; }
+
     /// Reset for a new stroke.
     void reset();
 
-    /// Generate dabs between two consecutive input points.
-    /// Returns the dabs to render.
-    std::vector<BrushDab> placeDabs(
-        const CanvasPoint& from, const CanvasPoint& to,
-        float brushSize, float hardness, const QColor& color);
+    /// Generate dabs between two consecutive input points, appending them
+    /// to `dabs` (a batch the caller reuses, so placing does not allocate).
+    void placeDabs(const CanvasPoint& from, const CanvasPoint& to,
+                   float brushSize, float hardness, std::vector<BrushDab>& dabs);
 
-    // Extension point: pressure curves, tilt mapping
+    /// The dab placeDabs() places at `point`: pressure and tilt applied.
+    BrushDab dabAt(const CanvasPoint& point, float brushSize, float hardness) const;
+
+    // Extension point: pressure curves
     // void setPressureCurve(const PressureCurve& curve);
 
 private:
+    /// Set the dab's rotation, aspect and texture from the tip and tilt.
+    void applyTip(BrushDab& dab, float tiltX, float tiltY) const;
+
     float m_spacing = 0.15f;  // 15% of diameter
+    DabTip m_tip;
     float m_accumDistance = 0.0f;
 };
 
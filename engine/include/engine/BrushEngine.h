@@ -3,58 +3,176 @@
 #include "core/Layer.h"
 #include "core/Stroke.h"
 #include "core/Types.h"
+#include "engine/BrushCapsule.h"
 #include "engine/BrushDab.h"
+#include "engine/BrushTipAtlas.h"
+#include "engine/MotionPredictor.h"
+#include "engine/StampCache.h"
+#include "engine/WetLayer.h"
 #include <QColor>
+#include <QRect>
 #include <memory>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace comicos {
 
 /// Core brush rendering engine.
 /// Converts input strokes into pixel modifications on tile data.
 /// This is the performance-critical hot path of the application.
+///
+/// Dabs accumulate into a wet layer during the stroke; the target layer's
+/// tiles are only modified once, by endStroke(). Until then the engine never
+/// dereferences the layer, so a stroke can be rasterized on another thread
+/// than the one that owns the document (see BrushThread).
+///
+/// addPoint() does not allocate once the engine has painted a stroke as
+/// long: points, dabs and stamps go into buffers kept from stroke to
+/// stroke, and the wet layer reuses its coverage tiles. Only stamps missing
+/// from the cache and stamps too large to cache are allocated.
 class BrushEngine {
 public:
     BrushEngine();
     ~BrushEngine();
 
     // --- Stroke Lifecycle ---
-    /// Begin a new stroke on the given layer.
+    /// Begin a new stroke on the given layer. strokeParams.targetLayerId()
+    /// must be the layer's id. `layer` may be null if the stroke is ended
+    /// with endStroke(Layer*), which names the layer only then.
     void beginStroke(Layer* layer, const Stroke& strokeParams);
 
     /// Add a point to the current stroke (called per tablet/mouse input).
     void addPoint(const CanvasPoint& point);
 
-    /// End the current stroke. Returns affected tile coordinates.
+    /// End the current stroke: composite the wet layer into the target
+    /// layer. Returns affected tile coordinates.
     std::vector<TileCoord> endStroke();
 
-    /// Cancel the current stroke (discard).
+    /// End the current stroke into `layer` rather than the one it began on,
+    /// e.g. its target looked up again by id because the original may be
+    /// gone. Null discards the stroke, like cancelStroke().
+    std::vector<TileCoord> endStroke(Layer* layer);
+
+    /// Cancel the current stroke (discard the wet layer).
     void cancelStroke();
 
-    bool isActive() const { return m_activeLayer != nullptr; }
+    bool isActive() const { return m_active; }
 
     /// Take ownership of before-snapshots captured during the stroke.
     /// Call after endStroke() to get tile data for undo.
     std::unordered_map<TileCoord, std::unique_ptr<Tile>> takeBeforeSnapshots();
 
+    /// Brush stamps, kept across strokes.
+    const StampCache& stampCache() const { return m_stampCache; }
+
+    /// Image tips a stroke can select with Stroke::setTipId(). Thread-safe,
+    /// so tips can be added while another thread paints.
+    BrushTipAtlas& tipAtlas() { return m_tips; }
+
+    /// Draw image tips from `tips` (another engine's atlas, which must
+    /// outlive this one) instead of tipAtlas(). Null = round tips only.
+    void setTipSource(const BrushTipAtlas* tips);
+
+    /// Only stamp dabs (and capsules) that reach `rect` (null = everywhere),
+    /// for drawing a recorded stroke into one tile. Dab spacing is unaffected.
+    void setClipRect(const QRect& rect) { m_clipRect = rect; }
+
+    /// Draw segments of large, hard round brushes as capsules instead of
+    /// dabs (see BrushCapsule; on by default). Off for benchmarks and
+    /// output comparison.
+    void setCapsules(bool enabled) { m_capsules = enabled; }
+    bool capsules() const { return m_capsules; }
+
+    /// The stroke begun last, with the points added so far.
+    const Stroke& currentStroke() const { return m_currentStroke; }
+
+    /// The stroke in progress, for display on top of its layer.
+    const WetLayer& wetLayer() const { return m_wetLayer; }
+
+    /// Replace `out` with the wet tiles changed since the last call (see
+    /// WetLayer::takeDirtyTiles()).
+    void takeDirtyTiles(std::vector<TileCoord>& out) { m_wetLayer.takeDirtyTiles(out); }
+
+    /// How overlapping dabs combine within a stroke (from the next stroke on).
+    void setAccumulation(WetLayer::Accumulation mode) { m_accumulation = mode; }
+    WetLayer::Accumulation accumulation() const { return m_accumulation; }
+
+    // --- Prediction ---
+    /// How far ahead predictedStamps() extrapolates the pen (0 = off).
+    void setPredictionHorizon(float ms) { m_predictor.setHorizon(ms); }
+    float predictionHorizon() const { return m_predictor.horizon(); }
+
+    /// Replace `placed` with dabs for where the pen is predicted to go next,
+    /// continuing the stroke's dab spacing. Provisional: for display only,
+    /// never part of the wet layer, so they are never committed.
+    void predictedStamps(std::vector<PlacedStamp>& placed);
+
     // --- Dab Rendering ---
     // Extension point: here is where the brush pipeline goes
-    // Currently renders simple circular dabs.
-    // Future: texture stamps, scatter, dynamics, wet brushes.
+    // Renders round, elliptical and image-tip stamps (see StampCache.h,
+    // BrushTipAtlas.h), and solid round segments as capsules
+    // (BrushCapsule.h). Future: scatter, dynamics, wet mixing.
 
 private:
-    /// Render a single dab onto the layer's tiles.
-    void renderDab(const BrushDab& dab);
+    /// How far the stroke points inside a capsule may stray from its chord:
+    /// position in pixels, pressure in opacity steps.
+    static constexpr float CAPSULE_TOLERANCE = 0.5f;
+    static constexpr float CAPSULE_PRESSURE_TOLERANCE = 1.0f / 255.0f;
+
+    /// True if the dabs at both points are solid discs, large enough for
+    /// capsules.
+    bool capsuleFits(const CanvasPoint& from, const CanvasPoint& to) const;
+
+    /// Take stroke point `index` into the pending capsule. Capsules are
+    /// deposited about one dab step long (the pixels show up as often as
+    /// dabs would), or shorter where the stroke bends or its pressure does
+    /// not change linearly.
+    void extendCapsule(int index);
+
+    /// Deposit the pending capsule up to stroke point `index`; it then
+    /// starts there.
+    void depositCapsule(int index);
+
+    /// True if the points strictly between `from` and `to` lie on the
+    /// capsule from `from` to `to`, within the tolerances.
+    bool followsChord(int from, int to) const;
+
+    /// Points reserved for a stroke up front.
+    static constexpr int RESERVED_POINTS = 1024;
+
+    /// Stamps for dabs into `placed` (replacing its contents): cached ones,
+    /// or uncached ones for dabs too large to cache.
+    void placeStamps(const std::vector<BrushDab>& dabs, std::vector<PlacedStamp>& placed);
+
+    /// Accumulate m_dabs into the wet layer.
+    void renderDabs();
 
-    /// Blend a single pixel (src over dst).
-    void blendPixel(Tile* tile, int localX, int localY,
-                    const QColor& color, float alpha);
+    /// Composite the wet layer into the target layer's tiles, capturing
+    /// before-snapshots as it goes.
+    void commitWetLayer();
 
-    Layer* m_activeLayer = nullptr;
+    bool m_active = false;
+    Layer* m_activeLayer = nullptr;  // Null until endStroke(Layer*) if begun without one
     Stroke m_currentStroke;
     DabPlacer m_dabPlacer;
+    MotionPredictor m_predictor;
     std::vector<TileCoord> m_affectedTiles;
-    std::unordered_map<TileCoord, std::unique_ptr<Tile>> m_beforeSnapshots;
+    std::vector<std::pair<TileCoord, std::unique_ptr<Tile>>> m_beforeSnapshots;
+    std::vector<BrushDab> m_dabs;       // Scratch: dabs of the current input segment
+    std::vector<PlacedStamp> m_stamps;  // Scratch: their stamps
+    std::vector<CanvasPoint> m_predicted;  // Scratch: predictedStamps() samples...
+    std::vector<BrushDab> m_predictedDabs;  // ...and their dabs
+    BrushTipAtlas m_tips;  // Before m_stampCache, which points to it
+    const BrushTipAtlas* m_tipSource = &m_tips;
+    StampCache m_stampCache;
+    QRect m_clipRect;
+    bool m_capsules = true;
+    int m_capsuleFrom = -1;              // Stroke point the pending capsule starts at
+    bool m_capsuleFromDeposited = false;  // Its disc is in the wet layer
+    BrushCapsule m_capsule;               // Scratch: the capsule being deposited
+    WetLayer m_wetLayer;
+    WetLayer::Accumulation m_accumulation = WetLayer::Accumulation::Max;
 };
 
 }  // namespace comicos
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "core/Layer.h"
+#include "core/LayerStack.h"
+#include "core/Stroke.h"
+#include "core/Types.h"
+#include "engine/BrushEngine.h"
+#include "engine/SpscQueue.h"
+#include "engine/WetLayer.h"
+#include <QThreadPool>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace comicos {
+
+/// Runs a BrushEngine on a dedicated thread, fed by a lock-free queue.
+///
+/// Input methods (GUI thread) only push events, so input handling never
+/// waits for rasterization. The brush thread places and rasterizes dabs and
+/// publishes the wet tiles it touched to an overlay copy. The renderer
+/// copies the overlay tiles it shows (copyOverlay()) and composites from its
+/// copy; the lock is only held for the tile copies on either side, never
+/// while rasterizing or compositing.
+///
+/// Each publish also draws a predicted stroke tip (MotionPredictor) into the
+/// overlay only; the next publish replaces it with the real dabs, so it is
+/// never committed.
+///
+/// The target layer is only modified on the GUI thread, and only named by
+/// id until then: commitStroke() looks it up, so a layer removed while its
+/// stroke was in flight just drops the stroke. Once a stroke is fully
+/// rasterized the brush thread reports it (setStrokeFinishedHandler) and
+/// waits for commitStroke() before it reads the next stroke's input, which
+/// keeps queueing meanwhile.
+class BrushThread {
+public:
+    /// Input-to-pixel latency: from the input event to the first frame the
+    /// renderer composited with its dabs.
+    struct Latency {
+        size_t samples = 0;
+        double lastMs = 0.0;
+        double meanMs = 0.0;
+        double maxMs = 0.0;
+    };
+
+    /// Pixels drawn by predicted dabs beyond the real stroke, and how many
+    /// of those the real samples did not cover once they caught up with the
+    /// prediction. Sampled: one prediction per horizon is scored.
+    struct PredictionStats {
+        size_t predictedPixels = 0;
+        size_t mispredictedPixels = 0;
+    };
+
+    /// A finished stroke, composited into its layer by commitStroke().
+    struct CommittedStroke {
+        Layer* layer = nullptr;  // Null if the layer was removed meanwhile
+        std::vector<TileCoord> tiles;
+        std::unordered_map<TileCoord, std::unique_ptr<Tile>> before;
+        Stroke stroke;  // As painted, with all its points (for vector layers)
+    };
+
+    BrushThread();
+    ~BrushThread();
+
+    BrushThread(const BrushThread&) = delete;
+    BrushThread& operator=(const BrushThread&) = delete;
+
+    // --- Input (GUI thread, never blocks) ---
+    /// Begin a stroke onto layer strokeParams.targetLayerId().
+    void beginStroke(const Stroke& strokeParams);
+    void addPoint(const CanvasPoint& point);
+    void endStroke();
+
+    /// Discard the stroke in progress. Finished strokes are unaffected.
+    void cancelStroke();
+
+    /// Prediction horizon for strokes begun from now on (0 = off). See
+    /// MotionPredictor.
+    void setPredictionHorizon(float ms) { m_predictionHorizon.store(ms); }
+    float predictionHorizon() const { return m_predictionHorizon.load(); }
+
+    /// Image tips for Stroke::setTipId(). Thread-safe; a tip added here can
+    /// be used by the next stroke.
+    BrushTipAtlas& tipAtlas() { return m_engine.tipAtlas(); }
+
+    /// A stroke was begun and not yet ended or cancelled.
+    bool isActive() const { return m_strokeOpen; }
+
+    /// Input is queued, being rasterized or waiting for commitStroke().
+    bool isBusy() const;
+
+    // --- Commit (GUI thread) ---
+    /// Composite the finished stroke into its layer, looked up in `layers`;
+    /// a stroke whose layer is gone is dropped. False if no stroke is
+    /// waiting; returns immediately either way.
+    bool commitStroke(LayerStack& layers, CommittedStroke* out);
+
+    /// Block until all input so far is rasterized, or a finished stroke
+    /// waits for commitStroke(). For document operations, not for input.
+    void waitForIdle();
+
+    // --- Output ---
+    /// Called on the brush thread when a stroke waits for commitStroke().
+    /// Set before the first stroke.
+    void setStrokeFinishedHandler(std::function<void()> handler);
+
+    /// Called on the brush thread when new tiles were published, at most
+    /// once until takePublishedTiles(). Set before the first stroke.
+    void setTilesPublishedHandler(std::function<void()> handler);
+
+    /// Replace `out` with the overlay tiles published since the last call
+    /// (GUI thread). The buffers trade places, as in
+    /// WetLayer::takeDirtyTiles().
+    void takePublishedTiles(std::vector<TileCoord>& out);
+
+    /// Replace `out` with the overlay's coverage of `coords` (the tiles the
+    /// renderer shows), under the overlay lock. Pass the result to
+    /// overlayPresented() once `out` is composited.
+    int64_t copyOverlay(const std::vector<TileCoord>& coords, WetLayer& out);
+
+    /// The renderer composited a copyOverlay() copy: records latency for
+    /// the input it shows.
+    void overlayPresented(int64_t copied);
+
+    Latency latency() const;
+    PredictionStats prediction() const;
+    /// Reset latency and prediction statistics.
+    void resetStats();
+
+private:
+    struct Event {
+        enum class Type : uint8_t { Begin, Point, End, Cancel };
+        Type type = Type::Point;
+        uint32_t serial = 0;     // Stroke the event belongs to
+        int64_t inputTime = 0;   // Steady clock, ns
+        CanvasPoint point;       // Point only; Begin takes its Stroke from m_beginParams
+    };
+
+    static constexpr size_t QUEUE_CAPACITY = 4096;
+    /// Publish at least this often while input keeps arriving.
+    static constexpr int64_t PUBLISH_INTERVAL_NS = 4'000'000;
+
+    static int64_t now();
+
+    // GUI thread
+    void push(const Event& event);
+    void flushOverflow();
+
+    // Brush thread
+    void run();
+    void process(const Event& event);
+    /// Stroke `serial` was cancelled and its Cancel event is still queued.
+    bool isCancelled(uint32_t serial) const;
+    bool isCancelledLocked(uint32_t serial) const;  // m_overlayMutex held
+    /// Copy new coverage to the overlay. With `predict`, the predicted tip
+    /// is drawn on top until the next publish() replaces it.
+    void publish(bool predict);
+
+    BrushEngine m_engine;
+    SpscQueue<Event> m_events{QUEUE_CAPACITY};
+    std::atomic<uint32_t> m_signal{0};  // Bumped per push; the brush thread waits on it
+    std::atomic<bool> m_stop{false};
+    QThreadPool m_thread;               // Single thread running run()
+
+    // GUI thread only
+    std::deque<Event> m_overflow;  // Input that found the queue full
+    uint64_t m_pushed = 0;
+    uint32_t m_serial = 0;
+    bool m_strokeOpen = false;
+
+    // Brush thread, then commitStroke() while m_finished
+    uint32_t m_strokeSerial = 0;
+    int64_t m_unpublishedSince = 0;  // Oldest input not yet in the overlay
+    int64_t m_lastPublish = 0;
+    std::vector<TileCoord> m_publishTiles;         // Scratch: publish()'s tiles
+    std::vector<PlacedStamp> m_predictedStamps;    // Scratch: its predicted dabs
+    WetLayer m_prediction;  // Predicted dabs only, as last published
+    double m_lastSampleTime = 0.0;
+    WetLayer m_scored;      // Prediction being scored, once input passes...
+    double m_scoredUntil = 0.0;  // ...this sample time
+
+    // Shared
+    std::atomic<uint64_t> m_processed{0};
+    std::atomic<uint32_t> m_cancelledSerial{0};  // Newest in m_cancelled, for a quick check
+    std::atomic<bool> m_finished{false};        // Stroke waits for commitStroke()
+    std::atomic<bool> m_publishPending{false};
+    std::atomic<float> m_predictionHorizon{MotionPredictor::DEFAULT_HORIZON_MS};
+    std::function<void()> m_onFinished;
+    std::function<void()> m_onPublished;
+
+    // Guarded by m_beginMutex: stroke settings of queued Begin events, in
+    // order. Kept out of Event so point events stay small.
+    std::mutex m_beginMutex;
+    std::deque<Stroke> m_beginParams;
+
+    // Guarded by m_overlayMutex
+    mutable std::mutex m_overlayMutex;
+    WetLayer m_overlay;
+    std::vector<TileCoord> m_publishedTiles;
+    std::vector<uint32_t> m_cancelled;  // Serials whose Cancel event is still queued
+    int64_t m_unpresentedSince = 0;
+    Latency m_latency;
+    PredictionStats m_predictionStats;
+};
+
+}  // namespace comicos
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QImage>
+#include <QString>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace comicos {
+
+/// Image brush tip: a square coverage mask with its full mip chain.
+///
+/// All levels live in one buffer, largest first, each half the size of the
+/// one before down to 1x1. A dab samples the level closest to its own
+/// diameter, so the cost per stamp pixel is four taps whatever the ratio
+/// between tip and dab size.
+class BrushTip {
+public:
+    /// `coverage` is width x height, 0..255. The tip is centred in a
+    /// power-of-two square; its diameter maps to the dab's.
+    BrushTip(const uint8_t* coverage, int width, int height);
+
+    int size() const { return m_size; }
+    int levels() const { return static_cast<int>(m_levels.size()); }
+
+    /// Mip level whose size is closest to `diameter` pixels.
+    int levelFor(float diameter) const;
+
+    /// Bilinear coverage (0..1) at (u, v) in [0, 1]² of the tip; 0 outside.
+    float sample(int level, float u, float v) const;
+
+private:
+    struct Level {
+        size_t offset = 0;
+        int size = 0;
+    };
+
+    int m_size = 0;
+    std::vector<Level> m_levels;
+    std::vector<uint8_t> m_texels;  // All levels, packed
+};
+
+/// Registry of brush tips. Tips are immutable once added and ids are never
+/// reused, so stamps cached for a tip stay valid. Thread-safe.
+class BrushTipAtlas {
+public:
+    static constexpr int MAX_TIP_SIZE = 2048;
+
+    BrushTipAtlas();
+    ~BrushTipAtlas();
+
+    /// Add a tip from coverage values; returns its id.
+    int addTip(const uint8_t* coverage, int width, int height);
+
+    /// Add a tip from an image: dark, opaque pixels paint. Larger images
+    /// are scaled down to MAX_TIP_SIZE. Returns -1 if the image is null.
+    int addTip(const QImage& image);
+
+    /// Returns -1 if the file cannot be read.
+    int loadTip(const QString& path);
+
+    /// The tip, or nullptr for an unknown id.
+    std::shared_ptr<const BrushTip> tip(int id) const;
+
+    int count() const;
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<std::shared_ptr<const BrushTip>> m_tips;
+};
+
+}  // namespace comicos
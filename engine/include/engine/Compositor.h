@@ -1,8 +1,11 @@
 #pragma once
 
+#include "core/DocumentPreview.h"
 #include "core/LayerStack.h"
 #include "core/Types.h"
+#include "engine/WetLayer.h"
 #include <QImage>
+#include <QRect>
 #include <QRectF>
 #include <vector>
 
@@ -17,18 +20,33 @@ public:
     ~Compositor();
 
     /// Composite all visible layers for the given tile coordinate.
-    /// Returns the composited RGBA8 tile data.
+    /// Returns the composited RGBA8 tile data. A `stroke` in progress is
+    /// drawn onto its target layer, as it will be once committed.
     std::vector<uint8_t> compositeTile(const LayerStack& layers,
-                                        const TileCoord& coord) const;
+                                        const TileCoord& coord,
+                                        const WetLayer* stroke = nullptr) const;
 
     /// Composite all visible layers in a region and return as QImage.
-    /// Used for export and preview.
+    /// Used for export and preview. Does not materialize lazy tiles, and
+    /// is safe to call concurrently on different documents.
     QImage compositeRegion(const LayerStack& layers,
                            const QRectF& region) const;
 
+    /// Composite a pixel rect into caller-owned RGBA8 rows (`bytesPerLine`
+    /// apart), e.g. one band of a streaming export.
+    void compositeRegionInto(const LayerStack& layers, const QRect& rect,
+                             uint8_t* out, qsizetype bytesPerLine) const;
+
     /// Flatten the entire canvas to a single QImage.
+    /// Holds the whole canvas in memory; for export files, use Exporter.
     QImage flatten(const LayerStack& layers, const QSize& canvasSize) const;
 
+    /// Thumbnail + preview pyramid for embedding in .cmc files.
+    /// Each layer tile is box-filtered before compositing, so the cost is
+    /// one pass over the tile pixels rather than a full-resolution flatten.
+    /// Lazy tiles are decoded to scratch and stay lazy.
+    DocumentPreview renderPreview(const LayerStack& layers, const QSize& canvasSize) const;
+
     // Extension point: here is where the compositing pipeline goes
     // Future features:
     // - GPU-accelerated compositing via compute shaders
@@ -38,6 +56,11 @@ public:
     // - Alpha lock
 
 private:
+    /// Composite one tile of all visible layers into `out` (TILE_BYTES),
+    /// decoding lazy tiles into `scratch`. False if no layer has the tile.
+    static bool compositeTileInto(const LayerStack& layers, const TileCoord& coord,
+                                  uint8_t* scratch, uint8_t* out);
+
     /// Blend two RGBA8 pixels using the given blend mode.
     static Pixel blendPixels(const Pixel& dst, const Pixel& src,
                              BlendMode mode, float layerOpacity);
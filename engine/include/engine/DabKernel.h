@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QColor>
+#include <QString>
+#include <cstdint>
+
+namespace comicos {
+
+/// What a dab deposits where it covers a pixel: source-over (straight
+/// alpha) with `color`, or for the eraser dst.a *= 1 - alpha.
+///
+/// Resolved to 8-bit integers once per stroke; the kernels blend in integer
+/// fixed point, so output does not depend on compiler or instruction set.
+struct DabPaint {
+    uint8_t opacity = 255;
+    uint8_t color[3] = {};  // Straight RGB
+    bool erase = false;
+
+    static DabPaint make(const QColor& color, float opacity, bool erase);
+};
+
+/// Round(x / 255) for x in [0, 255 * 255], without a division.
+inline uint32_t div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+/// Instruction sets the dab kernel is built for.
+enum class DabKernelLevel : uint8_t {
+    Scalar,  // Portable, also the reference output
+    Sse41,   // 4 pixels per vector, two vectors per iteration
+    Avx2,    // 8 pixels per vector
+};
+
+/// Row kernels for the dab path: stamp masks (see StampCache) accumulate
+/// into wet layer coverage, and coverage blends into RGBA8 tiles.
+///
+/// Everything is integer: alpha = coverage * opacity / 255 and the
+/// source-over terms are rounded with div255(); the one division, by the
+/// output alpha, is exact in every kernel. The SIMD kernels (x86 only,
+/// chosen at runtime from CPU features) produce identical bytes to the
+/// scalar ones.
+class DabKernels {
+public:
+    /// Blend `count` pixels starting at `pixels` with coverage mask[i] (0..255).
+    /// Pixels with zero coverage are left untouched.
+    static void stampRow(uint8_t* pixels, const uint8_t* mask, int count, const DabPaint& paint);
+
+    /// dst[i] = max(dst[i], div255(mask[i] * opacity)) for `count` bytes.
+    static void maxRow(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity);
+
+    /// dst[i] += div255(mask[i] * opacity), saturating at 255.
+    static void addRow(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity);
+
+    /// Kernels in use: the best the CPU supports unless overridden.
+    static DabKernelLevel level();
+
+    /// Force a kernel (benchmarks, output comparison). Levels the CPU or the
+    /// build lacks fall back to the best available one.
+    static void setLevel(DabKernelLevel level);
+
+    /// Best level this build and CPU support.
+    static DabKernelLevel bestLevel();
+
+    static QString name(DabKernelLevel level);
+
+private:
+    // Defined in DabKernel.cpp, DabKernelSse41.cpp and DabKernelAvx2.cpp
+    static void stampRowScalar(uint8_t* pixels, const uint8_t* mask, int count, const DabPaint& paint);
+    static void stampRowSse41(uint8_t* pixels, const uint8_t* mask, int count, const DabPaint& paint);
+    static void stampRowAvx2(uint8_t* pixels, const uint8_t* mask, int count, const DabPaint& paint);
+    static void maxRowScalar(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity);
+    static void maxRowSse41(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity);
+    static void maxRowAvx2(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity);
+    static void addRowScalar(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity);
+    static void addRowSse41(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity);
+    static void addRowAvx2(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity);
+};
+
+}  // namespace comicos
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "core/LayerStack.h"
+#include "engine/ImageEncoder.h"
+#include <QSize>
+#include <QString>
+
+namespace comicos {
+
+/// Options for Exporter::exportFlattened.
+struct ExportOptions {
+    ImageFormat format = ImageFormat::Png;
+    int bitDepth = 8;  // 8 or 16 bits per sample
+};
+
+/// Layered interchange formats written by Exporter::exportLayered.
+enum class LayeredFormat {
+    Psd,         // Photoshop (PSB above 30000 px), see PsdWriter
+    OpenRaster,  // .ora, see OraWriter
+};
+
+/// Writes documents to interchange formats for print and hand-off.
+class Exporter {
+public:
+    /// Stream the flattened canvas to an image file, one tile row (band)
+    /// at a time. Two band buffers alternate: band N+1 is composited on the
+    /// calling thread while band N is encoded on a worker, so peak memory is
+    /// two bands plus encoder state, independent of canvas height.
+    static bool exportFlattened(const LayerStack& layers, const QSize& canvasSize, int dpi,
+                                const QString& path, const ExportOptions& options = {});
+
+    /// Write every layer with its name, opacity, visibility and blend mode,
+    /// plus a flattened composite. Layers are encoded in parallel batches.
+    static bool exportLayered(const LayerStack& layers, const QSize& canvasSize, int dpi,
+                              const QString& path, LayeredFormat format);
+};
+
+}  // namespace comicos
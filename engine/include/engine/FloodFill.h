@@ -0,0 +1,124 @@
+#pragma once
+
+#include "core/LayerStack.h"
+#include "core/Selection.h"
+#include "core/Tile.h"
+#include "core/Types.h"
+#include <QColor>
+#include <QSize>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace comicos {
+
+/// Pixels a fill compares against its seed.
+enum class FillSample : uint8_t {
+    CurrentLayer,  // The layer being filled
+    Merged,        // All visible layers, as composited
+};
+
+struct FillOptions {
+    /// Largest per-channel difference from the seed (premultiplied, 0..255)
+    /// that still counts as the same colour.
+    int tolerance = 0;
+    FillSample sample = FillSample::CurrentLayer;
+    /// Close breaks in line art up to about twice this many pixels wide
+    /// (0 = off, at most FloodFill::MAX_GAP_CLOSE).
+    int gapClose = 0;
+};
+
+/// Bucket fill over the sparse tile grid.
+///
+/// The region is found with a scanline span fill over per-tile byte maps
+/// that are built lazily, for the tiles the fill reaches: a fill inside a
+/// small panel never looks at the rest of the page, and canvas areas
+/// without tiles cost a memset.
+///
+/// Gap closing grows everything that does not match the seed by gapClose
+/// pixels before filling, so the fill cannot slip through short breaks in
+/// the line art, then grows the filled region back by the same amount,
+/// limited to pixels that match the seed.
+class FloodFill {
+public:
+    static constexpr int MAX_GAP_CLOSE = 32;
+
+    /// `layer` is the layer being filled (sampled in CurrentLayer mode).
+    FloodFill(const LayerStack& layers, const Layer& layer, const QSize& canvasSize,
+              const FillOptions& options);
+    ~FloodFill();
+
+    FloodFill(const FloodFill&) = delete;
+    FloodFill& operator=(const FloodFill&) = delete;
+
+    /// Find the region connected to pixel (x, y). False if the seed is
+    /// outside the canvas or closed off by gap closing.
+    bool compute(int x, int y);
+
+    /// Tiles the region covers, sorted.
+    const std::vector<TileCoord>& tiles() const { return m_regionTiles; }
+
+    /// Region mask of a tile (TILE_PIXELS bytes, 255 inside), or nullptr.
+    const uint8_t* maskAt(const TileCoord& coord) const;
+
+    /// Paint the region onto `layer` in `color`, within `selection` if one
+    /// is given (unselected tiles are skipped). Returns the tiles changed;
+    /// `before` receives their previous content for undo (nullptr for
+    /// tiles that did not exist).
+    std::vector<TileCoord> apply(
+        Layer& layer, const QColor& color,
+        std::unordered_map<TileCoord, std::unique_ptr<Tile>>* before,
+        const Selection* selection = nullptr) const;
+
+private:
+    /// Per-pixel fill state.
+    enum : uint8_t { BLOCKED = 0, OPEN = 1, FILLED = 2 };
+
+    /// Barrier map (1 = does not match the seed) and fill state of one tile
+    /// of the canvas grid, both built on first use.
+    struct GridTile {
+        bool classified = false;
+        uint8_t uniform = 0;  // 0 or 1 if every barrier byte is that value, else MIXED
+        std::unique_ptr<uint8_t[]> barrier;
+        std::unique_ptr<uint8_t[]> state;
+        int filledPixels = 0;
+    };
+    static constexpr uint8_t MIXED = 2;
+
+    GridTile& gridAt(int tx, int ty) { return m_grid[ty * m_cols + tx]; }
+    const GridTile& gridAt(int tx, int ty) const { return m_grid[ty * m_cols + tx]; }
+
+    /// Canvas pixels inside the tile (edge tiles are partial).
+    int tileWidth(int tx) const;
+    int tileHeight(int ty) const;
+
+    void classify(int tx, int ty);
+    void buildState(int tx, int ty);
+    uint8_t* stateRow(int tx, int y);
+
+    /// Copy barrier (or, in the region pass, FILLED) flags of canvas row y,
+    /// columns [x0, x0 + count), into `line`; 0 outside the canvas.
+    void barrierLine(int y, int x0, int count, uint8_t* line);
+    void filledLine(int y, int x0, int count, uint8_t* line) const;
+
+    void fillFrom(int x, int y);
+    void buildRegion();
+
+    const LayerStack& m_layers;
+    const Layer& m_layer;
+    QSize m_canvas;
+    FillOptions m_options;
+    int m_cols = 0;
+    int m_rows = 0;
+    uint8_t m_seed[4] = {};  // Premultiplied RGBA
+    std::vector<GridTile> m_grid;
+    std::unordered_map<const uint8_t*, uint8_t> m_uniformBuffers;  // Buffer -> uniform
+    std::vector<uint8_t> m_scratch;
+
+    std::unordered_map<TileCoord, std::unique_ptr<uint8_t[]>> m_masks;
+    std::unordered_set<TileCoord> m_fullMasks;  // Whole tiles inside the region
+    std::vector<TileCoord> m_regionTiles;
+};
+
+}  // namespace comicos
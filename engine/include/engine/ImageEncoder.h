@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QSize>
+#include <cstdint>
+#include <memory>
+
+class QIODevice;
+
+namespace comicos {
+
+/// Output file format of a flattened export.
+enum class ImageFormat : uint8_t {
+    Png,
+    Tiff,
+};
+
+/// Incremental image encoder: rows are written top to bottom in any number
+/// of calls, so memory stays bounded by one band of rows plus compressor
+/// state, whatever the image height.
+///
+/// Input rows are straight-alpha RGBA8 (the tile format). With 16-bit
+/// output every sample is widened exactly (v * 257).
+///
+/// PNG: one zlib stream split over IDAT chunks (stored deflate blocks when
+/// built without zlib). TIFF: Adobe Deflate strips with horizontal
+/// predictor; switches to BigTIFF when the image could exceed 4 GiB.
+class ImageEncoder {
+public:
+    struct Params {
+        QSize size;
+        int bitDepth = 8;  // 8 or 16 bits per sample
+        int dpi = 300;
+    };
+
+    virtual ~ImageEncoder() = default;
+
+    /// Encoder writing to `device` (must be open, seekable for TIFF).
+    static std::unique_ptr<ImageEncoder> create(ImageFormat format, QIODevice* device);
+
+    /// Write the header. Must be called once, before writeRows().
+    virtual bool begin(const Params& params) = 0;
+
+    /// Append `rows` rows of RGBA8 pixels, each `stride` bytes apart.
+    virtual bool writeRows(const uint8_t* rgba, int rows, qsizetype stride) = 0;
+
+    /// Flush pending data and write the trailer. All rows must be written.
+    virtual bool finish() = 0;
+};
+
+}  // namespace comicos
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "core/Layer.h"
+#include "core/Tile.h"
+#include "core/Types.h"
+#include <QRect>
+#include <QTransform>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace comicos {
+
+/// How a layer transform samples its source.
+enum class TransformQuality : uint8_t {
+    Preview,   // Nearest pixel per 4x4 block, for interactive dragging
+    Bilinear,
+    Bicubic,   // Catmull-Rom
+};
+
+/// Moves, scales and rotates the pixels of one layer.
+///
+/// The layer's tiles when the transform begins are kept as the source
+/// (shared copy-on-write), and every apply() starts again from them, so a
+/// drag of many previews never blurs or clips the content. Each transform
+/// takes the cheapest exact path:
+///  - translations by whole tiles move tiles to new keys; no pixel is copied,
+///  - other whole-pixel translations copy row spans from the (up to) four
+///    source tiles under each destination tile,
+///  - anything else is resampled in premultiplied alpha, one destination
+///    tile per task, in parallel.
+class LayerTransform {
+public:
+    /// Keep the current tiles of `layer` as the source.
+    explicit LayerTransform(const Layer& layer);
+    ~LayerTransform();
+
+    LayerTransform(const LayerTransform&) = delete;
+    LayerTransform& operator=(const LayerTransform&) = delete;
+
+    /// Smallest rect holding every non-transparent source pixel.
+    const QRect& contentBounds() const { return m_bounds; }
+
+    /// Replace the tiles of `layer` with the source under `transform` (canvas
+    /// pixels, affine). Returns the tiles changed since the last call.
+    std::vector<TileCoord> apply(Layer& layer, const QTransform& transform,
+                                 TransformQuality quality);
+
+    /// Put the source back on `layer`. Returns the tiles changed.
+    std::vector<TileCoord> restore(Layer& layer);
+
+    /// Every tile the transform has changed, sorted, and their content
+    /// before it (nullptr where there was none), for StrokeCommand.
+    std::vector<TileCoord> touchedTiles() const;
+    std::unordered_map<TileCoord, std::unique_ptr<Tile>> takeBefore();
+
+private:
+    /// Pixels of source tile (tx, ty), or nullptr.
+    const uint8_t* sourceTile(int tx, int ty) const;
+    const uint8_t* sourcePixel(int x, int y) const;
+
+    /// Add the premultiplied N x N source texels from (x0, y0), weighted by
+    /// wx[i] * wy[j], to sum.
+    template <int N>
+    void accumulate(int x0, int y0, const float* wx, const float* wy, float sum[4]) const;
+
+    /// Render one destination tile; false if it came out transparent.
+    bool shiftTile(const TileCoord& coord, int dx, int dy, uint8_t* pixels) const;
+    bool resampleTile(const TileCoord& coord, const QTransform& inverse,
+                      TransformQuality quality, uint8_t* pixels) const;
+
+    /// Allocate `coords` on `tiles`, render each with `render` in parallel
+    /// and drop the ones that came out transparent from both.
+    template <typename Render>
+    void renderTiles(TileManager& tiles, std::vector<TileCoord>& coords, Render&& render);
+
+    std::unordered_map<TileCoord, std::unique_ptr<Tile>> m_source;
+    QRect m_bounds;
+
+    // Dense lookup over the source's tile range, for sampling
+    TileCoord m_gridOrigin;
+    int m_gridCols = 0;
+    int m_gridRows = 0;
+    std::vector<const uint8_t*> m_grid;
+
+    std::vector<TileCoord> m_written;         // Tiles the layer holds now
+    std::unordered_set<TileCoord> m_touched;  // Every tile written or removed
+};
+
+}  // namespace comicos
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "core/Types.h"
+#include <vector>
+
+namespace comicos {
+
+/// Extrapolates the pen a few milliseconds past the last input sample, so
+/// the stroke tip can be drawn where the pen is now rather than where it
+/// was when the sample was taken.
+///
+/// Uses the last three samples: velocity from the newest pair, acceleration
+/// from the change in velocity. Acceleration is capped so it can slow the
+/// pen down to a stop but never reverse it, which keeps overshoot at sharp
+/// turns within one horizon's worth of travel.
+class MotionPredictor {
+public:
+    static constexpr float DEFAULT_HORIZON_MS = 12.0f;
+    static constexpr float MAX_HORIZON_MS = 50.0f;
+
+    MotionPredictor();
+    ~MotionPredictor();
+
+    /// How far ahead to predict; 0 disables prediction.
+    void setHorizon(float ms);
+    float horizon() const { return m_horizon; }
+
+    /// Forget the samples (new stroke).
+    void reset();
+
+    /// Add a real sample. Timestamps are in milliseconds (CanvasPoint).
+    void addSample(const CanvasPoint& point);
+
+    /// Replace `predicted` with samples after the last real one, ending at
+    /// the horizon. Empty without enough timed history, or while the pen is
+    /// still or has paused.
+    void predict(std::vector<CanvasPoint>& predicted) const;
+
+private:
+    /// Samples further apart than this are a pause, not motion.
+    static constexpr double MAX_SAMPLE_GAP_MS = 50.0;
+    /// Spacing of the predicted samples.
+    static constexpr float STEP_MS = 4.0f;
+    /// Below this speed (px/ms) the pen counts as still.
+    static constexpr float MIN_SPEED = 0.01f;
+
+    float m_horizon = DEFAULT_HORIZON_MS;
+    CanvasPoint m_samples[3];  // Oldest first
+    int m_count = 0;
+};
+
+}  // namespace comicos
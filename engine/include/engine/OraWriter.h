@@ -0,0 +1,21 @@
+#pragma once
+
+#include "core/LayerStack.h"
+#include <QSize>
+#include <QString>
+
+namespace comicos {
+
+/// Layered OpenRaster (.ora) export: a ZIP with stack.xml, one PNG per
+/// layer (cropped to its tile bounds), mergedimage.png and a thumbnail.
+///
+/// Layer PNGs are encoded in parallel, a batch of layers at a time; each
+/// is streamed band by band, so only one band per worker is decoded and
+/// only the current batch of PNGs is held before being written out.
+class OraWriter {
+public:
+    static bool write(const LayerStack& layers, const QSize& canvasSize, int dpi,
+                      const QString& path);
+};
+
+}  // namespace comicos
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "core/LayerStack.h"
+#include <QSize>
+#include <QString>
+
+namespace comicos {
+
+/// Layered Photoshop export (PSD, or PSB above 30000 px per side).
+///
+/// Each layer is written with its name (also as Unicode), opacity,
+/// visibility and blend mode, cropped to the bounds of its allocated tiles.
+/// Channels are PackBits-compressed in parallel, one task per tile row of a
+/// layer, for batches of layers at a time: decoded pixels exist only for
+/// the bands being encoded, and compressed data only for the current batch.
+/// A flattened composite (also RLE) follows for readers that ignore layers.
+class PsdWriter {
+public:
+    static bool write(const LayerStack& layers, const QSize& canvasSize, int dpi,
+                      const QString& path);
+};
+
+}  // namespace comicos
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "core/Layer.h"
+#include "core/Types.h"
+#include <QSize>
+#include <cstdint>
+#include <vector>
+
+namespace comicos {
+
+struct RegionOptions {
+    /// A pixel is line art when its ink (alpha times darkness, 0..255)
+    /// reaches this. Works for lines on a transparent layer and for scans
+    /// on an opaque white background alike.
+    int inkThreshold = 128;
+};
+
+/// Connected regions between the lines of a line-art layer, for flatting.
+///
+/// Each tile is labelled on its own, in parallel: rows become runs of
+/// non-line pixels, and runs that touch the run above (4-connected) are
+/// joined with a union-find. Labels are then joined across tile borders
+/// and numbered 0..regionCount()-1 in reading order of their first tile.
+/// Storing runs instead of per-pixel labels keeps a full page at a few MB.
+class RegionMap {
+public:
+    static constexpr uint32_t NONE = ~0u;
+
+    /// Label the regions of `lineArt` inside the canvas. False if there
+    /// are none (the canvas is all line art, or empty).
+    bool build(const Layer& lineArt, const QSize& canvasSize, const RegionOptions& options = {});
+
+    int regionCount() const { return m_regionCount; }
+
+    /// Region of canvas pixel (x, y), or NONE for line art and outside.
+    uint32_t regionAt(int x, int y) const;
+
+    /// A different opaque colour for every region.
+    std::vector<Pixel> distinctColors() const;
+
+    /// Colours picked from hint strokes on `hints`: each region takes the
+    /// hint colour covering most of its pixels. Regions without hints get
+    /// a transparent colour and are left unpainted.
+    std::vector<Pixel> colorsFromHints(const Layer& hints) const;
+
+    /// Paint every region in colors[region] onto `target` (replacing what
+    /// was there). Returns the tiles written.
+    std::vector<TileCoord> paint(Layer& target, const std::vector<Pixel>& colors) const;
+
+private:
+    /// Non-line pixels [x0, x1) of one tile row. `label` is tile-local
+    /// while building, the region afterwards.
+    struct Run {
+        uint16_t x0;
+        uint16_t x1;
+        uint32_t label;
+    };
+
+    struct TileRuns {
+        std::vector<uint32_t> rowStart;  // TILE_SIZE + 1 offsets into runs
+        std::vector<Run> runs;
+        uint32_t labels = 0;             // Tile-local labels
+    };
+
+    TileRuns& tileAt(int tx, int ty) { return m_tiles[ty * m_cols + tx]; }
+    const TileRuns& tileAt(int tx, int ty) const { return m_tiles[ty * m_cols + tx]; }
+
+    void labelTile(const Layer& lineArt, int tx, int ty);
+
+    QSize m_canvas;
+    RegionOptions m_options;
+    int m_cols = 0;
+    int m_rows = 0;
+    int m_regionCount = 0;
+    std::vector<TileRuns> m_tiles;
+};
+
+}  // namespace comicos
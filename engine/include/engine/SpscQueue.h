@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace comicos {
+
+/// Bounded single-producer, single-consumer ring buffer.
+///
+/// tryPush() and tryPop() never block and never allocate: each side writes
+/// only its own index, and the release/acquire pair on that index hands the
+/// slot over. Exactly one thread may push and one other thread may pop.
+template <typename T>
+class SpscQueue {
+public:
+    /// Capacity is rounded up to a power of two.
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        m_slots.resize(size);
+        m_mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // --- Producer ---
+    /// False if the queue is full; `value` is left untouched.
+    bool tryPush(const T& value) {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) > m_mask) return false;
+        m_slots[tail & m_mask] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // --- Consumer ---
+    /// False if the queue is empty.
+    bool tryPop(T& value) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) return false;
+        value = std::move(m_slots[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Snapshot; exact only on the consumer side.
+    bool empty() const {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return m_slots.size(); }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::vector<T> m_slots;
+    size_t m_mask = 0;
+    // On separate cache lines: each side only writes its own index
+    alignas(CACHE_LINE) std::atomic<size_t> m_head{0};  // Next slot to pop
+    alignas(CACHE_LINE) std::atomic<size_t> m_tail{0};  // Next slot to push
+};
+
+}  // namespace comicos
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace comicos {
+
+class BrushTipAtlas;
+
+/// Shape of a dab beyond its position (see BrushDab).
+struct StampShape {
+    float radius = 1.0f;    // Half the major axis
+    float hardness = 1.0f;  // Round tip only
+    float rotation = 0.0f;  // Radians
+    float aspect = 1.0f;    // Minor / major axis, (0, 1]
+    int tipId = -1;         // BrushTipAtlas tip, or -1 for the round tip
+};
+
+/// Coverage mask of a dab at one quantized shape and sub-pixel offset.
+/// Coverage excludes opacity, which is applied when the stamp is blitted
+/// (DabKernels::stampRow).
+struct BrushStamp {
+    int size = 0;                 // Width and height in pixels
+    std::vector<uint8_t> mask;    // size * size, coverage 0..255
+    std::vector<uint16_t> spans;  // Per row: [begin, end) of non-zero coverage
+
+    int spanBegin(int row) const { return spans[row * 2]; }
+    int spanEnd(int row) const { return spans[row * 2 + 1]; }
+    size_t bytes() const { return mask.size() + spans.size() * sizeof(uint16_t); }
+};
+
+/// Cache of brush stamps, so a stroke blits masks instead of evaluating the
+/// falloff for every pixel of every dab.
+///
+/// Quantization (chosen to stay visually identical to analytic rendering):
+///   radius    0.25 px steps up to 16 px, then 1/64 octave (~1.1%)
+///   hardness  1/64 steps
+///   aspect    1/32 steps
+///   rotation  about one pixel of travel at the tip's edge; none for a
+///             round, circular tip
+///   offset    dab centre snapped to 1/4 px below 8 px radius, 1/2 px below
+///             16 px, whole pixels above
+///
+/// Image tips (BrushTipAtlas) are sampled from the mip level closest to the
+/// dab's diameter, so building a stamp costs the same per pixel for any
+/// tip resolution.
+///
+/// Stamps are evicted least recently used once the cache exceeds its
+/// memory cap. Dabs above MAX_RADIUS are built uncached: their masks are
+/// large and rarely reused.
+class StampCache {
+public:
+    static constexpr size_t DEFAULT_MAX_BYTES = 32 * 1024 * 1024;
+    static constexpr float MAX_RADIUS = 256.0f;
+
+    explicit StampCache(size_t maxBytes = DEFAULT_MAX_BYTES);
+    ~StampCache();
+
+    /// Tips for shapes with a tipId (not owned). Without an atlas, or for
+    /// an unknown id, dabs use the round tip.
+    void setTipAtlas(const BrushTipAtlas* tips) { m_tips = tips; }
+
+    /// Stamp for a dab centred at (x, y) canvas pixels. (*originX, *originY)
+    /// receives the canvas pixel under mask pixel (0, 0).
+    std::shared_ptr<const BrushStamp> stamp(float x, float y, const StampShape& shape,
+                                            int* originX, int* originY);
+    std::shared_ptr<const BrushStamp> stamp(float x, float y, float radius, float hardness,
+                                            int* originX, int* originY);
+
+    /// Same stamp as stamp() would return, built without touching any cache.
+    static std::shared_ptr<const BrushStamp> uncached(float x, float y, const StampShape& shape,
+                                                      const BrushTipAtlas* tips, int* originX,
+                                                      int* originY);
+    static std::shared_ptr<const BrushStamp> uncached(float x, float y, float radius,
+                                                      float hardness, int* originX, int* originY);
+
+    /// True if stamps of `shape` are solid discs (full coverage inside the
+    /// radius, none outside): a round, circular tip that quantizes to full
+    /// hardness. BrushCapsule draws such dabs without stamps.
+    static bool isSolidDisc(const StampShape& shape);
+
+    // --- Statistics ---
+    size_t size() const { return m_entries.size(); }
+    size_t bytes() const { return m_bytes; }
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+    float hitRate() const;
+
+    void clear();
+
+private:
+    /// Quantized dab and where its mask lands on the canvas.
+    struct Placement {
+        uint64_t key = 0;
+        float radius = 0.0f;
+        float hardness = 0.0f;
+        float rotation = 0.0f;
+        float aspect = 1.0f;
+        int tipId = -1;
+        float offsetX = 0.0f;  // Sub-pixel centre offset, 0..1
+        float offsetY = 0.0f;
+        int half = 0;          // Mask size is 2 * half
+        int originX = 0;
+        int originY = 0;
+    };
+
+    static Placement place(float x, float y, const StampShape& shape);
+    static std::shared_ptr<const BrushStamp> build(const Placement& placement,
+                                                   const BrushTipAtlas* tips);
+    void evictLRU();
+
+    struct Entry {
+        std::shared_ptr<const BrushStamp> stamp;
+        std::list<uint64_t>::iterator lru;
+    };
+
+    size_t m_maxBytes;
+    const BrushTipAtlas* m_tips = nullptr;
+    size_t m_bytes = 0;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    std::list<uint64_t> m_lruOrder;  // front = most recently used
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+};
+
+}  // namespace comicos
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "core/Stroke.h"
+#include "core/Types.h"
+#include "engine/BrushTipAtlas.h"
+#include <cstdint>
+#include <vector>
+
+namespace comicos {
+
+/// Draws VectorLayer tiles by replaying their strokes through a BrushEngine,
+/// exactly as they were painted. Every dab is still placed, to keep the
+/// stroke's spacing, but only those reaching the tile are stamped, so a
+/// tile costs its share of each stroke rather than the whole stroke.
+class StrokeRasterizer {
+public:
+    /// Make VectorLayer draw its tiles here, with image tips from `tips`
+    /// (null = round tips only). The atlas must outlive every layer.
+    static void install(const BrushTipAtlas* tips);
+
+    /// Draw `strokes`, in order, over a transparent tile `coord` into `out`
+    /// (TILE_BYTES). False if nothing was drawn. Each thread replays with
+    /// its own engine, so tiles can be drawn concurrently.
+    static bool rasterize(const std::vector<const Stroke*>& strokes, const TileCoord& coord,
+                          uint8_t* out, const BrushTipAtlas* tips);
+};
+
+}  // namespace comicos
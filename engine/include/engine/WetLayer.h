@@ -0,0 +1,144 @@
+#pragma once
+
+#include "core/Selection.h"
+#include "core/Types.h"
+#include "engine/BrushCapsule.h"
+#include "engine/DabKernel.h"
+#include "engine/StampCache.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace comicos {
+
+/// A stamp placed on the canvas: mask pixel (0, 0) lies at (originX, originY).
+struct PlacedStamp {
+    std::shared_ptr<const BrushStamp> stamp;
+    int originX = 0;
+    int originY = 0;
+    float opacity = 1.0f;
+};
+
+/// Per-stroke coverage buffer ("wet layer").
+///
+/// Dabs accumulate 8-bit coverage here instead of blending into the layer:
+/// one byte written per pixel instead of an RGBA read-modify-write, and
+/// overlapping dabs no longer build up alpha past the stroke's opacity.
+/// The renderer shows the buffer on top of its layer (see
+/// Compositor::compositeTile) and BrushEngine composites it into the layer
+/// once when the stroke ends. Cancelling a stroke just clears the buffer.
+///
+/// With a selection, dabs skip unselected tiles entirely (no coverage tile
+/// is even allocated), and coverage on partly selected tiles is clipped to
+/// the mask after each batch. Fully selected tiles cost nothing extra.
+///
+/// Depositing does not allocate once the layer has held a stroke as large:
+/// the per-batch tile lists are kept, and clear() keeps the coverage tiles
+/// (map nodes included) for the next stroke, up to MAX_SPARE_TILES.
+class WetLayer {
+public:
+    enum class Accumulation : uint8_t {
+        Max,       // Coverage never exceeds the strongest dab (pens, markers)
+        Additive,  // Dabs build up, saturating at full coverage (airbrush)
+    };
+
+    WetLayer();
+    ~WetLayer();
+
+    /// Start a stroke onto layer `layerId`. `paint` is the stroke's colour,
+    /// at full opacity; dab opacity goes into the coverage. Coverage stays
+    /// inside `selection`, if given.
+    void begin(LayerId layerId, const DabPaint& paint, Accumulation mode,
+               std::shared_ptr<const Selection> selection = {});
+
+    /// Drop all coverage; the layer stays untouched. Up to MAX_SPARE_TILES
+    /// coverage tiles are kept for reuse, the rest are freed.
+    void clear();
+
+    bool isActive() const { return m_active; }
+    LayerId layerId() const { return m_layerId; }
+    const DabPaint& paint() const { return m_paint; }
+    Accumulation mode() const { return m_mode; }
+    const std::shared_ptr<const Selection>& selection() const { return m_selection; }
+
+    /// Accumulate a batch of dabs (e.g. one input segment's worth).
+    /// Dabs are bucketed by tile and the buckets rendered in parallel for
+    /// big batches; within a tile dabs apply in order, so the result is
+    /// the same as depositing them one by one.
+    void deposit(const std::vector<PlacedStamp>& dabs);
+
+    /// Accumulate a swept segment (Max mode only; see BrushEngine).
+    void deposit(const BrushCapsule& capsule);
+
+    /// Coverage tile (TILE_PIXELS bytes), or nullptr if no dab reached it.
+    const uint8_t* coverageAt(const TileCoord& coord) const;
+
+    /// Tiles with coverage, in the order dabs first reached them.
+    const std::vector<TileCoord>& tiles() const { return m_order; }
+
+    /// Replace `out` with the tiles deposited into since the last call
+    /// (each listed once). The buffers trade places, so once both have grown
+    /// neither side allocates.
+    void takeDirtyTiles(std::vector<TileCoord>& out);
+
+    /// Update a display copy of `source`: take over its stroke settings and
+    /// copy the coverage of `coords` (e.g. source.takeDirtyTiles()). Tiles
+    /// `source` has no coverage for are cleared.
+    void copyTiles(const WetLayer& source, const std::vector<TileCoord>& coords);
+
+    /// Accumulate all of `other`'s coverage into this layer, as if its dabs
+    /// had been deposited here.
+    void mergeTiles(const WetLayer& other);
+
+    /// Pixels with coverage here and none in `other`.
+    size_t uncoveredPixels(const WetLayer& other) const;
+
+    /// Composite this tile's coverage into RGBA8 `pixels` (a layer tile or
+    /// a display copy of one). No-op where there is no coverage.
+    void applyTo(const TileCoord& coord, uint8_t* pixels) const;
+
+private:
+    /// Batches touching fewer stamp pixels than this stay on the calling thread.
+    static constexpr size_t PARALLEL_MIN_PIXELS = 128 * 1024;
+
+    /// Cleared coverage tiles kept for the next stroke: enough for a typical
+    /// stroke (2 MB), so a page-wide one does not pin its tiles afterwards.
+    static constexpr size_t MAX_SPARE_TILES = 32;
+
+    /// The dabs of one deposit() that reach one tile.
+    struct Bucket {
+        TileCoord coord;
+        uint8_t* coverage = nullptr;
+        const uint8_t* selection = nullptr;  // Mask of a partly selected tile
+        std::vector<int> dabs;
+    };
+
+    /// A tile one capsule reaches.
+    struct Target {
+        TileCoord coord;
+        uint8_t* coverage = nullptr;
+        const uint8_t* selection = nullptr;
+    };
+
+    using TileMap = std::unordered_map<TileCoord, std::unique_ptr<uint8_t[]>>;
+
+    uint8_t* coverageForWrite(const TileCoord& coord);
+
+    bool m_active = false;
+    LayerId m_layerId = 0;
+    DabPaint m_paint;
+    Accumulation m_mode = Accumulation::Max;
+    std::shared_ptr<const Selection> m_selection;
+    TileMap m_tiles;
+    std::vector<TileMap::node_type> m_spareTiles;  // Cleared, for coverageForWrite()
+    std::vector<TileCoord> m_order;
+    std::vector<TileCoord> m_dirty;
+
+    // deposit() scratch
+    std::vector<Bucket> m_buckets;  // Only the first m_bucketCount are in use
+    int m_bucketCount = 0;
+    std::vector<int> m_bucketGrid;  // Bucket per tile of the batch's tile range, or -1
+    std::vector<Target> m_targets;
+};
+
+}  // namespace comicos
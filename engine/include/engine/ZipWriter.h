@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+class QIODevice;
+
+namespace comicos {
+
+/// Minimal ZIP archive writer for container formats (OpenRaster).
+/// Entries are stored uncompressed: the payloads are PNGs, which deflate
+/// again would not shrink. Entry names are UTF-8. No ZIP64, so archives
+/// are limited to 4 GiB; writes fail beyond that.
+class ZipWriter {
+public:
+    explicit ZipWriter(QIODevice* device);
+
+    /// Append a stored entry.
+    bool addFile(const QString& name, const QByteArray& data);
+
+    /// Write the central directory. No entries can be added afterwards.
+    bool finish();
+
+private:
+    struct Entry {
+        QByteArray name;
+        uint32_t crc;
+        uint32_t size;
+        uint32_t offset;  // Of the local header
+    };
+
+    QIODevice* m_device;
+    std::vector<Entry> m_entries;
+};
+
+}  // namespace comicos
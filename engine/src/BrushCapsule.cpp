@@ -0,0 +1,225 @@
+#include "engine/BrushCapsule.h"
+#include "core/Types.h"
+#include "engine/DabKernel.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace comicos {
+
+namespace {
+
+uint8_t coverageFor(float opacity) {
+    return static_cast<uint8_t>(std::lround(std::clamp(opacity, 0.0f, 1.0f) * 255.0f));
+}
+
+/// Widen [*lo, *hi] by the part of row `yc` inside the disc. Both capsules
+/// sharing a disc compute its span from the same floats, so they agree on
+/// which pixels it holds.
+void addDiscSpan(float cx, float cy, float r, float yc, float* lo, float* hi) {
+    const float dy = yc - cy;
+    const float h2 = r * r - dy * dy;
+    if (h2 < 0.0f) return;
+    const float h = std::sqrt(h2);
+    *lo = std::min(*lo, cx - h);
+    *hi = std::max(*hi, cx + h);
+}
+
+/// std::floor without the library call (baseline x86-64 has no roundss).
+int floorToInt(float v) {
+    const int i = static_cast<int>(v);
+    return i - (static_cast<float>(i) > v);
+}
+
+/// Columns [*begin, *end) whose pixel centres lie in [lo, hi].
+void pixelSpan(float lo, float hi, int* begin, int* end) {
+    if (lo > hi) {
+        *begin = *end = 0;
+        return;
+    }
+    *begin = -floorToInt(0.5f - lo);  // ceil(lo - 0.5)
+    *end = std::max(floorToInt(hi - 0.5f) + 1, *begin);
+}
+
+/// Full coverage across a tile row: maxRow() with it as the mask writes
+/// the opacity unchanged (div255(255 * v) == v), in the SIMD kernels.
+constexpr auto FULL_ROW = [] {
+    std::array<uint8_t, TILE_SIZE> row{};
+    row.fill(255);
+    return row;
+}();
+
+/// dst[i] = max(dst[i], value) for up to a tile row.
+void maxFill(uint8_t* dst, int count, uint8_t value) {
+    if (count > 0) DabKernels::maxRow(dst, FULL_ROW.data(), count, value);
+}
+
+}  // namespace
+
+BrushCapsule::BrushCapsule(const BrushDab& from, const BrushDab& to, bool startDeposited) {
+    reset(from, to, startDeposited);
+}
+
+void BrushCapsule::reset(const BrushDab& from, const BrushDab& to, bool startDeposited) {
+    m_tangents[0] = m_tangents[1] = {};
+    m_bounds = QRect();
+    m_rows.clear();
+    m_pixels = 0;
+
+    const uint8_t fromCoverage = coverageFor(from.opacity);
+    const uint8_t toCoverage = coverageFor(to.opacity);
+    m_discCoverage = std::max(fromCoverage, toCoverage);
+    m_constant = fromCoverage == toCoverage;
+
+    const float dx = to.x - from.x;
+    const float dy = to.y - from.y;
+    const float length = std::sqrt(dx * dx + dy * dy);
+    m_disc = length <= std::abs(to.radius - from.radius) + 0.01f;
+
+    // Radius and opacity both follow pressure, so the larger disc is also
+    // the stronger one
+    const bool fromIsStrong = m_disc ? from.radius >= to.radius : fromCoverage >= toCoverage;
+    const BrushDab& strong = fromIsStrong ? from : to;
+    const BrushDab& weak = fromIsStrong ? to : from;
+    m_skipDisc = startDeposited && fromIsStrong;
+    m_empty = m_discCoverage == 0 || (m_disc && m_skipDisc);
+    if (m_empty) return;
+
+    m_ax = strong.x;
+    m_ay = strong.y;
+    m_ar = std::max(strong.radius, 0.0f);
+    m_ao = std::clamp(strong.opacity, 0.0f, 1.0f);
+    if (m_disc) {
+        m_constant = true;
+        m_bx = m_ax, m_by = m_ay, m_br = m_ar, m_bo = m_ao;
+    } else {
+        m_bx = weak.x;
+        m_by = weak.y;
+        m_br = std::max(weak.radius, 0.0f);
+        m_bo = std::clamp(weak.opacity, 0.0f, 1.0f);
+
+        // Outer tangents touch both discs where n . (b - a) = ar - br
+        m_dx = m_bx - m_ax;
+        m_dy = m_by - m_ay;
+        m_dr = m_br - m_ar;
+        m_a = m_dx * m_dx + m_dy * m_dy - m_dr * m_dr;
+        const float ux = m_dx / length;
+        const float uy = m_dy / length;
+        const float k = std::clamp(-m_dr / length, -1.0f, 1.0f);
+        const float s = std::sqrt(1.0f - k * k);
+        for (int i = 0; i < 2; ++i) {
+            const float sign = i == 0 ? 1.0f : -1.0f;
+            const float nx = k * ux - sign * s * uy;
+            const float ny = k * uy + sign * s * ux;
+            const float x0 = m_ax + m_ar * nx, y0 = m_ay + m_ar * ny;
+            const float x1 = m_bx + m_br * nx, y1 = m_by + m_br * ny;
+            if (y0 == y1) continue;  // Horizontal: the discs reach as far
+
+            Tangent& t = m_tangents[i];
+            t.slope = (x1 - x0) / (y1 - y0);
+            t.y0 = std::min(y0, y1);
+            t.y1 = std::max(y0, y1);
+            t.x0 = y0 < y1 ? x0 : x1;
+        }
+    }
+
+    const float left = std::min(m_ax - m_ar, m_bx - m_br);
+    const float top = std::min(m_ay - m_ar, m_by - m_br);
+    const float right = std::max(m_ax + m_ar, m_bx + m_br);
+    const float bottom = std::max(m_ay + m_ar, m_by + m_br);
+    m_bounds = QRect(QPoint(floorToInt(left), floorToInt(top)),
+                     QPoint(-floorToInt(-right), -floorToInt(-bottom)));
+
+    m_rows.resize(m_bounds.height());
+    for (int y = 0; y < m_bounds.height(); ++y) {
+        const Row& r = m_rows[y] = computeRow(m_bounds.top() + y);
+        m_pixels += r.end - r.begin - (m_skipDisc ? r.discEnd - r.discBegin : 0);
+    }
+}
+
+BrushCapsule::Row BrushCapsule::computeRow(int y) const {
+    const float yc = static_cast<float>(y) + 0.5f;
+
+    float lo = INFINITY, hi = -INFINITY;
+    addDiscSpan(m_ax, m_ay, m_ar, yc, &lo, &hi);
+    const float discLo = lo, discHi = hi;
+    if (!m_disc) {
+        addDiscSpan(m_bx, m_by, m_br, yc, &lo, &hi);
+        for (const Tangent& t : m_tangents) {
+            if (yc < t.y0 || yc > t.y1) continue;
+            const float x = t.x0 + (yc - t.y0) * t.slope;
+            lo = std::min(lo, x);
+            hi = std::max(hi, x);
+        }
+    }
+
+    Row r;
+    pixelSpan(lo, hi, &r.begin, &r.end);
+    pixelSpan(discLo, discHi, &r.discBegin, &r.discEnd);
+    r.discBegin = std::clamp(r.discBegin, r.begin, r.end);
+    r.discEnd = std::clamp(r.discEnd, r.discBegin, r.end);
+    return r;
+}
+
+bool BrushCapsule::coversTile(int tileX, int tileY) const {
+    if (m_empty) return false;
+
+    const int y0 = std::max(tileY, m_bounds.top());
+    const int y1 = std::min(tileY + TILE_SIZE, m_bounds.bottom() + 1);
+    const int tileEnd = tileX + TILE_SIZE;
+    for (int y = y0; y < y1; ++y) {
+        const Row& r = m_rows[y - m_bounds.top()];
+        const int begin = std::max(r.begin, tileX);
+        const int end = std::min(r.end, tileEnd);
+        if (begin >= end) continue;
+        if (!m_skipDisc) return true;
+        if (begin < r.discBegin || r.discEnd < end) return true;
+    }
+    return false;
+}
+
+uint8_t BrushCapsule::sweptCoverage(float qx, float qy) const {
+    // |q - t d|^2 <= (ar + t dr)^2 holds for t in an interval; the pixel is
+    // outside a's disc, so the strongest dab covering it is at the
+    // interval's start, t = C / (h + sqrt(h^2 - A C)) (the stable root)
+    const float h = qx * m_dx + qy * m_dy + m_ar * m_dr;
+    const float c = qx * qx + qy * qy - m_ar * m_ar;
+    const float denominator = h + std::sqrt(std::max(h * h - m_a * c, 0.0f));
+    const float t = denominator > 0.0f ? std::clamp(c / denominator, 0.0f, 1.0f) : 1.0f;
+    return coverageFor(m_ao + t * (m_bo - m_ao));
+}
+
+void BrushCapsule::depositTile(int tileX, int tileY, uint8_t* coverage) const {
+    if (m_empty) return;
+
+    const int y0 = std::max(tileY, m_bounds.top());
+    const int y1 = std::min(tileY + TILE_SIZE, m_bounds.bottom() + 1);
+    const int tileEnd = tileX + TILE_SIZE;
+    for (int y = y0; y < y1; ++y) {
+        const Row& r = m_rows[y - m_bounds.top()];
+        uint8_t* dst = coverage + (y - tileY) * TILE_SIZE;
+        const float qy = static_cast<float>(y) + 0.5f - m_ay;
+
+        // [begin, end) clipped to the tile
+        auto sweep = [&](int begin, int end) {
+            begin = std::max(begin, tileX);
+            end = std::min(end, tileEnd);
+            if (m_constant) {
+                maxFill(dst + begin - tileX, end - begin, m_discCoverage);
+                return;
+            }
+            for (int x = begin; x < end; ++x) {
+                const float qx = static_cast<float>(x) + 0.5f - m_ax;
+                dst[x - tileX] = std::max(dst[x - tileX], sweptCoverage(qx, qy));
+            }
+        };
+        sweep(r.begin, r.discBegin);
+        if (!m_skipDisc) {
+            const int begin = std::max(r.discBegin, tileX);
+            maxFill(dst + begin - tileX, std::min(r.discEnd, tileEnd) - begin, m_discCoverage);
+        }
+        sweep(r.discEnd, r.end);
+    }
+}
+
+}  // namespace comicos
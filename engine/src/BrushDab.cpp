@@ -1,4 +1,5 @@
 #include "engine/BrushDab.h"
+#include <algorithm>
 #include <cmath>
 
 namespace comicos {
@@ -10,13 +11,34 @@ void DabPlacer::reset() {
     m_accumDistance = 0.0f;
 }
 
-std::vector<BrushDab> DabPlacer::placeDabs(
-    const CanvasPoint& from, const CanvasPoint& to,
-    float brushSize, float hardness, const QColor& color) {
+void DabPlacer::applyTip(BrushDab& dab, float tiltX, float tiltY) const {
+    dab.rotation = m_tip.angle;
+    dab.aspect = m_tip.aspect;
+    dab.textureId = m_tip.textureId;
+    if (!m_tip.followTilt || (tiltX == 0.0f && tiltY == 0.0f)) return;
 
-    std::vector<BrushDab> dabs;
-    float radius = brushSize * 0.5f;
-    float step = std::max(brushSize * m_spacing, 0.5f);
+    // Tilt is in degrees from vertical per axis; a pen at 60 degrees (the
+    // usual hardware limit) halves the tip's width
+    constexpr float DEG_TO_RAD = 0.0174532925f;
+    const float tilt = std::min(std::sqrt(tiltX * tiltX + tiltY * tiltY), 60.0f);
+    dab.rotation += std::atan2(tiltY, tiltX);
+    dab.aspect *= std::cos(tilt * DEG_TO_RAD);
+}
+
+BrushDab DabPlacer::dabAt(const CanvasPoint& point, float brushSize, float hardness) const {
+    BrushDab dab;
+    dab.x = point.x;
+    dab.y = point.y;
+    dab.radius = brushSize * 0.5f * point.pressure;
+    dab.opacity = point.pressure;
+    dab.hardness = hardness;
+    applyTip(dab, point.tiltX, point.tiltY);
+    return dab;
+}
+
+void DabPlacer::placeDabs(const CanvasPoint& from, const CanvasPoint& to,
+                          float brushSize, float hardness, std::vector<BrushDab>& dabs) {
+    float step = this->step(brushSize);
 
     float dx = to.x - from.x;
     float dy = to.y - from.y;
@@ -25,41 +47,28 @@ std::vector<BrushDab> DabPlacer::placeDabs(
     if (dist < 0.001f) {
         // Single dab at current position
         if (m_accumDistance <= 0.0f) {
-            BrushDab dab;
-            dab.x = to.x;
-            dab.y = to.y;
-            dab.radius = radius * to.pressure;
-            dab.opacity = to.pressure;
-            dab.hardness = hardness;
-            dab.color = color;
-            dabs.push_back(dab);
+            dabs.push_back(dabAt(to, brushSize, hardness));
             m_accumDistance = step;
         }
-        return dabs;
+        return;
     }
 
     float remaining = step - m_accumDistance;
     float t = remaining / dist;
 
     while (t <= 1.0f) {
-        float x = from.x + dx * t;
-        float y = from.y + dy * t;
-        float pressure = from.pressure + (to.pressure - from.pressure) * t;
-
-        BrushDab dab;
-        dab.x = x;
-        dab.y = y;
-        dab.radius = radius * pressure;
-        dab.opacity = pressure;
-        dab.hardness = hardness;
-        dab.color = color;
-        dabs.push_back(dab);
+        CanvasPoint p;
+        p.x = from.x + dx * t;
+        p.y = from.y + dy * t;
+        p.pressure = from.pressure + (to.pressure - from.pressure) * t;
+        p.tiltX = from.tiltX + (to.tiltX - from.tiltX) * t;
+        p.tiltY = from.tiltY + (to.tiltY - from.tiltY) * t;
+        dabs.push_back(dabAt(p, brushSize, hardness));
 
         t += step / dist;
     }
 
     m_accumDistance = dist * (1.0f - (t - step / dist));
-    return dabs;
 }
 
 }  // namespace comicos
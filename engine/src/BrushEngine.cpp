@@ -4,32 +4,70 @@
 
 namespace comicos {
 
-BrushEngine::BrushEngine() = default;
+namespace {
+
+StampShape shapeOf(const BrushDab& dab) {
+    StampShape shape;
+    shape.radius = dab.radius < 0.1f ? 0.5f : dab.radius;
+    shape.hardness = dab.hardness;
+    shape.rotation = dab.rotation;
+    shape.aspect = dab.aspect;
+    shape.tipId = dab.textureId;
+    return shape;
+}
+
+}  // namespace
+
+BrushEngine::BrushEngine() {
+    m_stampCache.setTipAtlas(&m_tips);
+}
+
 BrushEngine::~BrushEngine() = default;
 
+void BrushEngine::setTipSource(const BrushTipAtlas* tips) {
+    if (tips == m_tipSource) return;
+    m_tipSource = tips;
+    m_stampCache.setTipAtlas(tips);
+}
+
 void BrushEngine::beginStroke(Layer* layer, const Stroke& strokeParams) {
+    m_active = true;
     m_activeLayer = layer;
-    m_currentStroke = strokeParams;
+    m_currentStroke = strokeParams;  // Keeps the point buffer of the last stroke
+    m_currentStroke.reservePoints(RESERVED_POINTS);
     m_dabPlacer.reset();
+    m_dabPlacer.setTip({strokeParams.tipId(), strokeParams.tipAngle(), strokeParams.tipAspect()});
+    m_predictor.reset();
+    m_capsuleFrom = -1;
     m_affectedTiles.clear();
     m_beforeSnapshots.clear();
+
+    // Not layer->id(): the layer may only be touched by endStroke()
+    const bool erase = strokeParams.toolType() == ToolType::Eraser;
+    m_wetLayer.begin(strokeParams.targetLayerId(),
+                     DabPaint::make(strokeParams.color(), 1.0f, erase), m_accumulation,
+                     strokeParams.selection());
 }
 
 void BrushEngine::addPoint(const CanvasPoint& point) {
-    if (!m_activeLayer) return;
+    if (!m_active) return;
 
     m_currentStroke.addPoint(point);
+    m_predictor.addSample(point);
 
     // Generate dabs from the last two points
+    m_dabs.clear();
     if (m_currentStroke.pointCount() < 2) {
         // First point: place a single dab
         CanvasPoint p = point;
-        auto dabs = m_dabPlacer.placeDabs(p, p,
-                                           m_currentStroke.brushSize(),
-                                           m_currentStroke.hardness(),
-                                           m_currentStroke.color());
-        for (auto& dab : dabs) {
-            renderDab(dab);
+        m_dabPlacer.placeDabs(p, p, m_currentStroke.brushSize(), m_currentStroke.hardness(),
+                              m_dabs);
+        if (capsuleFits(p, p)) {
+            m_capsuleFrom = 0;
+            m_capsuleFromDeposited = false;
+            depositCapsule(0);
+        } else {
+            renderDabs();
         }
         return;
     }
@@ -40,134 +78,200 @@ void BrushEngine::addPoint(const CanvasPoint& point) {
 
     // Here is where the brush pipeline goes:
     // Future: catmull-rom interpolation, stabilizer, smoothing
-    auto dabs = m_dabPlacer.placeDabs(prev, curr,
-                                       m_currentStroke.brushSize(),
-                                       m_currentStroke.hardness(),
-                                       m_currentStroke.color());
+    m_dabPlacer.placeDabs(prev, curr, m_currentStroke.brushSize(), m_currentStroke.hardness(),
+                          m_dabs);
 
-    for (auto& dab : dabs) {
-        renderDab(dab);
+    // Dabs are placed even for capsules, so spacing carries on after them
+    const int index = static_cast<int>(points.size()) - 1;
+    if (capsuleFits(prev, curr)) {
+        extendCapsule(index);
+        return;
     }
+    if (m_capsuleFrom >= 0) depositCapsule(index - 1);
+    m_capsuleFrom = -1;
+    renderDabs();
 }
 
 std::vector<TileCoord> BrushEngine::endStroke() {
+    if (m_active && m_capsuleFrom >= 0) {
+        depositCapsule(static_cast<int>(m_currentStroke.pointCount()) - 1);
+    }
+    if (m_active && m_activeLayer) commitWetLayer();
+    m_active = false;
     m_activeLayer = nullptr;
     auto result = std::move(m_affectedTiles);
     m_affectedTiles.clear();
     return result;
 }
 
+std::vector<TileCoord> BrushEngine::endStroke(Layer* layer) {
+    if (!layer) {
+        cancelStroke();
+        return {};
+    }
+    m_activeLayer = layer;
+    return endStroke();
+}
+
 void BrushEngine::cancelStroke() {
+    // Nothing reached the layer yet
+    m_active = false;
     m_activeLayer = nullptr;
+    m_wetLayer.clear();
     m_affectedTiles.clear();
     m_beforeSnapshots.clear();
 }
 
-std::unordered_map<TileCoord, std::unique_ptr<Tile>> BrushEngine::takeBeforeSnapshots() {
-    return std::move(m_beforeSnapshots);
-}
-
-void BrushEngine::renderDab(const BrushDab& dab) {
-    if (!m_activeLayer) return;
-
-    float r = dab.radius;
-    if (r < 0.1f) r = 0.5f;
-
-    int minX = static_cast<int>(std::floor(dab.x - r));
-    int minY = static_cast<int>(std::floor(dab.y - r));
-    int maxX = static_cast<int>(std::ceil(dab.x + r));
-    int maxY = static_cast<int>(std::ceil(dab.y + r));
-
-    // Snapshot tiles that the dab will touch, before any pixel modification
-    TileCoord tcMin = pixelToTile(minX, minY);
-    TileCoord tcMax = pixelToTile(maxX, maxY);
-    for (int ty = tcMin.ty; ty <= tcMax.ty; ++ty) {
-        for (int tx = tcMin.tx; tx <= tcMax.tx; ++tx) {
-            TileCoord tc{tx, ty};
-            if (m_beforeSnapshots.find(tc) == m_beforeSnapshots.end()) {
-                const Tile* existing = m_activeLayer->tiles().tileAt(tc);
-                if (existing && !existing->isEmpty()) {
-                    m_beforeSnapshots[tc] = existing->clone();
-                } else {
-                    m_beforeSnapshots[tc] = nullptr;  // tile was empty/missing
-                }
-            }
-        }
+// --- Capsules ---
+
+bool BrushEngine::capsuleFits(const CanvasPoint& from, const CanvasPoint& to) const {
+    if (!m_capsules || m_accumulation != WetLayer::Accumulation::Max) return false;
+
+    // Tilt along the segment is never steeper than at its ends, so the
+    // dabs between round ends are round too
+    const float size = m_currentStroke.brushSize();
+    const float hardness = m_currentStroke.hardness();
+    const BrushDab a = m_dabPlacer.dabAt(from, size, hardness);
+    const BrushDab b = m_dabPlacer.dabAt(to, size, hardness);
+    return std::max(a.radius, b.radius) >= BrushCapsule::MIN_RADIUS
+           && StampCache::isSolidDisc(shapeOf(a)) && StampCache::isSolidDisc(shapeOf(b));
+}
+
+void BrushEngine::extendCapsule(int index) {
+    if (m_capsuleFrom < 0) {
+        // After dabs: start at the previous point, whose disc is not in yet
+        m_capsuleFrom = index - 1;
+        m_capsuleFromDeposited = false;
     }
+    if (!followsChord(m_capsuleFrom, index)) depositCapsule(index - 1);
+
+    const auto& points = m_currentStroke.points();
+    const CanvasPoint& from = points[m_capsuleFrom];
+    const float dx = points[index].x - from.x;
+    const float dy = points[index].y - from.y;
+    const float step = m_dabPlacer.step(m_currentStroke.brushSize());
+    if (dx * dx + dy * dy >= step * step) depositCapsule(index);
+}
 
-    for (int py = minY; py <= maxY; ++py) {
-        for (int px = minX; px <= maxX; ++px) {
-            float dx = px + 0.5f - dab.x;
-            float dy = py + 0.5f - dab.y;
-            float dist = std::sqrt(dx * dx + dy * dy);
-
-            if (dist > r) continue;
-
-            // Hardness falloff
-            float t = dist / r;
-            float alpha;
-            if (t <= dab.hardness) {
-                alpha = 1.0f;
-            } else {
-                alpha = 1.0f - (t - dab.hardness) / (1.0f - dab.hardness + 0.001f);
-            }
-            alpha *= dab.opacity;
-
-            TileCoord tc = pixelToTile(px, py);
-            Tile* tile = m_activeLayer->tiles().getOrCreateTile(tc);
-
-            int localX = px - tc.tx * TILE_SIZE;
-            int localY = py - tc.ty * TILE_SIZE;
-            blendPixel(tile, localX, localY, dab.color, alpha);
-
-            // Track affected tiles
-            if (std::find(m_affectedTiles.begin(), m_affectedTiles.end(), tc) ==
-                m_affectedTiles.end()) {
-                m_affectedTiles.push_back(tc);
-            }
+void BrushEngine::depositCapsule(int index) {
+    if (index == m_capsuleFrom && m_capsuleFromDeposited) return;
+
+    const auto& points = m_currentStroke.points();
+    const float size = m_currentStroke.brushSize();
+    const float hardness = m_currentStroke.hardness();
+    m_capsule.reset(m_dabPlacer.dabAt(points[m_capsuleFrom], size, hardness),
+                    m_dabPlacer.dabAt(points[index], size, hardness), m_capsuleFromDeposited);
+    if (m_clipRect.isNull() || m_capsule.bounds().intersects(m_clipRect)) {
+        m_wetLayer.deposit(m_capsule);
+    }
+    m_capsuleFrom = index;
+    m_capsuleFromDeposited = true;
+}
+
+bool BrushEngine::followsChord(int from, int to) const {
+    const auto& points = m_currentStroke.points();
+    const CanvasPoint& a = points[from];
+    const CanvasPoint& b = points[to];
+    const float dx = b.x - a.x;
+    const float dy = b.y - a.y;
+    const float lengthSq = dx * dx + dy * dy;
+    for (int i = from + 1; i < to; ++i) {
+        const CanvasPoint& p = points[i];
+        const float t = lengthSq > 0.0f
+            ? std::clamp(((p.x - a.x) * dx + (p.y - a.y) * dy) / lengthSq, 0.0f, 1.0f)
+            : 0.0f;
+        const float ex = a.x + dx * t - p.x;
+        const float ey = a.y + dy * t - p.y;
+        const float pressure = a.pressure + (b.pressure - a.pressure) * t;
+        if (ex * ex + ey * ey > CAPSULE_TOLERANCE * CAPSULE_TOLERANCE
+            || std::abs(pressure - p.pressure) > CAPSULE_PRESSURE_TOLERANCE) {
+            return false;
         }
     }
+    return true;
 }
 
-void BrushEngine::blendPixel(Tile* tile, int localX, int localY,
-                              const QColor& color, float alpha) {
-    tile->ensureAllocated();
+std::unordered_map<TileCoord, std::unique_ptr<Tile>> BrushEngine::takeBeforeSnapshots() {
+    std::unordered_map<TileCoord, std::unique_ptr<Tile>> before;
+    before.reserve(m_beforeSnapshots.size());
+    for (auto& [tc, tile] : m_beforeSnapshots) before.emplace(tc, std::move(tile));
+    m_beforeSnapshots.clear();
+    return before;
+}
 
-    Pixel dst = tile->pixelAt(localX, localY);
+void BrushEngine::placeStamps(const std::vector<BrushDab>& dabs,
+                              std::vector<PlacedStamp>& placed) {
+    placed.resize(dabs.size());
+    for (size_t i = 0; i < dabs.size(); ++i) {
+        const BrushDab& dab = dabs[i];
+        const StampShape shape = shapeOf(dab);
 
-    // Eraser: reduce destination alpha
-    if (m_currentStroke.toolType() == ToolType::Eraser) {
-        float newA = (dst.a / 255.0f) * (1.0f - alpha);
-        Pixel result = dst;
-        result.a = static_cast<uint8_t>(std::clamp(newA * 255.0f, 0.0f, 255.0f));
-        tile->setPixelAt(localX, localY, result);
-        return;
+        PlacedStamp& p = placed[i];
+        p.stamp = shape.radius <= StampCache::MAX_RADIUS
+            ? m_stampCache.stamp(dab.x, dab.y, shape, &p.originX, &p.originY)
+            : StampCache::uncached(dab.x, dab.y, shape, m_tipSource, &p.originX, &p.originY);
+        p.opacity = dab.opacity;
+    }
+}
+
+void BrushEngine::renderDabs() {
+    if (!m_active) return;
+
+    if (!m_clipRect.isNull()) {
+        const QRectF clip(m_clipRect);
+        std::erase_if(m_dabs, [&](const BrushDab& dab) {
+            const float r = std::max(dab.radius, 0.5f) + 1.0f;  // + antialiasing
+            return !clip.intersects(QRectF(dab.x - r, dab.y - r, 2 * r, 2 * r));
+        });
     }
+    if (m_dabs.empty()) return;
+
+    // Stamps are looked up here, on the calling thread; the wet layer
+    // rasterizes the batch tile by tile
+    placeStamps(m_dabs, m_stamps);
+    m_wetLayer.deposit(m_stamps);
+    m_stamps.clear();  // Keeps the buffer, not the stamps
+}
+
+void BrushEngine::predictedStamps(std::vector<PlacedStamp>& placed) {
+    placed.clear();
+    if (!m_active || m_currentStroke.pointCount() == 0) return;
+
+    m_predictor.predict(m_predicted);
+    if (m_predicted.empty()) return;
+
+    // A copy of the placer continues the real spacing without advancing it
+    DabPlacer placer = m_dabPlacer;
+    m_predictedDabs.clear();
+    CanvasPoint from = m_currentStroke.points().back();
+    for (const CanvasPoint& to : m_predicted) {
+        placer.placeDabs(from, to, m_currentStroke.brushSize(), m_currentStroke.hardness(),
+                         m_predictedDabs);
+        from = to;
+    }
+    placeStamps(m_predictedDabs, placed);
+}
+
+void BrushEngine::commitWetLayer() {
+    const bool erase = m_wetLayer.paint().erase;
+    TileManager& tiles = m_activeLayer->tiles();
+
+    // One pass per tile: snapshot for undo, then composite the coverage
+    for (const TileCoord& tc : m_wetLayer.tiles()) {
+        const Tile* existing = tiles.tileAt(tc);
+        const bool empty = !existing || existing->isEmpty();
+        if (empty && erase) continue;  // Nothing to erase
+
+        // The wet layer lists each tile once, so a flat list is enough
+        m_beforeSnapshots.emplace_back(tc, empty ? nullptr : existing->clone());
+        m_affectedTiles.push_back(tc);
 
-    // Source-over alpha compositing
-    float sa = alpha;
-    float sr = color.redF() * sa;
-    float sg = color.greenF() * sa;
-    float sb = color.blueF() * sa;
-
-    float da = dst.a / 255.0f;
-    float dr = dst.r / 255.0f;
-    float dg = dst.g / 255.0f;
-    float db = dst.b / 255.0f;
-
-    float outA = sa + da * (1.0f - sa);
-    if (outA > 0.0f) {
-        float outR = (sr + dr * (1.0f - sa)) / outA;
-        float outG = (sg + dg * (1.0f - sa)) / outA;
-        float outB = (sb + db * (1.0f - sa)) / outA;
-
-        Pixel result;
-        result.r = static_cast<uint8_t>(std::clamp(outR * 255.0f, 0.0f, 255.0f));
-        result.g = static_cast<uint8_t>(std::clamp(outG * 255.0f, 0.0f, 255.0f));
-        result.b = static_cast<uint8_t>(std::clamp(outB * 255.0f, 0.0f, 255.0f));
-        result.a = static_cast<uint8_t>(std::clamp(outA * 255.0f, 0.0f, 255.0f));
-        tile->setPixelAt(localX, localY, result);
+        Tile* tile = tiles.getOrCreateTile(tc);
+        tile->ensureAllocated();
+        tile->setDirty(true);
+        m_wetLayer.applyTo(tc, tile->data());
     }
+    m_wetLayer.clear();
 }
 
 }  // namespace comicos
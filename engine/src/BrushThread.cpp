@@ -0,0 +1,353 @@
+#include "engine/BrushThread.h"
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace comicos {
+
+BrushThread::BrushThread() {
+    m_thread.setMaxThreadCount(1);
+    m_thread.start([this]() { run(); });
+}
+
+BrushThread::~BrushThread() {
+    m_stop.store(true);
+    m_finished.store(false);  // Release a thread waiting for commitStroke()
+    m_finished.notify_one();
+    m_signal.fetch_add(1);
+    m_signal.notify_one();
+    m_thread.waitForDone();
+}
+
+int64_t BrushThread::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// --- Input ---
+
+void BrushThread::beginStroke(const Stroke& strokeParams) {
+    if (m_strokeOpen) cancelStroke();
+
+    Event event;
+    event.type = Event::Type::Begin;
+    event.serial = ++m_serial;
+    event.inputTime = now();
+    {
+        std::lock_guard<std::mutex> lock(m_beginMutex);
+        m_beginParams.push_back(strokeParams);
+    }
+    m_strokeOpen = true;
+    push(event);
+}
+
+void BrushThread::addPoint(const CanvasPoint& point) {
+    if (!m_strokeOpen) return;
+
+    Event event;
+    event.type = Event::Type::Point;
+    event.serial = m_serial;
+    event.inputTime = now();
+    event.point = point;
+    if (event.point.timestamp <= 0.0) {
+        event.point.timestamp = static_cast<double>(event.inputTime) / 1e6;
+    }
+    push(event);
+}
+
+void BrushThread::endStroke() {
+    if (!m_strokeOpen) return;
+    m_strokeOpen = false;
+
+    Event event;
+    event.type = Event::Type::End;
+    event.serial = m_serial;
+    event.inputTime = now();
+    push(event);
+}
+
+void BrushThread::cancelStroke() {
+    if (!m_strokeOpen) return;
+    m_strokeOpen = false;
+
+    {
+        // Under the lock, so the brush thread cannot publish the stroke again
+        std::lock_guard<std::mutex> lock(m_overlayMutex);
+        m_cancelled.push_back(m_serial);
+        m_cancelledSerial.store(m_serial);
+        m_overlay.clear();
+        m_unpresentedSince = 0;
+    }
+
+    Event event;
+    event.type = Event::Type::Cancel;
+    event.serial = m_serial;
+    push(event);
+}
+
+bool BrushThread::isBusy() const {
+    return m_strokeOpen || !m_overflow.empty() || m_processed.load() != m_pushed
+           || m_finished.load();
+}
+
+void BrushThread::push(const Event& event) {
+    ++m_pushed;
+    flushOverflow();
+    if (!m_overflow.empty() || !m_events.tryPush(event)) {
+        // Queue full: keep the event here rather than wait for the brush
+        // thread; the next GUI-thread call retries
+        m_overflow.push_back(event);
+        return;
+    }
+    m_signal.fetch_add(1, std::memory_order_release);
+    m_signal.notify_one();
+}
+
+void BrushThread::flushOverflow() {
+    bool pushed = false;
+    while (!m_overflow.empty() && m_events.tryPush(m_overflow.front())) {
+        m_overflow.pop_front();
+        pushed = true;
+    }
+    if (pushed) {
+        m_signal.fetch_add(1, std::memory_order_release);
+        m_signal.notify_one();
+    }
+}
+
+// --- Commit ---
+
+bool BrushThread::commitStroke(LayerStack& layers, CommittedStroke* out) {
+    flushOverflow();
+    if (!m_finished.load(std::memory_order_acquire)) return false;
+
+    // The brush thread waits until m_finished is cleared: the engine is ours.
+    // The layer may have been removed since the stroke began.
+    out->layer = layers.layerById(m_engine.wetLayer().layerId());
+    out->tiles = m_engine.endStroke(out->layer);
+    out->before = m_engine.takeBeforeSnapshots();
+    out->stroke = m_engine.currentStroke();
+    {
+        // The stroke is in the layer now; nothing is drawn twice or missing
+        // because the renderer only runs while this thread waits
+        std::lock_guard<std::mutex> lock(m_overlayMutex);
+        m_overlay.clear();
+    }
+
+    m_finished.store(false, std::memory_order_release);
+    m_finished.notify_one();
+    return true;
+}
+
+void BrushThread::waitForIdle() {
+    for (;;) {
+        flushOverflow();
+        const uint64_t processed = m_processed.load(std::memory_order_acquire);
+        if (m_finished.load(std::memory_order_acquire)) return;
+        if (processed == m_pushed && m_overflow.empty()) return;
+        m_processed.wait(processed, std::memory_order_acquire);
+    }
+}
+
+// --- Output ---
+
+void BrushThread::setStrokeFinishedHandler(std::function<void()> handler) {
+    m_onFinished = std::move(handler);
+}
+
+void BrushThread::setTilesPublishedHandler(std::function<void()> handler) {
+    m_onPublished = std::move(handler);
+}
+
+void BrushThread::takePublishedTiles(std::vector<TileCoord>& out) {
+    flushOverflow();
+
+    out.clear();
+    std::lock_guard<std::mutex> lock(m_overlayMutex);
+    m_publishPending.store(false);
+    out.swap(m_publishedTiles);
+}
+
+int64_t BrushThread::copyOverlay(const std::vector<TileCoord>& coords, WetLayer& out) {
+    std::lock_guard<std::mutex> lock(m_overlayMutex);
+    out.clear();
+    out.copyTiles(m_overlay, coords);
+    // Oldest input in the copy, timed from here on
+    return std::exchange(m_unpresentedSince, 0);
+}
+
+void BrushThread::overlayPresented(int64_t copied) {
+    if (!copied) return;
+
+    const double ms = static_cast<double>(now() - copied) / 1e6;
+
+    std::lock_guard<std::mutex> lock(m_overlayMutex);
+    ++m_latency.samples;
+    m_latency.lastMs = ms;
+    m_latency.meanMs += (ms - m_latency.meanMs) / static_cast<double>(m_latency.samples);
+    m_latency.maxMs = std::max(m_latency.maxMs, ms);
+}
+
+BrushThread::Latency BrushThread::latency() const {
+    std::lock_guard<std::mutex> lock(m_overlayMutex);
+    return m_latency;
+}
+
+BrushThread::PredictionStats BrushThread::prediction() const {
+    std::lock_guard<std::mutex> lock(m_overlayMutex);
+    return m_predictionStats;
+}
+
+void BrushThread::resetStats() {
+    std::lock_guard<std::mutex> lock(m_overlayMutex);
+    m_latency = {};
+    m_predictionStats = {};
+}
+
+// --- Brush thread ---
+
+void BrushThread::run() {
+    Event event;
+    while (!m_stop.load()) {
+        const uint32_t signal = m_signal.load(std::memory_order_acquire);
+        if (!m_events.tryPop(event)) {
+            m_signal.wait(signal, std::memory_order_acquire);
+            continue;
+        }
+
+        process(event);
+
+        // Publish when caught up with input, and regularly while behind
+        if (m_unpublishedSince
+            && (m_events.empty() || now() - m_lastPublish >= PUBLISH_INTERVAL_NS)) {
+            publish(true);
+        }
+
+        m_processed.fetch_add(1, std::memory_order_release);
+        m_processed.notify_all();
+
+        // Hand the engine to commitStroke() until the stroke is committed
+        if (m_finished.load(std::memory_order_acquire)) {
+            if (m_onFinished) m_onFinished();
+            while (m_finished.load(std::memory_order_acquire)) {
+                m_finished.wait(true, std::memory_order_acquire);
+            }
+        }
+    }
+}
+
+void BrushThread::process(const Event& event) {
+    const bool cancelled = isCancelled(event.serial);
+
+    switch (event.type) {
+    case Event::Type::Begin: {
+        Stroke params;
+        {
+            std::lock_guard<std::mutex> lock(m_beginMutex);
+            params = std::move(m_beginParams.front());
+            m_beginParams.pop_front();
+        }
+        if (cancelled) break;
+        m_strokeSerial = event.serial;
+        m_engine.setPredictionHorizon(m_predictionHorizon.load());
+        m_engine.beginStroke(nullptr, params);  // The layer is named at commit
+        m_scored.clear();
+
+        std::lock_guard<std::mutex> lock(m_overlayMutex);
+        if (!isCancelledLocked(event.serial)) {
+            m_overlay.copyTiles(m_engine.wetLayer(), {});
+        }
+        break;
+    }
+    case Event::Type::Point:
+        if (cancelled || !m_engine.isActive()) break;
+        m_engine.addPoint(event.point);
+        m_lastSampleTime = event.point.timestamp;
+        if (!m_unpublishedSince) m_unpublishedSince = event.inputTime;
+        break;
+    case Event::Type::End:
+        if (cancelled || !m_engine.isActive()) break;
+        // Always publish: the last prediction must go
+        publish(false);
+        m_finished.store(true, std::memory_order_release);
+        break;
+    case Event::Type::Cancel: {
+        m_engine.cancelStroke();
+        m_unpublishedSince = 0;
+        m_prediction.clear();
+        m_scored.clear();
+
+        // Every earlier event of the stroke has been processed now
+        std::lock_guard<std::mutex> lock(m_overlayMutex);
+        m_cancelled.erase(std::remove(m_cancelled.begin(), m_cancelled.end(), event.serial),
+                          m_cancelled.end());
+        // publish() skips cancelled strokes; nothing of this one may stay
+        if (m_strokeSerial == event.serial) m_overlay.clear();
+        break;
+    }
+    }
+}
+
+bool BrushThread::isCancelled(uint32_t serial) const {
+    if (serial > m_cancelledSerial.load()) return false;  // Newer than any cancel
+    std::lock_guard<std::mutex> lock(m_overlayMutex);
+    return isCancelledLocked(serial);
+}
+
+bool BrushThread::isCancelledLocked(uint32_t serial) const {
+    return std::find(m_cancelled.begin(), m_cancelled.end(), serial) != m_cancelled.end();
+}
+
+void BrushThread::publish(bool predict) {
+    const WetLayer& wet = m_engine.wetLayer();
+    std::vector<TileCoord>& tiles = m_publishTiles;
+    m_engine.takeDirtyTiles(tiles);
+    const int64_t inputTime = m_unpublishedSince;
+    m_unpublishedSince = 0;
+    m_lastPublish = now();
+
+    // Restore the tiles the previous prediction drew over
+    tiles.insert(tiles.end(), m_prediction.tiles().begin(), m_prediction.tiles().end());
+    m_prediction.clear();
+
+    // Score a prediction once real input has covered its horizon
+    size_t predicted = 0, mispredicted = 0;
+    if (!m_scored.tiles().empty() && (!predict || m_lastSampleTime >= m_scoredUntil)) {
+        mispredicted = m_scored.uncoveredPixels(wet);
+        m_scored.clear();
+    }
+
+    if (predict) {
+        m_engine.predictedStamps(m_predictedStamps);
+        if (!m_predictedStamps.empty()) {
+            m_prediction.begin(wet.layerId(), wet.paint(), wet.mode(), wet.selection());
+            m_prediction.deposit(m_predictedStamps);
+            tiles.insert(tiles.end(), m_prediction.tiles().begin(), m_prediction.tiles().end());
+
+            if (m_scored.tiles().empty()) {
+                m_scored.copyTiles(m_prediction, m_prediction.tiles());
+                m_scoredUntil = m_lastSampleTime + m_engine.predictionHorizon();
+                predicted = m_scored.uncoveredPixels(wet);
+            }
+        }
+    }
+    std::sort(tiles.begin(), tiles.end());
+    tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+
+    {
+        std::lock_guard<std::mutex> lock(m_overlayMutex);
+        if (isCancelledLocked(m_strokeSerial)) return;  // Cancelled meanwhile
+
+        m_overlay.copyTiles(wet, tiles);
+        m_overlay.mergeTiles(m_prediction);
+        m_publishedTiles.insert(m_publishedTiles.end(), tiles.begin(), tiles.end());
+        if (!m_unpresentedSince) m_unpresentedSince = inputTime;
+        m_predictionStats.predictedPixels += predicted;
+        m_predictionStats.mispredictedPixels += mispredicted;
+    }
+
+    if (!m_publishPending.exchange(true) && m_onPublished) m_onPublished();
+}
+
+}  // namespace comicos
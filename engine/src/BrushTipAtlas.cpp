@@ -0,0 +1,130 @@
+#include "engine/BrushTipAtlas.h"
+#include <algorithm>
+#include <cmath>
+
+namespace comicos {
+
+// --- BrushTip ---
+
+BrushTip::BrushTip(const uint8_t* coverage, int width, int height) {
+    m_size = 1;
+    while (m_size < std::max(width, height)) m_size *= 2;
+
+    // Level sizes and offsets: S, S/2, ..., 1
+    size_t total = 0;
+    for (int size = m_size; size >= 1; size /= 2) {
+        m_levels.push_back({total, size});
+        total += static_cast<size_t>(size) * size;
+    }
+    m_texels.assign(total, 0);
+
+    // Level 0: the image centred in the square
+    const int padX = (m_size - width) / 2;
+    const int padY = (m_size - height) / 2;
+    for (int y = 0; y < height; ++y) {
+        std::copy_n(coverage + static_cast<size_t>(y) * width, width,
+                    m_texels.data() + static_cast<size_t>(y + padY) * m_size + padX);
+    }
+
+    // Each level is a 2x2 box filter of the one above
+    for (size_t l = 1; l < m_levels.size(); ++l) {
+        const uint8_t* src = m_texels.data() + m_levels[l - 1].offset;
+        uint8_t* dst = m_texels.data() + m_levels[l].offset;
+        const int srcSize = m_levels[l - 1].size;
+        const int size = m_levels[l].size;
+        for (int y = 0; y < size; ++y) {
+            const uint8_t* row0 = src + static_cast<size_t>(2 * y) * srcSize;
+            const uint8_t* row1 = row0 + srcSize;
+            for (int x = 0; x < size; ++x) {
+                const int sum = row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1];
+                dst[static_cast<size_t>(y) * size + x] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+int BrushTip::levelFor(float diameter) const {
+    if (diameter <= 0.0f) return levels() - 1;
+    const float level = std::log2(static_cast<float>(m_size) / diameter);
+    return std::clamp(static_cast<int>(std::lround(level)), 0, levels() - 1);
+}
+
+float BrushTip::sample(int level, float u, float v) const {
+    if (!(u >= 0.0f && u <= 1.0f && v >= 0.0f && v <= 1.0f)) return 0.0f;
+
+    const Level& l = m_levels[level];
+    const uint8_t* texels = m_texels.data() + l.offset;
+
+    // Texel centres at (i + 0.5) / size; clamp at the border
+    const float fx = u * l.size - 0.5f;
+    const float fy = v * l.size - 0.5f;
+    const int x0 = std::clamp(static_cast<int>(std::floor(fx)), 0, l.size - 1);
+    const int y0 = std::clamp(static_cast<int>(std::floor(fy)), 0, l.size - 1);
+    const int x1 = std::min(x0 + 1, l.size - 1);
+    const int y1 = std::min(y0 + 1, l.size - 1);
+    const float tx = std::clamp(fx - x0, 0.0f, 1.0f);
+    const float ty = std::clamp(fy - y0, 0.0f, 1.0f);
+
+    auto at = [&](int x, int y) { return static_cast<float>(texels[y * l.size + x]); };
+    const float top = at(x0, y0) + (at(x1, y0) - at(x0, y0)) * tx;
+    const float bottom = at(x0, y1) + (at(x1, y1) - at(x0, y1)) * tx;
+    return (top + (bottom - top) * ty) * (1.0f / 255.0f);
+}
+
+// --- BrushTipAtlas ---
+
+BrushTipAtlas::BrushTipAtlas() = default;
+BrushTipAtlas::~BrushTipAtlas() = default;
+
+int BrushTipAtlas::addTip(const uint8_t* coverage, int width, int height) {
+    if (!coverage || width <= 0 || height <= 0) return -1;
+
+    // Build outside the lock; mips of a large tip take a while
+    auto tip = std::make_shared<const BrushTip>(coverage, width, height);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tips.push_back(std::move(tip));
+    return static_cast<int>(m_tips.size()) - 1;
+}
+
+int BrushTipAtlas::addTip(const QImage& image) {
+    if (image.isNull()) return -1;
+
+    QImage source = image;
+    if (source.width() > MAX_TIP_SIZE || source.height() > MAX_TIP_SIZE) {
+        source = source.scaled(MAX_TIP_SIZE, MAX_TIP_SIZE, Qt::KeepAspectRatio,
+                               Qt::SmoothTransformation);
+    }
+    source = source.convertToFormat(QImage::Format_RGBA8888);
+
+    const int width = source.width();
+    const int height = source.height();
+    std::vector<uint8_t> coverage(static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* row = source.constScanLine(y);
+        for (int x = 0; x < width; ++x) {
+            const uint8_t* p = row + x * 4;
+            const int gray = (p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8;
+            coverage[static_cast<size_t>(y) * width + x] =
+                static_cast<uint8_t>((255 - gray) * p[3] / 255);
+        }
+    }
+    return addTip(coverage.data(), width, height);
+}
+
+int BrushTipAtlas::loadTip(const QString& path) {
+    return addTip(QImage(path));
+}
+
+std::shared_ptr<const BrushTip> BrushTipAtlas::tip(int id) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (id < 0 || id >= static_cast<int>(m_tips.size())) return nullptr;
+    return m_tips[id];
+}
+
+int BrushTipAtlas::count() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_tips.size());
+}
+
+}  // namespace comicos
@@ -9,21 +9,31 @@ Compositor::Compositor() = default;
 Compositor::~Compositor() = default;
 
 std::vector<uint8_t> Compositor::compositeTile(const LayerStack& layers,
-                                                const TileCoord& coord) const {
+                                                const TileCoord& coord,
+                                                const WetLayer* stroke) const {
     std::vector<uint8_t> result(TILE_BYTES, 0);
 
     // Here is where the compositing pipeline goes:
     // Bottom-to-top layer compositing with blend modes.
     // Future: GPU compute shader compositing for real-time performance.
 
+    const uint8_t* coverage = stroke ? stroke->coverageAt(coord) : nullptr;
+    std::vector<uint8_t> wet;
+
     for (auto& layerPtr : layers.layers()) {
         const Layer* layer = layerPtr.get();
         if (!layer->isVisible() || layer->opacity() <= 0.0f) continue;
 
         const Tile* tile = layer->tiles().tileAt(coord);
-        if (!tile || tile->isEmpty()) continue;
+        const uint8_t* src = tile && !tile->isEmpty() ? tile->constData() : nullptr;
 
-        const uint8_t* src = tile->constData();
+        // The stroke in progress shows on its layer before it is committed
+        if (coverage && layer->id() == stroke->layerId()) {
+            wet.assign(TILE_BYTES, 0);
+            if (src) std::memcpy(wet.data(), src, TILE_BYTES);
+            stroke->applyTo(coord, wet.data());
+            src = wet.data();
+        }
         if (!src) continue;
 
         float layerOpacity = layer->opacity();
@@ -47,23 +57,186 @@ std::vector<uint8_t> Compositor::compositeTile(const LayerStack& layers,
     return result;
 }
 
-QImage Compositor::compositeRegion(const LayerStack& /*layers*/,
+QImage Compositor::compositeRegion(const LayerStack& layers,
                                     const QRectF& region) const {
-    int w = static_cast<int>(std::ceil(region.width()));
-    int h = static_cast<int>(std::ceil(region.height()));
-    QImage image(w, h, QImage::Format_RGBA8888);
-    image.fill(Qt::transparent);
-
-    // Extension point: optimize by only compositing visible tiles
-    // For now, delegate to compositeTile per visible tile in region
+    const QRect rect = region.toAlignedRect();
+    QImage image(rect.size(), QImage::Format_RGBA8888);
+    if (rect.isEmpty()) return image;
 
+    compositeRegionInto(layers, rect, image.bits(), image.bytesPerLine());
     return image;
 }
 
+void Compositor::compositeRegionInto(const LayerStack& layers, const QRect& rect,
+                                     uint8_t* out, qsizetype bytesPerLine) const {
+    for (int y = 0; y < rect.height(); ++y) {
+        std::memset(out + y * bytesPerLine, 0, static_cast<size_t>(rect.width()) * 4);
+    }
+
+    // Only tiles that intersect the region are composited. Lazy tiles are
+    // decoded into scratch and stay lazy, so exporting a document that was
+    // just opened does not pull every tile into memory.
+    std::vector<uint8_t> scratch(TILE_BYTES);
+    std::vector<uint8_t> composite(TILE_BYTES);
+
+    const TileCoord first = pixelToTile(rect.left(), rect.top());
+    const TileCoord last = pixelToTile(rect.right(), rect.bottom());
+    for (int ty = first.ty; ty <= last.ty; ++ty) {
+        for (int tx = first.tx; tx <= last.tx; ++tx) {
+            if (!compositeTileInto(layers, {tx, ty}, scratch.data(), composite.data()))
+                continue;
+
+            // Copy the part of the tile inside the region
+            const QRect tileRect(tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+            const QRect part = tileRect.intersected(rect);
+            for (int y = part.top(); y <= part.bottom(); ++y) {
+                const uint8_t* src = composite.data() +
+                    ((y - tileRect.top()) * TILE_SIZE + (part.left() - tileRect.left())) * 4;
+                std::memcpy(out + (y - rect.top()) * bytesPerLine + (part.left() - rect.left()) * 4,
+                            src, static_cast<size_t>(part.width()) * 4);
+            }
+        }
+    }
+}
+
 QImage Compositor::flatten(const LayerStack& layers, const QSize& canvasSize) const {
     return compositeRegion(layers, QRectF(QPointF(0, 0), canvasSize));
 }
 
+/// Box-filters a tile down by `factor` (a power of two <= TILE_SIZE).
+/// Color is averaged premultiplied so transparent pixels don't darken
+/// edges; the output is straight alpha like the tiles.
+static void reduceTile(const uint8_t* src, int factor, uint8_t* dst) {
+    const int cell = TILE_SIZE / factor;
+    const uint64_t area = static_cast<uint64_t>(factor) * factor;
+
+    for (int cy = 0; cy < cell; ++cy) {
+        for (int cx = 0; cx < cell; ++cx) {
+            uint64_t r = 0, g = 0, b = 0, a = 0;
+            for (int y = 0; y < factor; ++y) {
+                const uint8_t* p = src + ((cy * factor + y) * TILE_SIZE + cx * factor) * 4;
+                for (int x = 0; x < factor; ++x, p += 4) {
+                    r += p[0] * p[3];
+                    g += p[1] * p[3];
+                    b += p[2] * p[3];
+                    a += p[3];
+                }
+            }
+
+            uint8_t* out = dst + (cy * cell + cx) * 4;
+            if (a == 0) {
+                std::memset(out, 0, 4);
+                continue;
+            }
+            out[0] = static_cast<uint8_t>((r + a / 2) / a);
+            out[1] = static_cast<uint8_t>((g + a / 2) / a);
+            out[2] = static_cast<uint8_t>((b + a / 2) / a);
+            out[3] = static_cast<uint8_t>((a + area / 2) / area);
+        }
+    }
+}
+
+DocumentPreview Compositor::renderPreview(const LayerStack& layers,
+                                          const QSize& canvasSize) const {
+    DocumentPreview preview;
+    if (canvasSize.isEmpty()) return preview;
+
+    // Power-of-two reduction, so each tile maps onto a whole cell of pixels
+    const int maxEdge = std::max(canvasSize.width(), canvasSize.height());
+    int factor = 1;
+    while (factor < TILE_SIZE && maxEdge > DocumentPreview::PYRAMID_MAX_SIZE * factor) {
+        factor *= 2;
+    }
+    const int cell = TILE_SIZE / factor;
+
+    QImage base((canvasSize.width() + factor - 1) / factor,
+                (canvasSize.height() + factor - 1) / factor, QImage::Format_RGBA8888);
+    base.fill(Qt::transparent);
+
+    std::vector<uint8_t> scratch(TILE_BYTES);
+    std::vector<uint8_t> reduced(static_cast<size_t>(cell) * cell * 4);
+    std::vector<uint8_t> composite(reduced.size());
+
+    const int tilesX = (canvasSize.width() + TILE_SIZE - 1) / TILE_SIZE;
+    const int tilesY = (canvasSize.height() + TILE_SIZE - 1) / TILE_SIZE;
+    for (int ty = 0; ty < tilesY; ++ty) {
+        for (int tx = 0; tx < tilesX; ++tx) {
+            TileCoord coord{tx, ty};
+            bool any = false;
+
+            for (const auto& layer : layers.layers()) {
+                if (!layer->isVisible() || layer->opacity() <= 0.0f) continue;
+                const uint8_t* src = layer->tiles().pixelsAt(coord, scratch.data());
+                if (!src) continue;
+
+                if (!any) std::fill(composite.begin(), composite.end(), 0);
+                any = true;
+
+                reduceTile(src, factor, reduced.data());
+                for (size_t i = 0; i < composite.size(); i += 4) {
+                    Pixel dst{composite[i], composite[i + 1], composite[i + 2], composite[i + 3]};
+                    Pixel px{reduced[i], reduced[i + 1], reduced[i + 2], reduced[i + 3]};
+                    Pixel out = blendPixels(dst, px, layer->blendMode(), layer->opacity());
+                    composite[i] = out.r;
+                    composite[i + 1] = out.g;
+                    composite[i + 2] = out.b;
+                    composite[i + 3] = out.a;
+                }
+            }
+            if (!any) continue;
+
+            // Copy the cell into the preview, clipped at the canvas edge
+            const int x0 = tx * cell;
+            const int y0 = ty * cell;
+            const int w = std::min(cell, base.width() - x0);
+            const int h = std::min(cell, base.height() - y0);
+            for (int y = 0; y < h; ++y) {
+                std::memcpy(base.scanLine(y0 + y) + x0 * 4,
+                            composite.data() + static_cast<size_t>(y) * cell * 4, w * 4);
+            }
+        }
+    }
+
+    // Pyramid: halve until the smallest level fits PYRAMID_MIN_SIZE
+    QImage level = base.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
+    while (true) {
+        preview.levels.push_back(level);
+        if (std::max(level.width(), level.height()) <= DocumentPreview::PYRAMID_MIN_SIZE) break;
+        level = level.scaled(std::max(1, level.width() / 2), std::max(1, level.height() / 2),
+                             Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    preview.thumbnail = level.scaled(DocumentPreview::THUMBNAIL_SIZE,
+                                     DocumentPreview::THUMBNAIL_SIZE,
+                                     Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return preview;
+}
+
+bool Compositor::compositeTileInto(const LayerStack& layers, const TileCoord& coord,
+                                   uint8_t* scratch, uint8_t* out) {
+    bool any = false;
+    for (const auto& layer : layers.layers()) {
+        if (!layer->isVisible() || layer->opacity() <= 0.0f) continue;
+        const uint8_t* src = layer->tiles().pixelsAt(coord, scratch);
+        if (!src) continue;
+
+        if (!any) std::memset(out, 0, TILE_BYTES);
+        any = true;
+
+        const BlendMode mode = layer->blendMode();
+        const float layerOpacity = layer->opacity();
+        for (int offset = 0; offset < TILE_BYTES; offset += 4) {
+            Pixel dst = {out[offset], out[offset + 1], out[offset + 2], out[offset + 3]};
+            Pixel srcPx = {src[offset], src[offset + 1], src[offset + 2], src[offset + 3]};
+            Pixel px = blendPixels(dst, srcPx, mode, layerOpacity);
+            out[offset] = px.r;
+            out[offset + 1] = px.g;
+            out[offset + 2] = px.b;
+            out[offset + 3] = px.a;
+        }
+    }
+    return any;
+}
+
 Pixel Compositor::blendPixels(const Pixel& dst, const Pixel& src,
                                BlendMode mode, float layerOpacity) {
     // Apply layer opacity to source
@@ -0,0 +1,198 @@
+#include "engine/DabKernel.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+
+#if defined(COMICOS_DAB_SIMD) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace comicos {
+
+// --- Paint ---
+
+DabPaint DabPaint::make(const QColor& color, float opacity, bool erase) {
+    DabPaint paint;
+    paint.opacity = static_cast<uint8_t>(std::lround(std::clamp(opacity, 0.0f, 1.0f) * 255.0f));
+    paint.color[0] = static_cast<uint8_t>(color.red());
+    paint.color[1] = static_cast<uint8_t>(color.green());
+    paint.color[2] = static_cast<uint8_t>(color.blue());
+    paint.erase = erase;
+    return paint;
+}
+
+// --- Scalar Kernels ---
+// The reference: SIMD kernels must produce the same bytes.
+
+/// 2^31 / d rounded up: n * RECIPROCALS[d] >> 31 is floor(n / d) for every
+/// n < 2^31 / 255, far above the largest blend numerator (255 * 255 + 127).
+static constexpr std::array<uint32_t, 256> RECIPROCALS = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t d = 1; d < 256; ++d) {
+        table[d] = static_cast<uint32_t>(((1ull << 31) + d - 1) / d);
+    }
+    return table;
+}();
+
+/// Blend one pixel with alpha 0..255. Eraser and paint are separate
+/// instantiations, so neither kernel branches on the mode per pixel.
+template <bool Erase>
+static inline void blendPixel(uint8_t* p, uint32_t alpha, const DabPaint& paint) {
+    const uint32_t dstWeight = div255(p[3] * (255 - alpha));
+    if constexpr (Erase) {
+        p[3] = static_cast<uint8_t>(dstWeight);
+        return;
+    }
+
+    // Source-over, straight alpha: out = (src * a + dst * dstWeight) / outA,
+    // rounded to nearest
+    const uint32_t outA = alpha + dstWeight;
+    if (outA == 0) return;
+    if (dstWeight == 0) {
+        p[0] = paint.color[0];
+        p[1] = paint.color[1];
+        p[2] = paint.color[2];
+        p[3] = static_cast<uint8_t>(outA);
+        return;
+    }
+    const uint64_t reciprocal = RECIPROCALS[outA];
+    for (int c = 0; c < 3; ++c) {
+        const uint32_t n = paint.color[c] * alpha + p[c] * dstWeight + (outA >> 1);
+        p[c] = static_cast<uint8_t>((n * reciprocal) >> 31);
+    }
+    p[3] = static_cast<uint8_t>(outA);
+}
+
+template <bool Erase>
+static void stampSpan(uint8_t* pixels, const uint8_t* mask, int count, const DabPaint& paint) {
+    for (int i = 0; i < count; ++i) {
+        if (mask[i] == 0) continue;
+        blendPixel<Erase>(pixels + i * 4, div255(mask[i] * paint.opacity), paint);
+    }
+}
+
+void DabKernels::stampRowScalar(uint8_t* pixels, const uint8_t* mask, int count,
+                                const DabPaint& paint) {
+    if (paint.erase) {
+        stampSpan<true>(pixels, mask, count, paint);
+    } else {
+        stampSpan<false>(pixels, mask, count, paint);
+    }
+}
+
+void DabKernels::maxRowScalar(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] = std::max(dst[i], static_cast<uint8_t>(div255(mask[i] * uint32_t{opacity})));
+    }
+}
+
+void DabKernels::addRowScalar(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity) {
+    for (int i = 0; i < count; ++i) {
+        const uint32_t sum = dst[i] + div255(mask[i] * uint32_t{opacity});
+        dst[i] = static_cast<uint8_t>(std::min<uint32_t>(sum, 255));
+    }
+}
+
+// --- Dispatch ---
+
+static DabKernelLevel detectLevel() {
+#if defined(COMICOS_DAB_SIMD) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && (_xgetbv(0) & 0x6) == 0x6) {  // OS saves YMM state
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    if (avx2) return DabKernelLevel::Avx2;
+    if (sse41) return DabKernelLevel::Sse41;
+#elif defined(COMICOS_DAB_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return DabKernelLevel::Avx2;
+    if (__builtin_cpu_supports("sse4.1")) return DabKernelLevel::Sse41;
+#endif
+    return DabKernelLevel::Scalar;
+}
+
+static std::atomic<DabKernelLevel>& currentLevel() {
+    static std::atomic<DabKernelLevel> level{DabKernels::bestLevel()};
+    return level;
+}
+
+DabKernelLevel DabKernels::bestLevel() {
+    static const DabKernelLevel best = detectLevel();
+    return best;
+}
+
+DabKernelLevel DabKernels::level() {
+    return currentLevel().load(std::memory_order_relaxed);
+}
+
+void DabKernels::setLevel(DabKernelLevel level) {
+    currentLevel().store(std::min(level, bestLevel()), std::memory_order_relaxed);
+}
+
+QString DabKernels::name(DabKernelLevel level) {
+    switch (level) {
+    case DabKernelLevel::Scalar: return QStringLiteral("scalar");
+    case DabKernelLevel::Sse41: return QStringLiteral("sse4.1");
+    case DabKernelLevel::Avx2: return QStringLiteral("avx2");
+    }
+    return {};
+}
+
+void DabKernels::stampRow(uint8_t* pixels, const uint8_t* mask, int count, const DabPaint& paint) {
+    switch (level()) {
+#ifdef COMICOS_DAB_SIMD
+    case DabKernelLevel::Avx2:
+        stampRowAvx2(pixels, mask, count, paint);
+        return;
+    case DabKernelLevel::Sse41:
+        stampRowSse41(pixels, mask, count, paint);
+        return;
+#endif
+    default:
+        stampRowScalar(pixels, mask, count, paint);
+        return;
+    }
+}
+
+void DabKernels::maxRow(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity) {
+    switch (level()) {
+#ifdef COMICOS_DAB_SIMD
+    case DabKernelLevel::Avx2:
+        maxRowAvx2(dst, mask, count, opacity);
+        return;
+    case DabKernelLevel::Sse41:
+        maxRowSse41(dst, mask, count, opacity);
+        return;
+#endif
+    default:
+        maxRowScalar(dst, mask, count, opacity);
+        return;
+    }
+}
+
+void DabKernels::addRow(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity) {
+    switch (level()) {
+#ifdef COMICOS_DAB_SIMD
+    case DabKernelLevel::Avx2:
+        addRowAvx2(dst, mask, count, opacity);
+        return;
+    case DabKernelLevel::Sse41:
+        addRowSse41(dst, mask, count, opacity);
+        return;
+#endif
+    default:
+        addRowScalar(dst, mask, count, opacity);
+        return;
+    }
+}
+
+}  // namespace comicos
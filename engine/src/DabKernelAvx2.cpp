@@ -0,0 +1,158 @@
+#include "engine/DabKernel.h"
+#include <immintrin.h>
+
+// Built with -mavx2 (see engine/CMakeLists.txt); only called when the CPU
+// reports AVX2. Produces the same bytes as the scalar kernels in
+// DabKernel.cpp, the same way the SSE4.1 kernels do.
+
+namespace comicos {
+
+namespace {
+
+struct Avx2Paint {
+    __m256i opacity, red, green, blue, rgb;
+    __m256i zero, c128, c255, byteMask, rgbMask;
+
+    explicit Avx2Paint(const DabPaint& paint)
+        : opacity(_mm256_set1_epi32(paint.opacity)),
+          red(_mm256_set1_epi32(paint.color[0])),
+          green(_mm256_set1_epi32(paint.color[1])),
+          blue(_mm256_set1_epi32(paint.color[2])),
+          rgb(_mm256_set1_epi32(paint.color[0] | paint.color[1] << 8 | paint.color[2] << 16)),
+          zero(_mm256_setzero_si256()),
+          c128(_mm256_set1_epi32(128)),
+          c255(_mm256_set1_epi32(255)),
+          byteMask(_mm256_set1_epi32(0xFF)),
+          rgbMask(_mm256_set1_epi32(0x00FFFFFF)) {}
+
+    template <int Shift>
+    __m256i channel(__m256i px) const {
+        return _mm256_and_si256(_mm256_srli_epi32(px, Shift), byteMask);
+    }
+
+    __m256i div255(__m256i x) const {
+        x = _mm256_add_epi32(x, c128);
+        return _mm256_srli_epi32(_mm256_add_epi32(x, _mm256_srli_epi32(x, 8)), 8);
+    }
+
+    /// Alpha (0..255) for 8-bit coverage.
+    __m256i alphaFor(__m256i coverage) const {
+        return div255(_mm256_mullo_epi16(coverage, opacity));
+    }
+
+    /// Blend eight pixels at p with `alpha`; lanes outside `write` keep dst.
+    template <bool Erase>
+    void blend(uint8_t* p, __m256i alpha, __m256i write) const {
+        const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const __m256i dstWeight =
+            div255(_mm256_mullo_epi16(channel<24>(px), _mm256_sub_epi32(c255, alpha)));
+
+        __m256i out;
+        if constexpr (Erase) {
+            out = _mm256_or_si256(_mm256_and_si256(px, rgbMask),
+                                  _mm256_slli_epi32(dstWeight, 24));
+        } else {
+            const __m256i outA = _mm256_add_epi32(alpha, dstWeight);
+            write = _mm256_and_si256(write, _mm256_cmpgt_epi32(outA, zero));
+
+            // Shortcuts as in the SSE4.1 kernel
+            const __m256i a = _mm256_slli_epi32(outA, 24);
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(dstWeight, zero)) == -1) {
+                out = _mm256_or_si256(rgb, a);
+            } else {
+                const bool opaque = _mm256_movemask_epi8(_mm256_cmpeq_epi32(outA, c255)) == -1;
+                const __m256i half = _mm256_srli_epi32(outA, 1);
+                const __m256 divisor = _mm256_cvtepi32_ps(outA);
+                auto mix = [&](__m256i src, __m256i dst) {
+                    const __m256i n = _mm256_add_epi32(_mm256_mullo_epi16(src, alpha),
+                                                       _mm256_mullo_epi16(dst, dstWeight));
+                    if (opaque) return div255(n);
+                    const __m256i rounded = _mm256_add_epi32(n, half);
+                    return _mm256_cvttps_epi32(
+                        _mm256_div_ps(_mm256_cvtepi32_ps(rounded), divisor));
+                };
+                const __m256i r = mix(red, channel<0>(px));
+                const __m256i g = _mm256_slli_epi32(mix(green, channel<8>(px)), 8);
+                const __m256i b = _mm256_slli_epi32(mix(blue, channel<16>(px)), 16);
+                out = _mm256_or_si256(_mm256_or_si256(r, g), _mm256_or_si256(b, a));
+            }
+        }
+
+        out = _mm256_blendv_epi8(px, out, write);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), out);
+    }
+};
+
+/// Returns how many pixels it handled; the scalar kernel does the rest.
+template <bool Erase>
+int stampSpan(uint8_t* pixels, const uint8_t* mask, int count, const DabPaint& paint) {
+    const Avx2Paint p(paint);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(mask + i));
+        if (_mm_testz_si128(bytes, bytes)) continue;
+
+        const __m256i coverage = _mm256_cvtepu8_epi32(bytes);
+        const __m256i write = _mm256_cmpgt_epi32(coverage, p.zero);
+        p.blend<Erase>(pixels + i * 4, p.alphaFor(coverage), write);
+    }
+    return i;
+}
+
+/// div255(mask * opacity) for 32 mask bytes, as in the SSE4.1 kernel.
+/// Unpacking and packing both work per 128-bit half, so bytes keep their order.
+inline __m256i scaleCoverage(__m256i mask, __m256i opacity) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i c128 = _mm256_set1_epi16(128);
+    auto scale = [&](__m256i m) {
+        const __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(m, opacity), c128);
+        return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+    };
+    return _mm256_packus_epi16(scale(_mm256_unpacklo_epi8(mask, zero)),
+                               scale(_mm256_unpackhi_epi8(mask, zero)));
+}
+
+/// Returns how many bytes it handled; the scalar kernel does the rest.
+template <bool Add>
+int accumulateSpan(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity) {
+    const __m256i o = _mm256_set1_epi16(opacity);
+
+    auto apply = [&](int i) {
+        auto* d = reinterpret_cast<__m256i*>(dst + i);
+        const __m256i coverage =
+            scaleCoverage(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask + i)), o);
+        const __m256i current = _mm256_loadu_si256(d);
+        _mm256_storeu_si256(d, Add ? _mm256_adds_epu8(current, coverage)
+                                   : _mm256_max_epu8(current, coverage));
+    };
+
+    int i = 0;
+    for (; i + 32 <= count; i += 32) apply(i);
+    if (!Add && i < count && count >= 32) {
+        apply(count - 32);  // Overlapping tail, as in the SSE4.1 kernel
+        return count;
+    }
+    return i;
+}
+
+}  // namespace
+
+void DabKernels::stampRowAvx2(uint8_t* pixels, const uint8_t* mask, int count,
+                              const DabPaint& paint) {
+    const int i = paint.erase ? stampSpan<true>(pixels, mask, count, paint)
+                              : stampSpan<false>(pixels, mask, count, paint);
+    stampRowScalar(pixels + i * 4, mask + i, count - i, paint);
+}
+
+void DabKernels::maxRowAvx2(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity) {
+    const int i = accumulateSpan<false>(dst, mask, count, opacity);
+    maxRowSse41(dst + i, mask + i, count - i, opacity);
+}
+
+void DabKernels::addRowAvx2(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity) {
+    const int i = accumulateSpan<true>(dst, mask, count, opacity);
+    addRowSse41(dst + i, mask + i, count - i, opacity);
+}
+
+}  // namespace comicos
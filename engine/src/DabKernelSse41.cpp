@@ -0,0 +1,163 @@
+#include "engine/DabKernel.h"
+#include <cstring>
+#include <smmintrin.h>
+
+// Built with -msse4.1 (see engine/CMakeLists.txt); only called when the CPU
+// reports SSE4.1. Produces the same bytes as the scalar kernels in
+// DabKernel.cpp: the same integer terms (all below 2^16, so 16-bit
+// multiplies are exact), and the division by the output alpha done in
+// float, which is exact for these operands (the quotient of two integers
+// below 2^17 never rounds across an integer).
+
+namespace comicos {
+
+namespace {
+
+struct Sse41Paint {
+    __m128i opacity, red, green, blue, rgb;
+    __m128i zero, c128, c255, byteMask, rgbMask;
+
+    explicit Sse41Paint(const DabPaint& paint)
+        : opacity(_mm_set1_epi32(paint.opacity)),
+          red(_mm_set1_epi32(paint.color[0])),
+          green(_mm_set1_epi32(paint.color[1])),
+          blue(_mm_set1_epi32(paint.color[2])),
+          rgb(_mm_set1_epi32(paint.color[0] | paint.color[1] << 8 | paint.color[2] << 16)),
+          zero(_mm_setzero_si128()),
+          c128(_mm_set1_epi32(128)),
+          c255(_mm_set1_epi32(255)),
+          byteMask(_mm_set1_epi32(0xFF)),
+          rgbMask(_mm_set1_epi32(0x00FFFFFF)) {}
+
+    template <int Shift>
+    __m128i channel(__m128i px) const {
+        return _mm_and_si128(_mm_srli_epi32(px, Shift), byteMask);
+    }
+
+    __m128i div255(__m128i x) const {
+        x = _mm_add_epi32(x, c128);
+        return _mm_srli_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 8)), 8);
+    }
+
+    /// Alpha (0..255) for 8-bit coverage.
+    __m128i alphaFor(__m128i coverage) const {
+        return div255(_mm_mullo_epi16(coverage, opacity));
+    }
+
+    /// Blend four pixels at p with `alpha`; lanes outside `write` keep dst.
+    template <bool Erase>
+    void blend(uint8_t* p, __m128i alpha, __m128i write) const {
+        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i dstWeight =
+            div255(_mm_mullo_epi16(channel<24>(px), _mm_sub_epi32(c255, alpha)));
+
+        __m128i out;
+        if constexpr (Erase) {
+            out = _mm_or_si128(_mm_and_si128(px, rgbMask), _mm_slli_epi32(dstWeight, 24));
+        } else {
+            const __m128i outA = _mm_add_epi32(alpha, dstWeight);
+            write = _mm_and_si128(write, _mm_cmpgt_epi32(outA, zero));
+
+            // Common cases without the division: nothing under the dab
+            // (the colour comes out as is), or opaque output (divide by 255)
+            const __m128i a = _mm_slli_epi32(outA, 24);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(dstWeight, zero)) == 0xFFFF) {
+                out = _mm_or_si128(rgb, a);
+            } else {
+                const bool opaque = _mm_movemask_epi8(_mm_cmpeq_epi32(outA, c255)) == 0xFFFF;
+                const __m128i half = _mm_srli_epi32(outA, 1);
+                const __m128 divisor = _mm_cvtepi32_ps(outA);
+                auto mix = [&](__m128i src, __m128i dst) {
+                    const __m128i n = _mm_add_epi32(_mm_mullo_epi16(src, alpha),
+                                                    _mm_mullo_epi16(dst, dstWeight));
+                    if (opaque) return div255(n);
+                    const __m128i rounded = _mm_add_epi32(n, half);
+                    return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(rounded), divisor));
+                };
+                const __m128i r = mix(red, channel<0>(px));
+                const __m128i g = _mm_slli_epi32(mix(green, channel<8>(px)), 8);
+                const __m128i b = _mm_slli_epi32(mix(blue, channel<16>(px)), 16);
+                out = _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+            }
+        }
+
+        out = _mm_blendv_epi8(px, out, write);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), out);
+    }
+};
+
+/// Returns how many pixels it handled; the scalar kernel does the rest.
+template <bool Erase>
+int stampSpan(uint8_t* pixels, const uint8_t* mask, int count, const DabPaint& paint) {
+    const Sse41Paint p(paint);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int32_t bytes;
+        std::memcpy(&bytes, mask + i, sizeof(bytes));
+        if (bytes == 0) continue;
+
+        const __m128i coverage = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+        const __m128i write = _mm_cmpgt_epi32(coverage, p.zero);
+        p.blend<Erase>(pixels + i * 4, p.alphaFor(coverage), write);
+    }
+    return i;
+}
+
+/// div255(mask * opacity) for 16 mask bytes; `opacity` is in every 16-bit
+/// lane. The products and the rounding stay below 2^16.
+inline __m128i scaleCoverage(__m128i mask, __m128i opacity) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c128 = _mm_set1_epi16(128);
+    auto scale = [&](__m128i m) {
+        const __m128i x = _mm_add_epi16(_mm_mullo_epi16(m, opacity), c128);
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    };
+    return _mm_packus_epi16(scale(_mm_unpacklo_epi8(mask, zero)),
+                            scale(_mm_unpackhi_epi8(mask, zero)));
+}
+
+/// Returns how many bytes it handled; the scalar kernel does the rest.
+template <bool Add>
+int accumulateSpan(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity) {
+    const __m128i o = _mm_set1_epi16(opacity);
+
+    auto apply = [&](int i) {
+        auto* d = reinterpret_cast<__m128i*>(dst + i);
+        const __m128i coverage =
+            scaleCoverage(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + i)), o);
+        const __m128i current = _mm_loadu_si128(d);
+        _mm_storeu_si128(d, Add ? _mm_adds_epu8(current, coverage)
+                                : _mm_max_epu8(current, coverage));
+    };
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) apply(i);
+    if (!Add && i < count && count >= 16) {
+        // Max is idempotent, so the tail reruns the last 16 bytes instead
+        apply(count - 16);
+        return count;
+    }
+    return i;
+}
+
+}  // namespace
+
+void DabKernels::stampRowSse41(uint8_t* pixels, const uint8_t* mask, int count,
+                               const DabPaint& paint) {
+    const int i = paint.erase ? stampSpan<true>(pixels, mask, count, paint)
+                              : stampSpan<false>(pixels, mask, count, paint);
+    stampRowScalar(pixels + i * 4, mask + i, count - i, paint);
+}
+
+void DabKernels::maxRowSse41(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity) {
+    const int i = accumulateSpan<false>(dst, mask, count, opacity);
+    maxRowScalar(dst + i, mask + i, count - i, opacity);
+}
+
+void DabKernels::addRowSse41(uint8_t* dst, const uint8_t* mask, int count, uint8_t opacity) {
+    const int i = accumulateSpan<true>(dst, mask, count, opacity);
+    addRowScalar(dst + i, mask + i, count - i, opacity);
+}
+
+}  // namespace comicos
@@ -0,0 +1,70 @@
+#include "engine/Exporter.h"
+#include "engine/Compositor.h"
+#include "engine/OraWriter.h"
+#include "engine/PsdWriter.h"
+#include <QSaveFile>
+#include <QThreadPool>
+#include <algorithm>
+#include <vector>
+
+namespace comicos {
+
+bool Exporter::exportFlattened(const LayerStack& layers, const QSize& canvasSize, int dpi,
+                               const QString& path, const ExportOptions& options) {
+    if (canvasSize.isEmpty()) return false;
+    if (options.bitDepth != 8 && options.bitDepth != 16) return false;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    auto encoder = ImageEncoder::create(options.format, &file);
+    if (!encoder || !encoder->begin({canvasSize, options.bitDepth, dpi})) {
+        file.cancelWriting();
+        return false;
+    }
+
+    const int width = canvasSize.width();
+    const int height = canvasSize.height();
+    const qsizetype stride = static_cast<qsizetype>(width) * 4;
+    std::vector<uint8_t> bands[2] = {
+        std::vector<uint8_t>(static_cast<size_t>(stride) * TILE_SIZE),
+        std::vector<uint8_t>(static_cast<size_t>(stride) * TILE_SIZE),
+    };
+
+    // Single encoder thread: bands are encoded in order. waitForDone() before
+    // each hand-off guarantees the buffer composited next is no longer read.
+    QThreadPool encoderThread;
+    encoderThread.setMaxThreadCount(1);
+    bool encoded = true;  // Written by the worker, read after waitForDone()
+
+    Compositor compositor;
+    for (int top = 0, band = 0; top < height; top += TILE_SIZE, ++band) {
+        const int rows = std::min(TILE_SIZE, height - top);
+        uint8_t* buffer = bands[band % 2].data();
+        compositor.compositeRegionInto(layers, QRect(0, top, width, rows), buffer, stride);
+
+        encoderThread.waitForDone();
+        if (!encoded) break;
+        encoderThread.start([&encoder, &encoded, buffer, rows, stride]() {
+            encoded = encoder->writeRows(buffer, rows, stride);
+        });
+    }
+    encoderThread.waitForDone();
+
+    if (!encoded || !encoder->finish()) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool Exporter::exportLayered(const LayerStack& layers, const QSize& canvasSize, int dpi,
+                             const QString& path, LayeredFormat format) {
+    switch (format) {
+    case LayeredFormat::Psd: return PsdWriter::write(layers, canvasSize, dpi, path);
+    case LayeredFormat::OpenRaster: return OraWriter::write(layers, canvasSize, dpi, path);
+    }
+    return false;
+}
+
+}  // namespace comicos
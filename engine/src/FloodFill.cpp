@@ -0,0 +1,536 @@
+#include "engine/FloodFill.h"
+#include "core/Parallel.h"
+#include "engine/Compositor.h"
+#include "engine/DabKernel.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace comicos {
+
+// --- Helpers ---
+
+/// Straight RGBA8 to premultiplied, so all transparent pixels compare equal.
+static inline void premultiply(const uint8_t* p, uint8_t* out) {
+    out[0] = static_cast<uint8_t>(div255(p[0] * p[3]));
+    out[1] = static_cast<uint8_t>(div255(p[1] * p[3]));
+    out[2] = static_cast<uint8_t>(div255(p[2] * p[3]));
+    out[3] = p[3];
+}
+
+static inline bool matches(const uint8_t* p, const uint8_t* seed, int tolerance) {
+    uint8_t pm[4];
+    premultiply(p, pm);
+    for (int c = 0; c < 4; ++c) {
+        if (std::abs(pm[c] - seed[c]) > tolerance) return false;
+    }
+    return true;
+}
+
+/// Runs of OPEN state bytes (FloodFill::OPEN == 1), eight bytes at a time.
+/// openRunEnd: first index in [from, end) that is not OPEN, or end.
+/// openRunBegin: lowest b <= end such that [b, end) is all OPEN.
+static constexpr uint64_t OPEN_WORD = 0x0101010101010101ull;
+
+static inline int openRunEnd(const uint8_t* row, int from, int end) {
+    int x = from;
+    for (uint64_t word; x + 8 <= end; x += 8) {
+        std::memcpy(&word, row + x, sizeof(word));
+        if (word != OPEN_WORD) break;
+    }
+    while (x < end && row[x] == 1) ++x;
+    return x;
+}
+
+static inline int openRunBegin(const uint8_t* row, int end) {
+    int b = end;
+    for (uint64_t word; b >= 8; b -= 8) {
+        std::memcpy(&word, row + b - 8, sizeof(word));
+        if (word != OPEN_WORD) break;
+    }
+    while (b > 0 && row[b - 1] == 1) --b;
+    return b;
+}
+
+/// Square dilation by `r` of the tile at (x0, y0): out[i] = 1 where a source
+/// flag lies within r pixels on both axes. `line(y, x, count, dst)` supplies
+/// 0/1 source flags for part of canvas row y. Two running-sum passes, so the
+/// cost does not depend on r.
+template <typename LineFn>
+static void dilateTile(int x0, int y0, int r, LineFn&& line, uint8_t* out) {
+    const int span = TILE_SIZE + 2 * r;
+    std::vector<uint8_t> src(span);
+    std::vector<uint8_t> rows(static_cast<size_t>(span) * TILE_SIZE);
+
+    // Horizontal pass over the tile's rows plus r above and below
+    for (int j = 0; j < span; ++j) {
+        line(y0 - r + j, x0 - r, span, src.data());
+        uint8_t* dst = rows.data() + static_cast<size_t>(j) * TILE_SIZE;
+        int count = 0;
+        for (int i = 0; i < 2 * r; ++i) count += src[i];
+        for (int x = 0; x < TILE_SIZE; ++x) {
+            count += src[x + 2 * r];
+            dst[x] = count > 0;
+            count -= src[x];
+        }
+    }
+
+    // Vertical pass
+    std::vector<int> counts(TILE_SIZE, 0);
+    for (int j = 0; j < 2 * r; ++j) {
+        const uint8_t* row = rows.data() + static_cast<size_t>(j) * TILE_SIZE;
+        for (int x = 0; x < TILE_SIZE; ++x) counts[x] += row[x];
+    }
+    for (int y = 0; y < TILE_SIZE; ++y) {
+        const uint8_t* add = rows.data() + static_cast<size_t>(y + 2 * r) * TILE_SIZE;
+        const uint8_t* sub = rows.data() + static_cast<size_t>(y) * TILE_SIZE;
+        for (int x = 0; x < TILE_SIZE; ++x) {
+            counts[x] += add[x];
+            out[y * TILE_SIZE + x] = counts[x] > 0;
+            counts[x] -= sub[x];
+        }
+    }
+}
+
+// --- FloodFill ---
+
+FloodFill::FloodFill(const LayerStack& layers, const Layer& layer, const QSize& canvasSize,
+                     const FillOptions& options)
+    : m_layers(layers), m_layer(layer), m_canvas(canvasSize), m_options(options) {
+    m_options.tolerance = std::clamp(m_options.tolerance, 0, 255);
+    m_options.gapClose = std::clamp(m_options.gapClose, 0, MAX_GAP_CLOSE);
+    m_cols = (std::max(m_canvas.width(), 0) + TILE_SIZE - 1) / TILE_SIZE;
+    m_rows = (std::max(m_canvas.height(), 0) + TILE_SIZE - 1) / TILE_SIZE;
+}
+
+FloodFill::~FloodFill() = default;
+
+int FloodFill::tileWidth(int tx) const {
+    return std::min(TILE_SIZE, m_canvas.width() - tx * TILE_SIZE);
+}
+
+int FloodFill::tileHeight(int ty) const {
+    return std::min(TILE_SIZE, m_canvas.height() - ty * TILE_SIZE);
+}
+
+bool FloodFill::compute(int x, int y) {
+    m_grid.clear();
+    m_masks.clear();
+    m_fullMasks.clear();
+    m_regionTiles.clear();
+    m_uniformBuffers.clear();
+    if (x < 0 || y < 0 || x >= m_canvas.width() || y >= m_canvas.height()) return false;
+
+    m_grid.resize(static_cast<size_t>(m_cols) * m_rows);
+    m_scratch.resize(TILE_BYTES);
+
+    // The seed colour, sampled the same way as every other pixel
+    const TileCoord seedTile = pixelToTile(x, y);
+    const int offset =
+        ((y - seedTile.ty * TILE_SIZE) * TILE_SIZE + (x - seedTile.tx * TILE_SIZE)) * 4;
+    const uint8_t transparent[4] = {};
+    std::vector<uint8_t> composite;
+    const uint8_t* pixels = nullptr;
+    if (m_options.sample == FillSample::Merged) {
+        composite = Compositor().compositeTile(m_layers, seedTile);
+        pixels = composite.data();
+    } else {
+        pixels = m_layer.tiles().pixelsAt(seedTile, m_scratch.data());
+    }
+    premultiply(pixels ? pixels + offset : transparent, m_seed);
+
+    if (stateRow(x / TILE_SIZE, y)[x % TILE_SIZE] != OPEN) {
+        m_grid.clear();
+        return false;
+    }
+    fillFrom(x, y);
+    buildRegion();
+    m_grid.clear();
+    m_uniformBuffers.clear();
+    return !m_regionTiles.empty();
+}
+
+const uint8_t* FloodFill::maskAt(const TileCoord& coord) const {
+    auto it = m_masks.find(coord);
+    return it != m_masks.end() ? it->second.get() : nullptr;
+}
+
+// --- Classification ---
+
+void FloodFill::classify(int tx, int ty) {
+    GridTile& g = gridAt(tx, ty);
+    if (g.classified) return;
+    g.classified = true;
+
+    const TileCoord coord{tx, ty};
+    std::vector<uint8_t> composite;
+    const uint8_t* pixels = nullptr;
+    if (m_options.sample == FillSample::Merged) {
+        composite = Compositor().compositeTile(m_layers, coord);
+        pixels = composite.data();
+    } else {
+        pixels = m_layer.tiles().pixelsAt(coord, m_scratch.data());
+    }
+
+    const int w = tileWidth(tx);
+    const int h = tileHeight(ty);
+    const bool whole = w == TILE_SIZE && h == TILE_SIZE;
+    if (!pixels) {
+        const uint8_t transparent[4] = {};
+        g.uniform = matches(transparent, m_seed, m_options.tolerance) ? 0 : 1;
+        if (g.uniform == 0 || whole) return;
+
+        // Partial edge tile: blocked inside the canvas, 0 beyond it
+        g.uniform = MIXED;
+        g.barrier = std::make_unique<uint8_t[]>(TILE_PIXELS);
+        for (int y = 0; y < h; ++y) std::memset(g.barrier.get() + y * TILE_SIZE, 1, w);
+        return;
+    }
+
+    // Layer tiles that share a buffer (interned, or filled earlier) share the
+    // answer; composites and decoded lazy tiles are temporaries
+    const bool resident = m_options.sample == FillSample::CurrentLayer &&
+                          pixels != m_scratch.data() && whole;
+    if (resident) {
+        auto known = m_uniformBuffers.find(pixels);
+        if (known != m_uniformBuffers.end()) {
+            g.uniform = known->second;
+            return;
+        }
+    }
+
+    // Line art is mostly long runs of one colour: only test a pixel when it
+    // differs from the one before
+    g.barrier = std::make_unique<uint8_t[]>(TILE_PIXELS);
+    int blocked = 0;
+    for (int y = 0; y < h; ++y) {
+        const uint8_t* src = pixels + y * TILE_SIZE * 4;
+        uint8_t* dst = g.barrier.get() + y * TILE_SIZE;
+        uint32_t last = 0;
+        uint8_t lastBlocked = 0;
+        for (int x = 0; x < w; ++x) {
+            uint32_t px;
+            std::memcpy(&px, src + x * 4, sizeof(px));
+            if (x == 0 || px != last) {
+                last = px;
+                lastBlocked = !matches(src + x * 4, m_seed, m_options.tolerance);
+            }
+            dst[x] = lastBlocked;
+            blocked += lastBlocked;
+        }
+    }
+    if (blocked == 0 || (whole && blocked == TILE_PIXELS)) {
+        g.uniform = blocked ? 1 : 0;
+        g.barrier.reset();
+        if (resident) m_uniformBuffers.emplace(pixels, g.uniform);
+    } else {
+        g.uniform = MIXED;
+    }
+}
+
+void FloodFill::barrierLine(int y, int x0, int count, uint8_t* line) {
+    std::memset(line, 0, count);
+    if (y < 0 || y >= m_canvas.height()) return;
+
+    const int begin = std::max(x0, 0);
+    const int end = std::min(x0 + count, m_canvas.width());
+    const int ty = y / TILE_SIZE;
+    const int ly = y - ty * TILE_SIZE;
+    for (int x = begin; x < end;) {
+        const int tx = x / TILE_SIZE;
+        const int segEnd = std::min(end, (tx + 1) * TILE_SIZE);
+        classify(tx, ty);
+        const GridTile& g = gridAt(tx, ty);
+        if (g.uniform == MIXED) {
+            std::memcpy(line + (x - x0), g.barrier.get() + ly * TILE_SIZE + (x - tx * TILE_SIZE),
+                        segEnd - x);
+        } else if (g.uniform == 1) {
+            std::memset(line + (x - x0), 1, segEnd - x);
+        }
+        x = segEnd;
+    }
+}
+
+void FloodFill::filledLine(int y, int x0, int count, uint8_t* line) const {
+    std::memset(line, 0, count);
+    if (y < 0 || y >= m_canvas.height()) return;
+
+    const int begin = std::max(x0, 0);
+    const int end = std::min(x0 + count, m_canvas.width());
+    const int ty = y / TILE_SIZE;
+    const int ly = y - ty * TILE_SIZE;
+    for (int x = begin; x < end;) {
+        const int tx = x / TILE_SIZE;
+        const int segEnd = std::min(end, (tx + 1) * TILE_SIZE);
+        const GridTile& g = gridAt(tx, ty);
+        if (g.filledPixels > 0) {
+            const uint8_t* state = g.state.get() + ly * TILE_SIZE + (x - tx * TILE_SIZE);
+            uint8_t* dst = line + (x - x0);
+            for (int i = 0; i < segEnd - x; ++i) dst[i] = state[i] == FILLED;
+        }
+        x = segEnd;
+    }
+}
+
+// --- Fill ---
+
+void FloodFill::buildState(int tx, int ty) {
+    GridTile& g = gridAt(tx, ty);
+    if (g.state) return;
+    g.state = std::make_unique<uint8_t[]>(TILE_PIXELS);  // Zeroed: BLOCKED
+
+    const int w = tileWidth(tx);
+    const int h = tileHeight(ty);
+    const int r = m_options.gapClose;
+    uint8_t* state = g.state.get();
+    auto openRows = [&]() {
+        for (int y = 0; y < h; ++y) std::memset(state + y * TILE_SIZE, OPEN, w);
+    };
+
+    classify(tx, ty);
+    if (r == 0) {
+        if (g.uniform == 0) {
+            openRows();
+        } else if (g.uniform == MIXED) {
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    state[y * TILE_SIZE + x] = g.barrier[y * TILE_SIZE + x] ? BLOCKED : OPEN;
+                }
+            }
+        }
+        return;
+    }
+
+    // Open where no barrier lies within r; skip the dilation when nothing
+    // within reach is a barrier
+    bool clear = g.uniform == 0;
+    for (int ny = std::max(ty - 1, 0); clear && ny <= std::min(ty + 1, m_rows - 1); ++ny) {
+        for (int nx = std::max(tx - 1, 0); nx <= std::min(tx + 1, m_cols - 1); ++nx) {
+            classify(nx, ny);
+            clear = clear && gridAt(nx, ny).uniform == 0;
+        }
+    }
+    if (clear) {
+        openRows();
+        return;
+    }
+    if (g.uniform == 1) return;
+
+    std::vector<uint8_t> grown(TILE_PIXELS);
+    dilateTile(tx * TILE_SIZE, ty * TILE_SIZE, r,
+               [this](int y, int x0, int count, uint8_t* line) { barrierLine(y, x0, count, line); },
+               grown.data());
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            state[y * TILE_SIZE + x] = grown[y * TILE_SIZE + x] ? BLOCKED : OPEN;
+        }
+    }
+}
+
+uint8_t* FloodFill::stateRow(int tx, int y) {
+    const int ty = y / TILE_SIZE;
+    buildState(tx, ty);
+    return gridAt(tx, ty).state.get() + (y - ty * TILE_SIZE) * TILE_SIZE;
+}
+
+void FloodFill::fillFrom(int x, int y) {
+    const int width = m_canvas.width();
+    const int height = m_canvas.height();
+
+    // Span seeds: each pop fills the whole horizontal run of OPEN pixels
+    // through the seed, then seeds every OPEN run next to it above and below
+    std::vector<std::pair<int, int>> seeds{{x, y}};
+    while (!seeds.empty()) {
+        const auto [sx, sy] = seeds.back();
+        seeds.pop_back();
+        if (stateRow(sx / TILE_SIZE, sy)[sx % TILE_SIZE] != OPEN) continue;
+
+        // Extend left and right, a tile row segment at a time
+        int xl = sx;
+        while (xl > 0) {
+            const int tx = (xl - 1) / TILE_SIZE;
+            const int b = openRunBegin(stateRow(tx, sy), xl - tx * TILE_SIZE);
+            xl = tx * TILE_SIZE + b;
+            if (b > 0) break;
+        }
+        int xr = sx + 1;
+        while (xr < width) {
+            const int tx = xr / TILE_SIZE;
+            const int e = openRunEnd(stateRow(tx, sy), xr - tx * TILE_SIZE, TILE_SIZE);
+            xr = tx * TILE_SIZE + e;
+            if (e < TILE_SIZE) break;
+        }
+
+        for (int tx = xl / TILE_SIZE; tx * TILE_SIZE < xr; ++tx) {
+            const int a = std::max(xl, tx * TILE_SIZE) - tx * TILE_SIZE;
+            const int b = std::min(xr, (tx + 1) * TILE_SIZE) - tx * TILE_SIZE;
+            std::memset(stateRow(tx, sy) + a, FILLED, b - a);
+            gridAt(tx, sy / TILE_SIZE).filledPixels += b - a;
+        }
+
+        for (const int ny : {sy - 1, sy + 1}) {
+            if (ny < 0 || ny >= height) continue;
+            for (int tx = xl / TILE_SIZE; tx * TILE_SIZE < xr; ++tx) {
+                const uint8_t* row = stateRow(tx, ny);
+                int lx = std::max(xl, tx * TILE_SIZE) - tx * TILE_SIZE;
+                const int end = std::min(xr, (tx + 1) * TILE_SIZE) - tx * TILE_SIZE;
+                while (lx < end) {
+                    const auto* open = static_cast<const uint8_t*>(
+                        std::memchr(row + lx, OPEN, end - lx));
+                    if (!open) break;
+                    lx = static_cast<int>(open - row);
+                    seeds.emplace_back(tx * TILE_SIZE + lx, ny);
+                    lx = openRunEnd(row, lx, end);
+                }
+            }
+        }
+    }
+}
+
+void FloodFill::buildRegion() {
+    const int r = m_options.gapClose;
+
+    // Tiles the region can reach: filled ones, and with gap closing their
+    // neighbours, which the fill grows back into
+    std::vector<uint8_t> candidate(m_grid.size(), 0);
+    for (int ty = 0; ty < m_rows; ++ty) {
+        for (int tx = 0; tx < m_cols; ++tx) {
+            if (gridAt(tx, ty).filledPixels == 0) continue;
+            const int reach = r > 0 ? 1 : 0;
+            for (int ny = std::max(ty - reach, 0); ny <= std::min(ty + reach, m_rows - 1); ++ny) {
+                for (int nx = std::max(tx - reach, 0); nx <= std::min(tx + reach, m_cols - 1);
+                     ++nx) {
+                    candidate[ny * m_cols + nx] = 1;
+                }
+            }
+        }
+    }
+
+    std::vector<TileCoord> coords;
+    for (int ty = 0; ty < m_rows; ++ty) {
+        for (int tx = 0; tx < m_cols; ++tx) {
+            if (!candidate[ty * m_cols + tx]) continue;
+            coords.push_back({tx, ty});
+            classify(tx, ty);  // Reads sources; not thread-safe
+        }
+    }
+
+    // Masks are independent per tile; the grid is only read from here on
+    std::vector<std::unique_ptr<uint8_t[]>> masks(coords.size());
+    std::vector<uint8_t> full(coords.size(), 0);
+    parallelFor(static_cast<int>(coords.size()), [&](int i) {
+        const int tx = coords[i].tx;
+        const int ty = coords[i].ty;
+        const GridTile& g = gridAt(tx, ty);
+        const int w = tileWidth(tx);
+        const int h = tileHeight(ty);
+        auto mask = std::make_unique<uint8_t[]>(TILE_PIXELS);
+
+        bool any = false;
+        if (g.filledPixels == w * h) {
+            for (int y = 0; y < h; ++y) std::memset(mask.get() + y * TILE_SIZE, 255, w);
+            any = true;
+            full[i] = w * h == TILE_PIXELS;
+        } else if (r == 0) {
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    const bool in = g.state[y * TILE_SIZE + x] == FILLED;
+                    mask[y * TILE_SIZE + x] = in ? 255 : 0;
+                    any = any || in;
+                }
+            }
+        } else if (g.uniform != 1) {
+            // Grow back by r, onto pixels that match the seed
+            std::vector<uint8_t> grown(TILE_PIXELS);
+            dilateTile(tx * TILE_SIZE, ty * TILE_SIZE, r,
+                       [this](int y, int x0, int count, uint8_t* line) {
+                           filledLine(y, x0, count, line);
+                       },
+                       grown.data());
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    const int p = y * TILE_SIZE + x;
+                    const bool in = grown[p] && (g.uniform == 0 || !g.barrier[p]);
+                    mask[p] = in ? 255 : 0;
+                    any = any || in;
+                }
+            }
+        }
+        if (any) masks[i] = std::move(mask);
+    });
+
+    for (size_t i = 0; i < coords.size(); ++i) {
+        if (!masks[i]) continue;
+        m_regionTiles.push_back(coords[i]);
+        m_masks[coords[i]] = std::move(masks[i]);
+        if (full[i]) m_fullMasks.insert(coords[i]);
+    }
+}
+
+// --- Output ---
+
+std::vector<TileCoord> FloodFill::apply(
+    Layer& layer, const QColor& color,
+    std::unordered_map<TileCoord, std::unique_ptr<Tile>>* before,
+    const Selection* selection) const {
+    TileManager& tiles = layer.tiles();
+    if (selection && selection->isEmpty()) selection = nullptr;
+
+    // Snapshots and tile creation touch the tile map: one thread. A tile the
+    // region covers completely ends up the same as any other such tile that
+    // had the same pixels, so only the first of those is blended and the
+    // rest share its buffer (a fill over a blank page allocates one tile)
+    std::vector<TileCoord> coords;
+    std::vector<Tile*> targets;
+    std::vector<int> sameAs;
+    std::unordered_map<const uint8_t*, int> firstFull;
+    for (const TileCoord& tc : m_regionTiles) {
+        const auto state = selection ? selection->stateAt(tc) : Selection::TileState::Full;
+        if (state == Selection::TileState::None) continue;
+
+        const Tile* existing = tiles.tileAt(tc);
+        const bool empty = !existing || existing->isEmpty();
+        if (before) (*before)[tc] = empty ? nullptr : existing->clone();
+
+        int source = -1;
+        if (state == Selection::TileState::Full && m_fullMasks.count(tc)) {
+            const auto [it, first] = firstFull.try_emplace(
+                empty ? nullptr : existing->constData(), static_cast<int>(targets.size()));
+            if (!first) source = it->second;
+        }
+        Tile* tile = tiles.getOrCreateTile(tc);
+        if (source < 0) tile->ensureAllocated();
+        tile->setDirty(true);
+        coords.push_back(tc);
+        targets.push_back(tile);
+        sameAs.push_back(source);
+    }
+
+    // Blending writes only each tile's own pixels
+    const DabPaint paint = DabPaint::make(color, static_cast<float>(color.alphaF()), false);
+    parallelFor(static_cast<int>(targets.size()), [&](int i) {
+        if (sameAs[i] >= 0) return;
+        uint8_t* pixels = targets[i]->data();
+        const uint8_t* mask = maskAt(coords[i]);
+        const uint8_t* selected = selection ? selection->maskAt(coords[i]) : nullptr;
+        uint8_t clipped[TILE_SIZE];
+        for (int y = 0; y < TILE_SIZE; ++y) {
+            const uint8_t* row = mask + y * TILE_SIZE;
+            if (selected) {
+                std::memcpy(clipped, row, TILE_SIZE);
+                Selection::clip(clipped, selected + y * TILE_SIZE, TILE_SIZE);
+                row = clipped;
+            }
+            DabKernels::stampRow(pixels + y * TILE_SIZE * 4, row, TILE_SIZE, paint);
+        }
+    });
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (sameAs[i] < 0) continue;
+        const Tile& source = *targets[sameAs[i]];
+        source.contentHash();  // Hashed once for all the copies
+        targets[i]->sharePixels(source);
+    }
+    return coords;
+}
+
+}  // namespace comicos
@@ -0,0 +1,458 @@
+#include "engine/ImageEncoder.h"
+#include "engine/Crc32.h"
+#include <QByteArray>
+#include <QIODevice>
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifdef COMICOS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace comicos {
+
+// --- Helpers ---
+
+/// Widens one RGBA8 row to the output sample depth. v * 257 repeats the
+/// byte, so 16-bit samples are the same in either byte order.
+static void convertRow(const uint8_t* src, int width, int bitDepth, uint8_t* dst) {
+    const size_t samples = static_cast<size_t>(width) * 4;
+    if (bitDepth == 8) {
+        std::memcpy(dst, src, samples);
+        return;
+    }
+    for (size_t i = 0; i < samples; ++i) {
+        dst[2 * i] = src[i];
+        dst[2 * i + 1] = src[i];
+    }
+}
+
+static void putBigEndian32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+static bool writeAll(QIODevice* device, const void* data, qint64 size) {
+    return device->write(static_cast<const char*>(data), size) == size;
+}
+
+// --- PNG ---
+
+/// zlib stream fed incrementally. Compressed with zlib when available;
+/// otherwise written as stored deflate blocks (valid, uncompressed).
+class ZlibStream {
+public:
+    ZlibStream() {
+#ifdef COMICOS_HAVE_ZLIB
+        std::memset(&m_stream, 0, sizeof(m_stream));
+        m_ok = deflateInit(&m_stream, Z_DEFAULT_COMPRESSION) == Z_OK;
+#else
+        const uint8_t header[2] = {0x78, 0x01};
+        m_out.append(reinterpret_cast<const char*>(header), 2);
+#endif
+    }
+
+    ~ZlibStream() {
+#ifdef COMICOS_HAVE_ZLIB
+        if (m_ok) deflateEnd(&m_stream);
+#endif
+    }
+
+    ZlibStream(const ZlibStream&) = delete;
+    ZlibStream& operator=(const ZlibStream&) = delete;
+
+    bool write(const uint8_t* data, size_t size) { return feed(data, size, false); }
+    bool finish() { return feed(nullptr, 0, true); }
+
+    /// Compressed bytes produced so far (the caller drains it).
+    QByteArray& output() { return m_out; }
+
+private:
+#ifdef COMICOS_HAVE_ZLIB
+    bool feed(const uint8_t* data, size_t size, bool last) {
+        if (!m_ok) return false;
+        m_stream.next_in = const_cast<Bytef*>(data);
+        m_stream.avail_in = static_cast<uInt>(size);
+        int status = Z_OK;
+        do {
+            uint8_t buffer[64 * 1024];
+            m_stream.next_out = buffer;
+            m_stream.avail_out = sizeof(buffer);
+            status = deflate(&m_stream, last ? Z_FINISH : Z_NO_FLUSH);
+            if (status == Z_STREAM_ERROR) return m_ok = false;
+            m_out.append(reinterpret_cast<const char*>(buffer),
+                         static_cast<qsizetype>(sizeof(buffer) - m_stream.avail_out));
+        } while (m_stream.avail_out == 0 || (last && status != Z_STREAM_END));
+        return true;
+    }
+
+    z_stream m_stream;
+    bool m_ok = false;
+#else
+    static constexpr size_t STORED_BLOCK = 65535;
+
+    bool feed(const uint8_t* data, size_t size, bool last) {
+        for (size_t i = 0; i < size; ++i) {
+            m_a = (m_a + data[i]) % 65521;
+            m_b = (m_b + m_a) % 65521;
+        }
+        m_pending.insert(m_pending.end(), data, data + size);
+        while (m_pending.size() >= STORED_BLOCK) {
+            writeBlock(m_pending.data(), STORED_BLOCK, false);
+            m_pending.erase(m_pending.begin(), m_pending.begin() + STORED_BLOCK);
+        }
+        if (last) {
+            writeBlock(m_pending.data(), m_pending.size(), true);
+            m_pending.clear();
+            uint8_t adler[4];
+            putBigEndian32(adler, (m_b << 16) | m_a);
+            m_out.append(reinterpret_cast<const char*>(adler), 4);
+        }
+        return true;
+    }
+
+    void writeBlock(const uint8_t* data, size_t size, bool final) {
+        const uint8_t header[5] = {
+            static_cast<uint8_t>(final ? 1 : 0),
+            static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8),
+            static_cast<uint8_t>(~size), static_cast<uint8_t>(~size >> 8)};
+        m_out.append(reinterpret_cast<const char*>(header), 5);
+        m_out.append(reinterpret_cast<const char*>(data), static_cast<qsizetype>(size));
+    }
+
+    std::vector<uint8_t> m_pending;
+    uint32_t m_a = 1;
+    uint32_t m_b = 0;
+#endif
+
+    QByteArray m_out;
+};
+
+class PngEncoder final : public ImageEncoder {
+public:
+    explicit PngEncoder(QIODevice* device) : m_device(device) {}
+
+    bool begin(const Params& params) override {
+        m_params = params;
+        m_bytesPerPixel = params.bitDepth / 2;  // 4 samples of 8 or 16 bits
+        m_rowBytes = static_cast<size_t>(params.size.width()) * m_bytesPerPixel;
+        m_previous.assign(m_rowBytes, 0);
+        m_current.resize(m_rowBytes);
+        for (auto& candidate : m_candidates) candidate.resize(m_rowBytes + 1);
+
+        static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        if (!writeAll(m_device, signature, 8)) return false;
+
+        uint8_t ihdr[13];
+        putBigEndian32(ihdr, static_cast<uint32_t>(params.size.width()));
+        putBigEndian32(ihdr + 4, static_cast<uint32_t>(params.size.height()));
+        ihdr[8] = static_cast<uint8_t>(params.bitDepth);
+        ihdr[9] = 6;  // RGBA
+        ihdr[10] = 0;  // Deflate
+        ihdr[11] = 0;  // Adaptive filtering
+        ihdr[12] = 0;  // No interlace
+        if (!writeChunk("IHDR", ihdr, sizeof(ihdr))) return false;
+
+        uint8_t phys[9];
+        const auto dotsPerMeter = static_cast<uint32_t>(params.dpi / 0.0254 + 0.5);
+        putBigEndian32(phys, dotsPerMeter);
+        putBigEndian32(phys + 4, dotsPerMeter);
+        phys[8] = 1;  // Meters
+        return writeChunk("pHYs", phys, sizeof(phys));
+    }
+
+    bool writeRows(const uint8_t* rgba, int rows, qsizetype stride) override {
+        for (int y = 0; y < rows; ++y) {
+            convertRow(rgba + y * stride, m_params.size.width(), m_params.bitDepth,
+                       m_current.data());
+            const auto& filtered = filterRow();
+            if (!m_zlib.write(filtered.data(), filtered.size())) return false;
+            m_previous.swap(m_current);
+        }
+        return flushIdat(false);
+    }
+
+    bool finish() override {
+        if (!m_zlib.finish() || !flushIdat(true)) return false;
+        return writeChunk("IEND", nullptr, 0);
+    }
+
+private:
+    static constexpr qsizetype IDAT_BYTES = 256 * 1024;
+
+    bool writeChunk(const char type[4], const uint8_t* data, size_t size) {
+        uint8_t header[8];
+        putBigEndian32(header, static_cast<uint32_t>(size));
+        std::memcpy(header + 4, type, 4);
+        uint32_t crc = crc32Update(0, header + 4, 4);
+        if (size > 0) crc = crc32Update(crc, data, size);
+        uint8_t trailer[4];
+        putBigEndian32(trailer, crc);
+        return writeAll(m_device, header, 8) && (size == 0 || writeAll(m_device, data, size)) &&
+               writeAll(m_device, trailer, 4);
+    }
+
+    /// Writes full IDAT chunks from the zlib output (everything if `all`).
+    bool flushIdat(bool all) {
+        QByteArray& out = m_zlib.output();
+        qsizetype written = 0;
+        while (out.size() - written >= IDAT_BYTES || (all && written < out.size())) {
+            const qsizetype size = std::min(IDAT_BYTES, out.size() - written);
+            if (!writeChunk("IDAT", reinterpret_cast<const uint8_t*>(out.constData()) + written,
+                            static_cast<size_t>(size)))
+                return false;
+            written += size;
+        }
+        if (written > 0) out = out.mid(written);
+        return true;
+    }
+
+    /// Filters m_current against m_previous with each PNG filter type and
+    /// returns the one with the smallest sum of absolute residuals (the
+    /// usual heuristic: small residuals compress best).
+    const std::vector<uint8_t>& filterRow() {
+        const uint8_t* cur = m_current.data();
+        const uint8_t* prev = m_previous.data();
+        const size_t bpp = static_cast<size_t>(m_bytesPerPixel);
+
+        auto paeth = [](int a, int b, int c) {
+            const int p = a + b - c;
+            const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            if (pa <= pb && pa <= pc) return a;
+            return pb <= pc ? b : c;
+        };
+
+        uint64_t best = UINT64_MAX;
+        size_t bestType = 0;
+        for (size_t type = 0; type < m_candidates.size(); ++type) {
+            uint8_t* out = m_candidates[type].data();
+            out[0] = static_cast<uint8_t>(type);
+            uint64_t sum = 0;
+            for (size_t i = 0; i < m_rowBytes; ++i) {
+                const int left = i >= bpp ? cur[i - bpp] : 0;
+                const int up = prev[i];
+                const int upLeft = i >= bpp ? prev[i - bpp] : 0;
+                int predictor = 0;
+                switch (type) {
+                case 1: predictor = left; break;
+                case 2: predictor = up; break;
+                case 3: predictor = (left + up) / 2; break;
+                case 4: predictor = paeth(left, up, upLeft); break;
+                default: break;
+                }
+                const auto residual = static_cast<uint8_t>(cur[i] - predictor);
+                out[i + 1] = residual;
+                sum += residual < 128 ? residual : 256 - residual;
+            }
+            if (sum < best) {
+                best = sum;
+                bestType = type;
+            }
+        }
+        return m_candidates[bestType];
+    }
+
+    QIODevice* m_device;
+    Params m_params;
+    int m_bytesPerPixel = 4;
+    size_t m_rowBytes = 0;
+    std::vector<uint8_t> m_previous;  // Previous row, output depth (zeros before the first)
+    std::vector<uint8_t> m_current;
+    std::array<std::vector<uint8_t>, 5> m_candidates;  // [filter type][row], per filter
+    ZlibStream m_zlib;
+};
+
+// --- TIFF ---
+
+class TiffEncoder final : public ImageEncoder {
+public:
+    explicit TiffEncoder(QIODevice* device) : m_device(device) {}
+
+    bool begin(const Params& params) override {
+        m_params = params;
+        m_rowBytes = static_cast<size_t>(params.size.width()) * 4 * (params.bitDepth / 8);
+        m_strip.reserve(m_rowBytes * STRIP_ROWS);
+
+        // Classic TIFF offsets are 32-bit; Deflate never grows data by more
+        // than a fraction of a percent, so the raw size decides the variant.
+        const quint64 rawBytes = static_cast<quint64>(m_rowBytes) * params.size.height();
+        m_bigTiff = rawBytes > 0xF0000000ull;
+
+        QByteArray header("II", 2);
+        if (m_bigTiff) {
+            appendLE(header, 43, 2);
+            appendLE(header, 8, 2);  // Offset size
+            appendLE(header, 0, 2);
+            appendLE(header, 0, 8);  // IFD offset, patched in finish()
+        } else {
+            appendLE(header, 42, 2);
+            appendLE(header, 0, 4);
+        }
+        return writeAll(m_device, header.constData(), header.size());
+    }
+
+    bool writeRows(const uint8_t* rgba, int rows, qsizetype stride) override {
+        for (int y = 0; y < rows; ++y) {
+            const size_t offset = m_strip.size();
+            m_strip.resize(offset + m_rowBytes);
+            convertRow(rgba + y * stride, m_params.size.width(), m_params.bitDepth,
+                       m_strip.data() + offset);
+            predictRow(m_strip.data() + offset);
+            if (m_strip.size() == m_rowBytes * STRIP_ROWS && !flushStrip()) return false;
+        }
+        return true;
+    }
+
+    bool finish() override {
+        if (!m_strip.empty() && !flushStrip()) return false;
+
+        const int bits = m_params.bitDepth;
+        const auto resolution = static_cast<quint64>(m_params.dpi);
+        const uint16_t offsetType = m_bigTiff ? TYPE_LONG8 : TYPE_LONG;
+
+        // Sorted by tag, as TIFF requires
+        const std::vector<Entry> entries = {
+            {256, TYPE_LONG, {static_cast<quint64>(m_params.size.width())}},
+            {257, TYPE_LONG, {static_cast<quint64>(m_params.size.height())}},
+            {258, TYPE_SHORT, {quint64(bits), quint64(bits), quint64(bits), quint64(bits)}},
+            {259, TYPE_SHORT, {8}},            // Compression: Adobe Deflate
+            {262, TYPE_SHORT, {2}},            // Photometric: RGB
+            {273, offsetType, m_stripOffsets},
+            {277, TYPE_SHORT, {4}},            // Samples per pixel
+            {278, TYPE_LONG, {STRIP_ROWS}},
+            {279, offsetType, m_stripSizes},
+            {282, TYPE_RATIONAL, {resolution, 1}},
+            {283, TYPE_RATIONAL, {resolution, 1}},
+            {284, TYPE_SHORT, {1}},            // Planar config: chunky
+            {296, TYPE_SHORT, {2}},            // Resolution unit: inch
+            {317, TYPE_SHORT, {2}},            // Predictor: horizontal differencing
+            {338, TYPE_SHORT, {2}},            // Extra sample: unassociated alpha
+        };
+
+        quint64 ifdOffset = static_cast<quint64>(m_device->pos());
+        if (ifdOffset % 2) {
+            if (!writeAll(m_device, "\0", 1)) return false;
+            ++ifdOffset;
+        }
+
+        // Values that don't fit in an entry go right after the IFD
+        const size_t countBytes = m_bigTiff ? 8 : 2;
+        const size_t entryBytes = m_bigTiff ? 20 : 12;
+        const size_t inlineBytes = m_bigTiff ? 8 : 4;
+        quint64 dataOffset = ifdOffset + countBytes + entries.size() * entryBytes +
+                             (m_bigTiff ? 8 : 4);
+
+        QByteArray ifd;
+        QByteArray data;
+        appendLE(ifd, entries.size(), countBytes);
+        for (const Entry& e : entries) {
+            QByteArray values;
+            for (quint64 v : e.values) appendLE(values, v, typeSize(e.type));
+            const quint64 count = e.type == TYPE_RATIONAL ? e.values.size() / 2 : e.values.size();
+
+            appendLE(ifd, e.tag, 2);
+            appendLE(ifd, e.type, 2);
+            appendLE(ifd, count, m_bigTiff ? 8 : 4);
+            if (static_cast<size_t>(values.size()) <= inlineBytes) {
+                values.append(QByteArray(static_cast<qsizetype>(inlineBytes) - values.size(), '\0'));
+                ifd.append(values);
+            } else {
+                appendLE(ifd, dataOffset + data.size(), inlineBytes);
+                data.append(values);
+                if (data.size() % 2) data.append('\0');
+            }
+        }
+        appendLE(ifd, 0, m_bigTiff ? 8 : 4);  // No next IFD
+
+        if (!writeAll(m_device, ifd.constData(), ifd.size()) ||
+            !writeAll(m_device, data.constData(), data.size()))
+            return false;
+
+        // Point the header at the IFD
+        QByteArray pointer;
+        appendLE(pointer, ifdOffset, m_bigTiff ? 8 : 4);
+        return m_device->seek(m_bigTiff ? 8 : 4) &&
+               writeAll(m_device, pointer.constData(), pointer.size());
+    }
+
+private:
+    static constexpr quint64 STRIP_ROWS = 64;
+    static constexpr uint16_t TYPE_SHORT = 3;
+    static constexpr uint16_t TYPE_LONG = 4;
+    static constexpr uint16_t TYPE_RATIONAL = 5;  // Stored as LONG pairs
+    static constexpr uint16_t TYPE_LONG8 = 16;
+
+    struct Entry {
+        uint16_t tag;
+        uint16_t type;
+        std::vector<quint64> values;
+    };
+
+    static size_t typeSize(uint16_t type) {
+        switch (type) {
+        case TYPE_SHORT: return 2;
+        case TYPE_LONG8: return 8;
+        default: return 4;
+        }
+    }
+
+    static void appendLE(QByteArray& out, quint64 value, size_t bytes) {
+        for (size_t i = 0; i < bytes; ++i) out.append(static_cast<char>(value >> (8 * i)));
+    }
+
+    /// Horizontal differencing per sample, right to left (TIFF predictor 2).
+    void predictRow(uint8_t* row) const {
+        const size_t width = static_cast<size_t>(m_params.size.width());
+        if (m_params.bitDepth == 8) {
+            for (size_t i = width * 4 - 1; i >= 4; --i) row[i] -= row[i - 4];
+            return;
+        }
+        // Little-endian 16-bit samples
+        auto* samples = row;
+        for (size_t i = width * 4 - 1; i >= 4; --i) {
+            const uint16_t cur = samples[2 * i] | (samples[2 * i + 1] << 8);
+            const uint16_t left = samples[2 * (i - 4)] | (samples[2 * (i - 4) + 1] << 8);
+            const auto diff = static_cast<uint16_t>(cur - left);
+            samples[2 * i] = static_cast<uint8_t>(diff);
+            samples[2 * i + 1] = static_cast<uint8_t>(diff >> 8);
+        }
+    }
+
+    bool flushStrip() {
+        // qCompress output is a zlib stream behind a 4-byte length prefix
+        QByteArray compressed = qCompress(m_strip.data(), static_cast<qsizetype>(m_strip.size()));
+        if (compressed.size() <= 4) return false;
+
+        m_stripOffsets.push_back(static_cast<quint64>(m_device->pos()));
+        m_stripSizes.push_back(static_cast<quint64>(compressed.size() - 4));
+        m_strip.clear();
+        return writeAll(m_device, compressed.constData() + 4, compressed.size() - 4);
+    }
+
+    QIODevice* m_device;
+    Params m_params;
+    size_t m_rowBytes = 0;
+    bool m_bigTiff = false;
+    std::vector<uint8_t> m_strip;  // Predicted rows of the current strip
+    std::vector<quint64> m_stripOffsets;
+    std::vector<quint64> m_stripSizes;
+};
+
+// --- Factory ---
+
+std::unique_ptr<ImageEncoder> ImageEncoder::create(ImageFormat format, QIODevice* device) {
+    switch (format) {
+    case ImageFormat::Png:
+        return std::make_unique<PngEncoder>(device);
+    case ImageFormat::Tiff:
+        return std::make_unique<TiffEncoder>(device);
+    }
+    return nullptr;
+}
+
+}  // namespace comicos
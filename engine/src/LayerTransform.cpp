@@ -0,0 +1,384 @@
+#include "engine/LayerTransform.h"
+#include "core/Parallel.h"
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace comicos {
+
+namespace {
+
+constexpr int PREVIEW_BLOCK = 4;
+static_assert(TILE_SIZE % PREVIEW_BLOCK == 0);
+
+// Texel lookups split coordinates with shifts instead of pixelToTile()
+constexpr int TILE_SHIFT = 8;
+static_assert(1 << TILE_SHIFT == TILE_SIZE);
+
+// Source positions step along a row in 16.16 fixed point: exact enough
+// over one tile row (error below 1/256 pixel) and cheap to split
+constexpr int FRACTION_BITS = 16;
+constexpr qreal FIXED_ONE = 1 << FRACTION_BITS;
+
+bool isWhole(qreal v) {
+    return std::abs(v - std::round(v)) < 1e-6;
+}
+
+/// Catmull-Rom weights of the four texels around offset t in [0, 1).
+void cubicWeights(float t, float w[4]) {
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    w[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+    w[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+    w[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+    w[3] = 0.5f * (t3 - t2);
+}
+
+/// Weighted sums are premultiplied: colour channels carry alpha.
+inline void addTexel(const uint8_t* p, float weight, float sum[4]) {
+    const float wa = weight * p[3];
+    sum[0] += wa * p[0];
+    sum[1] += wa * p[1];
+    sum[2] += wa * p[2];
+    sum[3] += wa;
+}
+
+/// Straight RGBA from a premultiplied sum; false if transparent.
+inline bool resolve(const float sum[4], uint8_t* out) {
+    if (sum[3] < 0.5f) {
+        std::memset(out, 0, 4);
+        return false;
+    }
+    const float inv = 1.0f / sum[3];
+    for (int c = 0; c < 3; ++c) {
+        out[c] = static_cast<uint8_t>(std::clamp(sum[c] * inv + 0.5f, 0.0f, 255.0f));
+    }
+    out[3] = static_cast<uint8_t>(std::min(sum[3] + 0.5f, 255.0f));
+    return true;
+}
+
+/// `count` pixels of row `ly` of `tile` from column `lx`; zeros for no tile.
+inline void copySpan(uint8_t* dst, const uint8_t* tile, int lx, int ly, int count) {
+    if (tile) {
+        std::memcpy(dst, tile + (ly * TILE_SIZE + lx) * 4, count * 4);
+    } else {
+        std::memset(dst, 0, count * 4);
+    }
+}
+
+}  // namespace
+
+// --- LayerTransform ---
+
+LayerTransform::LayerTransform(const Layer& layer) {
+    int minTx = 0, minTy = 0, maxTx = -1, maxTy = -1;
+    for (const Tile* tile : layer.tiles().allTiles()) {
+        const TileCoord& tc = tile->coord();
+        m_written.push_back(tc);
+        m_touched.insert(tc);
+        if (tile->isEmpty()) continue;
+        if (m_source.empty()) {
+            minTx = maxTx = tc.tx;
+            minTy = maxTy = tc.ty;
+        }
+        minTx = std::min(minTx, tc.tx);
+        minTy = std::min(minTy, tc.ty);
+        maxTx = std::max(maxTx, tc.tx);
+        maxTy = std::max(maxTy, tc.ty);
+        m_source[tc] = tile->clone();
+    }
+
+    m_gridOrigin = {minTx, minTy};
+    m_gridCols = maxTx - minTx + 1;
+    m_gridRows = maxTy - minTy + 1;
+    m_grid.assign(static_cast<size_t>(m_gridCols) * m_gridRows, nullptr);
+    std::vector<const Tile*> sources;
+    for (const auto& [tc, tile] : m_source) {
+        m_grid[(tc.ty - minTy) * m_gridCols + (tc.tx - minTx)] = tile->constData();
+        sources.push_back(tile.get());
+    }
+
+    // Exact bounds, for pivoting about the content rather than its tiles
+    std::vector<QRect> bounds(sources.size());
+    parallelFor(static_cast<int>(sources.size()), [&](int i) {
+        const uint8_t* pixels = sources[i]->constData();
+        int x0 = TILE_SIZE, x1 = -1, y0 = TILE_SIZE, y1 = -1;
+        for (int y = 0; y < TILE_SIZE; ++y) {
+            const uint8_t* row = pixels + y * TILE_SIZE * 4;
+            int first = 0;
+            while (first < TILE_SIZE && !row[first * 4 + 3]) ++first;
+            if (first == TILE_SIZE) continue;
+            int last = TILE_SIZE - 1;
+            while (!row[last * 4 + 3]) --last;
+            x0 = std::min(x0, first);
+            x1 = std::max(x1, last);
+            y0 = std::min(y0, y);
+            y1 = y;
+        }
+        if (x1 < 0) return;
+        const TileCoord& tc = sources[i]->coord();
+        bounds[i] = QRect(tc.tx * TILE_SIZE + x0, tc.ty * TILE_SIZE + y0,
+                          x1 - x0 + 1, y1 - y0 + 1);
+    });
+    for (const QRect& rect : bounds) m_bounds = m_bounds.united(rect);
+}
+
+LayerTransform::~LayerTransform() = default;
+
+const uint8_t* LayerTransform::sourceTile(int tx, int ty) const {
+    tx -= m_gridOrigin.tx;
+    ty -= m_gridOrigin.ty;
+    if (tx < 0 || ty < 0 || tx >= m_gridCols || ty >= m_gridRows) return nullptr;
+    return m_grid[ty * m_gridCols + tx];
+}
+
+const uint8_t* LayerTransform::sourcePixel(int x, int y) const {
+    const TileCoord tc = pixelToTile(x, y);
+    const uint8_t* tile = sourceTile(tc.tx, tc.ty);
+    if (!tile) return nullptr;
+    return tile + ((y - tc.ty * TILE_SIZE) * TILE_SIZE + (x - tc.tx * TILE_SIZE)) * 4;
+}
+
+// --- Rendering ---
+
+template <int N>
+void LayerTransform::accumulate(int x0, int y0, const float* wx, const float* wy,
+                                float sum[4]) const {
+    // Nearly every footprint lies inside one tile: look it up once
+    const int lx = x0 & (TILE_SIZE - 1);
+    const int ly = y0 & (TILE_SIZE - 1);
+    if (lx + N <= TILE_SIZE && ly + N <= TILE_SIZE) {
+        const uint8_t* tile = sourceTile(x0 >> TILE_SHIFT, y0 >> TILE_SHIFT);
+        if (!tile) return;
+        for (int j = 0; j < N; ++j) {
+            const uint8_t* row = tile + ((ly + j) * TILE_SIZE + lx) * 4;
+            for (int i = 0; i < N; ++i) addTexel(row + i * 4, wx[i] * wy[j], sum);
+        }
+        return;
+    }
+    for (int j = 0; j < N; ++j) {
+        for (int i = 0; i < N; ++i) {
+            const uint8_t* p = sourcePixel(x0 + i, y0 + j);
+            if (p && p[3]) addTexel(p, wx[i] * wy[j], sum);
+        }
+    }
+}
+
+bool LayerTransform::shiftTile(const TileCoord& coord, int dx, int dy, uint8_t* pixels) const {
+    // Columns split between two source tiles at the same place on every row
+    const int sx = coord.tx * TILE_SIZE - dx;
+    const TileCoord left = pixelToTile(sx, 0);
+    const int lx = sx - left.tx * TILE_SIZE;
+    const int split = TILE_SIZE - lx;  // Columns from the left tile
+
+    bool any = false;
+    for (int y = 0; y < TILE_SIZE; ++y) {
+        const int sy = coord.ty * TILE_SIZE + y - dy;
+        const int ty = pixelToTile(0, sy).ty;
+        const int ly = sy - ty * TILE_SIZE;
+        uint8_t* row = pixels + y * TILE_SIZE * 4;
+        const uint8_t* first = sourceTile(left.tx, ty);
+        copySpan(row, first, lx, ly, split);
+        any = any || first;
+        if (split < TILE_SIZE) {
+            const uint8_t* second = sourceTile(left.tx + 1, ty);
+            copySpan(row + split * 4, second, 0, ly, TILE_SIZE - split);
+            any = any || second;
+        }
+    }
+    return any;
+}
+
+bool LayerTransform::resampleTile(const TileCoord& coord, const QTransform& inverse,
+                                  TransformQuality quality, uint8_t* pixels) const {
+    const qreal originX = coord.tx * TILE_SIZE;
+    const qreal originY = coord.ty * TILE_SIZE;
+    bool any = false;
+
+    if (quality == TransformQuality::Preview) {
+        constexpr qreal centre = PREVIEW_BLOCK / 2.0;
+        for (int by = 0; by < TILE_SIZE; by += PREVIEW_BLOCK) {
+            for (int bx = 0; bx < TILE_SIZE; bx += PREVIEW_BLOCK) {
+                const QPointF s = inverse.map(QPointF(originX + bx + centre,
+                                                      originY + by + centre));
+                const uint8_t* p = sourcePixel(qFloor(s.x()), qFloor(s.y()));
+                uint8_t texel[4] = {};
+                if (p && p[3]) {
+                    std::memcpy(texel, p, 4);
+                    any = true;
+                }
+                for (int y = by; y < by + PREVIEW_BLOCK; ++y) {
+                    uint8_t* out = pixels + (y * TILE_SIZE + bx) * 4;
+                    for (int x = 0; x < PREVIEW_BLOCK; ++x) std::memcpy(out + x * 4, texel, 4);
+                }
+            }
+        }
+        return any;
+    }
+
+    // Source position of each pixel centre, stepped along the row. Texel
+    // centres sit at +0.5, hence the shift before splitting into texel and
+    // fraction.
+    const bool cubic = quality == TransformQuality::Bicubic;
+    const int64_t du = std::llround(inverse.m11() * FIXED_ONE);
+    const int64_t dv = std::llround(inverse.m12() * FIXED_ONE);
+    constexpr float toFraction = 1.0f / (1 << FRACTION_BITS);
+    for (int y = 0; y < TILE_SIZE; ++y) {
+        const QPointF start = inverse.map(QPointF(originX + 0.5, originY + y + 0.5));
+        int64_t u = std::llround((start.x() - 0.5) * FIXED_ONE);
+        int64_t v = std::llround((start.y() - 0.5) * FIXED_ONE);
+        uint8_t* out = pixels + y * TILE_SIZE * 4;
+        for (int x = 0; x < TILE_SIZE; ++x, out += 4, u += du, v += dv) {
+            const int x0 = static_cast<int>(u >> FRACTION_BITS);
+            const int y0 = static_cast<int>(v >> FRACTION_BITS);
+            const float ax = static_cast<float>(u & ((1 << FRACTION_BITS) - 1)) * toFraction;
+            const float ay = static_cast<float>(v & ((1 << FRACTION_BITS) - 1)) * toFraction;
+            float sum[4] = {};
+            if (cubic) {
+                float wx[4], wy[4];
+                cubicWeights(ax, wx);
+                cubicWeights(ay, wy);
+                accumulate<4>(x0 - 1, y0 - 1, wx, wy, sum);
+            } else {
+                const float wx[2] = {1.0f - ax, ax};
+                const float wy[2] = {1.0f - ay, ay};
+                accumulate<2>(x0, y0, wx, wy, sum);
+            }
+            any = resolve(sum, out) || any;
+        }
+    }
+    return any;
+}
+
+template <typename Render>
+void LayerTransform::renderTiles(TileManager& tiles, std::vector<TileCoord>& coords,
+                                 Render&& render) {
+    // Creating tiles touches the tile map: one thread. Every pixel is
+    // rewritten, so a buffer still shared (with the source, an undo
+    // snapshot) is swapped for a new one rather than copied; tiles the
+    // last apply() wrote are reused as they are.
+    std::vector<Tile*> targets;
+    targets.reserve(coords.size());
+    for (const TileCoord& tc : coords) {
+        Tile* tile = tiles.getOrCreateTile(tc);
+        if (tile->isShared()) *tile = Tile(tc);
+        tile->ensureAllocated();
+        tile->setDirty(true);
+        targets.push_back(tile);
+    }
+
+    std::vector<uint8_t> kept(coords.size());
+    parallelFor(static_cast<int>(coords.size()), [&](int i) {
+        kept[i] = render(coords[i], targets[i]->data());
+    });
+
+    size_t count = 0;
+    for (size_t i = 0; i < coords.size(); ++i) {
+        if (kept[i]) {
+            coords[count++] = coords[i];
+        } else {
+            tiles.removeTile(coords[i]);
+        }
+    }
+    coords.resize(count);
+}
+
+std::vector<TileCoord> LayerTransform::apply(Layer& layer, const QTransform& transform,
+                                             TransformQuality quality) {
+    TileManager& tiles = layer.tiles();
+    std::vector<TileCoord> output;
+
+    const bool translation = transform.type() <= QTransform::TxTranslate;
+    if (translation && isWhole(transform.dx()) && isWhole(transform.dy())) {
+        const int dx = qRound(transform.dx());
+        const int dy = qRound(transform.dy());
+        if (dx % TILE_SIZE == 0 && dy % TILE_SIZE == 0) {
+            // Whole tiles: new keys, same buffers
+            for (const auto& [tc, source] : m_source) {
+                const TileCoord moved{tc.tx + dx / TILE_SIZE, tc.ty + dy / TILE_SIZE};
+                tiles.getOrCreateTile(moved)->sharePixels(*source);
+                output.push_back(moved);
+            }
+        } else {
+            // Each source tile lands on up to 2x2 destination tiles
+            std::unordered_set<TileCoord> targets;
+            for (const auto& [tc, source] : m_source) {
+                const TileCoord first = pixelToTile(tc.tx * TILE_SIZE + dx, tc.ty * TILE_SIZE + dy);
+                const TileCoord last = pixelToTile((tc.tx + 1) * TILE_SIZE - 1 + dx,
+                                                   (tc.ty + 1) * TILE_SIZE - 1 + dy);
+                for (int ty = first.ty; ty <= last.ty; ++ty) {
+                    for (int tx = first.tx; tx <= last.tx; ++tx) targets.insert({tx, ty});
+                }
+            }
+            output.assign(targets.begin(), targets.end());
+            renderTiles(tiles, output, [&](const TileCoord& tc, uint8_t* pixels) {
+                return shiftTile(tc, dx, dy, pixels);
+            });
+        }
+    } else if (transform.isAffine() && transform.isInvertible()) {
+        // Destination tiles under the mapped bounds of each source tile
+        std::unordered_set<TileCoord> targets;
+        for (const auto& [tc, source] : m_source) {
+            const QRectF mapped = transform.mapRect(
+                QRectF(tc.tx * TILE_SIZE, tc.ty * TILE_SIZE, TILE_SIZE, TILE_SIZE));
+            const TileCoord first = pixelToTile(qFloor(mapped.left()) - 2,
+                                                qFloor(mapped.top()) - 2);
+            const TileCoord last = pixelToTile(qCeil(mapped.right()) + 1,
+                                               qCeil(mapped.bottom()) + 1);
+            for (int ty = first.ty; ty <= last.ty; ++ty) {
+                for (int tx = first.tx; tx <= last.tx; ++tx) targets.insert({tx, ty});
+            }
+        }
+        output.assign(targets.begin(), targets.end());
+        const QTransform inverse = transform.inverted();
+        renderTiles(tiles, output, [&](const TileCoord& tc, uint8_t* pixels) {
+            return resampleTile(tc, inverse, quality, pixels);
+        });
+    }
+    // A singular transform (scale 0) leaves nothing
+
+    // Drop what the last apply() wrote and this one did not
+    std::sort(output.begin(), output.end());
+    std::vector<TileCoord> changed = output;
+    for (const TileCoord& tc : m_written) {
+        if (std::binary_search(output.begin(), output.end(), tc)) continue;
+        tiles.removeTile(tc);
+        changed.push_back(tc);
+    }
+    m_touched.insert(output.begin(), output.end());
+    m_written = std::move(output);
+    return changed;
+}
+
+std::vector<TileCoord> LayerTransform::restore(Layer& layer) {
+    TileManager& tiles = layer.tiles();
+    std::vector<TileCoord> changed = m_written;
+    for (const TileCoord& tc : m_written) tiles.removeTile(tc);
+    m_written.clear();
+    for (const auto& [tc, source] : m_source) {
+        *tiles.getOrCreateTile(tc) = *source;
+        m_written.push_back(tc);
+        changed.push_back(tc);
+    }
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    return changed;
+}
+
+std::vector<TileCoord> LayerTransform::touchedTiles() const {
+    std::vector<TileCoord> coords(m_touched.begin(), m_touched.end());
+    std::sort(coords.begin(), coords.end());
+    return coords;
+}
+
+std::unordered_map<TileCoord, std::unique_ptr<Tile>> LayerTransform::takeBefore() {
+    std::unordered_map<TileCoord, std::unique_ptr<Tile>> before;
+    for (const TileCoord& tc : m_touched) {
+        auto it = m_source.find(tc);
+        before[tc] = it != m_source.end() ? it->second->clone() : nullptr;
+    }
+    return before;
+}
+
+}  // namespace comicos
@@ -0,0 +1,77 @@
+#include "engine/MotionPredictor.h"
+#include <algorithm>
+#include <cmath>
+
+namespace comicos {
+
+MotionPredictor::MotionPredictor() = default;
+MotionPredictor::~MotionPredictor() = default;
+
+void MotionPredictor::setHorizon(float ms) {
+    m_horizon = std::clamp(ms, 0.0f, MAX_HORIZON_MS);
+}
+
+void MotionPredictor::reset() {
+    m_count = 0;
+}
+
+void MotionPredictor::addSample(const CanvasPoint& point) {
+    if (m_count == 3) {
+        m_samples[0] = m_samples[1];
+        m_samples[1] = m_samples[2];
+        m_count = 2;
+    }
+    m_samples[m_count++] = point;
+}
+
+void MotionPredictor::predict(std::vector<CanvasPoint>& predicted) const {
+    predicted.clear();
+    if (m_horizon <= 0.0f || m_count < 2) return;
+
+    const CanvasPoint& last = m_samples[m_count - 1];
+    const CanvasPoint& prev = m_samples[m_count - 2];
+    const double dt = last.timestamp - prev.timestamp;
+    if (dt <= 0.0 || dt > MAX_SAMPLE_GAP_MS) return;
+
+    // Velocity in px/ms
+    const float vx = static_cast<float>((last.x - prev.x) / dt);
+    const float vy = static_cast<float>((last.y - prev.y) / dt);
+    const float speed = std::sqrt(vx * vx + vy * vy);
+    if (speed < MIN_SPEED) return;
+
+    // Acceleration in px/ms², from the velocity change between the pairs
+    float ax = 0.0f, ay = 0.0f;
+    if (m_count == 3) {
+        const CanvasPoint& first = m_samples[0];
+        const double dt0 = prev.timestamp - first.timestamp;
+        if (dt0 > 0.0 && dt0 <= MAX_SAMPLE_GAP_MS) {
+            const float v0x = static_cast<float>((prev.x - first.x) / dt0);
+            const float v0y = static_cast<float>((prev.y - first.y) / dt0);
+            const auto mid = static_cast<float>((dt + dt0) * 0.5);
+            ax = (vx - v0x) / mid;
+            ay = (vy - v0y) / mid;
+
+            // At most enough to stop the pen by the horizon
+            const float accel = std::sqrt(ax * ax + ay * ay);
+            const float maxAccel = speed / m_horizon;
+            if (accel > maxAccel) {
+                ax *= maxAccel / accel;
+                ay *= maxAccel / accel;
+            }
+        }
+    }
+
+    for (float t = STEP_MS;; t += STEP_MS) {
+        t = std::min(t, m_horizon);
+
+        CanvasPoint p = last;
+        p.x = last.x + vx * t + 0.5f * ax * t * t;
+        p.y = last.y + vy * t + 0.5f * ay * t * t;
+        p.timestamp = last.timestamp + t;
+        predicted.push_back(p);
+
+        if (t >= m_horizon) break;
+    }
+}
+
+}  // namespace comicos
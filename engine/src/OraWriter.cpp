@@ -0,0 +1,158 @@
+#include "engine/OraWriter.h"
+#include "core/Parallel.h"
+#include "engine/Compositor.h"
+#include "engine/ImageEncoder.h"
+#include "engine/ZipWriter.h"
+#include <QBuffer>
+#include <QByteArray>
+#include <QSaveFile>
+#include <QXmlStreamWriter>
+#include <algorithm>
+#include <vector>
+
+namespace comicos {
+
+constexpr int LAYER_BATCH = 16;  // Layer PNGs held at once before writing
+
+// --- Helpers ---
+
+/// Streams `rect` through the PNG encoder one tile row at a time.
+/// `readBand(rect, out, bytesPerLine)` fills the rows of each band.
+template <typename ReadBand>
+static QByteArray encodePng(const QRect& rect, int dpi, ReadBand&& readBand) {
+    QByteArray png;
+    QBuffer buffer(&png);
+    buffer.open(QIODevice::WriteOnly);
+
+    auto encoder = ImageEncoder::create(ImageFormat::Png, &buffer);
+    if (!encoder->begin({rect.size(), 8, dpi})) return {};
+
+    const qsizetype stride = static_cast<qsizetype>(rect.width()) * 4;
+    std::vector<uint8_t> band(static_cast<size_t>(stride) * TILE_SIZE);
+    for (int top = rect.top(); top <= rect.bottom(); top += TILE_SIZE) {
+        const QRect part(rect.left(), top, rect.width(),
+                         std::min(TILE_SIZE, rect.bottom() + 1 - top));
+        readBand(part, band.data(), stride);
+        if (!encoder->writeRows(band.data(), part.height(), stride)) return {};
+    }
+    if (!encoder->finish()) return {};
+    buffer.close();
+    return png;
+}
+
+static QString compositeOp(BlendMode mode) {
+    switch (mode) {
+    case BlendMode::Normal: return QStringLiteral("svg:src-over");
+    case BlendMode::Multiply: return QStringLiteral("svg:multiply");
+    case BlendMode::Screen: return QStringLiteral("svg:screen");
+    case BlendMode::Overlay: return QStringLiteral("svg:overlay");
+    }
+    return QStringLiteral("svg:src-over");
+}
+
+static QString layerSource(int index) {
+    return QStringLiteral("data/layer%1.png").arg(index);
+}
+
+// --- Writer ---
+
+bool OraWriter::write(const LayerStack& stack, const QSize& canvasSize, int dpi,
+                      const QString& path) {
+    if (canvasSize.isEmpty()) return false;
+    const QRect canvasRect(QPoint(0, 0), canvasSize);
+    const auto& layers = stack.layers();
+    const int layerCount = static_cast<int>(layers.size());
+
+    // Layer bounds; layers without tiles become a 1x1 transparent PNG
+    std::vector<QRect> bounds(layers.size());
+    for (int i = 0; i < layerCount; ++i) {
+        bounds[i] = layers[i]->tiles().boundingRect().toAlignedRect().intersected(canvasRect);
+        if (bounds[i].isEmpty()) bounds[i] = QRect(0, 0, 1, 1);
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    ZipWriter zip(&file);
+
+    // The mimetype must be the first entry, stored
+    if (!zip.addFile(QStringLiteral("mimetype"), QByteArrayLiteral("image/openraster")))
+        return false;
+
+    // stack.xml lists layers top to bottom
+    {
+        QByteArray xml;
+        QXmlStreamWriter writer(&xml);
+        writer.setAutoFormatting(true);
+        writer.writeStartDocument();
+        writer.writeStartElement(QStringLiteral("image"));
+        writer.writeAttribute(QStringLiteral("version"), QStringLiteral("0.0.5"));
+        writer.writeAttribute(QStringLiteral("w"), QString::number(canvasSize.width()));
+        writer.writeAttribute(QStringLiteral("h"), QString::number(canvasSize.height()));
+        writer.writeAttribute(QStringLiteral("xres"), QString::number(dpi));
+        writer.writeAttribute(QStringLiteral("yres"), QString::number(dpi));
+        writer.writeStartElement(QStringLiteral("stack"));
+        for (int i = layerCount - 1; i >= 0; --i) {
+            const Layer& layer = *layers[i];
+            writer.writeEmptyElement(QStringLiteral("layer"));
+            writer.writeAttribute(QStringLiteral("composite-op"), compositeOp(layer.blendMode()));
+            writer.writeAttribute(QStringLiteral("name"), layer.name());
+            writer.writeAttribute(QStringLiteral("opacity"),
+                                  QString::number(layer.opacity(), 'f', 3));
+            writer.writeAttribute(QStringLiteral("src"), layerSource(i));
+            writer.writeAttribute(QStringLiteral("visibility"),
+                                  layer.isVisible() ? QStringLiteral("visible")
+                                                    : QStringLiteral("hidden"));
+            writer.writeAttribute(QStringLiteral("x"), QString::number(bounds[i].left()));
+            writer.writeAttribute(QStringLiteral("y"), QString::number(bounds[i].top()));
+        }
+        writer.writeEndElement();
+        writer.writeEndElement();
+        writer.writeEndDocument();
+        if (!zip.addFile(QStringLiteral("stack.xml"), xml)) return false;
+    }
+
+    // Layer PNGs, encoded in parallel per batch and written in order
+    for (int batchStart = 0; batchStart < layerCount; batchStart += LAYER_BATCH) {
+        const int batchSize = std::min(LAYER_BATCH, layerCount - batchStart);
+        std::vector<QByteArray> pngs(static_cast<size_t>(batchSize));
+        parallelFor(batchSize, [&](int b) {
+            const int i = batchStart + b;
+            const TileManager& tiles = layers[i]->tiles();
+            pngs[b] = encodePng(bounds[i], dpi, [&](const QRect& rect, uint8_t* out, qsizetype bpl) {
+                tiles.readPixels(rect, out, bpl);
+            });
+        });
+
+        for (int b = 0; b < batchSize; ++b) {
+            if (pngs[b].isEmpty() || !zip.addFile(layerSource(batchStart + b), pngs[b]))
+                return false;
+        }
+    }
+
+    // Thumbnail: the smallest preview level (at most 256 px, as ORA asks)
+    {
+        DocumentPreview preview = Compositor().renderPreview(stack, canvasSize);
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        if (preview.levels.empty() || !preview.levels.back().save(&buffer, "PNG") ||
+            !zip.addFile(QStringLiteral("Thumbnails/thumbnail.png"), png))
+            return false;
+    }
+
+    // Flattened image for viewers that don't composite
+    {
+        Compositor compositor;
+        QByteArray merged = encodePng(canvasRect, dpi, [&](const QRect& rect, uint8_t* out,
+                                                          qsizetype bpl) {
+            compositor.compositeRegionInto(stack, rect, out, bpl);
+        });
+        if (merged.isEmpty() || !zip.addFile(QStringLiteral("mergedimage.png"), merged))
+            return false;
+    }
+
+    if (!zip.finish()) return false;
+    return file.commit();
+}
+
+}  // namespace comicos
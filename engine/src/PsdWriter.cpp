@@ -0,0 +1,371 @@
+#include "engine/PsdWriter.h"
+#include "core/Parallel.h"
+#include "engine/Compositor.h"
+#include <QByteArray>
+#include <QSaveFile>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace comicos {
+
+constexpr int PSD_MAX_SIZE = 30000;   // Larger canvases need PSB
+constexpr int PSB_MAX_SIZE = 300000;
+constexpr int LAYER_BATCH = 16;       // Layers whose compressed channels are held at once
+constexpr uint16_t COMPRESSION_RAW = 0;
+constexpr uint16_t COMPRESSION_RLE = 1;
+
+// --- Helpers ---
+
+static void put16(QByteArray& out, uint16_t v) {
+    out.append(static_cast<char>(v >> 8));
+    out.append(static_cast<char>(v));
+}
+
+static void put32(QByteArray& out, uint32_t v) {
+    put16(out, static_cast<uint16_t>(v >> 16));
+    put16(out, static_cast<uint16_t>(v));
+}
+
+static void put64(QByteArray& out, uint64_t v) {
+    put32(out, static_cast<uint32_t>(v >> 32));
+    put32(out, static_cast<uint32_t>(v));
+}
+
+/// PSB widens lengths and row byte counts; everything else is shared.
+static void putLength(QByteArray& out, uint64_t v, bool psb) {
+    if (psb) {
+        put64(out, v);
+    } else {
+        put32(out, static_cast<uint32_t>(v));
+    }
+}
+
+/// PackBits (Apple RLE): runs of 2-128 equal bytes become [1 - n][byte],
+/// literals of 1-128 bytes become [n - 1][bytes]. Appends to `out`.
+static void packBits(const uint8_t* src, size_t size, QByteArray& out) {
+    size_t i = 0;
+    while (i < size) {
+        size_t run = 1;
+        while (i + run < size && run < 128 && src[i + run] == src[i]) ++run;
+        if (run >= 2) {
+            out.append(static_cast<char>(1 - static_cast<int>(run)));
+            out.append(static_cast<char>(src[i]));
+            i += run;
+            continue;
+        }
+
+        // Literal until the next run of 3+ (a 2-run inside a literal is cheaper kept)
+        const size_t start = i++;
+        while (i < size && i - start < 128 &&
+               !(i + 2 < size && src[i] == src[i + 1] && src[i] == src[i + 2])) {
+            ++i;
+        }
+        out.append(static_cast<char>(i - start - 1));
+        out.append(reinterpret_cast<const char*>(src + start), static_cast<qsizetype>(i - start));
+    }
+}
+
+namespace {
+
+/// RLE channel planes of a block of rows, in file channel order.
+struct EncodedPlanes {
+    std::array<std::vector<uint32_t>, 4> rowSizes;
+    std::array<QByteArray, 4> data;
+};
+
+/// Channel order in the file, as RGBA sample indices.
+constexpr std::array<int, 4> LAYER_CHANNELS = {3, 0, 1, 2};   // A, R, G, B (ids -1, 0, 1, 2)
+constexpr std::array<int, 4> MERGED_CHANNELS = {0, 1, 2, 3};  // R, G, B, then alpha
+
+struct LayerRecord {
+    QRect rect;               // In canvas pixels; empty for layers without tiles
+    std::array<qint64, 4> lengthPos{};  // File offsets of the channel length fields
+    std::array<uint64_t, 4> length{};
+};
+
+}  // namespace
+
+/// Splits RGBA rows into channel planes and PackBits-compresses each row.
+static EncodedPlanes encodeRows(const uint8_t* rgba, int width, int rows, qsizetype stride,
+                                const std::array<int, 4>& channels) {
+    EncodedPlanes planes;
+    std::vector<uint8_t> plane(static_cast<size_t>(width));
+    for (size_t c = 0; c < channels.size(); ++c) {
+        planes.rowSizes[c].reserve(static_cast<size_t>(rows));
+        for (int y = 0; y < rows; ++y) {
+            const uint8_t* row = rgba + y * stride + channels[c];
+            for (int x = 0; x < width; ++x) plane[x] = row[x * 4];
+
+            const qsizetype before = planes.data[c].size();
+            packBits(plane.data(), plane.size(), planes.data[c]);
+            planes.rowSizes[c].push_back(static_cast<uint32_t>(planes.data[c].size() - before));
+        }
+    }
+    return planes;
+}
+
+/// Writes one RLE channel (compression, row counts, rows) from its bands.
+/// Returns the bytes written.
+static uint64_t writeChannel(QSaveFile& file, const std::vector<EncodedPlanes>& bands, size_t c,
+                             bool psb) {
+    QByteArray head;
+    put16(head, COMPRESSION_RLE);
+    for (const auto& band : bands) {
+        for (uint32_t size : band.rowSizes[c]) {
+            if (psb) {
+                put32(head, size);
+            } else {
+                put16(head, static_cast<uint16_t>(size));
+            }
+        }
+    }
+    uint64_t written = static_cast<uint64_t>(file.write(head));
+    for (const auto& band : bands) written += static_cast<uint64_t>(file.write(band.data[c]));
+    return written;
+}
+
+static const char* blendKey(BlendMode mode) {
+    switch (mode) {
+    case BlendMode::Normal: return "norm";
+    case BlendMode::Multiply: return "mul ";
+    case BlendMode::Screen: return "scrn";
+    case BlendMode::Overlay: return "over";
+    }
+    return "norm";
+}
+
+/// Extra data of a layer record: empty mask and blending ranges, Pascal
+/// name (UTF-8, padded to 4) and the Unicode name ('luni'), which readers
+/// prefer, so Korean names survive.
+static QByteArray layerExtraData(const QString& name) {
+    QByteArray extra;
+    put32(extra, 0);  // Layer mask
+    put32(extra, 0);  // Blending ranges
+
+    QByteArray pascal = name.toUtf8().left(255);
+    extra.append(static_cast<char>(pascal.size()));
+    extra.append(pascal);
+    while ((pascal.size() + 1) % 4) {
+        extra.append('\0');
+        pascal.append('\0');
+    }
+
+    const std::u16string utf16 = name.toStdU16String();
+    QByteArray luni;
+    put32(luni, static_cast<uint32_t>(utf16.size()));
+    for (char16_t ch : utf16) put16(luni, static_cast<uint16_t>(ch));
+    while (luni.size() % 4) luni.append('\0');
+
+    extra.append("8BIMluni", 8);
+    put32(extra, static_cast<uint32_t>(luni.size()));
+    extra.append(luni);
+    return extra;
+}
+
+// --- Writer ---
+
+bool PsdWriter::write(const LayerStack& stack, const QSize& canvasSize, int dpi,
+                      const QString& path) {
+    if (canvasSize.isEmpty()) return false;
+    if (canvasSize.width() > PSB_MAX_SIZE || canvasSize.height() > PSB_MAX_SIZE) return false;
+    const bool psb = canvasSize.width() > PSD_MAX_SIZE || canvasSize.height() > PSD_MAX_SIZE;
+    const QRect canvasRect(QPoint(0, 0), canvasSize);
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    // Header, color mode data (none for RGB), resolution resource
+    {
+        QByteArray head("8BPS", 4);
+        put16(head, psb ? 2 : 1);
+        head.append(QByteArray(6, '\0'));
+        put16(head, 4);  // Channels: RGB + alpha
+        put32(head, static_cast<uint32_t>(canvasSize.height()));
+        put32(head, static_cast<uint32_t>(canvasSize.width()));
+        put16(head, 8);  // Bits per channel
+        put16(head, 3);  // RGB
+        put32(head, 0);  // Color mode data
+
+        QByteArray resolution("8BIM", 4);
+        put16(resolution, 0x03ED);  // ResolutionInfo
+        put16(resolution, 0);       // Empty name, padded to even
+        put32(resolution, 16);
+        for (int axis = 0; axis < 2; ++axis) {
+            put32(resolution, static_cast<uint32_t>(dpi) << 16);  // Fixed 16.16
+            put16(resolution, 1);  // Pixels per inch
+            put16(resolution, 1);  // Display unit: inches
+        }
+        put32(head, static_cast<uint32_t>(resolution.size()));
+        head.append(resolution);
+        if (file.write(head) != head.size()) return false;
+    }
+
+    // Layer and mask information. Section and channel lengths are unknown
+    // until the data is written, so placeholders are patched at the end.
+    const auto& layers = stack.layers();
+    const int layerCount = static_cast<int>(layers.size());
+    const int lengthBytes = psb ? 8 : 4;
+    std::vector<LayerRecord> records(layers.size());
+
+    const qint64 layerMaskPos = file.pos();
+    const qint64 layerInfoPos = layerMaskPos + lengthBytes;
+    {
+        QByteArray placeholders(lengthBytes * 2, '\0');
+        put16(placeholders, static_cast<uint16_t>(-layerCount));  // Negative: merged alpha present
+        if (file.write(placeholders) != placeholders.size()) return false;
+    }
+
+    for (int i = 0; i < layerCount; ++i) {
+        const Layer& layer = *layers[i];
+        LayerRecord& record = records[i];
+        record.rect = layer.tiles().boundingRect().toAlignedRect().intersected(canvasRect);
+
+        QByteArray head;
+        put32(head, static_cast<uint32_t>(record.rect.isEmpty() ? 0 : record.rect.top()));
+        put32(head, static_cast<uint32_t>(record.rect.isEmpty() ? 0 : record.rect.left()));
+        put32(head, static_cast<uint32_t>(record.rect.isEmpty() ? 0 : record.rect.bottom() + 1));
+        put32(head, static_cast<uint32_t>(record.rect.isEmpty() ? 0 : record.rect.right() + 1));
+        put16(head, 4);
+        if (file.write(head) != head.size()) return false;
+
+        static constexpr int16_t CHANNEL_IDS[4] = {-1, 0, 1, 2};
+        for (int c = 0; c < 4; ++c) {
+            QByteArray channel;
+            put16(channel, static_cast<uint16_t>(CHANNEL_IDS[c]));
+            record.lengthPos[c] = file.pos() + 2;
+            putLength(channel, 0, psb);
+            if (file.write(channel) != channel.size()) return false;
+        }
+
+        QByteArray blend("8BIM", 4);
+        blend.append(blendKey(layer.blendMode()), 4);
+        blend.append(static_cast<char>(std::lround(layer.opacity() * 255.0f)));
+        blend.append('\0');                                   // Clipping: base
+        blend.append(static_cast<char>(layer.isVisible() ? 0 : 0x02));  // Flags: hidden
+        blend.append('\0');                                   // Filler
+        const QByteArray extra = layerExtraData(layer.name());
+        put32(blend, static_cast<uint32_t>(extra.size()));
+        blend.append(extra);
+        if (file.write(blend) != blend.size()) return false;
+    }
+
+    // Channel image data, bottom layer first. Within a batch, every tile row
+    // of every layer is an independent task.
+    for (int batchStart = 0; batchStart < layerCount; batchStart += LAYER_BATCH) {
+        const int batchEnd = std::min(layerCount, batchStart + LAYER_BATCH);
+
+        struct Task {
+            int layer;
+            QRect rect;
+        };
+        std::vector<Task> tasks;
+        std::vector<std::vector<size_t>> layerTasks(batchEnd - batchStart);
+        for (int i = batchStart; i < batchEnd; ++i) {
+            const QRect& rect = records[i].rect;
+            if (rect.isEmpty()) continue;
+            for (int top = rect.top(); top <= rect.bottom(); top += TILE_SIZE) {
+                layerTasks[i - batchStart].push_back(tasks.size());
+                tasks.push_back({i, QRect(rect.left(), top, rect.width(),
+                                          std::min(TILE_SIZE, rect.bottom() + 1 - top))});
+            }
+        }
+
+        std::vector<EncodedPlanes> encoded(tasks.size());
+        parallelFor(static_cast<int>(tasks.size()), [&](int t) {
+            const Task& task = tasks[t];
+            const qsizetype stride = static_cast<qsizetype>(task.rect.width()) * 4;
+            std::vector<uint8_t> band(static_cast<size_t>(stride) * task.rect.height());
+            layers[task.layer]->tiles().readPixels(task.rect, band.data(), stride);
+            encoded[t] = encodeRows(band.data(), task.rect.width(), task.rect.height(), stride,
+                                    LAYER_CHANNELS);
+        });
+
+        for (int i = batchStart; i < batchEnd; ++i) {
+            std::vector<EncodedPlanes> bands;
+            for (size_t t : layerTasks[i - batchStart]) bands.push_back(std::move(encoded[t]));
+
+            for (size_t c = 0; c < 4; ++c) {
+                if (bands.empty()) {
+                    QByteArray raw;
+                    put16(raw, COMPRESSION_RAW);
+                    records[i].length[c] = static_cast<uint64_t>(file.write(raw));
+                } else {
+                    records[i].length[c] = writeChannel(file, bands, c, psb);
+                }
+            }
+        }
+    }
+
+    // Pad the layer info to a multiple of 4, then an empty global mask
+    {
+        QByteArray tail;
+        const qint64 unpadded = file.pos() - (layerInfoPos + lengthBytes);
+        tail.append(QByteArray((4 - unpadded % 4) % 4, '\0'));
+        put32(tail, 0);
+        if (file.write(tail) != tail.size()) return false;
+    }
+    const qint64 layerMaskEnd = file.pos();
+    const qint64 layerInfoSize = layerMaskEnd - 4 - (layerInfoPos + lengthBytes);
+
+    // Merged image: RLE, all rows of R, then G, B and alpha. Bands are
+    // composited in parallel; only their compressed rows are kept.
+    {
+        const int width = canvasSize.width();
+        const qsizetype stride = static_cast<qsizetype>(width) * 4;
+        const int bandCount = (canvasSize.height() + TILE_SIZE - 1) / TILE_SIZE;
+        std::vector<EncodedPlanes> bands(bandCount);
+        Compositor compositor;
+        parallelFor(bandCount, [&](int b) {
+            const int top = b * TILE_SIZE;
+            const int rows = std::min(TILE_SIZE, canvasSize.height() - top);
+            std::vector<uint8_t> band(static_cast<size_t>(stride) * rows);
+            compositor.compositeRegionInto(stack, QRect(0, top, width, rows), band.data(), stride);
+            bands[b] = encodeRows(band.data(), width, rows, stride, MERGED_CHANNELS);
+        });
+
+        QByteArray head;
+        put16(head, COMPRESSION_RLE);
+        if (file.write(head) != head.size()) return false;
+        // Row counts of all channels precede all channel data
+        for (size_t c = 0; c < 4; ++c) {
+            QByteArray counts;
+            for (const auto& band : bands) {
+                for (uint32_t size : band.rowSizes[c]) {
+                    if (psb) {
+                        put32(counts, size);
+                    } else {
+                        put16(counts, static_cast<uint16_t>(size));
+                    }
+                }
+            }
+            if (file.write(counts) != counts.size()) return false;
+        }
+        for (size_t c = 0; c < 4; ++c) {
+            for (const auto& band : bands) {
+                if (file.write(band.data[c]) != band.data[c].size()) return false;
+            }
+        }
+    }
+
+    // Patch section and channel lengths
+    auto patch = [&](qint64 pos, uint64_t value) {
+        QByteArray bytes;
+        putLength(bytes, value, psb);
+        return file.seek(pos) && file.write(bytes) == bytes.size();
+    };
+    if (!patch(layerMaskPos, static_cast<uint64_t>(layerMaskEnd - layerInfoPos)) ||
+        !patch(layerInfoPos, static_cast<uint64_t>(layerInfoSize)))
+        return false;
+    for (const LayerRecord& record : records) {
+        for (int c = 0; c < 4; ++c) {
+            if (!patch(record.lengthPos[c], record.length[c])) return false;
+        }
+    }
+
+    return file.commit();
+}
+
+}  // namespace comicos
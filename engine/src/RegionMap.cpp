@@ -0,0 +1,353 @@
+#include "engine/RegionMap.h"
+#include "core/Parallel.h"
+#include "engine/DabKernel.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <unordered_map>
+
+namespace comicos {
+
+// --- Helpers ---
+
+/// Ink of a straight RGBA8 pixel: alpha times darkness (Rec. 601 luma).
+static inline int inkOf(const uint8_t* p) {
+    const int luma = (p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8;
+    return static_cast<int>(div255(p[3] * (255 - luma)));
+}
+
+/// Union-find over labels; the smaller label is always the root, so roots
+/// come first in label order.
+class LabelSets {
+public:
+    explicit LabelSets(size_t count) : m_parent(count) {
+        std::iota(m_parent.begin(), m_parent.end(), 0u);
+    }
+
+    void add() { m_parent.push_back(static_cast<uint32_t>(m_parent.size())); }
+
+    uint32_t find(uint32_t a) {
+        while (m_parent[a] != a) {
+            m_parent[a] = m_parent[m_parent[a]];
+            a = m_parent[a];
+        }
+        return a;
+    }
+
+    void unite(uint32_t a, uint32_t b) {
+        a = find(a);
+        b = find(b);
+        if (a < b) {
+            m_parent[b] = a;
+        } else if (b < a) {
+            m_parent[a] = b;
+        }
+    }
+
+    /// Number the sets 0..n-1 in order of their smallest label; returns n.
+    uint32_t compact(std::vector<uint32_t>& out) {
+        out.resize(m_parent.size());
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < m_parent.size(); ++i) {
+            const uint32_t root = find(i);
+            out[i] = root == i ? n++ : out[root];
+        }
+        return n;
+    }
+
+private:
+    std::vector<uint32_t> m_parent;
+};
+
+// --- Labelling ---
+
+bool RegionMap::build(const Layer& lineArt, const QSize& canvasSize, const RegionOptions& options) {
+    m_canvas = canvasSize;
+    m_options = options;
+    m_options.inkThreshold = std::clamp(m_options.inkThreshold, 1, 255);
+    m_cols = (std::max(m_canvas.width(), 0) + TILE_SIZE - 1) / TILE_SIZE;
+    m_rows = (std::max(m_canvas.height(), 0) + TILE_SIZE - 1) / TILE_SIZE;
+    m_regionCount = 0;
+    m_tiles.assign(static_cast<size_t>(m_cols) * m_rows, {});
+    if (m_tiles.empty()) return false;
+
+    // Tiles are independent; reading the layer concurrently is safe
+    // (TileManager::pixelsAt) as long as nothing writes it
+    const int count = static_cast<int>(m_tiles.size());
+    parallelFor(count, [&](int i) { labelTile(lineArt, i % m_cols, i / m_cols); });
+
+    std::vector<uint32_t> base(m_tiles.size() + 1, 0);
+    for (size_t i = 0; i < m_tiles.size(); ++i) base[i + 1] = base[i] + m_tiles[i].labels;
+    LabelSets sets(base.back());
+
+    // Join labels across tile borders: runs that reach the right edge with
+    // the neighbour's runs starting at 0, bottom rows with the top rows below
+    for (int ty = 0; ty < m_rows; ++ty) {
+        for (int tx = 0; tx < m_cols; ++tx) {
+            const TileRuns& t = tileAt(tx, ty);
+            const uint32_t tBase = base[ty * m_cols + tx];
+
+            if (tx + 1 < m_cols) {
+                const TileRuns& right = tileAt(tx + 1, ty);
+                const uint32_t rBase = base[ty * m_cols + tx + 1];
+                for (int y = 0; y < TILE_SIZE; ++y) {
+                    if (t.rowStart[y] == t.rowStart[y + 1]) continue;
+                    if (right.rowStart[y] == right.rowStart[y + 1]) continue;
+                    const Run& a = t.runs[t.rowStart[y + 1] - 1];
+                    const Run& b = right.runs[right.rowStart[y]];
+                    if (a.x1 == TILE_SIZE && b.x0 == 0) {
+                        sets.unite(tBase + a.label, rBase + b.label);
+                    }
+                }
+            }
+
+            if (ty + 1 < m_rows) {
+                const TileRuns& below = tileAt(tx, ty + 1);
+                const uint32_t bBase = base[(ty + 1) * m_cols + tx];
+                uint32_t a = t.rowStart[TILE_SIZE - 1];
+                const uint32_t aEnd = t.rowStart[TILE_SIZE];
+                for (uint32_t b = below.rowStart[0]; b < below.rowStart[1]; ++b) {
+                    const Run& rb = below.runs[b];
+                    while (a < aEnd && t.runs[a].x1 <= rb.x0) ++a;
+                    for (uint32_t k = a; k < aEnd && t.runs[k].x0 < rb.x1; ++k) {
+                        sets.unite(tBase + t.runs[k].label, bBase + rb.label);
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> region;
+    m_regionCount = static_cast<int>(sets.compact(region));
+    parallelFor(count, [&](int i) {
+        for (Run& run : m_tiles[i].runs) run.label = region[base[i] + run.label];
+    });
+    return m_regionCount > 0;
+}
+
+void RegionMap::labelTile(const Layer& lineArt, int tx, int ty) {
+    TileRuns& t = tileAt(tx, ty);
+    const int w = std::min(TILE_SIZE, m_canvas.width() - tx * TILE_SIZE);
+    const int h = std::min(TILE_SIZE, m_canvas.height() - ty * TILE_SIZE);
+
+    const TileCoord coord{tx, ty};
+    const TileManager& tiles = lineArt.tiles();
+    std::unique_ptr<uint8_t[]> scratch;
+    if (tiles.hasTile(coord) && !tiles.isResident(coord)) scratch.reset(new uint8_t[TILE_BYTES]);
+    const uint8_t* pixels = tiles.pixelsAt(coord, scratch.get());
+
+    t.rowStart.assign(TILE_SIZE + 1, 0);
+    t.runs.clear();
+    LabelSets sets(0);
+    std::vector<uint8_t> line(TILE_SIZE, 0);
+    uint32_t prevBegin = 0;
+    uint32_t prevEnd = 0;
+    for (int y = 0; y < TILE_SIZE; ++y) {
+        const auto begin = static_cast<uint32_t>(t.runs.size());
+        t.rowStart[y] = begin;
+        if (y >= h) continue;
+
+        // Line flags for the row; only pixels that differ from the one
+        // before are tested, since line art is mostly long flat runs
+        if (pixels) {
+            const uint8_t* src = pixels + y * TILE_SIZE * 4;
+            uint32_t last = 0;
+            uint8_t lastLine = 0;
+            for (int x = 0; x < w; ++x) {
+                uint32_t px;
+                std::memcpy(&px, src + x * 4, sizeof(px));
+                if (x == 0 || px != last) {
+                    last = px;
+                    lastLine = inkOf(src + x * 4) >= m_options.inkThreshold;
+                }
+                line[x] = lastLine;
+            }
+        }
+
+        for (int x = 0; x < w;) {
+            while (x < w && line[x]) ++x;
+            const int start = x;
+            while (x < w && !line[x]) ++x;
+            if (start == x) continue;
+            const auto index = static_cast<uint32_t>(t.runs.size());
+            t.runs.push_back({static_cast<uint16_t>(start), static_cast<uint16_t>(x), index});
+            sets.add();
+        }
+
+        // 4-connected: join runs that overlap a run of the row above
+        uint32_t a = prevBegin;
+        for (uint32_t b = begin; b < t.runs.size(); ++b) {
+            while (a < prevEnd && t.runs[a].x1 <= t.runs[b].x0) ++a;
+            for (uint32_t k = a; k < prevEnd && t.runs[k].x0 < t.runs[b].x1; ++k) sets.unite(k, b);
+        }
+        prevBegin = begin;
+        prevEnd = static_cast<uint32_t>(t.runs.size());
+    }
+    t.rowStart[TILE_SIZE] = static_cast<uint32_t>(t.runs.size());
+
+    std::vector<uint32_t> local;
+    t.labels = sets.compact(local);
+    for (Run& run : t.runs) run.label = local[run.label];
+}
+
+uint32_t RegionMap::regionAt(int x, int y) const {
+    if (x < 0 || y < 0 || x >= m_canvas.width() || y >= m_canvas.height()) return NONE;
+    if (m_tiles.empty()) return NONE;
+
+    const TileRuns& t = tileAt(x / TILE_SIZE, y / TILE_SIZE);
+    const int lx = x % TILE_SIZE;
+    const int ly = y % TILE_SIZE;
+    const auto first = t.runs.begin() + t.rowStart[ly];
+    const auto last = t.runs.begin() + t.rowStart[ly + 1];
+    auto it = std::upper_bound(first, last, lx, [](int v, const Run& run) { return v < run.x0; });
+    if (it == first) return NONE;
+    --it;
+    return lx < it->x1 ? it->label : NONE;
+}
+
+// --- Colours ---
+
+std::vector<Pixel> RegionMap::distinctColors() const {
+    // Multiplying by an odd constant permutes 24-bit values, so every
+    // region gets its own colour, and neighbouring ids land far apart
+    std::vector<Pixel> colors(m_regionCount);
+    for (int i = 0; i < m_regionCount; ++i) {
+        const uint32_t v = (static_cast<uint32_t>(i) + 1) * 0x9E3779u & 0xFFFFFFu;
+        colors[i] = {static_cast<uint8_t>(v >> 16), static_cast<uint8_t>(v >> 8),
+                     static_cast<uint8_t>(v), 255};
+    }
+    return colors;
+}
+
+std::vector<Pixel> RegionMap::colorsFromHints(const Layer& hints) const {
+    // Votes per tile, key = region << 24 | RGB; hint pixels count when at
+    // least half opaque, so soft stroke edges do not leak into neighbours
+    using Votes = std::unordered_map<uint64_t, uint64_t>;
+    std::vector<Votes> votes(m_tiles.size());
+    parallelFor(static_cast<int>(m_tiles.size()), [&](int i) {
+        const TileCoord coord{i % m_cols, i / m_cols};
+        const TileManager& tiles = hints.tiles();
+        std::unique_ptr<uint8_t[]> scratch;
+        if (tiles.hasTile(coord) && !tiles.isResident(coord)) {
+            scratch.reset(new uint8_t[TILE_BYTES]);
+        }
+        const uint8_t* pixels = tiles.pixelsAt(coord, scratch.get());
+        if (!pixels) return;
+
+        const TileRuns& t = m_tiles[i];
+        for (int y = 0; y < TILE_SIZE; ++y) {
+            for (uint32_t r = t.rowStart[y]; r < t.rowStart[y + 1]; ++r) {
+                const Run& run = t.runs[r];
+                uint64_t key = 0;
+                uint64_t count = 0;
+                for (int x = run.x0; x < run.x1; ++x) {
+                    const uint8_t* p = pixels + (y * TILE_SIZE + x) * 4;
+                    if (p[3] < 128) continue;
+                    const uint64_t k = static_cast<uint64_t>(run.label) << 24 |
+                                       static_cast<uint64_t>(p[0]) << 16 | p[1] << 8 | p[2];
+                    if (k != key && count > 0) {
+                        votes[i][key] += count;
+                        count = 0;
+                    }
+                    key = k;
+                    ++count;
+                }
+                if (count > 0) votes[i][key] += count;
+            }
+        }
+    });
+
+    // Most votes wins; ties go to the smaller RGB value, so the result does
+    // not depend on the order tiles finished in
+    std::vector<uint64_t> best(m_regionCount, 0);
+    std::vector<uint32_t> bestRgb(m_regionCount, 0);
+    Votes total;
+    for (const Votes& tileVotes : votes) {
+        for (const auto& [key, count] : tileVotes) total[key] += count;
+    }
+    for (const auto& [key, count] : total) {
+        const auto region = static_cast<uint32_t>(key >> 24);
+        const auto rgb = static_cast<uint32_t>(key & 0xFFFFFF);
+        if (count > best[region] || (count == best[region] && rgb < bestRgb[region])) {
+            best[region] = count;
+            bestRgb[region] = rgb;
+        }
+    }
+
+    std::vector<Pixel> colors(m_regionCount);
+    for (int i = 0; i < m_regionCount; ++i) {
+        if (!best[i]) continue;
+        colors[i] = {static_cast<uint8_t>(bestRgb[i] >> 16), static_cast<uint8_t>(bestRgb[i] >> 8),
+                     static_cast<uint8_t>(bestRgb[i]), 255};
+    }
+    return colors;
+}
+
+// --- Output ---
+
+std::vector<TileCoord> RegionMap::paint(Layer& target, const std::vector<Pixel>& colors) const {
+    TileManager& tiles = target.tiles();
+    auto packed = [&](uint32_t region) {
+        uint32_t v;
+        std::memcpy(&v, &colors[region], sizeof(v));
+        return v;
+    };
+
+    // Tile creation touches the tile map: one thread. Whole tiles of one
+    // colour over nothing come out identical, so they share one buffer
+    std::vector<TileCoord> coords;
+    std::vector<Tile*> targets;
+    std::vector<int> sameAs;
+    std::unordered_map<uint32_t, int> firstSolid;
+    for (int ty = 0; ty < m_rows; ++ty) {
+        for (int tx = 0; tx < m_cols; ++tx) {
+            const TileRuns& t = tileAt(tx, ty);
+            const bool any = std::any_of(t.runs.begin(), t.runs.end(), [&](const Run& run) {
+                return colors[run.label].a > 0;
+            });
+            if (!any) continue;
+
+            const TileCoord coord{tx, ty};
+            const Tile* existing = tiles.tileAt(coord);
+            const bool solid = t.runs.size() == TILE_SIZE && t.labels == 1 &&
+                               std::all_of(t.runs.begin(), t.runs.end(), [](const Run& run) {
+                                   return run.x0 == 0 && run.x1 == TILE_SIZE;
+                               });
+            int source = -1;
+            if (solid && (!existing || existing->isEmpty())) {
+                const auto [it, first] = firstSolid.try_emplace(
+                    packed(t.runs.front().label), static_cast<int>(targets.size()));
+                if (!first) source = it->second;
+            }
+
+            Tile* tile = tiles.getOrCreateTile(coord);
+            if (source < 0) tile->ensureAllocated();
+            tile->setDirty(true);
+            coords.push_back(coord);
+            targets.push_back(tile);
+            sameAs.push_back(source);
+        }
+    }
+
+    parallelFor(static_cast<int>(targets.size()), [&](int i) {
+        if (sameAs[i] >= 0) return;
+        const TileRuns& t = tileAt(coords[i].tx, coords[i].ty);
+        uint8_t* pixels = targets[i]->data();
+        for (int y = 0; y < TILE_SIZE; ++y) {
+            uint8_t* row = pixels + y * TILE_SIZE * 4;
+            for (uint32_t r = t.rowStart[y]; r < t.rowStart[y + 1]; ++r) {
+                const Run& run = t.runs[r];
+                if (colors[run.label].a == 0) continue;
+                const uint32_t value = packed(run.label);
+                for (int x = run.x0; x < run.x1; ++x) std::memcpy(row + x * 4, &value, 4);
+            }
+        }
+    });
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (sameAs[i] >= 0) targets[i]->sharePixels(*targets[sameAs[i]]);
+    }
+    return coords;
+}
+
+}  // namespace comicos
@@ -0,0 +1,248 @@
+#include "engine/StampCache.h"
+#include "engine/BrushTipAtlas.h"
+#include <algorithm>
+#include <cmath>
+
+namespace comicos {
+
+// --- Quantization ---
+
+constexpr float LINEAR_RADIUS_LIMIT = 16.0f;
+constexpr int LINEAR_RADIUS_STEPS = 4;  // Per pixel, up to LINEAR_RADIUS_LIMIT
+constexpr int LINEAR_RADIUS_INDICES = 64;  // LINEAR_RADIUS_LIMIT * LINEAR_RADIUS_STEPS
+constexpr int OCTAVE_RADIUS_STEPS = 64;
+constexpr int HARDNESS_STEPS = 64;
+constexpr int ASPECT_STEPS = 32;
+constexpr int MAX_ROTATION_STEPS = 1024;
+constexpr float TWO_PI = 6.28318530718f;
+
+static int radiusIndex(float radius) {
+    if (radius <= LINEAR_RADIUS_LIMIT)
+        return std::max(1, static_cast<int>(std::lround(radius * LINEAR_RADIUS_STEPS)));
+    return LINEAR_RADIUS_INDICES
+           + static_cast<int>(std::lround(std::log2(radius / LINEAR_RADIUS_LIMIT)
+                                          * OCTAVE_RADIUS_STEPS));
+}
+
+static float radiusForIndex(int index) {
+    if (index <= LINEAR_RADIUS_INDICES)
+        return static_cast<float>(index) / LINEAR_RADIUS_STEPS;
+    return LINEAR_RADIUS_LIMIT
+           * std::exp2(static_cast<float>(index - LINEAR_RADIUS_INDICES) / OCTAVE_RADIUS_STEPS);
+}
+
+/// Rotation steps per turn: about one pixel of travel at the tip's edge.
+static int rotationSteps(float radius) {
+    int steps = 16;
+    while (steps < MAX_ROTATION_STEPS && steps < TWO_PI * radius) steps *= 2;
+    return steps;
+}
+
+/// Sub-pixel positions per axis; small dabs show their offset, large ones don't.
+static int subpixelSteps(float radius) {
+    if (radius < 8.0f) return 4;
+    if (radius < 16.0f) return 2;
+    return 1;
+}
+
+/// Snap a centre coordinate to 1/steps pixel: whole pixel plus offset index.
+static void snapCenter(float v, int steps, int* whole, int* offset) {
+    const long long q = std::llround(static_cast<double>(v) * steps);
+    const long long w = q >= 0 ? q / steps : -((-q + steps - 1) / steps);
+    *whole = static_cast<int>(w);
+    *offset = static_cast<int>(q - w * steps);
+}
+
+// --- Cache ---
+
+StampCache::StampCache(size_t maxBytes) : m_maxBytes(maxBytes) {}
+StampCache::~StampCache() = default;
+
+StampCache::Placement StampCache::place(float x, float y, const StampShape& shape) {
+    Placement p;
+    const int rIndex = radiusIndex(shape.radius);
+    const int hIndex =
+        static_cast<int>(std::lround(std::clamp(shape.hardness, 0.0f, 1.0f) * HARDNESS_STEPS));
+    const int aIndex = std::max(
+        1, static_cast<int>(std::lround(std::clamp(shape.aspect, 0.0f, 1.0f) * ASPECT_STEPS)));
+    p.radius = radiusForIndex(rIndex);
+    p.hardness = static_cast<float>(hIndex) / HARDNESS_STEPS;
+    p.aspect = static_cast<float>(aIndex) / ASPECT_STEPS;
+    p.tipId = std::max(shape.tipId, -1);
+
+    // A round, circular tip looks the same at any angle
+    int rotIndex = 0;
+    if (p.tipId >= 0 || aIndex < ASPECT_STEPS) {
+        const int steps = rotationSteps(p.radius);
+        const float turns = shape.rotation / TWO_PI;
+        rotIndex = static_cast<int>(std::lround((turns - std::floor(turns)) * steps)) % steps;
+        p.rotation = static_cast<float>(rotIndex) * TWO_PI / steps;
+    }
+
+    const int steps = subpixelSteps(p.radius);
+    int wholeX = 0, wholeY = 0, subX = 0, subY = 0;
+    snapCenter(x, steps, &wholeX, &subX);
+    snapCenter(y, steps, &wholeY, &subY);
+
+    // Mask pixel (half, half) holds the snapped centre's whole pixel
+    p.half = static_cast<int>(std::ceil(p.radius)) + 1;
+    p.originX = wholeX - p.half;
+    p.originY = wholeY - p.half;
+    p.offsetX = static_cast<float>(subX) / steps;
+    p.offsetY = static_cast<float>(subY) / steps;
+    p.key = static_cast<uint64_t>(rIndex) | static_cast<uint64_t>(hIndex) << 16
+            | static_cast<uint64_t>(subX) << 24 | static_cast<uint64_t>(subY) << 26
+            | static_cast<uint64_t>(rotIndex) << 28 | static_cast<uint64_t>(aIndex) << 38
+            | static_cast<uint64_t>(p.tipId + 1) << 44;
+    return p;
+}
+
+std::shared_ptr<const BrushStamp> StampCache::stamp(float x, float y, const StampShape& shape,
+                                                    int* originX, int* originY) {
+    const Placement p = place(x, y, shape);
+    *originX = p.originX;
+    *originY = p.originY;
+
+    auto it = m_entries.find(p.key);
+    if (it != m_entries.end()) {
+        ++m_hits;
+        m_lruOrder.splice(m_lruOrder.begin(), m_lruOrder, it->second.lru);
+        return it->second.stamp;
+    }
+
+    ++m_misses;
+    auto built = build(p, m_tips);
+    m_lruOrder.push_front(p.key);
+    m_entries[p.key] = {built, m_lruOrder.begin()};
+    m_bytes += built->bytes();
+    while (m_bytes > m_maxBytes && m_entries.size() > 1) {
+        evictLRU();
+    }
+    return built;
+}
+
+std::shared_ptr<const BrushStamp> StampCache::stamp(float x, float y, float radius,
+                                                    float hardness, int* originX,
+                                                    int* originY) {
+    StampShape shape;
+    shape.radius = radius;
+    shape.hardness = hardness;
+    return stamp(x, y, shape, originX, originY);
+}
+
+std::shared_ptr<const BrushStamp> StampCache::uncached(float x, float y,
+                                                       const StampShape& shape,
+                                                       const BrushTipAtlas* tips, int* originX,
+                                                       int* originY) {
+    const Placement p = place(x, y, shape);
+    *originX = p.originX;
+    *originY = p.originY;
+    return build(p, tips);
+}
+
+std::shared_ptr<const BrushStamp> StampCache::uncached(float x, float y, float radius,
+                                                       float hardness, int* originX,
+                                                       int* originY) {
+    StampShape shape;
+    shape.radius = radius;
+    shape.hardness = hardness;
+    return uncached(x, y, shape, nullptr, originX, originY);
+}
+
+bool StampCache::isSolidDisc(const StampShape& shape) {
+    return shape.tipId < 0
+           && std::lround(std::clamp(shape.hardness, 0.0f, 1.0f) * HARDNESS_STEPS) == HARDNESS_STEPS
+           && std::lround(std::clamp(shape.aspect, 0.0f, 1.0f) * ASPECT_STEPS) == ASPECT_STEPS;
+}
+
+float StampCache::hitRate() const {
+    const size_t lookups = m_hits + m_misses;
+    return lookups ? static_cast<float>(m_hits) / lookups : 0.0f;
+}
+
+void StampCache::clear() {
+    m_entries.clear();
+    m_lruOrder.clear();
+    m_bytes = 0;
+}
+
+void StampCache::evictLRU() {
+    if (m_lruOrder.empty()) return;
+
+    auto it = m_entries.find(m_lruOrder.back());
+    m_bytes -= it->second.stamp->bytes();
+    m_entries.erase(it);
+    m_lruOrder.pop_back();
+}
+
+std::shared_ptr<const BrushStamp> StampCache::build(const Placement& p,
+                                                   const BrushTipAtlas* tips) {
+    const float radius = p.radius;
+    const float hardness = p.hardness;
+    const float centerX = p.half + p.offsetX;
+    const float centerY = p.half + p.offsetY;
+    const int size = 2 * p.half;
+
+    auto stamp = std::make_shared<BrushStamp>();
+    stamp->size = size;
+    stamp->mask.assign(static_cast<size_t>(size) * size, 0);
+    stamp->spans.assign(static_cast<size_t>(size) * 2, 0);
+
+    // Falloff on squared distances (sqrt only in the ramp), evaluated once per stamp
+    const float radiusSq = radius * radius;
+    const float hardRadius = hardness * radius;
+    const float hardRadiusSq = hardRadius * hardRadius;
+    const float invRadius = 1.0f / radius;
+    const float invRamp = 1.0f / (1.0f - hardness + 0.001f);
+
+    // Rotated and squashed tips: stamp pixel -> tip space, where the tip
+    // is the unit disc (round) or the unit square (image)
+    const std::shared_ptr<const BrushTip> tip = tips && p.tipId >= 0 ? tips->tip(p.tipId) : nullptr;
+    const bool shaped = tip || p.aspect < 1.0f;
+    const float cosR = std::cos(p.rotation);
+    const float sinR = std::sin(p.rotation);
+    const float invAspect = 1.0f / p.aspect;
+    const int level = tip ? tip->levelFor(2.0f * radius) : 0;
+
+    auto coverageAt = [&](float dx, float dy) -> float {
+        if (!shaped) {
+            const float d2 = dx * dx + dy * dy;
+            if (d2 > radiusSq) return 0.0f;
+            if (d2 <= hardRadiusSq) return 1.0f;
+            return 1.0f - (std::sqrt(d2) * invRadius - hardness) * invRamp;
+        }
+
+        const float u = (dx * cosR + dy * sinR) * invRadius;
+        const float v = (dy * cosR - dx * sinR) * invRadius * invAspect;
+        if (tip) return tip->sample(level, u * 0.5f + 0.5f, v * 0.5f + 0.5f);
+
+        const float d2 = (u * u + v * v) * radiusSq;
+        if (d2 > radiusSq) return 0.0f;
+        if (d2 <= hardRadiusSq) return 1.0f;
+        return 1.0f - (std::sqrt(d2) * invRadius - hardness) * invRamp;
+    };
+
+    for (int y = 0; y < size; ++y) {
+        const float dy = (y + 0.5f) - centerY;
+        uint8_t* row = stamp->mask.data() + static_cast<size_t>(y) * size;
+        int begin = size, end = 0;
+        for (int x = 0; x < size; ++x) {
+            const float dx = (x + 0.5f) - centerX;
+            const float alpha = coverageAt(dx, dy);
+            const auto coverage =
+                static_cast<uint8_t>(std::lround(std::clamp(alpha, 0.0f, 1.0f) * 255.0f));
+            if (coverage == 0) continue;
+
+            row[x] = coverage;
+            begin = std::min(begin, x);
+            end = x + 1;
+        }
+        if (begin < end) {
+            stamp->spans[y * 2] = static_cast<uint16_t>(begin);
+            stamp->spans[y * 2 + 1] = static_cast<uint16_t>(end);
+        }
+    }
+    return stamp;
+}
+
+}  // namespace comicos
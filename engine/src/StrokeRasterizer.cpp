@@ -0,0 +1,47 @@
+#include "engine/StrokeRasterizer.h"
+#include "core/Layer.h"
+#include "core/VectorLayer.h"
+#include "engine/BrushEngine.h"
+#include <QRect>
+#include <cstring>
+
+namespace comicos {
+
+void StrokeRasterizer::install(const BrushTipAtlas* tips) {
+    VectorLayer::setRasterizer(
+        [tips](const std::vector<const Stroke*>& strokes, const TileCoord& coord, uint8_t* out) {
+            return rasterize(strokes, coord, out, tips);
+        });
+}
+
+bool StrokeRasterizer::rasterize(const std::vector<const Stroke*>& strokes,
+                                 const TileCoord& coord, uint8_t* out,
+                                 const BrushTipAtlas* tips) {
+    // Per thread: the canvas, page residency and export draw concurrently.
+    // The engine keeps its stamp cache from tile to tile.
+    thread_local BrushEngine engine;
+    thread_local Layer canvas(0);
+    thread_local Stroke params;  // Keeps its point buffer, like the engine
+
+    engine.setTipSource(tips);
+    engine.setClipRect(QRect(coord.tx * TILE_SIZE, coord.ty * TILE_SIZE, TILE_SIZE, TILE_SIZE));
+    for (const Stroke* stroke : strokes) {
+        params = *stroke;
+        params.clearPoints();
+        params.setTargetLayerId(canvas.id());
+        engine.beginStroke(&canvas, params);
+        for (const CanvasPoint& point : stroke->points()) engine.addPoint(point);
+        engine.endStroke();
+        engine.takeBeforeSnapshots();
+    }
+    engine.setClipRect({});
+
+    // Dabs near the edge also touched neighbouring tiles; only this one counts
+    const Tile* tile = canvas.tiles().tileAt(coord);
+    const bool drawn = tile && !tile->isEmpty();
+    if (drawn) std::memcpy(out, tile->constData(), TILE_BYTES);
+    canvas.clear();
+    return drawn;
+}
+
+}  // namespace comicos
@@ -0,0 +1,275 @@
+#include "engine/WetLayer.h"
+#include "core/Parallel.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace comicos {
+
+WetLayer::WetLayer() = default;
+WetLayer::~WetLayer() = default;
+
+void WetLayer::begin(LayerId layerId, const DabPaint& paint, Accumulation mode,
+                     std::shared_ptr<const Selection> selection) {
+    clear();
+    m_active = true;
+    m_layerId = layerId;
+    m_paint = paint;
+    m_paint.opacity = 255;
+    m_mode = mode;
+    if (selection && !selection->isEmpty()) m_selection = std::move(selection);
+}
+
+void WetLayer::clear() {
+    m_active = false;
+    m_selection.reset();
+    while (!m_tiles.empty() && m_spareTiles.size() < MAX_SPARE_TILES) {
+        m_spareTiles.push_back(m_tiles.extract(m_tiles.begin()));
+    }
+    m_tiles.clear();
+    m_order.clear();
+    m_dirty.clear();
+}
+
+// --- Accumulation ---
+
+/// Stamp rows and columns over one tile, in stamp coordinates.
+struct StampClip {
+    int sx0, sx1, sy0, sy1;
+};
+
+static StampClip clipToTile(const PlacedStamp& dab, int tileX, int tileY) {
+    const int size = dab.stamp->size;
+    return {std::max(tileX - dab.originX, 0), std::min(tileX + TILE_SIZE - dab.originX, size),
+            std::max(tileY - dab.originY, 0), std::min(tileY + TILE_SIZE - dab.originY, size)};
+}
+
+/// False for tiles under the stamp's empty corners.
+static bool coversTile(const PlacedStamp& dab, const StampClip& clip) {
+    const BrushStamp& stamp = *dab.stamp;
+    for (int sy = clip.sy0; sy < clip.sy1; ++sy) {
+        if (std::max(stamp.spanBegin(sy), clip.sx0) < std::min(stamp.spanEnd(sy), clip.sx1))
+            return true;
+    }
+    return false;
+}
+
+static uint8_t scaledOpacity(float opacity) {
+    return static_cast<uint8_t>(std::lround(std::clamp(opacity, 0.0f, 1.0f) * 255.0f));
+}
+
+/// Accumulate the part of one dab that falls on a tile.
+static void depositTile(const PlacedStamp& dab, const StampClip& clip, int tileX, int tileY,
+                        uint8_t* coverage, WetLayer::Accumulation mode) {
+    const BrushStamp& stamp = *dab.stamp;
+    const uint8_t opacity = scaledOpacity(dab.opacity);
+    for (int sy = clip.sy0; sy < clip.sy1; ++sy) {
+        const int x0 = std::max(stamp.spanBegin(sy), clip.sx0);
+        const int x1 = std::min(stamp.spanEnd(sy), clip.sx1);
+        if (x0 >= x1) continue;
+
+        uint8_t* dst = coverage + (dab.originY + sy - tileY) * TILE_SIZE
+                       + (dab.originX + x0 - tileX);
+        const uint8_t* mask = stamp.mask.data() + sy * stamp.size + x0;
+        if (mode == WetLayer::Accumulation::Max) {
+            DabKernels::maxRow(dst, mask, x1 - x0, opacity);
+        } else {
+            DabKernels::addRow(dst, mask, x1 - x0, opacity);
+        }
+    }
+}
+
+void WetLayer::deposit(const std::vector<PlacedStamp>& dabs) {
+    if (dabs.empty()) return;
+
+    // Tile range of the batch, for the bucket lookup grid
+    TileCoord rangeMin{INT_MAX, INT_MAX}, rangeMax{INT_MIN, INT_MIN};
+    for (const PlacedStamp& dab : dabs) {
+        const int size = dab.stamp->size;
+        const TileCoord tcMin = pixelToTile(dab.originX, dab.originY);
+        const TileCoord tcMax = pixelToTile(dab.originX + size - 1, dab.originY + size - 1);
+        rangeMin = {std::min(rangeMin.tx, tcMin.tx), std::min(rangeMin.ty, tcMin.ty)};
+        rangeMax = {std::max(rangeMax.tx, tcMax.tx), std::max(rangeMax.ty, tcMax.ty)};
+    }
+    const int gridCols = rangeMax.tx - rangeMin.tx + 1;
+    m_bucketGrid.assign(static_cast<size_t>(gridCols) * (rangeMax.ty - rangeMin.ty + 1), -1);
+
+    // Bucket dabs by tile, keeping dab order within each bucket
+    m_bucketCount = 0;
+    size_t work = 0;
+    for (int i = 0; i < static_cast<int>(dabs.size()); ++i) {
+        const PlacedStamp& dab = dabs[i];
+        if (scaledOpacity(dab.opacity) == 0) continue;
+
+        const int size = dab.stamp->size;
+        const TileCoord tcMin = pixelToTile(dab.originX, dab.originY);
+        const TileCoord tcMax = pixelToTile(dab.originX + size - 1, dab.originY + size - 1);
+        for (int ty = tcMin.ty; ty <= tcMax.ty; ++ty) {
+            for (int tx = tcMin.tx; tx <= tcMax.tx; ++tx) {
+                if (!coversTile(dab, clipToTile(dab, tx * TILE_SIZE, ty * TILE_SIZE))) continue;
+
+                const TileCoord tc{tx, ty};
+                const auto state = m_selection ? m_selection->stateAt(tc)
+                                               : Selection::TileState::Full;
+                if (state == Selection::TileState::None) continue;
+
+                int& index = m_bucketGrid[(ty - rangeMin.ty) * gridCols + (tx - rangeMin.tx)];
+                if (index < 0) {
+                    // Buckets past m_bucketCount keep their dab lists' buffers
+                    if (m_bucketCount == static_cast<int>(m_buckets.size())) {
+                        m_buckets.emplace_back();
+                    }
+                    index = m_bucketCount++;
+                    Bucket& bucket = m_buckets[index];
+                    bucket.coord = tc;
+                    bucket.coverage = coverageForWrite(tc);
+                    bucket.selection = m_selection ? m_selection->maskAt(tc) : nullptr;
+                    bucket.dabs.clear();
+                    m_dirty.push_back(tc);
+                }
+                m_buckets[index].dabs.push_back(i);
+            }
+        }
+        work += static_cast<size_t>(size) * size;
+    }
+
+    // Each bucket writes only its own coverage tile, so buckets run in
+    // parallel and the result does not depend on scheduling
+    auto renderBucket = [&](int b) {
+        const Bucket& bucket = m_buckets[b];
+        const int tileX = bucket.coord.tx * TILE_SIZE;
+        const int tileY = bucket.coord.ty * TILE_SIZE;
+        for (int i : bucket.dabs) {
+            depositTile(dabs[i], clipToTile(dabs[i], tileX, tileY), tileX, tileY,
+                        bucket.coverage, m_mode);
+        }
+        // Clipping once per batch is the same as clipping every dab: the
+        // mask caps coverage under both max and saturating addition
+        if (bucket.selection) Selection::clip(bucket.coverage, bucket.selection, TILE_PIXELS);
+    };
+    if (m_bucketCount > 1 && work >= PARALLEL_MIN_PIXELS) {
+        parallelFor(m_bucketCount, renderBucket);
+    } else {
+        for (int b = 0; b < m_bucketCount; ++b) renderBucket(b);
+    }
+}
+
+void WetLayer::deposit(const BrushCapsule& capsule) {
+    if (capsule.isEmpty()) return;
+
+    m_targets.clear();
+    const QRect& bounds = capsule.bounds();
+    const TileCoord tcMin = pixelToTile(bounds.left(), bounds.top());
+    const TileCoord tcMax = pixelToTile(bounds.right(), bounds.bottom());
+    for (int ty = tcMin.ty; ty <= tcMax.ty; ++ty) {
+        for (int tx = tcMin.tx; tx <= tcMax.tx; ++tx) {
+            const TileCoord tc{tx, ty};
+            if (m_selection && m_selection->stateAt(tc) == Selection::TileState::None) continue;
+            if (!capsule.coversTile(tx * TILE_SIZE, ty * TILE_SIZE)) continue;
+
+            const uint8_t* mask = m_selection ? m_selection->maskAt(tc) : nullptr;
+            m_targets.push_back({tc, coverageForWrite(tc), mask});
+            m_dirty.push_back(tc);
+        }
+    }
+
+    auto renderTarget = [&](int i) {
+        const Target& target = m_targets[i];
+        capsule.depositTile(target.coord.tx * TILE_SIZE, target.coord.ty * TILE_SIZE,
+                            target.coverage);
+        if (target.selection) Selection::clip(target.coverage, target.selection, TILE_PIXELS);
+    };
+    const int count = static_cast<int>(m_targets.size());
+    if (count > 1 && capsule.pixelCount() >= PARALLEL_MIN_PIXELS) {
+        parallelFor(count, renderTarget);
+    } else {
+        for (int i = 0; i < count; ++i) renderTarget(i);
+    }
+}
+
+uint8_t* WetLayer::coverageForWrite(const TileCoord& coord) {
+    auto it = m_tiles.find(coord);
+    if (it != m_tiles.end()) return it->second.get();
+
+    if (m_spareTiles.empty()) {
+        it = m_tiles.emplace(coord, std::make_unique<uint8_t[]>(TILE_PIXELS)).first;  // Zeroed
+    } else {
+        TileMap::node_type node = std::move(m_spareTiles.back());
+        m_spareTiles.pop_back();
+        node.key() = coord;
+        std::memset(node.mapped().get(), 0, TILE_PIXELS);
+        it = m_tiles.insert(std::move(node)).position;
+    }
+    m_order.push_back(coord);
+    return it->second.get();
+}
+
+// --- Output ---
+
+void WetLayer::takeDirtyTiles(std::vector<TileCoord>& out) {
+    std::sort(m_dirty.begin(), m_dirty.end());
+    m_dirty.erase(std::unique(m_dirty.begin(), m_dirty.end()), m_dirty.end());
+    out.clear();
+    out.swap(m_dirty);
+}
+
+void WetLayer::copyTiles(const WetLayer& source, const std::vector<TileCoord>& coords) {
+    m_active = source.m_active;
+    m_layerId = source.m_layerId;
+    m_paint = source.m_paint;
+    m_mode = source.m_mode;
+    m_selection = source.m_selection;
+    for (const TileCoord& tc : coords) {
+        const uint8_t* coverage = source.coverageAt(tc);
+        if (coverage) {
+            std::memcpy(coverageForWrite(tc), coverage, TILE_PIXELS);
+        } else if (auto it = m_tiles.find(tc); it != m_tiles.end()) {
+            std::memset(it->second.get(), 0, TILE_PIXELS);
+        }
+    }
+}
+
+void WetLayer::mergeTiles(const WetLayer& other) {
+    for (const TileCoord& tc : other.m_order) {
+        const uint8_t* src = other.coverageAt(tc);
+        uint8_t* dst = coverageForWrite(tc);
+        // At full opacity the row kernels take the coverage as is
+        if (m_mode == Accumulation::Max) {
+            DabKernels::maxRow(dst, src, TILE_PIXELS, 255);
+        } else {
+            DabKernels::addRow(dst, src, TILE_PIXELS, 255);
+        }
+    }
+}
+
+size_t WetLayer::uncoveredPixels(const WetLayer& other) const {
+    size_t count = 0;
+    for (const TileCoord& tc : m_order) {
+        const uint8_t* mine = coverageAt(tc);
+        const uint8_t* theirs = other.coverageAt(tc);
+        for (int i = 0; i < TILE_PIXELS; ++i) {
+            if (mine[i] && !(theirs && theirs[i])) ++count;
+        }
+    }
+    return count;
+}
+
+const uint8_t* WetLayer::coverageAt(const TileCoord& coord) const {
+    auto it = m_tiles.find(coord);
+    return it != m_tiles.end() ? it->second.get() : nullptr;
+}
+
+void WetLayer::applyTo(const TileCoord& coord, uint8_t* pixels) const {
+    const uint8_t* coverage = coverageAt(coord);
+    if (!coverage) return;
+
+    // The coverage tile is a stamp mask the size of the tile
+    for (int y = 0; y < TILE_SIZE; ++y) {
+        DabKernels::stampRow(pixels + y * TILE_SIZE * 4, coverage + y * TILE_SIZE, TILE_SIZE,
+                             m_paint);
+    }
+}
+
+}  // namespace comicos
@@ -0,0 +1,97 @@
+#include "engine/ZipWriter.h"
+#include "engine/Crc32.h"
+#include <QIODevice>
+
+namespace comicos {
+
+constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+constexpr uint32_t END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06054b50;
+constexpr uint16_t VERSION_NEEDED = 10;  // Stored entries only
+constexpr uint16_t FLAG_UTF8_NAMES = 0x0800;
+constexpr uint16_t DOS_DATE = (0 << 9) | (1 << 5) | 1;  // 1980-01-01: reproducible output
+constexpr uint32_t MAX_OFFSET = 0xFFFFFFFFu;
+
+static void put16(QByteArray& out, uint16_t v) {
+    out.append(static_cast<char>(v));
+    out.append(static_cast<char>(v >> 8));
+}
+
+static void put32(QByteArray& out, uint32_t v) {
+    put16(out, static_cast<uint16_t>(v));
+    put16(out, static_cast<uint16_t>(v >> 16));
+}
+
+ZipWriter::ZipWriter(QIODevice* device) : m_device(device) {}
+
+bool ZipWriter::addFile(const QString& name, const QByteArray& data) {
+    const qint64 offset = m_device->pos();
+    if (offset < 0 || static_cast<quint64>(offset) + 30 + name.size() * 3 + data.size() > MAX_OFFSET)
+        return false;
+
+    Entry entry;
+    entry.name = name.toUtf8();
+    entry.crc = crc32Update(0, reinterpret_cast<const uint8_t*>(data.constData()),
+                            static_cast<size_t>(data.size()));
+    entry.size = static_cast<uint32_t>(data.size());
+    entry.offset = static_cast<uint32_t>(offset);
+
+    QByteArray header;
+    put32(header, LOCAL_HEADER_SIGNATURE);
+    put16(header, VERSION_NEEDED);
+    put16(header, FLAG_UTF8_NAMES);
+    put16(header, 0);  // Stored
+    put16(header, 0);  // Time
+    put16(header, DOS_DATE);
+    put32(header, entry.crc);
+    put32(header, entry.size);  // Compressed
+    put32(header, entry.size);  // Uncompressed
+    put16(header, static_cast<uint16_t>(entry.name.size()));
+    put16(header, 0);  // Extra field
+    header.append(entry.name);
+
+    if (m_device->write(header) != header.size() || m_device->write(data) != data.size())
+        return false;
+    m_entries.push_back(std::move(entry));
+    return true;
+}
+
+bool ZipWriter::finish() {
+    const qint64 directoryOffset = m_device->pos();
+    QByteArray directory;
+    for (const Entry& e : m_entries) {
+        put32(directory, CENTRAL_HEADER_SIGNATURE);
+        put16(directory, 20);  // Made by: MS-DOS, spec 2.0
+        put16(directory, VERSION_NEEDED);
+        put16(directory, FLAG_UTF8_NAMES);
+        put16(directory, 0);  // Stored
+        put16(directory, 0);
+        put16(directory, DOS_DATE);
+        put32(directory, e.crc);
+        put32(directory, e.size);
+        put32(directory, e.size);
+        put16(directory, static_cast<uint16_t>(e.name.size()));
+        put16(directory, 0);  // Extra field
+        put16(directory, 0);  // Comment
+        put16(directory, 0);  // Disk
+        put16(directory, 0);  // Internal attributes
+        put32(directory, 0);  // External attributes
+        put32(directory, e.offset);
+        directory.append(e.name);
+    }
+    if (static_cast<quint64>(directoryOffset) + directory.size() > MAX_OFFSET) return false;
+
+    QByteArray end;
+    put32(end, END_OF_CENTRAL_DIRECTORY_SIGNATURE);
+    put16(end, 0);  // This disk
+    put16(end, 0);  // Directory disk
+    put16(end, static_cast<uint16_t>(m_entries.size()));
+    put16(end, static_cast<uint16_t>(m_entries.size()));
+    put32(end, static_cast<uint32_t>(directory.size()));
+    put32(end, static_cast<uint32_t>(directoryOffset));
+    put16(end, 0);  // Comment
+
+    return m_device->write(directory) == directory.size() && m_device->write(end) == end.size();
+}
+
+}  // namespace comicos
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/Document.h"
+#include "engine/WetLayer.h"
 #include "render/CanvasRenderer.h"
 #include "render/TileRenderer.h"
 #include <QQuickItem>
@@ -8,6 +9,8 @@
 
 namespace comicos {
 
+class BrushThread;
+
 /// QQuickItem that renders the canvas in QML.
 /// This is the bridge between the C++ rendering pipeline and the QML UI.
 /// It handles:
@@ -41,6 +44,10 @@ public:
     Document* document() const { return m_document; }
 
     // --- Rendering ---
+    /// Source of the stroke in progress, shown on top of its layer. Each
+    /// frame copies the visible part of its overlay (copyOverlay()).
+    void setBrushThread(BrushThread* brushThread) { m_brushThread = brushThread; }
+
     void invalidateCanvas();
     void invalidateTiles(const std::vector<TileCoord>& tiles);
     void fitCanvasInView();
@@ -80,6 +87,8 @@ protected:
 
 private:
     Document* m_document = nullptr;
+    BrushThread* m_brushThread = nullptr;
+    WetLayer m_overlay;  // Visible part of the brush thread's overlay, per frame
     CanvasRenderer m_renderer;
     TileRenderer m_tileRenderer;
 
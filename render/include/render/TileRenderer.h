@@ -15,6 +15,7 @@ namespace comicos {
 
 class LayerStack;
 class Compositor;
+class WetLayer;
 
 /// Manages SceneGraph nodes for visible tiles.
 /// Creates and updates QSGSimpleTextureNode instances for each
@@ -30,6 +31,9 @@ public:
     /// Set the compositor for compositing layer tiles.
     void setCompositor(const Compositor* compositor);
 
+    /// Stroke in progress, drawn onto its layer until committed (may be null).
+    void setStrokeOverlay(const WetLayer* stroke);
+
     /// Update the SceneGraph for visible tiles.
     /// Called from QQuickItem::updatePaintNode on the render thread.
     QSGNode* updateSceneGraph(
@@ -52,6 +56,7 @@ private:
 
     const LayerStack* m_layers = nullptr;
     const Compositor* m_compositor = nullptr;
+    const WetLayer* m_stroke = nullptr;
 
     std::unordered_map<TileCoord, TileNode> m_nodes;
     QSGRectangleNode* m_paperNode = nullptr;
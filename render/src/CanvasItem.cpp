@@ -1,4 +1,5 @@
 #include "render/CanvasItem.h"
+#include "engine/BrushThread.h"
 #include <QMouseEvent>
 #include <QWheelEvent>
 #include <QKeyEvent>
@@ -117,10 +118,22 @@ QSGNode* CanvasItem::updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData*) {
     // Get visible tiles
     auto visibleTiles = m_renderer.visibleTiles(m_document->canvasSize());
 
-    return m_tileRenderer.updateSceneGraph(
+    // The brush thread keeps publishing while the frame composites: only
+    // the copy of the visible overlay tiles holds its lock
+    int64_t overlayCopied = 0;
+    if (m_brushThread) {
+        overlayCopied = m_brushThread->copyOverlay(visibleTiles, m_overlay);
+        m_tileRenderer.setStrokeOverlay(&m_overlay);
+    } else {
+        m_tileRenderer.setStrokeOverlay(nullptr);
+    }
+
+    QSGNode* node = m_tileRenderer.updateSceneGraph(
         oldNode, window(), visibleTiles,
         m_renderer.viewMatrix(),
         m_document->canvasSize());
+    if (m_brushThread) m_brushThread->overlayPresented(overlayCopied);
+    return node;
 }
 
 // --- Input Handling ---
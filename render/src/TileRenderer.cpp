@@ -1,6 +1,8 @@
 #include "render/TileRenderer.h"
 #include "core/LayerStack.h"
+#include "core/VectorLayer.h"
 #include "engine/Compositor.h"
+#include "engine/WetLayer.h"
 #include <QSGRectangleNode>
 #include <QSGSimpleTextureNode>
 #include <QSGTransformNode>
@@ -26,6 +28,10 @@ void TileRenderer::setCompositor(const Compositor* compositor) {
     m_compositor = compositor;
 }
 
+void TileRenderer::setStrokeOverlay(const WetLayer* stroke) {
+    m_stroke = stroke;
+}
+
 QSGNode* TileRenderer::updateSceneGraph(
     QSGNode* oldNode,
     QQuickWindow* window,
@@ -81,6 +87,8 @@ QSGNode* TileRenderer::updateSceneGraph(
                 break;
             }
         }
+        // The stroke in progress may cover tiles its layer doesn't have yet
+        if (m_stroke && m_stroke->coverageAt(tc)) hasData = true;
 
         if (!hasData) {
             // Remove existing node if it exists
@@ -96,7 +104,7 @@ QSGNode* TileRenderer::updateSceneGraph(
         }
 
         // Composite tile data from all layers
-        auto data = m_compositor->compositeTile(*m_layers, tc);
+        auto data = m_compositor->compositeTile(*m_layers, tc, m_stroke);
 
         // Create QImage from composited RGBA8 data
         QImage image(data.data(), TILE_SIZE, TILE_SIZE, TILE_SIZE * 4,
@@ -124,6 +132,14 @@ QSGNode* TileRenderer::updateSceneGraph(
         tileNode.sgNode->setFiltering(QSGTexture::Nearest);
     }
 
+    // Vector layers keep the tiles they drew for the view; past their cache
+    // budget, those scrolled out of it are dropped (and drawn again if needed)
+    for (const auto& layerPtr : m_layers->layers()) {
+        if (layerPtr->type() != LayerType::Vector) continue;
+        static_cast<const VectorLayer&>(*layerPtr).evictRaster(visibleSet,
+                                                              VectorLayer::RASTER_CACHE_TILES);
+    }
+
     // Remove nodes for tiles no longer visible
     std::vector<TileCoord> toRemove;
     for (auto& [coord, node] : m_nodes) {
@@ -0,0 +1,210 @@
+#include <QColor>
+#include <QCoreApplication>
+
+#include "core/LayerStack.h"
+#include "core/Stroke.h"
+#include "engine/BrushThread.h"
+#include "engine/WetLayer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace comicos;
+
+// The per-sample brush path must not allocate once it is warmed up: input
+// queueing, dab placement and rasterization, prediction and publishing to
+// the overlay. Drives a BrushThread through the same strokes twice and
+// counts every allocation, on all threads, while the second pass adds its
+// points. The strokes must also reach the layer, so a thread that dropped
+// its input cannot pass.
+//
+// With glibc the C allocator itself is replaced (malloc, calloc, realloc,
+// aligned allocation), which also covers operator new and Qt containers.
+// Elsewhere only operator new, plain and aligned, is counted: replacing
+// malloc portably is not possible.
+
+namespace {
+
+std::atomic<bool> g_counting{false};
+std::atomic<size_t> g_allocations{0};
+
+void countAllocation() {
+    if (g_counting.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+}  // namespace
+
+#if defined(__GLIBC__)
+
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* p, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+
+void* malloc(std::size_t size) {
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) {
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, std::size_t size) {
+    countAllocation();
+    return __libc_realloc(p, size);
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size) {
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** p, std::size_t alignment, std::size_t size) {
+    countAllocation();
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+}
+
+#else
+
+void* operator new(std::size_t size) {
+    countAllocation();
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    countAllocation();
+    const auto align = static_cast<std::size_t>(alignment);
+    size = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+#if defined(_MSC_VER)
+    if (void* p = _aligned_malloc(size, align)) return p;
+#else
+    if (void* p = std::aligned_alloc(align, size)) return p;
+#endif
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+#if defined(_MSC_VER)
+void operator delete(void* p, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { _aligned_free(p); }
+#else
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#endif
+
+#endif
+
+namespace {
+
+/// A wave across a few tiles, one sample per 4 ms so prediction runs.
+std::vector<CanvasPoint> strokePath() {
+    std::vector<CanvasPoint> points;
+    for (int i = 0; i < 300; ++i) {
+        CanvasPoint p;
+        p.x = 200.0f + i * 4.0f;
+        p.y = 500.0f + 80.0f * std::sin(i * 0.04f);
+        p.pressure = 0.4f + 0.5f * std::abs(std::sin(i * 0.02f));
+        p.timestamp = 1.0 + i * 4.0;
+        points.push_back(p);
+    }
+    return points;
+}
+
+Stroke strokeParams(LayerId layer, float size, float hardness) {
+    Stroke params;
+    params.setColor(QColor(200, 30, 40));
+    params.setBrushSize(size);
+    params.setHardness(hardness);
+    params.setTargetLayerId(layer);
+    return params;
+}
+
+/// What the renderer keeps from frame to frame.
+struct View {
+    std::vector<TileCoord> visible;    // Tiles on screen
+    std::vector<TileCoord> published;  // From takePublishedTiles()
+    WetLayer overlay;                  // From copyOverlay()
+};
+
+/// Allocations while one stroke was painted, and whether it reached the layer.
+struct Result {
+    size_t allocations = 0;
+    bool painted = false;
+};
+
+/// Paint one stroke, processing and presenting every sample as the
+/// renderer would. Counts allocations from the first point to the last.
+Result paint(BrushThread& brush, LayerStack& layers, const Stroke& params,
+             const std::vector<CanvasPoint>& path, View& view) {
+    brush.beginStroke(params);
+    brush.waitForIdle();
+
+    g_allocations.store(0);
+    g_counting.store(true);
+    for (const CanvasPoint& p : path) {
+        brush.addPoint(p);
+        brush.waitForIdle();
+        brush.takePublishedTiles(view.published);
+        brush.overlayPresented(brush.copyOverlay(view.visible, view.overlay));
+    }
+    g_counting.store(false);
+    Result result;
+    result.allocations = g_allocations.load();
+
+    brush.endStroke();
+    brush.waitForIdle();
+    BrushThread::CommittedStroke committed;
+    if (!brush.commitStroke(layers, &committed) || !committed.layer) return result;
+    for (const TileCoord& coord : committed.tiles) {
+        const Tile* tile = committed.layer->tiles().tileAt(coord);
+        if (tile && !tile->isEmpty()) result.painted = true;
+    }
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+
+    LayerStack layers;
+    const LayerId layer = layers.addLayer()->id();
+    const std::vector<CanvasPoint> path = strokePath();
+    BrushThread brush;
+    View view;
+    for (int ty = 0; ty < 4; ++ty) {
+        for (int tx = 0; tx < 8; ++tx) view.visible.push_back({tx, ty});
+    }
+
+    struct Brush {
+        const char* name;
+        float size;
+        float hardness;
+    };
+    bool ok = true;
+    for (const Brush& b : {Brush{"soft 40", 40.0f, 0.5f}, Brush{"hard 300", 300.0f, 1.0f}}) {
+        const Stroke params = strokeParams(layer, b.size, b.hardness);
+        paint(brush, layers, params, path, view);  // Warm-up
+        const Result result = paint(brush, layers, params, path, view);
+        std::printf("%-9s %zu allocations over %zu points%s\n", b.name, result.allocations,
+                    path.size(), result.painted ? "" : ", NOTHING PAINTED");
+        ok = ok && result.allocations == 0 && result.painted;
+    }
+    return ok ? 0 : 1;
+}